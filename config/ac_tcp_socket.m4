@@ -31,6 +31,11 @@ if test -z "${HAVE_TCP_SOCKET_TRUE}"; then
 fi
 
 dnl Check for the library.
+dnl The shared memory channels for peers on the same node need shm_open.
+if test -z "${HAVE_TCP_SOCKET_TRUE}"; then
+	  AC_SEARCH_LIBS(shm_open, rt,
+		  [test "$ac_cv_search_shm_open" = "none required" || TCP_SOCKET_LIBS="$TCP_SOCKET_LIBS $ac_cv_search_shm_open"])
+fi
 
 LIBS="$save_LIBS"
 LDFLAGS="$save_LDFLAGS"
@@ -42,6 +42,7 @@
 #include "tcp/dart_rpc_tcp.h"
 #include "tcp/dc_base_tcp.h"
 #include "tcp/ds_base_tcp.h"
+#include "tcp/dart_rdma_tcp.h"
 
 #endif
 
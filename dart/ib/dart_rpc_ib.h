@@ -390,13 +390,20 @@ enum cmd_type {
 	cp_lock,
 	/* Shared spaces specific. */
 	ss_obj_put,
+	ss_obj_put_batch,
+	ss_obj_pull,
 	ss_obj_update,
 	ss_obj_get_dht_peers,
 	ss_obj_get_desc,
+	ss_obj_get_desc_batch,
 	ss_obj_query,
 	ss_obj_cq_register,
 	ss_obj_cq_notify,
 	ss_obj_get,
+	ss_obj_get_strided,
+	ss_obj_summary,
+	ss_obj_get_summary,
+	ss_obj_get_batch,
 	ss_obj_hint,
         ss_obj_filter,
 	ss_obj_info,
@@ -408,6 +415,9 @@ enum cmd_type {
 	dimes_ss_info_msg,
 	dimes_locate_data_msg,
 	dimes_put_msg,
+	dimes_obj_release_msg,
+	dimes_obj_read_ack_msg,
+	dimes_obj_retire_msg,
 #endif
 	//Added for CCGrid Demo
 	CN_TIMING_AVG,
@@ -423,6 +433,12 @@ enum lock_type {
 	lk_grant
 };
 
+/* Release a message from msg_buf_alloc(); messages are not pooled here */
+static inline void msg_buf_free(struct msg_buf *msg)
+{
+	free(msg);
+}
+
 /*
   Default instance for completion_callback; it frees the memory.
 */
@@ -109,10 +109,20 @@ enum cmd_type {
   ss_code_put,
   ss_code_reply, // 30
   cp_remove,
+  ss_obj_pull,
+  ss_obj_get_strided,
+  ss_obj_summary,
+  ss_obj_get_summary,
+  ss_obj_put_batch,
+  ss_obj_get_desc_batch,
+  ss_obj_get_batch,
 #ifdef DS_HAVE_DIMES
   dimes_ss_info_msg,
   dimes_locate_data_msg,
   dimes_put_msg,
+  dimes_obj_release_msg,
+  dimes_obj_read_ack_msg,
+  dimes_obj_retire_msg,
 #endif
   // Added for CCGrid Demo
   CN_TIMING_AVG,
@@ -417,6 +427,12 @@ struct rpc_server {
 	struct ibv_context* global_ctx;
 };
 
+/* Release a message from msg_buf_alloc(); messages are not pooled here */
+static inline void msg_buf_free(struct msg_buf* msg_)
+{
+	free(msg_);
+}
+
 /* Default for completion_callback */
 static int default_completion_callback(struct rpc_server* rpc_s_, struct msg_buf* msg_)
 {
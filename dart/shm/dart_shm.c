@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dart_shm.h"
+
+static size_t shm_ring_bytes(uint64_t ring_size) {
+    return sizeof(struct shm_ring) + (size_t)ring_size;
+}
+
+/* Map the segment and point `tx`/`rx` at the rings; the creator sends on the first one */
+static int shm_channel_map(struct shm_channel *ch, int fd, size_t map_size, int f_creator) {
+    ch->base = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ch->base == MAP_FAILED) {
+        printf("[%s]: map shared memory segment failed!\n", __func__);
+        ch->base = NULL;
+        return -1;
+    }
+    ch->map_size = map_size;
+
+    struct shm_ring *first = (struct shm_ring *)ch->base;
+    struct shm_ring *second = (struct shm_ring *)((char *)ch->base + shm_ring_bytes(first->size));
+    ch->tx = f_creator ? first : second;
+    ch->rx = f_creator ? second : first;
+    return 0;
+}
+
+/* Create the segment `name` holding two rings of `ring_size` bytes each */
+int shm_channel_create(struct shm_channel *ch, const char *name, uint64_t ring_size) {
+    size_t map_size = 2 * shm_ring_bytes(ring_size);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        printf("[%s]: create shared memory segment %s failed!\n", __func__, name);
+        goto err_out;
+    }
+    if (ftruncate(fd, (off_t)map_size) < 0) {
+        printf("[%s]: size shared memory segment %s failed!\n", __func__, name);
+        goto err_out;
+    }
+
+    /* The pages come zeroed. Both ends start out as sleepers, so the
+       first bytes are signaled even before the rings are polled. */
+    void *base = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        printf("[%s]: map shared memory segment %s failed!\n", __func__, name);
+        goto err_out;
+    }
+    struct shm_ring *first = (struct shm_ring *)base;
+    struct shm_ring *second = (struct shm_ring *)((char *)base + shm_ring_bytes(ring_size));
+    first->size = second->size = ring_size;
+    first->f_waiting = second->f_waiting = 1;
+    munmap(base, map_size);
+
+    if (shm_channel_map(ch, fd, map_size, 1) < 0) {
+        goto err_out;
+    }
+    close(fd);
+    return 0;
+
+    err_out:
+    if (fd >= 0) {
+        close(fd);
+        shm_unlink(name);
+    }
+    return -1;
+}
+
+/* Map the segment `name` created by the other end of the channel */
+int shm_channel_attach(struct shm_channel *ch, const char *name) {
+    struct stat st;
+    int fd = shm_open(name, O_RDWR, 0600);
+    if (fd < 0) {
+        /* Most likely the other end is on another node */
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || shm_channel_map(ch, fd, (size_t)st.st_size, 0) < 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+void shm_channel_unlink(const char *name) {
+    shm_unlink(name);
+}
+
+void shm_channel_free(struct shm_channel *ch) {
+    if (ch->base != NULL) {
+        munmap(ch->base, ch->map_size);
+    }
+    memset(ch, 0, sizeof(*ch));
+}
+
+uint64_t shm_ring_used(struct shm_ring *ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/* Copy up to `size` bytes into the ring without blocking, returns the number copied */
+uint64_t shm_ring_write(struct shm_ring *ring, const char *buffer, uint64_t size) {
+    uint64_t head = ring->head;
+    uint64_t space = ring->size - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+    if (size > space) {
+        size = space;
+    }
+
+    uint64_t off = head % ring->size;
+    uint64_t n = (size < ring->size - off) ? size : ring->size - off;
+    memcpy(ring->data + off, buffer, (size_t)n);
+    memcpy(ring->data, buffer + n, (size_t)(size - n));
+
+    __atomic_store_n(&ring->head, head + size, __ATOMIC_RELEASE);
+    return size;
+}
+
+/* Copy up to `size` bytes out of the ring without blocking, returns the number copied */
+uint64_t shm_ring_read(struct shm_ring *ring, char *buffer, uint64_t size) {
+    uint64_t tail = ring->tail;
+    uint64_t used = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+    if (size > used) {
+        size = used;
+    }
+
+    uint64_t off = tail % ring->size;
+    uint64_t n = (size < ring->size - off) ? size : ring->size - off;
+    memcpy(buffer, ring->data + off, (size_t)n);
+    memcpy(buffer + n, ring->data, (size_t)(size - n));
+
+    __atomic_store_n(&ring->tail, tail + size, __ATOMIC_RELEASE);
+    return size;
+}
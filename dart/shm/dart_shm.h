@@ -0,0 +1,48 @@
+#ifndef __DART_SHM_H__
+#define __DART_SHM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+  Byte ring in shared memory with a single producer and a single
+  consumer; `head` and `tail` count all bytes ever written and read.
+*/
+struct shm_ring {
+    uint64_t head; /* Moved by the producer */
+    char pad0[56];
+    uint64_t tail; /* Moved by the consumer */
+    char pad1[56];
+    int f_waiting; /* Flag: the consumer may sleep, wake it up after writing */
+    char pad2[60];
+    uint64_t size;
+    char pad3[56];
+    char data[];
+};
+
+/* Two rings between a pair of processes, one for each direction */
+struct shm_channel {
+    void *base;
+    size_t map_size;
+    struct shm_ring *tx;
+    struct shm_ring *rx;
+};
+
+int shm_channel_create(struct shm_channel *ch, const char *name, uint64_t ring_size);
+int shm_channel_attach(struct shm_channel *ch, const char *name);
+void shm_channel_unlink(const char *name);
+void shm_channel_free(struct shm_channel *ch);
+
+uint64_t shm_ring_used(struct shm_ring *ring);
+uint64_t shm_ring_write(struct shm_ring *ring, const char *buffer, uint64_t size);
+uint64_t shm_ring_read(struct shm_ring *ring, char *buffer, uint64_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DART_SHM_H__ */
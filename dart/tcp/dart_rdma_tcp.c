@@ -0,0 +1,589 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#include "dart_rdma_tcp.h"
+
+#ifdef DS_HAVE_DIMES
+#include "debug.h"
+
+/* Max number of reads sent on a connection ahead of their answers */
+#define RDMA_MAX_POSTED 64
+/* Failed connects in a row after which a peer is taken as gone */
+#define RDMA_MAX_CONNECT_FAILS 3
+
+/* A read as sent to the service of the owner of the memory */
+struct rdma_read_req {
+    uint64_t address;
+    uint64_t length;
+} __attribute__((__packed__));
+
+/* A memory region of this process that other peers may read */
+struct rdma_mem_entry {
+    struct list_head entry;
+    uint64_t base_addr;
+    size_t size;
+};
+
+static struct dart_rdma_handle *drh = NULL;
+static int rdma_error_flag = 0; /* Set by check_reads(), reported by process_reads() */
+
+/* Read by the service threads, which may outlive `drh` */
+static struct list_head rdma_mem_list = LIST_HEAD_INIT(rdma_mem_list);
+static pthread_rwlock_t rdma_mem_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static int rdma_send_bytes(int sockfd, const char *buffer, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(sockfd, buffer, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buffer += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+static int rdma_recv_bytes(int sockfd, char *buffer, size_t size) {
+    while (size > 0) {
+        ssize_t n = recv(sockfd, buffer, size, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return -1;
+        }
+        buffer += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+/*
+  Processes with the same key share a node and a pid namespace, so the
+  pid of one is meaningful to the other: hash the boot id of the kernel
+  and the pid namespace.
+*/
+static uint64_t rdma_host_key(void) {
+    char boot_id[64];
+    struct stat st;
+    uint64_t key = 14695981039346656037ULL;
+    size_t i, n;
+
+    FILE *f = fopen("/proc/sys/kernel/random/boot_id", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    n = fread(boot_id, 1, sizeof(boot_id), f);
+    fclose(f);
+    if (n == 0 || stat("/proc/self/ns/pid", &st) < 0) {
+        return 0;
+    }
+
+    for (i = 0; i < n; ++i) {
+        key = (key ^ (unsigned char)boot_id[i]) * 1099511628211ULL;
+    }
+    for (i = 0; i < sizeof(st.st_ino); ++i) {
+        key = (key ^ (unsigned char)(st.st_ino >> (8 * i))) * 1099511628211ULL;
+    }
+    return (key != 0) ? key : 1;
+}
+
+/* Caller holds `rdma_mem_lock` */
+static int rdma_mem_readable(uint64_t address, uint64_t length) {
+    struct rdma_mem_entry *mem;
+    list_for_each_entry(mem, &rdma_mem_list, struct rdma_mem_entry, entry) {
+        if (address >= mem->base_addr && length <= mem->size &&
+            address - mem->base_addr <= mem->size - length) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Answer the reads of one peer until it closes the connection */
+static void *rdma_service(void *arg) {
+    int sockfd = (int)(intptr_t)arg;
+    struct rdma_read_req req;
+
+    while (rdma_recv_bytes(sockfd, (char *)&req, sizeof(req)) == 0) {
+        /* Registered memory is not released while it is being sent */
+        pthread_rwlock_rdlock(&rdma_mem_lock);
+        if (!rdma_mem_readable(req.address, req.length)) {
+            pthread_rwlock_unlock(&rdma_mem_lock);
+            printf("[%s]: read of %llu bytes at 0x%llx is out of registered memory!\n", __func__,
+                (unsigned long long)req.length, (unsigned long long)req.address);
+            break;
+        }
+        int err = rdma_send_bytes(sockfd, (const char *)(uintptr_t)req.address, (size_t)req.length);
+        pthread_rwlock_unlock(&rdma_mem_lock);
+        if (err < 0) {
+            break;
+        }
+    }
+    close(sockfd);
+    return NULL;
+}
+
+int dart_rdma_serve(int sockfd) {
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&thread, &attr, rdma_service, (void *)(intptr_t)sockfd);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        printf("[%s]: create read service thread failed!\n", __func__);
+        close(sockfd);
+        return -1;
+    }
+    return 0;
+}
+
+static struct dart_rdma_tran *dart_rdma_find_read_tran(int tran_id, struct list_head *tran_list) {
+    struct dart_rdma_tran *read_tran = NULL;
+    list_for_each_entry(read_tran, tran_list, struct dart_rdma_tran, entry) {
+        if (read_tran->tran_id == tran_id) {
+            return read_tran;
+        }
+    }
+    return NULL;
+}
+
+/* Connection to the read service of `peer`, opened on first use */
+static struct dart_rdma_conn *rdma_get_conn(struct node_id *peer) {
+    int id = peer->ptlmap.id;
+
+    if (id >= drh->conn_size) {
+        int size = (id + 1 > 2 * drh->conn_size) ? id + 1 : 2 * drh->conn_size;
+        struct dart_rdma_conn **tab = (struct dart_rdma_conn **)realloc(drh->conn_tab, sizeof(*tab) * size);
+        if (tab == NULL) {
+            printf("[%s]: allocate connection table failed!\n", __func__);
+            return NULL;
+        }
+        memset(tab + drh->conn_size, 0, sizeof(*tab) * (size - drh->conn_size));
+        drh->conn_tab = tab;
+        drh->conn_size = size;
+    }
+
+    struct dart_rdma_conn *conn = drh->conn_tab[id];
+    if (conn == NULL) {
+        conn = (struct dart_rdma_conn *)malloc(sizeof(*conn));
+        if (conn == NULL) {
+            printf("[%s]: allocate connection failed!\n", __func__);
+            return NULL;
+        }
+        conn->sockfd = -1;
+        INIT_LIST_HEAD(&conn->posted_ops_list);
+        conn->num_posted = 0;
+        conn->num_fails = 0;
+        drh->conn_tab[id] = conn;
+    }
+
+    if (conn->sockfd < 0) {
+        /* The peer is taken as gone after a few failures, so its readers fail fast */
+        if (conn->num_fails >= RDMA_MAX_CONNECT_FAILS) {
+            return NULL;
+        }
+        conn->sockfd = rpc_connect_rdma(drh->rpc_s, peer);
+        if (conn->sockfd < 0) {
+            printf("[%s]: connect to read service of peer %d failed!\n", __func__, id);
+            conn->num_fails++;
+            return NULL;
+        }
+        conn->num_fails = 0;
+    }
+    return conn;
+}
+
+/* Drop a broken connection; the transactions of the reads waiting on it fail */
+static void rdma_close_conn(struct dart_rdma_conn *conn) {
+    struct dart_rdma_op *op, *t;
+    list_for_each_entry_safe(op, t, &conn->posted_ops_list, struct dart_rdma_op, entry) {
+        op->tran->num_posted--;
+        op->tran->f_err = 1;
+        list_del(&op->entry);
+        free(op);
+    }
+    conn->num_posted = 0;
+    if (conn->sockfd >= 0) {
+        close(conn->sockfd);
+        conn->sockfd = -1;
+        conn->num_fails++;
+    }
+}
+
+/* Send as many scheduled reads of `read_tran` as the connection takes */
+static int rdma_post_reads(struct dart_rdma_tran *read_tran, struct dart_rdma_conn *conn) {
+    struct rdma_read_req req[RDMA_MAX_POSTED];
+    int n = 0;
+
+    while (conn->num_posted + n < RDMA_MAX_POSTED && !list_empty(&read_tran->read_ops_list)) {
+        struct dart_rdma_op *op = list_entry(read_tran->read_ops_list.next, struct dart_rdma_op, entry);
+        req[n].address = read_tran->src.base_addr + op->src_offset;
+        req[n].length = op->bytes;
+        list_del(&op->entry);
+        list_add_tail(&op->entry, &conn->posted_ops_list);
+        ++n;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    conn->num_posted += n;
+    read_tran->num_posted += n;
+    if (rdma_send_bytes(conn->sockfd, (const char *)req, sizeof(req[0]) * n) < 0) {
+        printf("[%s]: send reads to peer %d failed!\n", __func__, read_tran->remote_peer->ptlmap.id);
+        return -1;
+    }
+    return 0;
+}
+
+/* Copy the scheduled reads straight out of the owner on this node, 0 if all succeeded */
+static int rdma_vm_read(struct dart_rdma_tran *read_tran) {
+    struct iovec local[RDMA_MAX_POSTED], remote[RDMA_MAX_POSTED];
+    struct dart_rdma_op *ops[RDMA_MAX_POSTED];
+    struct dart_rdma_op *op;
+
+    while (!list_empty(&read_tran->read_ops_list)) {
+        ssize_t total = 0;
+        int i, n = 0;
+        list_for_each_entry(op, &read_tran->read_ops_list, struct dart_rdma_op, entry) {
+            if (n == RDMA_MAX_POSTED) {
+                break;
+            }
+            local[n].iov_base = (void *)(uintptr_t)(read_tran->dst.base_addr + op->dst_offset);
+            local[n].iov_len = op->bytes;
+            remote[n].iov_base = (void *)(uintptr_t)(read_tran->src.base_addr + op->src_offset);
+            remote[n].iov_len = op->bytes;
+            total += (ssize_t)op->bytes;
+            ops[n++] = op;
+        }
+
+        errno = 0;
+        if (process_vm_readv((pid_t)read_tran->src.pid, local, n, remote, n, 0) != total) {
+            if (errno == EPERM || errno == ENOSYS) {
+                /* Not allowed here (e.g. ptrace restrictions), use sockets from now on */
+                drh->f_vm_read = 0;
+            }
+            return -1;
+        }
+        for (i = 0; i < n; ++i) {
+            list_del(&ops[i]->entry);
+            free(ops[i]);
+        }
+    }
+    return 0;
+}
+
+static int dart_perform_local_copy(struct dart_rdma_tran *tran) {
+    struct dart_rdma_op *op, *t;
+    list_for_each_entry_safe(op, t, &tran->read_ops_list, struct dart_rdma_op, entry) {
+        memcpy((void *)(uintptr_t)(tran->dst.base_addr + op->dst_offset),
+               (const void *)(uintptr_t)(tran->src.base_addr + op->src_offset),
+               op->bytes);
+        list_del(&op->entry);
+        free(op);
+    }
+    return 0;
+}
+
+int dart_rdma_init(struct rpc_server *rpc_s) {
+    if (drh) {
+        uloga("%s(): dart rdma already init!\n", __func__);
+        return 0;
+    }
+
+    drh = (struct dart_rdma_handle *)malloc(sizeof(*drh));
+    if (drh == NULL) {
+        printf("[%s]: allocate DART RDMA handle failed!\n", __func__);
+        return -1;
+    }
+    memset(drh, 0, sizeof(*drh));
+
+    drh->rpc_s = rpc_s;
+    INIT_LIST_HEAD(&drh->read_tran_list);
+    drh->host_key = rdma_host_key();
+    drh->f_vm_read = (drh->host_key != 0);
+
+    /* DATASPACES_TCP_VM_READ=0 sends the reads of peers on this node through sockets too */
+    char *vm_read = getenv("DATASPACES_TCP_VM_READ");
+    if (vm_read != NULL && strcmp(vm_read, "0") == 0) {
+        drh->f_vm_read = 0;
+    }
+    return 0;
+}
+
+int dart_rdma_finalize() {
+    if (drh) {
+        int i;
+        for (i = 0; i < drh->conn_size; ++i) {
+            if (drh->conn_tab[i] != NULL) {
+                rdma_close_conn(drh->conn_tab[i]);
+                free(drh->conn_tab[i]);
+            }
+        }
+        free(drh->conn_tab);
+        free(drh);
+        drh = NULL;
+    }
+    return 0;
+}
+
+int dart_rdma_register_mem(struct dart_rdma_mem_handle *mem_hndl, void *data, size_t bytes) {
+    if (!drh) {
+        uloga("%s(): dart rdma not init!\n", __func__);
+        return -1;
+    }
+
+    struct rdma_mem_entry *mem = (struct rdma_mem_entry *)malloc(sizeof(*mem));
+    if (mem == NULL) {
+        printf("[%s]: allocate memory region failed!\n", __func__);
+        return -1;
+    }
+    mem->base_addr = (uint64_t)(uintptr_t)data;
+    mem->size = bytes;
+    pthread_rwlock_wrlock(&rdma_mem_lock);
+    list_add(&mem->entry, &rdma_mem_list);
+    pthread_rwlock_unlock(&rdma_mem_lock);
+
+    mem_hndl->base_addr = mem->base_addr;
+    mem_hndl->size = bytes;
+    mem_hndl->host_key = drh->host_key;
+    mem_hndl->pid = (int)getpid();
+    return 0;
+}
+
+int dart_rdma_deregister_mem(struct dart_rdma_mem_handle *mem_hndl) {
+    struct rdma_mem_entry *mem, *t;
+
+    /* Waits for the reads being answered from the region */
+    pthread_rwlock_wrlock(&rdma_mem_lock);
+    list_for_each_entry_safe(mem, t, &rdma_mem_list, struct rdma_mem_entry, entry) {
+        if (mem->base_addr == mem_hndl->base_addr) {
+            list_del(&mem->entry);
+            free(mem);
+            pthread_rwlock_unlock(&rdma_mem_lock);
+            return 0;
+        }
+    }
+    pthread_rwlock_unlock(&rdma_mem_lock);
+
+    uloga("%s(): memory region at 0x%llx not registered!\n", __func__, (unsigned long long)mem_hndl->base_addr);
+    return -1;
+}
+
+int dart_rdma_set_memregion_to_cmd(struct dart_rdma_mem_handle *mem_hndl, struct rpc_cmd *cmd) {
+    cmd->mr.address = mem_hndl->base_addr;
+    cmd->mr.length = mem_hndl->size;
+    cmd->mr.host_key = mem_hndl->host_key;
+    cmd->mr.pid = mem_hndl->pid;
+    return 0;
+}
+
+int dart_rdma_get_memregion_from_cmd(struct dart_rdma_mem_handle *mem_hndl, struct rpc_cmd *cmd) {
+    mem_hndl->base_addr = cmd->mr.address;
+    mem_hndl->size = cmd->mr.length;
+    mem_hndl->host_key = cmd->mr.host_key;
+    mem_hndl->pid = cmd->mr.pid;
+    return 0;
+}
+
+int dart_rdma_create_read_tran(struct node_id *remote_peer, struct dart_rdma_tran **pp) {
+    static int tran_id_ = 0;
+
+    if (!remote_peer) {
+        uloga("%s(): ERROR remote_peer is NULL.\n", __func__);
+        return -1;
+    }
+
+    struct dart_rdma_tran *read_tran = (struct dart_rdma_tran *)malloc(sizeof(*read_tran));
+    if (read_tran == NULL) {
+        return -1;
+    }
+    memset(read_tran, 0, sizeof(*read_tran));
+    read_tran->tran_id = tran_id_++;
+    read_tran->remote_peer = remote_peer;
+    INIT_LIST_HEAD(&read_tran->read_ops_list);
+    list_add(&read_tran->entry, &drh->read_tran_list);
+
+    *pp = read_tran;
+    return 0;
+}
+
+int dart_rdma_delete_read_tran(int tran_id) {
+    struct dart_rdma_tran *read_tran = dart_rdma_find_read_tran(tran_id, &drh->read_tran_list);
+    if (read_tran == NULL) {
+        uloga("%s(): read tran with id= %d not found!\n", __func__, tran_id);
+        return -1;
+    }
+
+    if (read_tran->num_posted > 0) {
+        /* Abandoned: the answers still on the way can not be told apart from the next ones */
+        struct dart_rdma_conn *conn = drh->conn_tab[read_tran->remote_peer->ptlmap.id];
+        rdma_close_conn(conn);
+    }
+    if (!list_empty(&read_tran->read_ops_list) && !read_tran->f_err) {
+        uloga("%s(): read tran with id= %d not complete!\n", __func__, tran_id);
+        return -1;
+    }
+
+    struct dart_rdma_op *op, *t;
+    list_for_each_entry_safe(op, t, &read_tran->read_ops_list, struct dart_rdma_op, entry) {
+        list_del(&op->entry);
+        free(op);
+    }
+    list_del(&read_tran->entry);
+    free(read_tran);
+    return 0;
+}
+
+int dart_rdma_schedule_read(int tran_id, size_t src_offset, size_t dst_offset, size_t bytes) {
+    if (!drh) {
+        uloga("%s(): dart rdma not init!\n", __func__);
+        return -1;
+    }
+
+    struct dart_rdma_tran *read_tran = dart_rdma_find_read_tran(tran_id, &drh->read_tran_list);
+    if (read_tran == NULL) {
+        uloga("%s(): read tran with id= %d not found!\n", __func__, tran_id);
+        return -1;
+    }
+
+    struct dart_rdma_op *read_op = (struct dart_rdma_op *)malloc(sizeof(*read_op));
+    if (read_op == NULL) {
+        uloga("%s(): malloc() failed\n", __func__);
+        return -1;
+    }
+    memset(read_op, 0, sizeof(*read_op));
+    read_op->tran = read_tran;
+    read_op->tran_id = tran_id;
+    read_op->src_offset = src_offset;
+    read_op->dst_offset = dst_offset;
+    read_op->bytes = bytes;
+
+    list_add_tail(&read_op->entry, &read_tran->read_ops_list);
+    return 0;
+}
+
+/*
+  Local data is copied right away, and so is data of a peer on this
+  node when process_vm_readv() is allowed. Otherwise the first reads
+  are sent to the peer and the answers are taken in check_reads().
+*/
+int dart_rdma_perform_reads(int tran_id) {
+    if (!drh) {
+        uloga("%s(): dart rdma not init!\n", __func__);
+        return -1;
+    }
+
+    struct dart_rdma_tran *read_tran = dart_rdma_find_read_tran(tran_id, &drh->read_tran_list);
+    if (read_tran == NULL) {
+        uloga("%s(): read tran with id= %d not found!\n", __func__, tran_id);
+        return -1;
+    }
+
+    if (drh->rpc_s->ptlmap.id == read_tran->remote_peer->ptlmap.id) {
+        return dart_perform_local_copy(read_tran);
+    }
+
+    if (drh->f_vm_read && read_tran->src.host_key == drh->host_key && read_tran->src.pid != (int)getpid()) {
+        if (rdma_vm_read(read_tran) == 0) {
+            return 0;
+        }
+    }
+
+    struct dart_rdma_conn *conn = rdma_get_conn(read_tran->remote_peer);
+    if (conn == NULL) {
+        read_tran->f_err = 1;
+        return -1;
+    }
+    if (rdma_post_reads(read_tran, conn) < 0) {
+        rdma_close_conn(conn);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+  Take answers from the peer, those of earlier transactions first, until
+  `tran_id` is complete. A transaction that lost reads is not complete:
+  0 is returned for it and process_reads() reports the failure.
+*/
+int dart_rdma_check_reads(int tran_id) {
+    struct dart_rdma_conn *conn = NULL;
+
+    if (!drh) {
+        uloga("%s(): dart rdma not init!\n", __func__);
+        goto err_out;
+    }
+
+    struct dart_rdma_tran *read_tran = dart_rdma_find_read_tran(tran_id, &drh->read_tran_list);
+    if (read_tran == NULL) {
+        uloga("%s(): read tran with id= %d not found!\n", __func__, tran_id);
+        goto err_out;
+    }
+
+    if (read_tran->f_err) {
+        uloga("%s(): read tran with id= %d lost reads!\n", __func__, tran_id);
+        goto err_out;
+    }
+    if (list_empty(&read_tran->read_ops_list) && read_tran->num_posted == 0) {
+        return 1;
+    }
+
+    conn = rdma_get_conn(read_tran->remote_peer);
+    if (conn == NULL) {
+        read_tran->f_err = 1;
+        goto err_out;
+    }
+    if (rdma_post_reads(read_tran, conn) < 0) {
+        goto err_out_conn;
+    }
+
+    while (read_tran->num_posted > 0) {
+        struct dart_rdma_op *op = list_entry(conn->posted_ops_list.next, struct dart_rdma_op, entry);
+        if (rdma_recv_bytes(conn->sockfd, (char *)(uintptr_t)(op->tran->dst.base_addr + op->dst_offset),
+                op->bytes) < 0) {
+            printf("[%s]: recv read data from peer %d failed!\n", __func__, read_tran->remote_peer->ptlmap.id);
+            goto err_out_conn;
+        }
+        list_del(&op->entry);
+        op->tran->num_posted--;
+        conn->num_posted--;
+        free(op);
+
+        if (rdma_post_reads(read_tran, conn) < 0) {
+            goto err_out_conn;
+        }
+    }
+
+#ifdef DEBUG
+    uloga("%s(): read transaction %d complete!\n", __func__, tran_id);
+#endif
+    return 1;
+
+    err_out_conn:
+    rdma_close_conn(conn);
+    err_out:
+    rdma_error_flag = 1;
+    return 0;
+}
+
+int dart_rdma_process_reads() {
+    if (rdma_error_flag) {
+        rdma_error_flag = 0;
+        return -1;
+    }
+    return 0;
+}
+#endif
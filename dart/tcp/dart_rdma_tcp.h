@@ -0,0 +1,100 @@
+#ifndef __DART_RDMA_TCP_H__
+#define __DART_RDMA_TCP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "config.h"
+
+#ifdef DS_HAVE_DIMES
+#include "dart_rpc_tcp.h"
+
+/*
+  One-sided reads emulated over sockets: the reader sends the address
+  and length of each read to the owner of the memory, where a service
+  thread answers with the bytes, so the owner does not have to be in a
+  DART call. A reader on the same node copies straight out of the
+  owner's address space with process_vm_readv() instead.
+*/
+
+enum dart_memory_type {
+    dart_memory_non_rdma = 0,
+    dart_memory_rdma,
+};
+
+struct dart_rdma_mem_handle {
+    uint64_t base_addr;
+    size_t size;
+    enum dart_memory_type mem_type;
+    uint64_t host_key; /* Node of the owner, see struct rdma_mr */
+    int pid; /* Process of the owner */
+};
+
+struct dart_rdma_op {
+    struct list_head entry;
+    struct dart_rdma_tran *tran;
+    int tran_id;
+    size_t src_offset;
+    size_t dst_offset;
+    size_t bytes;
+    int ret;
+};
+
+struct dart_rdma_tran {
+    struct list_head entry;
+    struct list_head read_ops_list; /* Scheduled reads not sent yet */
+    int num_posted; /* Reads sent and not answered yet */
+    int f_err; /* Flag: reads were lost, the destination is incomplete */
+    int tran_id;
+    struct node_id *remote_peer;
+    struct dart_rdma_mem_handle src;
+    struct dart_rdma_mem_handle dst;
+};
+
+/* Connection to the read service of a peer; the reads of all
+   transactions on it are answered in the order they were sent */
+struct dart_rdma_conn {
+    int sockfd; /* -1 after a failure, reconnected on the next read */
+    struct list_head posted_ops_list;
+    int num_posted;
+    int num_fails; /* Failed connects in a row */
+};
+
+struct dart_rdma_handle {
+    struct rpc_server *rpc_s;
+    struct list_head read_tran_list;
+
+    struct dart_rdma_conn **conn_tab; /* By peer id, NULL until the first read */
+    int conn_size;
+
+    uint64_t host_key;
+    int f_vm_read; /* Flag: process_vm_readv() works for peers on this node */
+};
+
+int dart_rdma_init(struct rpc_server *rpc_s);
+int dart_rdma_finalize();
+
+int dart_rdma_register_mem(struct dart_rdma_mem_handle *mem_hndl, void *data, size_t bytes);
+int dart_rdma_deregister_mem(struct dart_rdma_mem_handle *mem_hndl);
+
+int dart_rdma_set_memregion_to_cmd(struct dart_rdma_mem_handle *mem_hndl, struct rpc_cmd *cmd);
+int dart_rdma_get_memregion_from_cmd(struct dart_rdma_mem_handle *mem_hndl, struct rpc_cmd *cmd);
+
+int dart_rdma_create_read_tran(struct node_id *remote_peer, struct dart_rdma_tran **pp);
+int dart_rdma_delete_read_tran(int tran_id);
+
+int dart_rdma_schedule_read(int tran_id, size_t src_offset, size_t dst_offset, size_t bytes);
+int dart_rdma_perform_reads(int tran_id);
+int dart_rdma_process_reads();
+int dart_rdma_check_reads(int tran_id);
+
+/* Serve the reads coming through `sockfd`, a connection accepted by the listener */
+int dart_rdma_serve(int sockfd);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DART_RDMA_TCP_H__ */
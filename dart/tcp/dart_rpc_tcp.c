@@ -2,17 +2,51 @@
 #include <arpa/inet.h>
 #include <ifaddrs.h>
 #include <net/if.h>
-#include <sys/ioctl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
 
 #include "dart_rpc_tcp.h"
 #include "debug.h"
 
 /* It may be better to store these values in rpc_server struct */
-/* Best size of bytes to be written in a single socket write call */
+/* Size of bytes to start with in a socket write call; writes grow from
+   there unless DATASPACES_TCP_WRITE_SIZE pins the size */
 static uint64_t socket_best_write_size = 16384;
+static int socket_fixed_write_size = 0;
+#define SOCKET_MAX_WRITE_SIZE (8 << 20)
+/* Max number of buffers gathered in a single socket write call */
+#define SOCKET_MAX_IOV 1024
+/* Payloads from this size on are sent with MSG_ZEROCOPY, 0 disables it */
+static uint64_t socket_zerocopy_size = 0;
 /* Best size of bytes to be read in a single socket read call */
 static uint64_t socket_best_read_size = 87380;
+/* Longest time (ms) a server waits for socket events in one call */
+static int socket_poll_timeout = 100;
+/* Max bytes written to one peer per event loop pass, so that a large
+   reply does not hold up the others */
+static uint64_t socket_send_quota = 4 << 20;
+/* Connections opened to each remote peer, and the smallest payload
+   striped across them; 1 keeps everything on a single connection */
+static int socket_num_streams = 1;
+static uint64_t socket_stripe_size = 4 << 20;
+/* Number of peers this process opened extra connections to so far */
+static int stream_count = 0;
+/* Size of each shared memory ring to a peer on the same node, 0 keeps such peers on TCP */
+static uint64_t shm_ring_size = 1 << 20;
+/* Number of shared memory segments created by this process so far */
+static int shm_count = 0;
+
+/* Max number of ready sockets handled per event loop iteration */
+#define RPC_MAX_EVENTS 64
+/* Idle spins on a shared memory ring between checks that the peer is still there */
+#define SHM_CHECK_SPINS 1024
+/* Max number of free blocks kept in each pool of an RPC server */
+#define RPC_POOL_MAX 4096
 
 static uint64_t str_to_uint64(const char *s) {
     uint64_t res = 0;
@@ -26,19 +60,38 @@ static uint64_t str_to_uint64(const char *s) {
     return res;
 }
 
-/* It's really bad to use global variables to store RPC services (and 64 at most), but I have no choice */
-static int num_service = 0;
-static struct {
-    enum cmd_type rpc_cmd;
-    rpc_service rpc_func;
-} rpc_commands[64];
+/*
+  Services are registered into a table of the calling thread, which the
+  RPC server set up by that thread dispatches from; dcg_alloc() and
+  dsg_alloc() register theirs before dc_alloc()/ds_alloc(). A server and
+  a client running in threads of one process thus keep their handlers
+  for the same commands apart.
+*/
+static __thread struct rpc_service_tab *thread_service_tab = NULL;
+
+static struct rpc_service_tab *rpc_thread_service_tab(void) {
+    if (thread_service_tab == NULL) {
+        thread_service_tab = (struct rpc_service_tab *)calloc(1, sizeof(struct rpc_service_tab));
+    }
+    return thread_service_tab;
+}
 
 void rpc_add_service(enum cmd_type rpc_cmd, rpc_service rpc_func) {
-    rpc_commands[num_service].rpc_cmd = rpc_cmd;
-    rpc_commands[num_service].rpc_func = rpc_func;
-    ++num_service;
+    struct rpc_service_tab *tab = rpc_thread_service_tab();
+    if (tab == NULL || tab->num_service == sizeof(tab->rpc_commands) / sizeof(tab->rpc_commands[0])) {
+        printf("[%s]: add RPC service %d failed!\n", __func__, (int)rpc_cmd);
+        return;
+    }
+    tab->rpc_commands[tab->num_service].rpc_cmd = rpc_cmd;
+    tab->rpc_commands[tab->num_service].rpc_func = rpc_func;
+    ++tab->num_service;
 }
 
+/* Address of the master server running in this process, if any; clients in
+   the same process connect to it without going through the config file */
+static struct sockaddr_in local_master_address;
+static int f_local_master = 0;
+
 /* Search the address for a specific interface, or the first valid address if the interface is NULL */
 static struct sockaddr_in search_ip_address(const char *interface) {
     struct sockaddr_in address;
@@ -65,35 +118,332 @@ static struct sockaddr_in search_ip_address(const char *interface) {
     return address;
 }
 
-static int socket_send_bytes(int sockfd, char *buffer, uint64_t size) {
-    while (size > 0) {
-        ssize_t n = send(sockfd, buffer, (size_t)(socket_best_write_size < size ? socket_best_write_size : size), 0);
+/*
+  Send what is left of the `iovcnt` buffers of `iov`, from byte `*off`
+  of `iov[*first]` on, with as few sendmsg() calls as the socket takes,
+  at most SOCKET_MAX_IOV buffers per call; `*first` and `*off` keep
+  track of the progress. With MSG_DONTWAIT in `flags` it stops when the
+  socket is full, and in any case after `quota` bytes. The size of a
+  call doubles while the socket takes all of it, and drops to what it
+  took otherwise. The number of calls made with MSG_ZEROCOPY is added
+  to `num_zc`. Returns the number of bytes sent.
+*/
+static int64_t socket_sendv(int sockfd, const struct iovec *iov, int iovcnt, int *first, size_t *off,
+    int flags, uint64_t quota, uint32_t *num_zc) {
+    struct iovec vec[SOCKET_MAX_IOV];
+    uint64_t chunk = socket_best_write_size;
+    uint64_t total = 0;
+
+    while (total < quota) {
+        while (*first < iovcnt && *off == iov[*first].iov_len) {
+            ++*first;
+            *off = 0;
+        }
+        if (*first == iovcnt) {
+            break;
+        }
+
+        /* Gather up to `chunk` bytes of what is left for this call */
+        uint64_t max = (chunk < quota - total) ? chunk : quota - total;
+        uint64_t len = 0;
+        size_t o = *off;
+        int cnt = 0, i;
+        for (i = *first; i < iovcnt && cnt < SOCKET_MAX_IOV && len < max; ++i, o = 0) {
+            uint64_t l = iov[i].iov_len - o;
+            if (l > max - len) {
+                l = max - len;
+            }
+            if (l > 0) {
+                vec[cnt].iov_base = (char *)iov[i].iov_base + o;
+                vec[cnt].iov_len = (size_t)l;
+                ++cnt;
+                len += l;
+            }
+        }
+
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = vec;
+        mh.msg_iovlen = cnt;
+        ssize_t n = sendmsg(sockfd, &mh, flags);
         if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && (flags & MSG_DONTWAIT)) {
+                break;
+            }
+#ifdef MSG_ZEROCOPY
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                /* Out of locked pages, copy the rest */
+                flags &= ~MSG_ZEROCOPY;
+                continue;
+            }
+#endif
             printf("[%s]: send bytes through socket failed!\n", __func__);
             goto err_out;
         }
-        buffer += n;
-        size -= n;
+#ifdef MSG_ZEROCOPY
+        if (flags & MSG_ZEROCOPY) {
+            ++*num_zc;
+        }
+#endif
+
+        if (!socket_fixed_write_size) {
+            if ((uint64_t)n == len) {
+                chunk = (chunk * 2 < SOCKET_MAX_WRITE_SIZE) ? chunk * 2 : SOCKET_MAX_WRITE_SIZE;
+            } else if (n > 0) {
+                chunk = (uint64_t)n;
+            }
+        }
+
+        total += (uint64_t)n;
+        while (n > 0) {
+            size_t l = iov[*first].iov_len - *off;
+            if ((size_t)n >= l) {
+                n -= l;
+                ++*first;
+                *off = 0;
+            } else {
+                *off += n;
+                n = 0;
+            }
+        }
     }
-    return 0;
+    return (int64_t)total;
 
     err_out:
     return -1;
 }
 
-static int socket_recv_bytes(int sockfd, char *buffer, uint64_t size, int f_blocking) {
-    if (!f_blocking) {
-        /* Check if there is no data to read, return immediately. */
-        int count = 0;
-        ioctl(sockfd, FIONREAD, &count);
-        if (count == 0) {
-            return 1;
+static int socket_send_bytes(int sockfd, char *buffer, uint64_t size) {
+    struct iovec iov = { .iov_base = buffer, .iov_len = (size_t)size };
+    size_t off = 0;
+    int first = 0;
+
+    return (socket_sendv(sockfd, &iov, 1, &first, &off, 0, UINT64_MAX, NULL) < 0) ? -1 : 0;
+}
+
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+/*
+  Read the zero copy completions the kernel queues on the error queue
+  of the socket of `peer`, without blocking, and run the callbacks of
+  the requests whose last zero copy send it is done with. Returns the
+  number of notifications read, -1 on error.
+*/
+static int peer_reap_zerocopy(struct rpc_server *rpc_s, struct node_id *peer) {
+    struct list_head done;
+    struct rpc_request *request, *tmp;
+    int num = 0, err = 0;
+
+    INIT_LIST_HEAD(&done);
+    pthread_mutex_lock(&peer->send_lock);
+    while (peer->sockfd >= 0) {
+        char control[128];
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        if (recvmsg(peer->sockfd, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                printf("[%s]: read zero copy completions of peer %d failed!\n", __func__, peer->ptlmap.id);
+                err = -1;
+            }
+            break;
+        }
+        ++num;
+
+        struct cmsghdr *cm;
+        for (cm = CMSG_FIRSTHDR(&mh); cm != NULL; cm = CMSG_NXTHDR(&mh, cm)) {
+            struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                /* The kernel copied anyway (e.g. loopback), stop paying for the notifications */
+                peer->f_zerocopy = 0;
+            }
+            /* TCP completes the sends in order, up to id `ee_data` here */
+            list_for_each_entry_safe(request, tmp, &peer->zc_list, struct rpc_request, req_entry) {
+                if ((int32_t)(serr->ee_data - request->zc_last) < 0) {
+                    break;
+                }
+                list_del(&request->req_entry);
+                list_add_tail(&request->req_entry, &done);
+            }
+        }
+    }
+    pthread_mutex_unlock(&peer->send_lock);
+
+    list_for_each_entry_safe(request, tmp, &done, struct rpc_request, req_entry) {
+        list_del(&request->req_entry);
+        if ((*request->cb)(rpc_s, request) < 0) {
+            printf("[%s]: call request callback function failed!\n", __func__);
+            err = -1;
         }
     }
+    return (err < 0) ? err : num;
+}
+#endif
+
+/* Wake the peer up through its socket if it sleeps in its event loop */
+static void peer_shm_notify(struct node_id *peer) {
+    struct shm_ring *ring = peer->shm.tx;
+    char c = 0;
+
+    /* Pairs with the fence in rpc_shm_set_waiting() */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->f_waiting, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&ring->f_waiting, 0, __ATOMIC_RELAXED);
+        send(peer->sockfd, &c, 1, MSG_DONTWAIT);
+    }
+}
 
+/* Copy what is left of `iov` into the ring to `peer` until it is full, at most `quota` bytes; same progress tracking as socket_sendv() */
+static int64_t peer_shm_sendv(struct node_id *peer, const struct iovec *iov, int iovcnt, int *first, size_t *off, uint64_t quota) {
+    uint64_t total = 0;
+
+    while (*first < iovcnt && total < quota) {
+        uint64_t size = iov[*first].iov_len - *off;
+        if (size > quota - total) {
+            size = quota - total;
+        }
+        uint64_t n = shm_ring_write(peer->shm.tx, (const char *)iov[*first].iov_base + *off, size);
+        total += n;
+        *off += n;
+        if (*off == iov[*first].iov_len) {
+            ++*first;
+            *off = 0;
+        } else if (n < size) {
+            /* Full */
+            break;
+        }
+    }
+    if (total > 0) {
+        peer_shm_notify(peer);
+    }
+    return (int64_t)total;
+}
+
+/* Set `request` up to write the `iovcnt` buffers of `iov`; large payloads may go out with MSG_ZEROCOPY */
+static void peer_init_request(struct node_id *peer, struct rpc_request *request, const struct iovec *iov, int iovcnt) {
+    request->iov = iov;
+    request->iovcnt = iovcnt;
+    request->first = 0;
+    request->off = 0;
+    request->flags = 0;
+    request->num_zc = 0;
+    request->num_stripes = 0;
+
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    /* A receive request goes on with the reply in its caller, with no
+       callback to hold back until the kernel is done with the pages */
+    if (peer->f_zerocopy && !peer->f_shm && request->iodir != io_receive) {
+        uint64_t size = 0;
+        int i;
+        for (i = 0; i < iovcnt; ++i) {
+            size += iov[i].iov_len;
+        }
+        if (size >= socket_zerocopy_size) {
+            request->flags = MSG_ZEROCOPY;
+        }
+    }
+#endif
+}
+
+/*
+  Split the payload of `request`, all but the first `skip` bytes, into
+  one stripe per connection of `peer` if it is large enough. The peer
+  cuts what it reads the same way, see peer_recv_striped(); the first
+  `skip` bytes (a command) go ahead of stripe 0 on the first connection.
+*/
+static void peer_stripe_request(struct node_id *peer, struct rpc_request *request, uint64_t skip) {
+    uint64_t size = 0, pos = 0, len;
+    int i, first = 0;
+
+    if (peer->num_streams <= 1) {
+        return;
+    }
+    for (i = 0; i < request->iovcnt; ++i) {
+        size += request->iov[i].iov_len;
+    }
+    size -= skip;
+    if (size < peer->stripe_size) {
+        return;
+    }
+
+    /* The stripes do not wait for zero copy notifications */
+    request->flags = 0;
+    request->num_stripes = peer->num_streams;
+    len = (size + peer->num_streams - 1) / peer->num_streams;
+    for (i = 0; i < peer->num_streams; ++i) {
+        uint64_t start = (i == 0) ? 0 : skip + len * i;
+        uint64_t end = skip + ((len * (i + 1) < size) ? len * (i + 1) : size);
+        if (start > end) {
+            start = end;
+        }
+
+        /* Find the buffer holding byte `start` */
+        while (first < request->iovcnt && pos + request->iov[first].iov_len <= start) {
+            pos += request->iov[first].iov_len;
+            ++first;
+        }
+        request->stripe_first[i] = first;
+        request->stripe_off[i] = (size_t)(start - pos);
+        request->stripe_left[i] = end - start;
+    }
+}
+
+/*
+  Write what is left of `request` to `peer` without blocking, at most
+  `quota` bytes; called with `peer->send_lock` held. Returns the number
+  of bytes written.
+*/
+static int64_t peer_write_request(struct node_id *peer, struct rpc_request *request, uint64_t quota) {
+    if (request->num_stripes > 0) {
+        uint64_t total = 0;
+        int i, f_done = 1;
+        for (i = 0; i < request->num_stripes && total < quota; ++i) {
+            uint64_t max = quota - total;
+            if (request->stripe_left[i] == 0) {
+                continue;
+            }
+            int64_t n = socket_sendv(i ? peer->stream_sockfd[i] : peer->sockfd, request->iov, request->iovcnt,
+                &request->stripe_first[i], &request->stripe_off[i], MSG_DONTWAIT,
+                (request->stripe_left[i] < max) ? request->stripe_left[i] : max, NULL);
+            if (n < 0) {
+                return -1;
+            }
+            request->stripe_left[i] -= (uint64_t)n;
+            total += (uint64_t)n;
+        }
+        for (i = 0; i < request->num_stripes; ++i) {
+            if (request->stripe_left[i] > 0) {
+                f_done = 0;
+            }
+        }
+        if (f_done) {
+            request->first = request->iovcnt;
+        }
+        return (int64_t)total;
+    }
+    if (peer->f_shm) {
+        return peer_shm_sendv(peer, request->iov, request->iovcnt, &request->first, &request->off, quota);
+    }
+    return socket_sendv(peer->sockfd, request->iov, request->iovcnt, &request->first, &request->off,
+        request->flags | MSG_DONTWAIT, quota, &request->num_zc);
+}
+
+static int socket_recv_bytes(int sockfd, char *buffer, uint64_t size) {
     while (size > 0) {
         ssize_t n = recv(sockfd, buffer, (size_t)(socket_best_read_size < size ? socket_best_read_size : size), 0);
         if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             printf("[%s]: receive bytes through socket failed!\n", __func__);
             goto err_out;
         }
@@ -110,16 +460,142 @@ static int socket_recv_bytes(int sockfd, char *buffer, uint64_t size, int f_bloc
     return -1;
 }
 
+/* Read a payload striped by peer_stripe_request(), from all connections of `peer` at once */
+static int peer_recv_striped(struct node_id *peer, char *buffer, uint64_t size) {
+    struct pollfd pfd[RPC_MAX_STREAMS];
+    char *pos[RPC_MAX_STREAMS];
+    uint64_t left[RPC_MAX_STREAMS];
+    uint64_t len = (size + peer->num_streams - 1) / peer->num_streams;
+    int i, num_left = 0;
+
+    for (i = 0; i < peer->num_streams; ++i) {
+        uint64_t start = (len * i < size) ? len * i : size;
+        uint64_t end = (len * (i + 1) < size) ? len * (i + 1) : size;
+        pos[i] = buffer + start;
+        left[i] = end - start;
+        pfd[i].fd = i ? peer->stream_sockfd[i] : peer->sockfd;
+        pfd[i].events = POLLIN;
+        if (left[i] > 0) {
+            ++num_left;
+        }
+    }
+
+    while (num_left > 0) {
+        for (i = 0; i < peer->num_streams; ++i) {
+            /* Negative descriptors are left out by poll() */
+            pfd[i].fd = (left[i] > 0) ? (i ? peer->stream_sockfd[i] : peer->sockfd) : -1;
+        }
+        if (poll(pfd, peer->num_streams, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("[%s]: wait for data from peer %d failed!\n", __func__, peer->ptlmap.id);
+            goto err_out;
+        }
+        for (i = 0; i < peer->num_streams; ++i) {
+            if (left[i] == 0 || !(pfd[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            ssize_t n = recv(pfd[i].fd, pos[i], (size_t)left[i], MSG_DONTWAIT);
+            if (n < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+                    continue;
+                }
+                printf("[%s]: receive bytes through socket failed!\n", __func__);
+                goto err_out;
+            }
+            if (n == 0) {
+                printf("[%s]: connection has already closed, skip!\n", __func__);
+                goto err_out;
+            }
+            pos[i] += n;
+            left[i] -= (uint64_t)n;
+            if (left[i] == 0) {
+                --num_left;
+            }
+        }
+    }
+    return 0;
+
+    err_out:
+    return -1;
+}
+
+/* Read all the wake up bytes from the socket of a shared memory peer, returns 2 if the peer closed the connection */
+static int socket_drain(int sockfd) {
+    char buffer[64];
+    while (1) {
+        ssize_t n = recv(sockfd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n > 0) {
+            continue;
+        }
+        if (n == 0) {
+            return 2;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+}
+
+/* Tell whether a shared memory peer went away, checked every so many idle spins on its rings */
+static int peer_shm_gone(struct node_id *peer, unsigned int *spins) {
+    if ((++*spins % SHM_CHECK_SPINS) != 0) {
+        return 0;
+    }
+    return socket_drain(peer->sockfd) != 0;
+}
+
+static int peer_recv_bytes(struct node_id *peer, char *buffer, uint64_t size) {
+    unsigned int spins = 0;
+
+    if (!peer->f_shm) {
+        if (peer->num_streams > 1 && size >= peer->stripe_size) {
+            return peer_recv_striped(peer, buffer, size);
+        }
+        return socket_recv_bytes(peer->sockfd, buffer, size);
+    }
+
+    while (size > 0) {
+        uint64_t n = shm_ring_read(peer->shm.rx, buffer, size);
+        if (n == 0) {
+            if (peer_shm_gone(peer, &spins)) {
+                printf("[%s]: peer %d closed the connection!\n", __func__, peer->ptlmap.id);
+                return -1;
+            }
+            sched_yield();
+            continue;
+        }
+        buffer += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/* Returns 1 if no RPC command is pending, 2 if the peer closed the connection */
 static int socket_recv_rpc_cmd(int sockfd, struct rpc_cmd *cmd) {
     /* TODO: should deserialize data */
-    int ret = socket_recv_bytes(sockfd, (char *)cmd, (uint64_t)sizeof(*cmd), 0);
-    if (ret < 0) {
+    ssize_t n;
+    do {
+        n = recv(sockfd, (char *)cmd, sizeof(*cmd), MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            /* No RPC command available yet */
+            return 1;
+        }
         printf("[%s]: receive RPC command through socket failed!\n", __func__);
         goto err_out;
     }
-    if (ret == 1) {
-        /* No RPC command available yet */
-        return 1;
+    if (n == 0) {
+        return 2;
+    }
+
+    /* A command is written at once, so the rest of it is on its way */
+    if (n < sizeof(*cmd) && socket_recv_bytes(sockfd, (char *)cmd + n, (uint64_t)(sizeof(*cmd) - n)) < 0) {
+        printf("[%s]: receive RPC command through socket failed!\n", __func__);
+        goto err_out;
     }
     return 0;
 
@@ -127,13 +603,36 @@ static int socket_recv_rpc_cmd(int sockfd, struct rpc_cmd *cmd) {
     return -1;
 }
 
-/* It will send the component type, id and appid */
-int rpc_send_connection_info(struct rpc_server *rpc_s, struct node_id *peer) {
+/* Same as socket_recv_rpc_cmd(), a command in the ring is complete or about to be */
+static int peer_recv_rpc_cmd(struct node_id *peer, struct rpc_cmd *cmd) {
+    if (!peer->f_shm) {
+        return socket_recv_rpc_cmd(peer->sockfd, cmd);
+    }
+    if (shm_ring_used(peer->shm.rx) == 0) {
+        return 1;
+    }
+    return peer_recv_bytes(peer, (char *)cmd, (uint64_t)sizeof(*cmd));
+}
+
+static void rpc_fill_connection_info(struct rpc_server *rpc_s, struct node_id *peer, struct connection_info *info) {
+    memset(info, 0, sizeof(*info));
+    info->cmp_type = rpc_s->cmp_type;
+    info->id = rpc_s->ptlmap.id;
+    info->app_id = rpc_s->ptlmap.appid;
+    info->app_size = rpc_s->app_num_peers;
+    info->num_streams = socket_num_streams;
+    info->stream_key = peer->stream_key;
+    info->stripe_size = socket_stripe_size;
+}
+
+/*
+  It will send the component type, id, appid, the shared memory segment
+  offered, if any, and the number of connections we are going to open
+*/
+int rpc_send_connection_info(struct rpc_server *rpc_s, struct node_id *peer, const char *shm_name) {
     struct connection_info info;
-    info.cmp_type = rpc_s->cmp_type;
-    info.id = rpc_s->ptlmap.id;
-    info.app_id = rpc_s->ptlmap.appid;
-    info.app_size = rpc_s->app_num_peers;
+    rpc_fill_connection_info(rpc_s, peer, &info);
+    strncpy(info.shm_name, shm_name, sizeof(info.shm_name) - 1);
 
     /* TODO: should serialize data */
     if (socket_send_bytes(peer->sockfd, (char *)&info, (uint64_t)sizeof(info)) < 0) {
@@ -147,7 +646,7 @@ int rpc_send_connection_info(struct rpc_server *rpc_s, struct node_id *peer) {
 }
 
 int rpc_recv_connection_info(int sockfd, struct connection_info *info) {
-    if (socket_recv_bytes(sockfd, (char *)info, (uint64_t)sizeof(*info), 1) < 0) {
+    if (socket_recv_bytes(sockfd, (char *)info, (uint64_t)sizeof(*info)) < 0) {
         printf("[%s]: recv connection info failed!\n", __func__);
         goto err_out;
     }
@@ -157,6 +656,62 @@ int rpc_recv_connection_info(int sockfd, struct connection_info *info) {
     return -1;
 }
 
+static void rpc_pool_init(struct rpc_pool *pool, size_t size) {
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->head = NULL;
+    pool->size = size;
+    pool->count = 0;
+}
+
+/* Take a block from `pool`, or from malloc() if it is empty */
+static void *rpc_pool_get(struct rpc_pool *pool) {
+    void *block;
+
+    pthread_mutex_lock(&pool->lock);
+    block = pool->head;
+    if (block != NULL) {
+        pool->head = *(void **)block;
+        --pool->count;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (block == NULL) {
+        block = malloc(pool->size);
+    }
+    return block;
+}
+
+static void rpc_pool_put(struct rpc_pool *pool, void *block) {
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count < RPC_POOL_MAX) {
+        *(void **)block = pool->head;
+        pool->head = block;
+        ++pool->count;
+        block = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    free(block);
+}
+
+static void rpc_pool_free(struct rpc_pool *pool) {
+    while (pool->head != NULL) {
+        void *block = pool->head;
+        pool->head = *(void **)block;
+        free(block);
+    }
+    pool->count = 0;
+    pthread_mutex_destroy(&pool->lock);
+}
+
+static struct rpc_request *rpc_request_alloc(struct rpc_server *rpc_s) {
+    return (struct rpc_request *)rpc_pool_get(&rpc_s->req_pool);
+}
+
+static void rpc_request_free(struct rpc_server *rpc_s, struct rpc_request *request) {
+    rpc_pool_put(&rpc_s->req_pool, request);
+}
+
 static int rpc_cb_request_posted(struct rpc_server *rpc_s, struct rpc_request *request) {
     if (request->msg != NULL && request->msg->cb != NULL) {
         if ((*request->msg->cb)(rpc_s, request->msg) < 0) {
@@ -164,13 +719,13 @@ static int rpc_cb_request_posted(struct rpc_server *rpc_s, struct rpc_request *r
             goto err_out;
         }
     }
-    free(request);
+    rpc_request_free(rpc_s, request);
     request = NULL;
     return 0;
 
     err_out:
     if (request != NULL) {
-        free(request);
+        rpc_request_free(rpc_s, request);
     }
     return -1;
 }
@@ -226,36 +781,574 @@ struct rpc_server* rpc_server_init(const char *interface, int app_num_peers, voi
     rpc_s->app_num_peers = app_num_peers;
     rpc_s->thread_alive = 0; /* Should be set to 1 before creating the thread */
     rpc_s->dart_ref = dart_ref;
+    pthread_mutex_init(&rpc_s->fd_lock, NULL);
+    rpc_pool_init(&rpc_s->msg_pool, sizeof(struct msg_buf) + sizeof(struct rpc_cmd) + 7);
+    rpc_pool_init(&rpc_s->req_pool, sizeof(struct rpc_request));
+    rpc_s->epfd = -1;
+
+    rpc_s->service_tab = rpc_thread_service_tab();
+    if (rpc_s->service_tab == NULL) {
+        printf("[%s]: allocate RPC service table failed!\n", __func__);
+        goto err_out;
+    }
+
+    rpc_s->epfd = epoll_create1(0);
+    if (rpc_s->epfd < 0) {
+        printf("[%s]: create epoll instance failed!\n", __func__);
+        goto err_out;
+    }
+
+    if (rpc_server_init_socket(rpc_s) < 0) {
+        printf("[%s]: initialize socket for RPC server failed!\n", __func__);
+        goto err_out;
+    }
+
+    char *write_size = getenv("DATASPACES_TCP_WRITE_SIZE");
+    if (write_size != NULL) {
+        socket_best_write_size = str_to_uint64(write_size);
+        socket_fixed_write_size = 1;
+    }
+    char *read_size = getenv("DATASPACES_TCP_READ_SIZE");
+    if (read_size != NULL) {
+        socket_best_read_size = str_to_uint64(read_size);
+    }
+
+    char *zerocopy_size = getenv("DATASPACES_TCP_ZEROCOPY_SIZE");
+    if (zerocopy_size != NULL) {
+        socket_zerocopy_size = str_to_uint64(zerocopy_size);
+    }
+    char *poll_timeout = getenv("DATASPACES_TCP_POLL_TIMEOUT");
+    if (poll_timeout != NULL) {
+        socket_poll_timeout = (int)str_to_uint64(poll_timeout);
+    }
+    char *send_quota = getenv("DATASPACES_TCP_SEND_QUOTA");
+    if (send_quota != NULL) {
+        socket_send_quota = str_to_uint64(send_quota);
+    }
+    char *num_streams = getenv("DATASPACES_TCP_NUM_STREAMS");
+    if (num_streams != NULL) {
+        socket_num_streams = (int)str_to_uint64(num_streams);
+        if (socket_num_streams < 1) {
+            socket_num_streams = 1;
+        }
+        if (socket_num_streams > RPC_MAX_STREAMS) {
+            socket_num_streams = RPC_MAX_STREAMS;
+        }
+    }
+    char *stripe_size = getenv("DATASPACES_TCP_STRIPE_SIZE");
+    if (stripe_size != NULL) {
+        socket_stripe_size = str_to_uint64(stripe_size);
+    }
+    char *ring_size = getenv("DATASPACES_SHM_RING_SIZE");
+    if (ring_size != NULL) {
+        shm_ring_size = str_to_uint64(ring_size);
+    }
+
+    return rpc_s;
+
+    err_out:
+    if (rpc_s != NULL) {
+        if (rpc_s->epfd >= 0) {
+            close(rpc_s->epfd);
+        }
+        free(rpc_s);
+    }
+    return NULL;
+}
+
+/* Initialize the per-peer request list and send lock */
+void rpc_peer_init(struct node_id *peer) {
+    pthread_mutexattr_t attr;
+
+    INIT_LIST_HEAD(&peer->req_list);
+    INIT_LIST_HEAD(&peer->zc_list);
+
+    /* Completion callbacks may send to the same peer again */
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&peer->send_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/* Record `peer` as the owner of socket `sockfd`, NULL to forget it */
+static int rpc_map_socket(struct rpc_server *rpc_s, int sockfd, struct node_id *peer) {
+    pthread_mutex_lock(&rpc_s->fd_lock);
+    if (sockfd >= rpc_s->fd_peer_size) {
+        int size = rpc_s->fd_peer_size ? rpc_s->fd_peer_size : 64;
+        while (size <= sockfd) {
+            size *= 2;
+        }
+        struct node_id **tab = (struct node_id **)realloc(rpc_s->fd_peer_tab, sizeof(*tab) * size);
+        if (tab == NULL) {
+            pthread_mutex_unlock(&rpc_s->fd_lock);
+            printf("[%s]: allocate socket table failed!\n", __func__);
+            return -1;
+        }
+        memset(tab + rpc_s->fd_peer_size, 0, sizeof(*tab) * (size - rpc_s->fd_peer_size));
+        rpc_s->fd_peer_tab = tab;
+        rpc_s->fd_peer_size = size;
+    }
+    rpc_s->fd_peer_tab[sockfd] = peer;
+    pthread_mutex_unlock(&rpc_s->fd_lock);
+    return 0;
+}
+
+static struct node_id *rpc_socket_peer(struct rpc_server *rpc_s, int sockfd) {
+    struct node_id *peer = NULL;
+
+    pthread_mutex_lock(&rpc_s->fd_lock);
+    if (sockfd < rpc_s->fd_peer_size) {
+        peer = rpc_s->fd_peer_tab[sockfd];
+    }
+    pthread_mutex_unlock(&rpc_s->fd_lock);
+    return peer;
+}
+
+/* Add `peer` to the peers whose rings the event loop polls */
+static int rpc_shm_peer_add(struct rpc_server *rpc_s, struct node_id *peer) {
+    pthread_mutex_lock(&rpc_s->fd_lock);
+    if (rpc_s->num_shm_peers == rpc_s->max_shm_peers) {
+        int size = rpc_s->max_shm_peers ? 2 * rpc_s->max_shm_peers : 16;
+        struct node_id **tab = (struct node_id **)realloc(rpc_s->shm_peer_tab, sizeof(*tab) * size);
+        if (tab == NULL) {
+            pthread_mutex_unlock(&rpc_s->fd_lock);
+            printf("[%s]: allocate shared memory peer table failed!\n", __func__);
+            return -1;
+        }
+        rpc_s->shm_peer_tab = tab;
+        rpc_s->max_shm_peers = size;
+    }
+    rpc_s->shm_peer_tab[rpc_s->num_shm_peers++] = peer;
+    pthread_mutex_unlock(&rpc_s->fd_lock);
+    return 0;
+}
+
+static void rpc_shm_peer_remove(struct rpc_server *rpc_s, int sockfd) {
+    int i;
+
+    pthread_mutex_lock(&rpc_s->fd_lock);
+    for (i = 0; i < rpc_s->num_shm_peers; ++i) {
+        if (rpc_s->shm_peer_tab[i]->sockfd == sockfd) {
+            rpc_s->shm_peer_tab[i] = rpc_s->shm_peer_tab[--rpc_s->num_shm_peers];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&rpc_s->fd_lock);
+}
+
+/* Add the socket of a newly connected peer to the event loop */
+int rpc_watch_peer(struct rpc_server *rpc_s, struct node_id *peer) {
+    struct epoll_event event;
+
+    if (rpc_map_socket(rpc_s, peer->sockfd, peer) < 0) {
+        goto err_out;
+    }
+
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    if (socket_zerocopy_size > 0 && !peer->f_shm) {
+        int one = 1;
+        peer->f_zerocopy = (setsockopt(peer->sockfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0);
+        peer->zc_next = 0;
+    }
+#endif
+
+    /* Edge triggered: the event loop reads a socket until it would
+       block, and hears of room to write only after a write blocked */
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = peer->sockfd;
+    if (epoll_ctl(rpc_s->epfd, EPOLL_CTL_ADD, peer->sockfd, &event) < 0) {
+        printf("[%s]: watch socket of peer %d failed!\n", __func__, peer->ptlmap.id);
+        rpc_map_socket(rpc_s, peer->sockfd, NULL);
+        goto err_out;
+    }
+    if (peer->f_shm && rpc_shm_peer_add(rpc_s, peer) < 0) {
+        goto err_out;
+    }
+    return 0;
+
+    err_out:
+    return -1;
+}
+
+/* Add an extra connection of `peer` to the event loop, only to hear of room to write */
+static int rpc_watch_stream(struct rpc_server *rpc_s, struct node_id *peer, int sockfd) {
+    struct epoll_event event;
+
+    if (rpc_map_socket(rpc_s, sockfd, peer) < 0) {
+        return -1;
+    }
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLOUT | EPOLLET;
+    event.data.fd = sockfd;
+    if (epoll_ctl(rpc_s->epfd, EPOLL_CTL_ADD, sockfd, &event) < 0) {
+        printf("[%s]: watch extra socket of peer %d failed!\n", __func__, peer->ptlmap.id);
+        rpc_map_socket(rpc_s, sockfd, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+static void rpc_set_send_pending(struct rpc_server *rpc_s, struct node_id *peer, int f_pending);
+
+/* Drop a peer that closed its connection from the event loop, and close all its sockets */
+static void rpc_unwatch_peer(struct rpc_server *rpc_s, struct node_id *peer) {
+    struct rpc_request *request, *tmp;
+    struct list_head done;
+    int i;
+
+    epoll_ctl(rpc_s->epfd, EPOLL_CTL_DEL, peer->sockfd, NULL);
+    rpc_map_socket(rpc_s, peer->sockfd, NULL);
+    if (peer->f_shm) {
+        rpc_shm_peer_remove(rpc_s, peer->sockfd);
+    }
+
+    pthread_mutex_lock(&peer->send_lock);
+    if (peer->f_shm) {
+        /* The segment name is unlinked once both ends attached, only the mapping is left */
+        peer->f_shm = 0;
+        shm_channel_free(&peer->shm);
+    }
+    for (i = 1; i < peer->num_streams; ++i) {
+        epoll_ctl(rpc_s->epfd, EPOLL_CTL_DEL, peer->stream_sockfd[i], NULL);
+        rpc_map_socket(rpc_s, peer->stream_sockfd[i], NULL);
+        close(peer->stream_sockfd[i]);
+    }
+    peer->num_streams = 1;
+    rpc_set_send_pending(rpc_s, peer, 0);
+    close(peer->sockfd);
+    peer->sockfd = -1;
+    peer->f_connected = 0;
+    /* No zero copy completions come for a closed socket */
+    INIT_LIST_HEAD(&done);
+    list_for_each_entry_safe(request, tmp, &peer->zc_list, struct rpc_request, req_entry) {
+        list_del(&request->req_entry);
+        list_add_tail(&request->req_entry, &done);
+    }
+    pthread_mutex_unlock(&peer->send_lock);
+
+    list_for_each_entry_safe(request, tmp, &done, struct rpc_request, req_entry) {
+        list_del(&request->req_entry);
+        (*request->cb)(rpc_s, request);
+    }
+}
+
+/*
+  Set up a connection accepted by a listener thread. A peer on the same
+  node offers a shared memory segment; we answer with one byte telling
+  whether we could attach it, so both ends agree on the path to use.
+*/
+int rpc_accept_peer(struct rpc_server *rpc_s, struct node_id *peer, int sockfd, const struct connection_info *info) {
+    char shm_name[sizeof(info->shm_name) + 1];
+    char ack = 0;
+
+    memcpy(shm_name, info->shm_name, sizeof(info->shm_name));
+    shm_name[sizeof(info->shm_name)] = '\0';
+
+    peer->sockfd = sockfd;
+    peer->f_shm = 0;
+    if (shm_name[0] != '\0' && shm_channel_attach(&peer->shm, shm_name) == 0) {
+        peer->f_shm = 1;
+        ack = 1;
+    }
+    peer->f_connected = 1;
+    if (rpc_watch_peer(rpc_s, peer) < 0) {
+        printf("[%s]: watch socket of newly connected peer failed!\n", __func__);
+    }
+
+    if (shm_name[0] != '\0' && socket_send_bytes(sockfd, &ack, 1) < 0) {
+        printf("[%s]: answer shared memory offer of peer %d failed!\n", __func__, peer->ptlmap.id);
+        goto err_out;
+    }
+
+    /* The extra connections come next, through the same listener */
+    peer->num_streams = 1;
+    if (!peer->f_shm && info->num_streams > 1 && info->num_streams <= RPC_MAX_STREAMS) {
+        peer->stream_key = info->stream_key;
+        peer->stripe_size = info->stripe_size;
+        peer->num_streams_accepted = 1;
+        pthread_mutex_lock(&rpc_s->fd_lock);
+        if (rpc_s->num_stream_wait == rpc_s->max_stream_wait) {
+            int size = rpc_s->max_stream_wait ? 2 * rpc_s->max_stream_wait : 16;
+            struct node_id **tab = (struct node_id **)realloc(rpc_s->stream_wait_tab, sizeof(*tab) * size);
+            if (tab == NULL) {
+                pthread_mutex_unlock(&rpc_s->fd_lock);
+                printf("[%s]: allocate stream table failed!\n", __func__);
+                goto err_out;
+            }
+            rpc_s->stream_wait_tab = tab;
+            rpc_s->max_stream_wait = size;
+        }
+        rpc_s->stream_wait_tab[rpc_s->num_stream_wait++] = peer;
+        pthread_mutex_unlock(&rpc_s->fd_lock);
+    }
+    return 0;
+
+    err_out:
+    return -1;
+}
+
+/*
+  Take an extra connection of a peer accepted before. Once all of them
+  are in, the peer stripes large payloads, and we tell it so.
+*/
+int rpc_accept_stream(struct rpc_server *rpc_s, int sockfd, const struct connection_info *info) {
+    struct node_id *peer = NULL;
+    char ack = 1;
+    int i;
+
+    pthread_mutex_lock(&rpc_s->fd_lock);
+    for (i = 0; i < rpc_s->num_stream_wait; ++i) {
+        if (rpc_s->stream_wait_tab[i]->stream_key == info->stream_key) {
+            peer = rpc_s->stream_wait_tab[i];
+            break;
+        }
+    }
+    if (peer == NULL || info->stream < 1 || info->stream >= info->num_streams) {
+        pthread_mutex_unlock(&rpc_s->fd_lock);
+        printf("[%s]: extra connection %d of an unknown peer, skip!\n", __func__, info->stream);
+        close(sockfd);
+        return -1;
+    }
+    peer->stream_sockfd[info->stream] = sockfd;
+    if (++peer->num_streams_accepted < info->num_streams) {
+        pthread_mutex_unlock(&rpc_s->fd_lock);
+        return 0;
+    }
+    rpc_s->stream_wait_tab[i] = rpc_s->stream_wait_tab[--rpc_s->num_stream_wait];
+    pthread_mutex_unlock(&rpc_s->fd_lock);
+
+    for (i = 1; i < info->num_streams; ++i) {
+        rpc_watch_stream(rpc_s, peer, peer->stream_sockfd[i]);
+    }
+    /* The peer sends nothing before our answer, so no striped payload is missed */
+    peer->num_streams = info->num_streams;
+    if (socket_send_bytes(peer->sockfd, &ack, 1) < 0) {
+        printf("[%s]: answer extra connections of peer %d failed!\n", __func__, peer->ptlmap.id);
+        return -1;
+    }
+    return 0;
+}
+
+/* Add `peer` to the peers with queued requests for the event loop, or take it out */
+static void rpc_set_send_pending(struct rpc_server *rpc_s, struct node_id *peer, int f_pending) {
+    int i;
+
+    if (peer->f_send_pending == f_pending) {
+        return;
+    }
+    pthread_mutex_lock(&rpc_s->fd_lock);
+    if (f_pending) {
+        if (rpc_s->num_send_fds == rpc_s->max_send_fds) {
+            int size = rpc_s->max_send_fds ? 2 * rpc_s->max_send_fds : 16;
+            int *tab = (int *)realloc(rpc_s->send_fd_tab, sizeof(*tab) * size);
+            if (tab == NULL) {
+                pthread_mutex_unlock(&rpc_s->fd_lock);
+                printf("[%s]: allocate pending peer table failed!\n", __func__);
+                return;
+            }
+            rpc_s->send_fd_tab = tab;
+            rpc_s->max_send_fds = size;
+        }
+        rpc_s->send_fd_tab[rpc_s->num_send_fds++] = peer->sockfd;
+    } else {
+        for (i = 0; i < rpc_s->num_send_fds; ++i) {
+            if (rpc_s->send_fd_tab[i] == peer->sockfd) {
+                rpc_s->send_fd_tab[i] = rpc_s->send_fd_tab[--rpc_s->num_send_fds];
+                break;
+            }
+        }
+    }
+    peer->f_send_pending = f_pending;
+    pthread_mutex_unlock(&rpc_s->fd_lock);
+}
+
+/*
+  Write the queued requests of `peer` in order, at most `quota` bytes,
+  without blocking, then run the callbacks of the requests written in
+  full. A request that fails is completed too, so that its callback
+  releases the buffers. Returns 1 if requests are left that the peer
+  could take right away (quota used up, or a ring with no write event
+  to wait for), 0 if not, -1 on error.
+*/
+static int peer_progress_send(struct rpc_server *rpc_s, struct node_id *peer, uint64_t quota) {
+    struct list_head done;
+    struct rpc_request *request, *tmp;
+    int err = 0, more;
+
+    INIT_LIST_HEAD(&done);
+    pthread_mutex_lock(&peer->send_lock);
+    while (!list_empty(&peer->req_list) && quota > 0) {
+        request = list_entry(peer->req_list.next, struct rpc_request, req_entry);
+        int64_t n = peer_write_request(peer, request, quota);
+        if (n < 0) {
+            printf("[%s]: send RPC request to peer %d failed!\n", __func__, peer->ptlmap.id);
+            err = -1;
+        } else {
+            quota -= (uint64_t)n;
+            if (request->first < request->iovcnt) {
+                break;
+            }
+        }
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+        /* The kernel numbers the zero copy sends in order; the callback
+           waits for the last one, see peer_reap_zerocopy() */
+        if (request->num_zc > 0) {
+            peer->zc_next += request->num_zc;
+            request->zc_last = peer->zc_next - 1;
+            if (n >= 0) {
+                list_del(&request->req_entry);
+                list_add_tail(&request->req_entry, &peer->zc_list);
+                continue;
+            }
+        }
+#endif
+        list_del(&request->req_entry);
+        /* A receive request goes on with the reply in its caller */
+        if (request->iodir != io_receive) {
+            list_add_tail(&request->req_entry, &done);
+        }
+    }
+    more = !list_empty(&peer->req_list) && (quota == 0 || peer->f_shm);
+    rpc_set_send_pending(rpc_s, peer, !list_empty(&peer->req_list));
+    pthread_mutex_unlock(&peer->send_lock);
+
+    list_for_each_entry_safe(request, tmp, &done, struct rpc_request, req_entry) {
+        list_del(&request->req_entry);
+        if ((*request->cb)(rpc_s, request) < 0) {
+            printf("[%s]: call request callback function failed!\n", __func__);
+            err = -1;
+        }
+    }
+    return (err < 0) ? err : more;
+}
+
+/* Wait for room in the sockets the first queued request of `peer` still writes to */
+static void peer_wait_writable(struct node_id *peer) {
+    struct pollfd pfd[RPC_MAX_STREAMS];
+    int i, num_fds = 0;
+
+    pthread_mutex_lock(&peer->send_lock);
+    if (!list_empty(&peer->req_list)) {
+        struct rpc_request *request = list_entry(peer->req_list.next, struct rpc_request, req_entry);
+        for (i = 0; i < request->num_stripes; ++i) {
+            if (request->stripe_left[i] > 0) {
+                pfd[num_fds].fd = i ? peer->stream_sockfd[i] : peer->sockfd;
+                pfd[num_fds].events = POLLOUT;
+                ++num_fds;
+            }
+        }
+        if (request->num_stripes == 0) {
+            pfd[0].fd = peer->sockfd;
+            pfd[0].events = POLLOUT;
+            num_fds = 1;
+        }
+    }
+    pthread_mutex_unlock(&peer->send_lock);
 
-    if (rpc_server_init_socket(rpc_s) < 0) {
-        printf("[%s]: initialize socket for RPC server failed!\n", __func__);
-        goto err_out;
+    if (num_fds > 0) {
+        poll(pfd, num_fds, -1);
     }
+}
 
-    char *write_size = getenv("DATASPACES_TCP_WRITE_SIZE");
-    if (write_size != NULL) {
-        socket_best_write_size = str_to_uint64(write_size);
+/* Write all the queued requests of `peer`, waiting for room as needed */
+static int peer_flush_send(struct rpc_server *rpc_s, struct node_id *peer) {
+    unsigned int spins = 0;
+    int err = 0, f_empty;
+
+    while (1) {
+        if (peer_progress_send(rpc_s, peer, UINT64_MAX) < 0) {
+            /* Keep going, failed requests leave the queue */
+            err = -1;
+        }
+        pthread_mutex_lock(&peer->send_lock);
+        f_empty = list_empty(&peer->req_list);
+        pthread_mutex_unlock(&peer->send_lock);
+        if (f_empty) {
+            break;
+        }
+
+        if (peer->f_shm) {
+            if (peer_shm_gone(peer, &spins)) {
+                printf("[%s]: peer %d closed the connection!\n", __func__, peer->ptlmap.id);
+                return -1;
+            }
+            sched_yield();
+        } else {
+            peer_wait_writable(peer);
+        }
     }
-    char *read_size = getenv("DATASPACES_TCP_READ_SIZE");
-    if (read_size != NULL) {
-        socket_best_read_size = str_to_uint64(read_size);
+    return err;
+}
+
+/*
+  Queue `request` behind the earlier ones to `peer` and write as much
+  as the peer takes right away. A server leaves the rest to its event
+  loop, so a slow reader does not hold it up; a client has no loop
+  running between calls, so it waits until all is written. From here
+  on the request callback owns the buffers, even if the write fails.
+*/
+static void peer_post_request(struct rpc_server *rpc_s, struct node_id *peer, struct rpc_request *request) {
+    pthread_mutex_lock(&peer->send_lock);
+    list_add_tail(&request->req_entry, &peer->req_list);
+    pthread_mutex_unlock(&peer->send_lock);
+
+    if (rpc_s->cmp_type == DART_CLIENT) {
+        peer_flush_send(rpc_s, peer);
+    } else {
+        peer_progress_send(rpc_s, peer, UINT64_MAX);
     }
+}
 
-    return rpc_s;
+/* Give each peer with queued requests up to `socket_send_quota` more bytes; returns the number of peers that could take more now */
+static int rpc_progress_send_peers(struct rpc_server *rpc_s) {
+    int i, num_fds, num_more = 0;
 
-    err_out:
-    if (rpc_s != NULL) {
-        free(rpc_s);
+    pthread_mutex_lock(&rpc_s->fd_lock);
+    num_fds = rpc_s->num_send_fds;
+    int sockfd_tab[num_fds + 1];
+    memcpy(sockfd_tab, rpc_s->send_fd_tab, sizeof(int) * num_fds);
+    pthread_mutex_unlock(&rpc_s->fd_lock);
+
+    for (i = 0; i < num_fds; ++i) {
+        struct node_id *peer = rpc_socket_peer(rpc_s, sockfd_tab[i]);
+        if (peer == NULL) {
+            continue;
+        }
+        if (peer_progress_send(rpc_s, peer, socket_send_quota) > 0) {
+            ++num_more;
+        }
     }
-    return NULL;
+    return num_more;
 }
 
 void rpc_server_set_peer_ref(struct rpc_server *rpc_s, struct node_id *peer_tab, int num_peers) {
+    int i, j;
+
     rpc_s->num_peers = num_peers;
     rpc_s->peer_tab = peer_tab;
+
+    /* Connected peers may have been copied to the new table */
+    pthread_mutex_lock(&rpc_s->fd_lock);
+    rpc_s->num_shm_peers = 0;
+    pthread_mutex_unlock(&rpc_s->fd_lock);
+    for (i = 0; i < num_peers; ++i) {
+        if (peer_tab[i].f_connected) {
+            rpc_map_socket(rpc_s, peer_tab[i].sockfd, &peer_tab[i]);
+            for (j = 1; j < peer_tab[i].num_streams; ++j) {
+                rpc_map_socket(rpc_s, peer_tab[i].stream_sockfd[j], &peer_tab[i]);
+            }
+            if (peer_tab[i].f_shm) {
+                rpc_shm_peer_add(rpc_s, &peer_tab[i]);
+            }
+        }
+    }
 }
 
 int rpc_write_config(struct rpc_server *rpc_s, const char *filename) {
+    local_master_address = rpc_s->ptlmap.address;
+    __atomic_store_n(&f_local_master, 1, __ATOMIC_RELEASE);
+
     FILE *f = fopen(filename, "wt");
     if(f == NULL) {
         printf("[%s]: open config file failed!\n", __func__);
@@ -287,6 +1380,10 @@ int rpc_read_config(struct sockaddr_in *address, const char *filename) {
     char *port = getenv("P2TPID");
 
     FILE *f = NULL;
+    if ((ip == NULL || port == NULL) && __atomic_load_n(&f_local_master, __ATOMIC_ACQUIRE)) {
+        *address = local_master_address;
+        return 0;
+    }
     if (ip == NULL || port == NULL) {
         f = fopen(filename, "rt");
         if (f == NULL) {
@@ -316,14 +1413,10 @@ int rpc_read_config(struct sockaddr_in *address, const char *filename) {
     return -1;
 }
 
-/* Connect to a peer */
-int rpc_connect(struct rpc_server *rpc_s, struct node_id *peer) {
-    if (peer->f_connected) {
-        return 0;
-    }
-
-    peer->sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (peer->sockfd < 0) {
+/* Open a connection to the listening socket of `peer` */
+static int rpc_open_socket(struct rpc_server *rpc_s, struct node_id *peer) {
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) {
         printf("[%s]: create socket failed!\n", __func__);
         goto err_out;
     }
@@ -333,43 +1426,166 @@ int rpc_connect(struct rpc_server *rpc_s, struct node_id *peer) {
     local_addr.sin_family = AF_INET;
     local_addr.sin_addr = rpc_s->ptlmap.address.sin_addr;
     local_addr.sin_port = htons(0);
-    if (bind(peer->sockfd, (struct sockaddr *)&local_addr, (socklen_t)sizeof(local_addr)) < 0) {
+    if (bind(sockfd, (struct sockaddr *)&local_addr, (socklen_t)sizeof(local_addr)) < 0) {
         printf("[%s]: bind local socket failed!\n", __func__);
         goto err_out;
     }
 
-    if (connect(peer->sockfd, (struct sockaddr *)&peer->ptlmap.address, sizeof(peer->ptlmap.address)) < 0) {
+    if (connect(sockfd, (struct sockaddr *)&peer->ptlmap.address, sizeof(peer->ptlmap.address)) < 0) {
         printf("[%s]: connect to peer %d failed!\n", __func__, peer->ptlmap.id);
         goto err_out;
     }
-    if (rpc_send_connection_info(rpc_s, peer) < 0) {
+    return sockfd;
+
+    err_out:
+    if (sockfd >= 0) {
+        close(sockfd);
+    }
+    return -1;
+}
+
+/*
+  Open the extra connections to `peer` once it knows how many to
+  expect; it answers on the first connection when it has them all.
+*/
+static int rpc_connect_streams(struct rpc_server *rpc_s, struct node_id *peer) {
+    struct connection_info info;
+    char ack = 0;
+    int i;
+
+    for (i = 1; i < socket_num_streams; ++i) {
+        peer->stream_sockfd[i] = rpc_open_socket(rpc_s, peer);
+        if (peer->stream_sockfd[i] < 0) {
+            goto err_out;
+        }
+        rpc_fill_connection_info(rpc_s, peer, &info);
+        info.stream = i;
+        if (socket_send_bytes(peer->stream_sockfd[i], (char *)&info, (uint64_t)sizeof(info)) < 0) {
+            printf("[%s]: send connection info of stream %d failed!\n", __func__, i);
+            close(peer->stream_sockfd[i]);
+            goto err_out;
+        }
+    }
+    if (socket_recv_bytes(peer->sockfd, &ack, 1) < 0 || !ack) {
+        printf("[%s]: peer %d did not take the extra connections!\n", __func__, peer->ptlmap.id);
+        goto err_out;
+    }
+
+    peer->stripe_size = socket_stripe_size;
+    peer->num_streams = socket_num_streams;
+    for (i = 1; i < peer->num_streams; ++i) {
+        rpc_watch_stream(rpc_s, peer, peer->stream_sockfd[i]);
+    }
+    return 0;
+
+    err_out:
+    while (--i > 0) {
+        close(peer->stream_sockfd[i]);
+    }
+    return -1;
+}
+
+/*
+  Connect to a peer; one on the same node is offered shared memory
+  rings, a remote one gets `socket_num_streams` connections.
+*/
+int rpc_connect(struct rpc_server *rpc_s, struct node_id *peer) {
+    char shm_name[32] = "";
+
+    if (peer->f_connected) {
+        return 0;
+    }
+    peer->f_shm = 0;
+    peer->num_streams = 1;
+
+    peer->sockfd = rpc_open_socket(rpc_s, peer);
+    if (peer->sockfd < 0) {
+        goto err_out;
+    }
+    if (socket_num_streams > 1) {
+        int count = __atomic_fetch_add(&stream_count, 1, __ATOMIC_RELAXED);
+        peer->stream_key = ((uint64_t)rpc_s->ptlmap.address.sin_addr.s_addr << 32) |
+            ((uint64_t)getpid() << 10) | (uint64_t)(count & 0x3ff);
+    }
+
+    if (shm_ring_size > 0 && peer->ptlmap.address.sin_addr.s_addr == rpc_s->ptlmap.address.sin_addr.s_addr) {
+        snprintf(shm_name, sizeof(shm_name), "/dspaces-%d-%d", (int)getpid(), __atomic_fetch_add(&shm_count, 1, __ATOMIC_RELAXED));
+        if (shm_channel_create(&peer->shm, shm_name, shm_ring_size) < 0) {
+            shm_name[0] = '\0';
+        }
+    }
+    if (rpc_send_connection_info(rpc_s, peer, shm_name) < 0) {
         printf("[%s]: send connection info failed!\n", __func__);
         goto err_out;
     }
+    if (shm_name[0] != '\0') {
+        /* The peer has attached the segment once it answers, the name is no longer needed */
+        char ack = 0;
+        if (socket_recv_bytes(peer->sockfd, &ack, 1) < 0) {
+            goto err_out;
+        }
+        shm_channel_unlink(shm_name);
+        if (ack) {
+            peer->f_shm = 1;
+        } else {
+            shm_channel_free(&peer->shm);
+        }
+        shm_name[0] = '\0';
+    }
+    if (!peer->f_shm && socket_num_streams > 1 && rpc_connect_streams(rpc_s, peer) < 0) {
+        goto err_out;
+    }
+    if (rpc_watch_peer(rpc_s, peer) < 0) {
+        goto err_out;
+    }
     peer->f_connected = 1;
     return 0;
 
     err_out:
+    if (shm_name[0] != '\0') {
+        shm_channel_unlink(shm_name);
+        shm_channel_free(&peer->shm);
+    }
     if (peer->sockfd >= 0) {
         close(peer->sockfd);
     }
     return -1;
 }
 
+/* Open a connection to the one-sided read service of `peer`, returns the socket */
+int rpc_connect_rdma(struct rpc_server *rpc_s, struct node_id *peer) {
+    struct connection_info info;
+    int sockfd = rpc_open_socket(rpc_s, peer);
+    if (sockfd < 0) {
+        return -1;
+    }
+
+    rpc_fill_connection_info(rpc_s, peer, &info);
+    info.num_streams = 1;
+    info.f_rdma = 1;
+    if (socket_send_bytes(sockfd, (char *)&info, (uint64_t)sizeof(info)) < 0) {
+        printf("[%s]: send connection info to peer %d failed!\n", __func__, peer->ptlmap.id);
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
 static int rpc_process_cmd(struct rpc_server *rpc_s, struct rpc_cmd *cmd) {
     ulog("[%s]: peer %d (%s) will process RPC command %d from %d.\n", __func__,
         rpc_s->ptlmap.id, rpc_s->cmp_type == DART_SERVER ? "server" : "client", (int)cmd->cmd, cmd->id);
+    struct rpc_service_tab *tab = rpc_s->service_tab;
     int i;
-    for (i = 0; i < num_service; ++i) {
-        if (cmd->cmd == rpc_commands[i].rpc_cmd) {
-            if (rpc_commands[i].rpc_func(rpc_s, cmd) < 0) {
+    for (i = 0; i < tab->num_service; ++i) {
+        if (cmd->cmd == tab->rpc_commands[i].rpc_cmd) {
+            if (tab->rpc_commands[i].rpc_func(rpc_s, cmd) < 0) {
                 printf("[%s]: call RPC command function failed!\n", __func__);
                 goto err_out;
             }
             break;
         }
     }
-    if (i == num_service) {
+    if (i == tab->num_service) {
         printf("[%s]: unknown RPC command %d!\n", __func__, (int)cmd->cmd);
         goto err_out;
     }
@@ -383,7 +1599,7 @@ static int rpc_process_cmd(struct rpc_server *rpc_s, struct rpc_cmd *cmd) {
 static int rpc_process_event_peer(struct rpc_server *rpc_s, struct node_id *peer) {
     while (1) {
         struct rpc_cmd cmd;
-        int ret = socket_recv_rpc_cmd(peer->sockfd, &cmd);
+        int ret = peer_recv_rpc_cmd(peer, &cmd);
         if (ret < 0) {
             printf("[%s]: receive RPC command from peer %d failed!\n", __func__, peer->ptlmap.id);
             goto err_out;
@@ -392,6 +1608,11 @@ static int rpc_process_event_peer(struct rpc_server *rpc_s, struct node_id *peer
             /* No event to process */
             break;
         }
+        if (ret == 2) {
+            ulog("[%s]: peer %d closed the connection.\n", __func__, peer->ptlmap.id);
+            rpc_unwatch_peer(rpc_s, peer);
+            break;
+        }
 
         /* It is more convenient to set id here */
         cmd.id = peer->ptlmap.id;
@@ -406,12 +1627,104 @@ static int rpc_process_event_peer(struct rpc_server *rpc_s, struct node_id *peer
     return -1;
 }
 
+/* Process the RPC requests waiting in shared memory rings, returns the number of peers served */
+static int rpc_process_shm_peers(struct rpc_server *rpc_s) {
+    int i, num_ready = 0;
+
+    pthread_mutex_lock(&rpc_s->fd_lock);
+    int sockfd_tab[rpc_s->num_shm_peers + 1];
+    for (i = 0; i < rpc_s->num_shm_peers; ++i) {
+        if (shm_ring_used(rpc_s->shm_peer_tab[i]->shm.rx) > 0) {
+            sockfd_tab[num_ready++] = rpc_s->shm_peer_tab[i]->sockfd;
+        }
+    }
+    pthread_mutex_unlock(&rpc_s->fd_lock);
+
+    for (i = 0; i < num_ready; ++i) {
+        struct node_id *peer = rpc_socket_peer(rpc_s, sockfd_tab[i]);
+        if (peer != NULL && rpc_process_event_peer(rpc_s, peer) < 0) {
+            printf("[%s]: process event for peer %d failed, skip!\n", __func__, peer->ptlmap.id);
+        }
+    }
+    return num_ready;
+}
+
+/* Ask the writers of our rings for a wake up byte or stop asking; returns the number of rings with data */
+static int rpc_shm_set_waiting(struct rpc_server *rpc_s, int f_waiting) {
+    int i, num_ready = 0;
+
+    pthread_mutex_lock(&rpc_s->fd_lock);
+    for (i = 0; i < rpc_s->num_shm_peers; ++i) {
+        __atomic_store_n(&rpc_s->shm_peer_tab[i]->shm.rx->f_waiting, f_waiting, __ATOMIC_RELAXED);
+    }
+    /* Pairs with the fence in peer_shm_notify() */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (i = 0; i < rpc_s->num_shm_peers; ++i) {
+        if (shm_ring_used(rpc_s->shm_peer_tab[i]->shm.rx) > 0) {
+            ++num_ready;
+        }
+    }
+    pthread_mutex_unlock(&rpc_s->fd_lock);
+    return num_ready;
+}
+
+/*
+  Process the RPC requests from the peers with pending data. A server
+  blocks for up to `socket_poll_timeout` ms when all peers are idle; a
+  client only checks for events, as it polls in its own wait loops.
+  Shared memory rings are polled first; before blocking, their writers
+  are asked to send a byte on the socket when they add data.
+*/
 int rpc_process_event(struct rpc_server *rpc_s) {
-    int i;
-    for (i = 0; i < rpc_s->num_peers; ++i) {
-        struct node_id *peer = &rpc_s->peer_tab[i];
-        if (!peer->f_connected) {
-            /* Not connected yet, no need for processing event */
+    struct epoll_event events[RPC_MAX_EVENTS];
+    int timeout = (rpc_s->cmp_type == DART_SERVER) ? socket_poll_timeout : 0;
+    int f_sleep = 0;
+    int i, n;
+
+    if (rpc_progress_send_peers(rpc_s) > 0) {
+        timeout = 0;
+    }
+    if (rpc_process_shm_peers(rpc_s) > 0) {
+        timeout = 0;
+    }
+    if (timeout > 0) {
+        f_sleep = 1;
+        if (rpc_shm_set_waiting(rpc_s, 1) > 0) {
+            timeout = 0;
+        }
+    }
+
+    n = epoll_wait(rpc_s->epfd, events, RPC_MAX_EVENTS, timeout);
+    if (f_sleep) {
+        rpc_shm_set_waiting(rpc_s, 0);
+    }
+    if (n < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        printf("[%s]: wait for socket events failed!\n", __func__);
+        return -1;
+    }
+
+    for (i = 0; i < n; ++i) {
+        /* Look the peer up at each event, as the table may change under a registration */
+        struct node_id *peer = rpc_socket_peer(rpc_s, events[i].data.fd);
+        if (peer == NULL) {
+            continue;
+        }
+
+        /* Room again in the socket of a peer we have requests queued for */
+        if ((events[i].events & EPOLLOUT) && peer->f_send_pending) {
+            peer_progress_send(rpc_s, peer, socket_send_quota);
+        }
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+        /* Zero copy completions wait on the error queue of the socket */
+        if ((events[i].events & EPOLLERR) && peer_reap_zerocopy(rpc_s, peer) > 0 &&
+            !(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+            continue;
+        }
+#endif
+        if (!(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
             continue;
         }
 
@@ -419,6 +1732,11 @@ int rpc_process_event(struct rpc_server *rpc_s) {
             printf("[%s]: process event for peer %d failed, skip!\n", __func__, peer->ptlmap.id);
             continue;
         }
+        /* The socket of a shared memory peer only carries wake ups, and its close */
+        if (peer->f_shm && socket_drain(peer->sockfd) == 2) {
+            ulog("[%s]: peer %d closed the connection.\n", __func__, peer->ptlmap.id);
+            rpc_unwatch_peer(rpc_s, peer);
+        }
     }
     return 0;
 }
@@ -433,69 +1751,50 @@ int rpc_barrier(struct rpc_server *rpc_s, void *comm) {
     return 0;
 }
 
-static int rpc_post_request(struct rpc_server *rpc_s, struct node_id *peer, struct rpc_request *request) {
-    if (socket_send_bytes(peer->sockfd, (char *)request->data, (uint64_t)request->size) < 0) {
-        printf("[%s]: send RPC request to peer %d failed!\n", __func__, peer->ptlmap.id);
-        goto err_out;
-    }
-
-    if (request->iodir == io_send) {
-        if (socket_send_bytes(peer->sockfd, (char *)request->msg->msg_data, (uint64_t)request->msg->size) < 0) {
-            printf("[%s]: send to peer %d directly failed!\n", __func__, peer->ptlmap.id);
-            goto err_out;
-        }
-    } else if (request->iodir == io_receive) {
-        if (socket_recv_bytes(peer->sockfd, (char *)request->msg->msg_data, (uint64_t)request->msg->size, 1) < 0) {
-            printf("[%s]: receive from peer %d directly failed!\n", __func__, peer->ptlmap.id);
-            goto err_out;
-        }
-    }
-
-    if (request->cb == NULL) {
-        printf("[%s]: request doesn't have a callback function, may cause memory leak!\n", __func__);
-        goto err_out;
-    }
-
-    if ((*request->cb)(rpc_s, request) < 0) {
-        printf("[%s]: call request callback function failed!\n", __func__);
+int rpc_send(struct rpc_server *rpc_s, struct node_id *peer, struct msg_buf *msg) {
+    struct rpc_request *request = rpc_request_alloc(rpc_s);
+    if (request == NULL) {
+        printf("[%s]: allocate request failed!\n", __func__);
         return -1;
     }
-    return 0;
 
-    err_out:
-    if (request->msg != NULL) {
-        if (request->msg->msg_data != NULL) {
-            free(request->msg->msg_data);
-        }
-        free(request->msg);
+    pthread_mutex_lock(&peer->send_lock);
+    if (!peer->f_connected) {
+        rpc_connect(rpc_s, peer);
     }
-    free(request);
-    return -1;
-}
-
-static int peer_process_send_list(struct rpc_server *rpc_s, struct node_id *peer) {
-    while (!list_empty(&peer->req_list)) {
-        struct rpc_request *request = list_entry(peer->req_list.next, struct rpc_request, req_entry);
-        request->msg->msg_rpc->id = rpc_s->ptlmap.id;
-        list_del(&request->req_entry);
+    pthread_mutex_unlock(&peer->send_lock);
 
-        if (rpc_post_request(rpc_s, peer, request) < 0) {
-            printf("[%s]: post RPC request for peer %d failed!\n", __func__, peer->ptlmap.id);
-            goto err_out;
-        }
-    }
+    /* TODO: should serialize data */
+    /* The payload of a send follows the command in the same write */
+    request->msg = msg;
+    request->iodir = io_send;
+    request->data = msg->msg_rpc;
+    request->size = sizeof(*msg->msg_rpc);
+    request->cb = (request_callback)rpc_cb_request_posted;
+    request->vec[0].iov_base = request->data;
+    request->vec[0].iov_len = request->size;
+    request->vec[1].iov_base = msg->msg_data;
+    request->vec[1].iov_len = (size_t)msg->size;
+    peer_init_request(peer, request, request->vec, 2);
+    peer_stripe_request(peer, request, (uint64_t)request->size);
+    peer_post_request(rpc_s, peer, request);
     return 0;
-
-    err_out:
-    return -1;
 }
 
-int rpc_send(struct rpc_server *rpc_s, struct node_id *peer, struct msg_buf *msg) {
+/*
+  Written ahead of the data of a direct send, the reply to an
+  rpc_receive(): commands sent to the same peer by other threads, or
+  ahead of the reply, are told apart from it this way.
+*/
+static struct rpc_cmd rpc_reply_cmd = { .cmd = cn_data };
+
+int rpc_send_direct(struct rpc_server *rpc_s, struct node_id *peer, struct msg_buf *msg) {
     if (!peer->f_connected) {
-        rpc_connect(rpc_s, peer);
+        printf("[%s]: cannot send to an unconnected peer directly!\n", __func__);
+        goto err_out;
     }
 
-    struct rpc_request *request = (struct rpc_request *)malloc(sizeof(struct rpc_request));
+    struct rpc_request *request = rpc_request_alloc(rpc_s);
     if (request == NULL) {
         printf("[%s]: allocate request failed!\n", __func__);
         goto err_out;
@@ -504,60 +1803,86 @@ int rpc_send(struct rpc_server *rpc_s, struct node_id *peer, struct msg_buf *msg
     /* TODO: should serialize data */
     request->msg = msg;
     request->iodir = io_send;
-    request->data = msg->msg_rpc;
-    request->size = sizeof(*msg->msg_rpc);
+    request->data = &rpc_reply_cmd;
+    request->size = sizeof(rpc_reply_cmd);
     request->cb = (request_callback)rpc_cb_request_posted;
-    list_add(&request->req_entry, &peer->req_list);
-    if (peer_process_send_list(rpc_s, peer) < 0) {
-        printf("[%s]: process send list for peer %d failed!\n", __func__, peer->ptlmap.id);
-        goto err_out;
-    }
+    request->vec[0].iov_base = request->data;
+    request->vec[0].iov_len = request->size;
+    request->vec[1].iov_base = msg->msg_data;
+    request->vec[1].iov_len = (size_t)msg->size;
+    peer_init_request(peer, request, request->vec, 2);
+    peer_stripe_request(peer, request, (uint64_t)request->size);
+    peer_post_request(rpc_s, peer, request);
     return 0;
 
     err_out:
-    /* Request will be free in callback function */
     return -1;
 }
 
-int rpc_send_direct(struct rpc_server *rpc_s, struct node_id *peer, struct msg_buf *msg) {
+/*
+  Send the buffers listed in `msg` directly: `msg_data` is a table of
+  `size` iovec_t entries (same layout as struct iovec), e.g. filled by
+  ssd_copyv(). The peer receives them packed, as if sent in one piece.
+*/
+int rpc_send_directv(struct rpc_server *rpc_s, struct node_id *peer, struct msg_buf *msg) {
     if (!peer->f_connected) {
         printf("[%s]: cannot send to an unconnected peer directly!\n", __func__);
         goto err_out;
     }
 
-    /* TODO: should serialize data */
-    if (socket_send_bytes(peer->sockfd, (char *)msg->msg_data, (uint64_t)msg->size) < 0) {
-        printf("[%s]: send to peer %d directly failed!\n", __func__, peer->ptlmap.id);
+    struct rpc_request *header = rpc_request_alloc(rpc_s);
+    if (header == NULL) {
+        printf("[%s]: allocate request failed!\n", __func__);
         goto err_out;
     }
-
-    if (msg->cb != NULL) {
-        if ((*msg->cb)(rpc_s, msg) < 0) {
-            printf("[%s]: call message callback function failed!\n", __func__);
-            goto err_out;
-        }
+    struct rpc_request *request = rpc_request_alloc(rpc_s);
+    if (request == NULL) {
+        printf("[%s]: allocate request failed!\n", __func__);
+        rpc_request_free(rpc_s, header);
+        goto err_out;
     }
+
+    /* The table has no room for the header, which goes as a request of its own */
+    header->msg = NULL;
+    header->iodir = io_send;
+    header->data = &rpc_reply_cmd;
+    header->size = sizeof(rpc_reply_cmd);
+    header->cb = (request_callback)rpc_cb_request_posted;
+    header->vec[0].iov_base = header->data;
+    header->vec[0].iov_len = header->size;
+    peer_init_request(peer, header, header->vec, 1);
+
+    request->msg = msg;
+    request->iodir = io_send;
+    request->data = NULL;
+    request->size = 0;
+    request->cb = (request_callback)rpc_cb_request_posted;
+    peer_init_request(peer, request, (const struct iovec *)msg->msg_data, (int)msg->size);
+    peer_stripe_request(peer, request, 0);
+
+    /* Nothing may come between the header and the data */
+    pthread_mutex_lock(&peer->send_lock);
+    peer_post_request(rpc_s, peer, header);
+    peer_post_request(rpc_s, peer, request);
+    pthread_mutex_unlock(&peer->send_lock);
     return 0;
 
     err_out:
     return -1;
 }
 
-// added by Tong
-int rpc_send_directv(struct rpc_server *rpc_s, struct node_id *peer, struct msg_buf *msg) {
-
-  return 0;
-}
-
+/* Send the command of `msg` and read the reply into its buffer */
 int rpc_receive(struct rpc_server *rpc_s, struct node_id *peer, struct msg_buf *msg) {
-    if (!peer->f_connected) {
-        rpc_connect(rpc_s, peer);
-    }
-
-    struct rpc_request *request = (struct rpc_request *)malloc(sizeof(struct rpc_request));
+    struct rpc_request *request = rpc_request_alloc(rpc_s);
     if (request == NULL) {
         printf("[%s]: allocate request failed!\n", __func__);
-        goto err_out;
+        return -1;
+    }
+
+    /* Hold the lock until the reply is in, so that no other thread reads it */
+    pthread_mutex_lock(&peer->send_lock);
+    if (!peer->f_connected) {
+        rpc_connect(rpc_s, peer);
     }
 
     /* TODO: should serialize data */
@@ -566,15 +1891,57 @@ int rpc_receive(struct rpc_server *rpc_s, struct node_id *peer, struct msg_buf *
     request->data = msg->msg_rpc;
     request->size = sizeof(*msg->msg_rpc);
     request->cb = (request_callback)rpc_cb_request_posted;
-    list_add(&request->req_entry, &peer->req_list);
-    if (peer_process_send_list(rpc_s, peer) < 0) {
-        printf("[%s]: process send list for peer %d failed!\n", __func__, peer->ptlmap.id);
+    request->vec[0].iov_base = request->data;
+    request->vec[0].iov_len = request->size;
+    peer_init_request(peer, request, request->vec, 1);
+    list_add_tail(&request->req_entry, &peer->req_list);
+    if (peer_flush_send(rpc_s, peer) < 0) {
+        printf("[%s]: send RPC request to peer %d failed!\n", __func__, peer->ptlmap.id);
+        goto err_out;
+    }
+
+    /*
+      The peer may send commands ahead of the reply, and wait for our
+      answer to one before replying (e.g. a server pulling data put
+      lazily), so they are processed here as they come.
+    */
+    while (1) {
+        struct rpc_cmd cmd;
+        if (peer_recv_bytes(peer, (char *)&cmd, (uint64_t)sizeof(cmd)) < 0) {
+            printf("[%s]: receive reply header from peer %d failed!\n", __func__, peer->ptlmap.id);
+            goto err_out;
+        }
+        if (cmd.cmd == cn_data) {
+            break;
+        }
+        cmd.id = peer->ptlmap.id;
+        if (rpc_process_cmd(rpc_s, &cmd) < 0) {
+            printf("[%s]: process RPC command from peer %d failed!\n", __func__, peer->ptlmap.id);
+        }
+        if (peer_flush_send(rpc_s, peer) < 0) {
+            printf("[%s]: send to peer %d failed!\n", __func__, peer->ptlmap.id);
+            goto err_out;
+        }
+    }
+    if (peer_recv_bytes(peer, (char *)msg->msg_data, (uint64_t)msg->size) < 0) {
+        printf("[%s]: receive from peer %d directly failed!\n", __func__, peer->ptlmap.id);
         goto err_out;
     }
+    pthread_mutex_unlock(&peer->send_lock);
+
+    if ((*request->cb)(rpc_s, request) < 0) {
+        printf("[%s]: call request callback function failed!\n", __func__);
+        return -1;
+    }
     return 0;
 
     err_out:
-    /* Request will be free in callback function */
+    /* The caller frees `msg` and its buffer */
+    if (request->req_entry.next != NULL) {
+        list_del(&request->req_entry);
+    }
+    pthread_mutex_unlock(&peer->send_lock);
+    rpc_request_free(rpc_s, request);
     return -1;
 }
 
@@ -585,7 +1952,7 @@ int rpc_receive_direct(struct rpc_server *rpc_s, struct node_id *peer, struct ms
     }
 
     /* TODO: should deserialize data */
-    if (socket_recv_bytes(peer->sockfd, (char *)msg->msg_data, (uint64_t)msg->size, 1) < 0) {
+    if (peer_recv_bytes(peer, (char *)msg->msg_data, (uint64_t)msg->size) < 0) {
         printf("[%s]: receive from peer %d directly failed!\n", __func__, peer->ptlmap.id);
         goto err_out;
     }
@@ -606,33 +1973,62 @@ int rpc_receive_direct(struct rpc_server *rpc_s, struct node_id *peer, struct ms
 /* TODO: */
 int rpc_server_free(struct rpc_server *rpc_s) {
     if(rpc_s != NULL) {
+        close(rpc_s->epfd);
+        free(rpc_s->fd_peer_tab);
+        free(rpc_s->shm_peer_tab);
+        free(rpc_s->send_fd_tab);
+        free(rpc_s->stream_wait_tab);
+        rpc_pool_free(&rpc_s->msg_pool);
+        rpc_pool_free(&rpc_s->req_pool);
+        /* The table stays with its thread if freed elsewhere */
+        if (rpc_s->service_tab == thread_service_tab) {
+            free(thread_service_tab);
+            thread_service_tab = NULL;
+        }
         free(rpc_s);
     }
     return 0;
 }
 
+/*
+  Messages with at most one command come from the pool of the RPC
+  server. Only the command is sent over the wire, so it is the only
+  part cleared; the other fields are set one by one.
+*/
 struct msg_buf* msg_buf_alloc(struct rpc_server *rpc_s, const struct node_id *peer, int num_rpcs) {
     size_t size = sizeof(struct msg_buf) + sizeof(struct rpc_cmd) * num_rpcs + 7; /* 7 is for alignment padding */
-    struct msg_buf *msg = (struct msg_buf *)malloc(size);
+    struct rpc_pool *pool = (num_rpcs <= 1 && rpc_s != NULL) ? &rpc_s->msg_pool : NULL;
+    struct msg_buf *msg = (pool != NULL) ? (struct msg_buf *)rpc_pool_get(pool) : (struct msg_buf *)malloc(size);
     if (msg == NULL) {
         printf("[%s]: allocate message failed!\n", __func__);
-        goto err_out;
+        return NULL;
     }
 
-    memset(msg, 0, size);
-    msg->peer = peer;
+    INIT_LIST_HEAD(&msg->msg_entry);
+    msg->msg_rpc = NULL;
+    msg->msg_data = NULL;
+    msg->size = 0;
+    msg->refcont = 0;
+    msg->sync_op_id = NULL;
     msg->cb = default_completion_with_data_callback;
+    msg->private = NULL;
+    msg->peer = peer;
+    msg->pool = pool;
     if (num_rpcs > 0) {
         msg->msg_rpc = (struct rpc_cmd *)(msg + 1);
         ALIGN_ADDR_QUAD_BYTES(msg->msg_rpc);
+        memset(msg->msg_rpc, 0, sizeof(struct rpc_cmd) * num_rpcs);
     }
     return msg;
+}
 
-    err_out:
-    if (msg != NULL) {
+/* Release a message from msg_buf_alloc(); free() is still fine too, the message just is not recycled */
+void msg_buf_free(struct msg_buf *msg) {
+    if (msg->pool != NULL) {
+        rpc_pool_put(msg->pool, msg);
+    } else {
         free(msg);
     }
-    return NULL;
 }
 
 void rpc_mem_info_cache(struct node_id *peer, struct msg_buf *msg, struct rpc_cmd *cmd) {
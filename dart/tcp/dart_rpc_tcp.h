@@ -10,14 +10,17 @@ extern "C" {
 #include <string.h>
 #include <stdint.h>
 #include <errno.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
 #include <net/if.h>
-#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <sys/socket.h>
 
 #include "config.h"
 #include "list.h"
+#include "shm/dart_shm.h"
 
 #define ALIGN_ADDR_QUAD_BYTES(a)                                \
         unsigned long _a = (unsigned long) (a);                 \
@@ -61,11 +64,24 @@ struct lockhdr {
 } __attribute__ ((__packed__));
 
 
+#ifdef DS_HAVE_DIMES
+/* Memory region read by the emulated one-sided reads of dart_rdma_tcp.c */
+struct rdma_mr {
+        uint64_t address;
+        uint64_t length;
+        uint64_t host_key; /* Same on all processes of a node, 0 if unknown */
+        int pid;
+} __attribute__((__packed__));
+#endif
+
 /* Rpc command structure. */
 struct rpc_cmd {
         unsigned char            cmd;            // type of command
         unsigned char            num_msg;
         unsigned int           id; //Dart ID
+#ifdef DS_HAVE_DIMES
+        struct rdma_mr           mr;
+#endif
 
         unsigned char            pad[280+(BBOX_MAX_NDIM-3)*24];// payload of the command
 } __attribute__((__packed__));
@@ -117,6 +133,9 @@ enum io_dir {
         io_count
 };
 
+/* Max number of connections to a peer, the first one included */
+#define RPC_MAX_STREAMS 16
+
 struct rpc_request{
     struct list_head req_entry;
     struct msg_buf  *msg;
@@ -126,6 +145,22 @@ struct rpc_request{
     size_t  size;
 
     request_callback cb;
+
+    /* Buffers to write, and how far the writes got while queued */
+    struct iovec vec[2];
+    const struct iovec *iov;
+    int iovcnt, first;
+    size_t off;
+    int flags; /* MSG_ZEROCOPY for large payloads */
+    uint32_t num_zc; /* Zero copy writes to wait for before the callback */
+    uint32_t zc_last; /* Id the kernel gave to the last of them */
+
+    /* A large payload goes out in one stripe per connection of the
+       peer; stripe i starts at (stripe_first[i], stripe_off[i]) */
+    int num_stripes;
+    int stripe_first[RPC_MAX_STREAMS];
+    size_t stripe_off[RPC_MAX_STREAMS];
+    uint64_t stripe_left[RPC_MAX_STREAMS];
 };
 
 struct msg_buf{
@@ -143,6 +178,16 @@ struct msg_buf{
     completion_callback cb;
     void    *private;
     const struct node_id    *peer;
+
+    struct rpc_pool *pool; /* Where msg_buf_free() returns it, NULL for free() */
+};
+
+/* Free list of same size blocks, shared by the threads of an RPC server */
+struct rpc_pool {
+    pthread_mutex_t lock;
+    void *head; /* Free blocks link through their first word */
+    size_t size;
+    int count;
 };
 
 enum rpc_component {
@@ -164,6 +209,29 @@ struct rpc_server {
     pthread_t comm_thread; /* Thread for managing connections */
     int thread_alive;
 
+    int epfd; /* Epoll instance watching all connected peer sockets */
+    /* Peer of each watched socket, indexed by descriptor; set by the
+       connection thread too, so guarded by `fd_lock` */
+    struct node_id **fd_peer_tab;
+    int fd_peer_size;
+    /* Sockets of the peers with requests queued, progressed by the event loop */
+    int *send_fd_tab;
+    int num_send_fds, max_send_fds;
+    /* Accepted peers still waiting for their extra connections */
+    struct node_id **stream_wait_tab;
+    int num_stream_wait, max_stream_wait;
+    /* Peers reached through shared memory, polled by the event loop */
+    struct node_id **shm_peer_tab;
+    int num_shm_peers, max_shm_peers;
+    pthread_mutex_t fd_lock;
+
+    /* Recycled messages (with up to one command) and requests */
+    struct rpc_pool msg_pool;
+    struct rpc_pool req_pool;
+
+    /* Services to dispatch, a server and a client may share a process */
+    struct rpc_service_tab *service_tab;
+
     void *dart_ref; /* Points to dart_server or dart_client struct */
 };
 
@@ -183,6 +251,30 @@ struct node_id {
 
     int sockfd; /* Socket */
     int f_connected; /* Flag: if the peer is connected through `sockfd` */
+
+    /* Serialize the writes to `sockfd` from different threads, and
+       guard `req_list`, the requests waiting to be written in order */
+    pthread_mutex_t send_lock;
+    int f_send_pending; /* Flag: `req_list` is not empty, see rpc_server */
+
+    int f_zerocopy; /* Flag: large sends to the peer use MSG_ZEROCOPY */
+    uint32_t zc_next; /* Id the kernel gives to the next zero copy send */
+    /* Requests written in full, waiting for the kernel to be done with
+       their pages before the callback; guarded by `send_lock` */
+    struct list_head zc_list;
+
+    /* Shared memory rings to a peer on the same node; `sockfd` then
+       only carries the wake up bytes */
+    struct shm_channel shm;
+    int f_shm;
+
+    /* Extra connections carrying the stripes of payloads from
+       `stripe_size` bytes on; stream 0 is `sockfd` */
+    int num_streams;
+    int stream_sockfd[RPC_MAX_STREAMS];
+    uint64_t stripe_size;
+    uint64_t stream_key; /* Matches the extra connections of a peer being accepted */
+    int num_streams_accepted;
 };
 
 enum cmd_type { 
@@ -205,13 +297,20 @@ enum cmd_type {
     /* Shared spaces specific. */
     ss_obj_hint,
     ss_obj_put,
+    ss_obj_put_batch,
+    ss_obj_pull,
     ss_obj_update,
     ss_obj_get_dht_peers,
     ss_obj_get_desc,
+    ss_obj_get_desc_batch,
     ss_obj_query,
     ss_obj_cq_register,
     ss_obj_cq_notify,
     ss_obj_get,
+    ss_obj_get_strided,
+    ss_obj_summary,
+    ss_obj_get_summary,
+    ss_obj_get_batch,
     ss_obj_filter,
     ss_obj_info,
     ss_info,
@@ -235,12 +334,24 @@ enum cmd_type {
     dimes_obj_get_msg,
     dimes_obj_get_ack_v3_msg,
     dimes_get_ack_msg,
+    dimes_obj_release_msg,
+    dimes_obj_read_ack_msg,
+    dimes_obj_retire_msg,
 #endif
     /* Added for CCGrid Demo. */
     CN_TIMING_AVG,
     _CMD_COUNT
 };
 
+/* RPC services registered by one thread, dispatched by the RPC server it sets up */
+struct rpc_service_tab {
+    int num_service;
+    struct {
+        enum cmd_type rpc_cmd;
+        rpc_service rpc_func;
+    } rpc_commands[64];
+};
+
 enum lock_type {
     lk_read_get,
     lk_read_release,
@@ -254,6 +365,12 @@ struct connection_info {
     int id;
     int app_id;
     int app_size;
+    char shm_name[32]; /* Shared memory segment offered to the peer, empty for none */
+    int num_streams; /* Connections the peer opens, the first one included */
+    int stream; /* Index of this connection, 0 for the first one */
+    uint64_t stream_key;
+    uint64_t stripe_size;
+    int f_rdma; /* Flag: a connection for one-sided reads, see dart_rdma_tcp.h */
 } __attribute__((__packed__));
 
 struct payload_app_info {
@@ -274,9 +391,11 @@ struct payload_unregistration_info {
     int num_cp;
 } __attribute__((__packed__));
 
+void msg_buf_free(struct msg_buf *msg);
+
 static int default_completion_callback(struct rpc_server *rpc_s, struct msg_buf *msg) {
     if (msg != NULL) {
-        free(msg);
+        msg_buf_free(msg);
     }
     return 0;
 }
@@ -286,21 +405,26 @@ static int default_completion_with_data_callback(struct rpc_server *rpc_s, struc
         if (msg->msg_data != NULL) {
             free(msg->msg_data);
         }
-        free(msg);
+        msg_buf_free(msg);
     }
     return 0;
 }
 
 void rpc_add_service(enum cmd_type rpc_cmd, rpc_service rpc_func);
 
-int rpc_send_connection_info(struct rpc_server *rpc_s, struct node_id *peer);
+int rpc_send_connection_info(struct rpc_server *rpc_s, struct node_id *peer, const char *shm_name);
 int rpc_recv_connection_info(int sockfd, struct connection_info *info);
+int rpc_accept_peer(struct rpc_server *rpc_s, struct node_id *peer, int sockfd, const struct connection_info *info);
+int rpc_accept_stream(struct rpc_server *rpc_s, int sockfd, const struct connection_info *info);
 
 struct rpc_server* rpc_server_init(const char *interface, int app_num_peers, void *dart_ref, enum rpc_component cmp_type);
+void rpc_peer_init(struct node_id *peer);
 void rpc_server_set_peer_ref(struct rpc_server *rpc_s, struct node_id *peer_tab, int num_peers);
 int rpc_write_config(struct rpc_server *rpc_s, const char *filename);
 int rpc_read_config(struct sockaddr_in *address, const char *filename);
 int rpc_connect(struct rpc_server *rpc_s, struct node_id *peer);
+int rpc_connect_rdma(struct rpc_server *rpc_s, struct node_id *peer);
+int rpc_watch_peer(struct rpc_server *rpc_s, struct node_id *peer);
 int rpc_process_event(struct rpc_server *rpc_s);
 int rpc_barrier(struct rpc_server *rpc_s, void *comm);
 int rpc_send(struct rpc_server *rpc_s, struct node_id *peer, struct msg_buf *msg);
@@ -313,8 +437,8 @@ struct msg_buf* msg_buf_alloc(struct rpc_server *rpc_s, const struct node_id *pe
 
 int rpc_send_directv(struct rpc_server *, struct node_id *, struct msg_buf *); //uncommented by Tong.
 
-// void rpc_mem_info_cache(struct node_id *peer, struct msg_buf *msg, struct rpc_cmd *cmd);
-// void rpc_mem_info_reset(struct node_id *peer, struct msg_buf *msg, struct rpc_cmd *cmd);
+void rpc_mem_info_cache(struct node_id *peer, struct msg_buf *msg, struct rpc_cmd *cmd);
+void rpc_mem_info_reset(struct node_id *peer, struct msg_buf *msg, struct rpc_cmd *cmd);
 
 // void rpc_report_md_usage(struct rpc_server *);
 
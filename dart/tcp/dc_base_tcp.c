@@ -1,5 +1,6 @@
 #include "mpi.h"
 #include "dc_base_tcp.h"
+#include "dart_rdma_tcp.h"
 #include "debug.h"
 
 static int rpc_cb_recv_cn_register(struct rpc_server *rpc_s, struct msg_buf *msg) {
@@ -21,7 +22,7 @@ static int rpc_cb_recv_cn_register(struct rpc_server *rpc_s, struct msg_buf *msg
     dc_barrier(dc);
 
     free(msg->msg_data);
-    free(msg);
+    msg_buf_free(msg);
     return 0;
 }
 
@@ -52,7 +53,7 @@ static int rpc_handler_cn_register(struct rpc_server *rpc_s, struct rpc_cmd *cmd
     int i;
     for (i = 0; i < dc->peer_size; ++i) {
         struct node_id *peer = &dc->peer_tab[i];
-        INIT_LIST_HEAD(&peer->req_list);
+        rpc_peer_init(peer);
     }
 
     rpc_server_set_peer_ref(rpc_s, dc->peer_tab, dc->peer_size);
@@ -102,6 +103,20 @@ static void *dc_listen(void *client) {
             close(sockfd_c);
             continue;
         }
+        if (info.stream > 0) {
+            /* An extra connection of a peer accepted before */
+            rpc_accept_stream(dc->rpc_s, sockfd_c, &info);
+            continue;
+        }
+        if (info.f_rdma) {
+#ifdef DS_HAVE_DIMES
+            /* A DIMES reader of our memory, answered by a service thread */
+            dart_rdma_serve(sockfd_c);
+#else
+            close(sockfd_c);
+#endif
+            continue;
+        }
         struct node_id *peer = NULL;
         if (info.cmp_type == DART_CLIENT) {
             printf("[%s]: accept connection from a client, this should not happen, skip!\n", __func__);
@@ -121,8 +136,9 @@ static void *dc_listen(void *client) {
             close(sockfd_c);
             continue;
         }
-        peer->sockfd = sockfd_c;
-        peer->f_connected = 1;
+        if (rpc_accept_peer(dc->rpc_s, peer, sockfd_c, &info) < 0) {
+            printf("[%s]: set up newly connected peer failed!\n", __func__);
+        }
     }
 }
 
@@ -138,7 +154,7 @@ static int dc_register_at_master(struct dart_client *dc, int appid) {
     const char *filename_conf = "conf";
 
     struct node_id *peer_master = &dc->peer_tab[0];
-    INIT_LIST_HEAD(&peer_master->req_list);
+    rpc_peer_init(peer_master);
     if (rpc_read_config(&peer_master->ptlmap.address, filename_conf) < 0) {
         printf("[%s]: read RPC config file failed!\n", __func__);
         goto err_out;
@@ -190,7 +206,7 @@ static int dc_register_at_master(struct dart_client *dc, int appid) {
 
     err_out:
     if (msg != NULL) {
-        free(msg);
+        msg_buf_free(msg);
     }
     return -1;
 }
@@ -267,7 +283,7 @@ static int dc_unregister(struct dart_client *dc) {
 
     err_out:
     if (msg != NULL) {
-        free(msg);
+        msg_buf_free(msg);
     }
     return -1;
 }
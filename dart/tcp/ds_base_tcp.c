@@ -68,7 +68,7 @@ static int rpc_handler_cn_unregister(struct rpc_server *rpc_s, struct rpc_cmd *c
 
     err_out:
     if (msg != NULL) {
-        free(msg);
+        msg_buf_free(msg);
     }
     return -1;
 }
@@ -133,7 +133,7 @@ static int ds_register_cp(struct dart_server *ds) {
         if (msg->msg_data != NULL) {
             free(msg->msg_data);
         }
-        free(msg);
+        msg_buf_free(msg);
     }
     return -1;
 }
@@ -156,7 +156,7 @@ int rpc_cb_recv_sp_announce_cp(struct rpc_server *rpc_s, struct msg_buf *msg) {
     }
 
     free(msg->msg_data);
-    free(msg);
+    msg_buf_free(msg);
     return 0;
 }
 
@@ -206,7 +206,7 @@ int rpc_handler_sp_announce_cp(struct rpc_server *rpc_s, struct rpc_cmd *cmd) {
         if (msg->msg_data != NULL) {
             free(msg->msg_data);
         }
-        free(msg);
+        msg_buf_free(msg);
     }
     return -1;
 }
@@ -257,7 +257,7 @@ int ds_announce_cp(struct dart_server *ds, struct app_info *app) {
         if (msg->msg_data != NULL) {
             free(msg->msg_data);
         }
-        free(msg);
+        msg_buf_free(msg);
     }
     return -1;
 }
@@ -326,7 +326,7 @@ int rpc_cb_recv_sp_reg_reply(struct rpc_server *rpc_s, struct msg_buf *msg) {
     }
 
     free(msg->msg_data);
-    free(msg);
+    msg_buf_free(msg);
     return 0;
 }
 
@@ -367,7 +367,7 @@ int rpc_handler_sp_reg_reply(struct rpc_server *rpc_s, struct rpc_cmd *cmd) {
         if (msg->msg_data != NULL) {
             free(msg->msg_data);
         }
-        free(msg);
+        msg_buf_free(msg);
     }
     return -1;
 }
@@ -438,7 +438,7 @@ int rpc_handler_sp_reg_request(struct rpc_server *rpc_s, struct rpc_cmd *cmd) {
         if (msg->msg_data != NULL) {
             free(msg->msg_data);
         }
-        free(msg);
+        msg_buf_free(msg);
     }
     return -1;
 }
@@ -458,6 +458,11 @@ static void *ds_listen(void *server) {
             close(sockfd_c);
             continue;
         }
+        if (info.stream > 0) {
+            /* An extra connection of a peer accepted before */
+            rpc_accept_stream(ds->rpc_s, sockfd_c, &info);
+            continue;
+        }
         struct node_id *peer = NULL;
         if (info.id == -1) {
             /* Still in registration phase, it should be the master server */
@@ -499,8 +504,9 @@ static void *ds_listen(void *server) {
                 continue;
             }
         }
-        peer->sockfd = sockfd_c;
-        peer->f_connected = 1;
+        if (rpc_accept_peer(ds->rpc_s, peer, sockfd_c, &info) < 0) {
+            printf("[%s]: set up newly connected peer failed!\n", __func__);
+        }
     }
 }
 
@@ -569,7 +575,7 @@ int ds_boot_slave(struct dart_server *ds) {
 
     err_out:
     if (msg != NULL) {
-        free(msg);
+        msg_buf_free(msg);
     }
     return -1;
 }
@@ -662,7 +668,7 @@ struct dart_server *ds_alloc(int num_sp, int num_cp, void *dart_ref) {
     int i;
     for (i = 0; i < ds->peer_size; ++i) {
         struct node_id *peer = &ds->peer_tab[i];
-        INIT_LIST_HEAD(&peer->req_list);
+        rpc_peer_init(peer);
         /* TODO: what are the following two lines of code for? */
         // peer->num_msg_at_peer = ds->rpc_s->max_num_msg;
         // peer->num_msg_ret = 0;
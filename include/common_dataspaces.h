@@ -59,6 +59,13 @@ int common_dspaces_get (const char *var_name,
         uint64_t *ub,
         void *data);
 
+int common_dspaces_get_strided(const char *var_name,
+        unsigned int ver, int size,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        uint64_t *stride,
+        void *data);
 int common_dspaces_hint (const char *var_name,
 	unsigned int ver, int size,
 	int ndim,
@@ -72,8 +79,58 @@ int common_dspaces_put (const char *var_name,
         uint64_t *ub,
         void *data);
 
+int common_dspaces_iget (const char *var_name, 
+        unsigned int ver, int size,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        void *data);
+
+int common_dspaces_iput (const char *var_name, 
+        unsigned int ver, int size,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        void *data);
+
+int common_dspaces_put_batch(int num_vars, const char **var_names,
+        unsigned int ver, int *sizes,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        void **data);
+
+int common_dspaces_get_batch(int num_vars, const char **var_names,
+        unsigned int ver, int *sizes,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        void **data);
+
+int common_dspaces_test(int req_id, int *flag);
+int common_dspaces_wait(int req_id);
+int common_dspaces_waitall(int num_req, int *req_ids);
+
 int common_dspaces_remove (const char *var_name, unsigned int ver);
 
+int common_dspaces_select(const char *var_name, unsigned int ver,
+        int elem_type, int op,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        double lo, double hi, int num_bins,
+        double *result, uint64_t *bins);
+
+int common_dspaces_define_summary(const char *var_name, int elem_type);
+int common_dspaces_get_range(const char *var_name,
+        unsigned int ver, int size,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        double lo, double hi,
+        int max_bb, uint64_t *lb_tab, uint64_t *ub_tab,
+        void *data);
+
 int common_dspaces_put_sync(void);
 void common_dspaces_finalize (void);
 int common_dspaces_get_num_space_server(void);
@@ -180,6 +180,14 @@ void dspaces_unlock_on_write(const char *lock_name,void *comm);
  * staging server. User applications need to call dspaces_put_sync to check if
  * the most recent dspaces_put is complete or not.
  *
+ * Variables listed in the environment variable DATASPACES_LAZY_PUT
+ * (names separated by commas, or "*" for all) are put lazily: only the
+ * descriptor goes to the server, and the server pulls the data from
+ * the client when it is first read. The client answers pulls while it
+ * is in a DataSpaces call, such as the lock routines, and pushes the
+ * data it still holds in dspaces_finalize(). Set it to the same value
+ * on all ranks of the application.
+ *
  * Note: ordering of dimension (fast->slow) is 0, 1, ..., n-1. For C row-major
  * array, the dimensions need to be reordered to construct the bounding box. For
  * example, the bounding box for C array c[2][4] is lb: {0,0}, ub: {3,1}. 
@@ -213,6 +221,12 @@ int dspaces_put (const char *var_name,
  * After successful return of the routine, received data is copied into user
  * buffer pointed by "data".
  *
+ * If the environment variable DATASPACES_READ_CACHE_SIZE is set to a
+ * size in bytes, retrieved regions are cached on the client, and a
+ * region of the same version that is contained in a cached region is
+ * served locally. Cached versions are dropped by dspaces_remove() and
+ * when a newer version replaces them in the space.
+ *
  * Note: ordering of dimension (fast->slow) is 0, 1, ..., n-1. For row-major
  * array, the dimensions need to be reordered to construct the bounding box. For
  * example, the bounding box for C array c[2][4] is lb: {0,0}, ub: {3,1}.
@@ -236,6 +250,136 @@ int dspaces_get (const char *var_name,
         int ndim, uint64_t *lb, uint64_t *ub,
         void *data);
 
+/**
+ * @brief Query the space for every stride-th point of a region.
+ *
+ * Same as dspaces_get(), except that only the points
+ * (lb[0]+k0*stride[0], ..., lb[n-1]+k{n-1}*stride[n-1]) within the
+ * bounding box are returned, densely packed in "data": the buffer holds
+ * (ub[i]-lb[i])/stride[i]+1 elements along dimension i. The servers
+ * select the points before sending, so only the reduced data travels.
+ * Strided regions are not kept in the read cache.
+ *
+ * @param[in] stride:   step along each dimension, at least 1; a stride of 1
+ *              on all dimensions is a regular dspaces_get().
+ *
+ * @return  0 indicates success.
+ */
+int dspaces_get_strided (const char *var_name,
+        unsigned int ver, int size,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        uint64_t *stride, void *data);
+
+/**
+ * @brief Non-blocking version of dspaces_put.
+ *
+ * Arguments are the same as for dspaces_put. The routine returns a request
+ * handle that can be passed to dspaces_test, dspaces_wait or
+ * dspaces_waitall to check the completion of the data transfer. The user
+ * buffer pointed by "data" should not be modified before the request
+ * completes.
+ *
+ * @return  Non-negative request handle on success, negative value on error.
+ */
+int dspaces_iput (const char *var_name,
+        unsigned int ver, int size,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        void *data);
+
+/**
+ * @brief Non-blocking version of dspaces_get.
+ *
+ * Arguments are the same as for dspaces_get. The routine locates the data
+ * and posts the transfers, but returns without waiting for them; the user
+ * buffer pointed by "data" holds the result only after the request is
+ * completed with dspaces_test, dspaces_wait or dspaces_waitall. Multiple
+ * requests can be in flight at the same time.
+ *
+ * @return  Non-negative request handle on success, negative value on error
+ *      (-EAGAIN if the data is not available in the space).
+ */
+int dspaces_iget (const char *var_name,
+        unsigned int ver, int size,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        void *data);
+
+/**
+ * @brief Insert a batch of variables with a single request.
+ *
+ * All variables in the batch share the same version and local bounding box
+ * {(lb[0],..,lb[n-1]), (ub[0],..,ub[n-1])}; variable i has name
+ * var_names[i], element size sizes[i] and data buffer data[i]. The data is
+ * packed and sent to the staging server in one transfer, so it pays off for
+ * many small variables. The user buffers can be reused as soon as the
+ * routine returns; dspaces_put_sync waits for the batch to be inserted.
+ *
+ * @param[in] num_vars:     Number of variables in the batch.
+ * @param[in] var_names:    Names of the variables.
+ * @param[in] ver:      Version of the variables.
+ * @param[in] sizes:        Size (in bytes) for each element of each variable.
+ * @param[in] ndim:     the number of dimensions for the local bounding
+ *              box.
+ * @param[in] lb:       coordinates for the lower corner of the local
+ *              bounding box.
+ * @param[in] ub:       coordinates for the upper corner of the local
+ *              bounding box.
+ * @param[in] data:     Pointers to the user data buffers.
+ *
+ * @return  0 indicates success.
+ */
+int dspaces_put_batch (int num_vars, const char **var_names,
+        unsigned int ver, int *sizes,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        void **data);
+
+/**
+ * @brief Retrieve a batch of variables with one request per server.
+ *
+ * Arguments are the same as for dspaces_put_batch. Object descriptors for
+ * all variables are queried with at most one request per server, and the
+ * data held by one server is returned in a single transfer. After successful
+ * return of the routine, data[i] holds variable i.
+ *
+ * @return  0 indicates success, -EAGAIN if any variable is not available.
+ */
+int dspaces_get_batch (int num_vars, const char **var_names,
+        unsigned int ver, int *sizes,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        void **data);
+
+/**
+ * @brief Check if a non-blocking request is complete.
+ *
+ * When the request is complete "flag" is set to 1 and the request handle
+ * is released; otherwise "flag" is set to 0.
+ *
+ * @param[in] req:      Request handle returned by dspaces_iget/dspaces_iput.
+ * @param[out] flag:    Set to 1 if the request completed, 0 otherwise.
+ *
+ * @return  0 indicates success.
+ */
+int dspaces_test(int req, int *flag);
+
+/**
+ * @brief Block till the completion of a non-blocking request and release
+ *    the request handle.
+ *
+ * @param[in] req:      Request handle returned by dspaces_iget/dspaces_iput.
+ *
+ * @return  0 indicates success.
+ */
+int dspaces_wait(int req);
+
+/**
+ * @brief Block till the completion of all requests in "reqs".
+ *
+ * @param[in] num_req:  Number of request handles.
+ * @param[in] reqs:     Array of request handles.
+ *
+ * @return  0 indicates success, otherwise the first error encountered.
+ */
+int dspaces_waitall(int num_req, int *reqs);
+
 /**
 * @brief Query the space to send data prefetch hint specified by a geometric descriptor.
 *
@@ -275,6 +419,133 @@ int dspaces_hint(const char *var_name,
 int dspaces_remove (const char *var_name,
 	unsigned int ver);
 
+/* Element types and reductions for dspaces_select(). */
+enum dspaces_elem_type {
+    DSPACES_DOUBLE = 0,
+    DSPACES_FLOAT,
+    DSPACES_INT32,
+    DSPACES_INT64,
+};
+
+enum dspaces_select_op {
+    DSPACES_MIN = 0,
+    DSPACES_MAX,
+    DSPACES_SUM,
+    DSPACES_AVG,
+    /* Only for dspaces_select_hist(). */
+    DSPACES_HIST,
+};
+
+#define DSPACES_SELECT_MAX_BINS 64
+
+/**
+ * @brief Reduce a region of the space to a single value.
+ *
+ * The reduction runs in the servers that hold the data: each server
+ * reduces its own parts of the region, and the partial results are
+ * merged along a tree of those servers, so only the final value comes
+ * back to the client. The data is read in staging, so it must have
+ * been put with dspaces_put(), not with the DIMES API.
+ *
+ * @param[in] var_name:     Name of the variable.
+ * @param[in] ver:      Version of the variable.
+ * @param[in] elem_type:    Element type of the variable, one of
+ *              DSPACES_DOUBLE, DSPACES_FLOAT, DSPACES_INT32 or
+ *              DSPACES_INT64; it must match the element size used to
+ *              put the data.
+ * @param[in] op:       DSPACES_MIN, DSPACES_MAX, DSPACES_SUM or DSPACES_AVG.
+ * @param[in] ndim:     the number of dimensions for the bounding box.
+ * @param[in] lb:       coordinates for the lower corner of the bounding box.
+ * @param[in] ub:       coordinates for the upper corner of the bounding box.
+ * @param[out] result:  the value of the reduction.
+ *
+ * @return  0 indicates success, -ENOENT that no data is stored in the
+ * region.
+ */
+int dspaces_select(const char *var_name,
+        unsigned int ver, int elem_type, int op,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        double *result);
+
+/**
+ * @brief Compute a histogram of a region of the space.
+ *
+ * Same as dspaces_select(), with 'num_bins' equal bins over [lo, hi];
+ * the last bin includes 'hi', and values out of the range are not
+ * counted.
+ *
+ * @param[in] lo, hi:   range of the histogram, lo < hi.
+ * @param[in] num_bins: number of bins, at most DSPACES_SELECT_MAX_BINS.
+ * @param[out] bins:    counts of the 'num_bins' bins.
+ *
+ * @return  0 indicates success.
+ */
+int dspaces_select_hist(const char *var_name,
+        unsigned int ver, int elem_type,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        double lo, double hi, int num_bins, uint64_t *bins);
+
+/**
+ * @brief Keep the value range of the objects of a variable.
+ *
+ * From now on, every dspaces_put() of the variable by this client has
+ * the servers record the min and max of the object in the index, so
+ * that dspaces_query_range() and dspaces_get_range() can skip the
+ * objects that can not hold values of interest. Objects put with
+ * DATASPACES_LAZY_PUT, with dspaces_put_batch() or through DIMES have
+ * no value range.
+ *
+ * @param[in] var_name:     Name of the variable.
+ * @param[in] elem_type:    Element type of the variable, one of
+ *              DSPACES_DOUBLE, DSPACES_FLOAT, DSPACES_INT32 or
+ *              DSPACES_INT64.
+ *
+ * @return  0 indicates success.
+ */
+int dspaces_define_summary(const char *var_name, int elem_type);
+
+/**
+ * @brief Find the parts of a region that may hold values in [lo, hi].
+ *
+ * Only the index is read, not the data: a part matches if the value
+ * range of its object overlaps [lo, hi], or if its object has no value
+ * range, see dspaces_define_summary().
+ *
+ * @param[in] var_name:     Name of the variable.
+ * @param[in] ver:      Version of the variable.
+ * @param[in] ndim:     the number of dimensions for the bounding box.
+ * @param[in] lb:       coordinates for the lower corner of the bounding box.
+ * @param[in] ub:       coordinates for the upper corner of the bounding box.
+ * @param[in] lo, hi:   range of values.
+ * @param[in] max_bb:   size of 'lb_tab' and 'ub_tab', in bounding boxes.
+ * @param[out] lb_tab, ub_tab:  corners of the first 'max_bb' matching
+ *              parts, 'ndim' coordinates each.
+ *
+ * @return  the number of matching parts, which may be larger than
+ * 'max_bb', or a negative error code.
+ */
+int dspaces_query_range(const char *var_name,
+        unsigned int ver,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        double lo, double hi,
+        int max_bb, uint64_t *lb_tab, uint64_t *ub_tab);
+
+/**
+ * @brief Read only the parts of a region that may hold values in [lo, hi].
+ *
+ * Same as dspaces_get(), but the parts that dspaces_query_range()
+ * would not return are neither transferred nor written to 'data'.
+ *
+ * @param[in] lo, hi:   range of values.
+ *
+ * @return  the number of parts read, or a negative error code.
+ */
+int dspaces_get_range(const char *var_name,
+        unsigned int ver, int size,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        double lo, double hi,
+        void *data);
+
 /**
  * @brief Define the global dimension for array variable.
  *
@@ -43,6 +43,14 @@ struct query_cache {
         int                     num_ent;
 };
 
+/* Cache of fetched regions, see 'struct dcg_space'. */
+struct read_cache {
+        struct list_head        rc_list;
+        int                     num_ent;
+        uint64_t                size;
+        uint64_t                max_size;
+};
+
 struct query_tran {
         struct list_head        q_list;
         int                     num_ent;
@@ -61,6 +69,10 @@ struct dcg_space {
         struct query_cache      qc;
         struct query_tran       qt;
 
+        /* Read cache of fetched regions, 'struct obj_data' entries
+           in LRU order; disabled if 'rc.max_size' is 0. */
+        struct read_cache       rc;
+
         int                     f_ss_info;
         struct ss_info          ss_info;
         struct bbox             ss_domain;
@@ -71,8 +83,24 @@ struct dcg_space {
         /* List of 'struct gdim_list_entry' */
         struct list_head        gdim_list;
 
+        /* Local copies of the shared space dhts, used to locate the
+           DHT peers for batched queries without a round trip; list
+           of 'struct sspace_list_entry'. */
+        struct sspace           *default_ssd;
+        struct list_head        sspace_list;
+
         int                     num_pending;
 
+        /* Variables put lazily, as listed in DATASPACES_LAZY_PUT, and
+           the objects held for the servers until they pull them; list
+           of 'struct lazy_obj'. */
+        const char              *lazy_vars;
+        struct list_head        lazy_list;
+
+        /* Variables the servers keep the value range of the objects
+           for; list of 'struct summary_var'. */
+        struct list_head        summary_list;
+
         enum sspace_hash_version    hash_version;
         int    max_versions; 
         /* Version bookeeping for objects available in the space. */
@@ -85,12 +113,23 @@ int dcg_barrier(struct dcg_space *);
 void dcg_free(struct dcg_space *);
 int dcg_obj_put(struct obj_data *);
 int dcg_obj_get(struct obj_data *);
+int dcg_obj_get_nb(struct obj_data *);
+int dcg_obj_get_test(int, int *);
+int dcg_obj_get_wait(int);
+int dcg_obj_get_strided(struct obj_data *, const uint64_t *);
+int dcg_define_summary(const char *, int);
+int dcg_obj_get_range(struct obj_data *, double, double, int,
+                      struct bbox *, int);
+int dcg_obj_put_batch(struct obj_data *[], int);
+int dcg_obj_get_batch(struct obj_data *[], int);
 int dcg_obj_hint(struct obj_data *);
 int dcg_get_versions(int **);
-int dcg_obj_filter(struct obj_data *);
+int dcg_obj_filter(struct obj_data *, const struct obj_filter_spec *,
+                   struct obj_filter_res *);
 int dcg_obj_cq_register(struct obj_data *);
 int dcg_obj_cq_update(int);
 int dcg_obj_sync(int);
+int dcg_obj_sync_test(int, int *);
 
 int dcg_lock_on_read(const char *, void *comm);
 int dcg_unlock_on_read(const char *, void *comm);
@@ -58,6 +58,8 @@ struct fetch_entry {
     struct obj_descriptor src_odsc;
     struct obj_descriptor dst_odsc;
     struct dart_rdma_tran *read_tran;
+    int *server_tab; // Servers that handed us the location
+    int num_server;
 };
 
 struct query_dht_d {
@@ -84,7 +86,8 @@ struct query_tran_entry_d {
     struct query_dht_d        *qh;
 
     unsigned int    f_locate_data_complete:1,
-                    f_complete:1;
+                    f_complete:1,
+                    f_err:1; // Flag: a location reply could not be used
 };
 
 struct query_tran_d {
@@ -102,6 +105,8 @@ struct dimes_client_option {
     size_t rdma_buffer_size;
     size_t rdma_buffer_usage;
     int max_num_concurrent_rdma_read_op;
+    size_t read_overhead; // Cost of a read, in bytes moved
+    double max_read_waste; // Bytes a slab read may waste, per byte needed
 };
 
 struct dimes_client {
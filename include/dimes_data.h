@@ -59,6 +59,9 @@ struct dimes_memory_obj {
     struct obj_descriptor obj_desc;
     struct global_dimension gdim;
     struct dart_rdma_mem_handle rdma_handle;
+    int num_put; // Servers the location was put to
+    int num_retired; // Servers a newer put retired it on, see dimes_obj_retire_msg
+    int num_released; // Servers done with it, see dimes_obj_release_msg
 };
 
 #define STORAGE_GROUP_NAME_MAXLEN 256
@@ -90,23 +93,65 @@ struct hdr_dimes_get {
 	struct obj_descriptor odsc;
 } __attribute__((__packed__));
 
-struct obj_location_wrapper {
-    struct list_head entry;
-    struct rpc_cmd *data_ref;
-};
+// Header structure for the read ack and release messages of an object.
+struct hdr_dimes_ack {
+    struct dimes_obj_id obj_id;
+    struct obj_descriptor odsc;
+} __attribute__((__packed__));
 
 struct obj_location_list_node {
     struct list_head entry;
     struct rpc_cmd cmd; 
+    uint32_t query_stamp; // Last query that visited the node
+    int num_located; // Times the location was handed to a reader
+    int num_acked; // Readers done with it
+    int f_retired; // Flag: replaced by a newer put, waits for the readers
+};
+
+/*
+  Cell of the grid index, lists the object locations whose bbox
+  overlaps it.
+*/
+struct obj_location_cell {
+    struct obj_location_cell *next;
+    uint64_t coord[BBOX_MAX_NDIM];
+    int num_nodes;
+    int max_nodes;
+    struct obj_location_list_node **nodes;
+};
+
+/*
+  Uniform grid over the domain of a variable. Each object location is
+  filed under the cells its bbox overlaps, and the cells are hashed by
+  their coordinates. The size of the cells is that of the first object
+  put, since the objects of a variable usually come from one regular
+  decomposition; objects that would span too many cells are kept in
+  'unindexed' and checked by every lookup.
+*/
+struct obj_location_grid {
+    int num_dims;
+    uint64_t cell_size[BBOX_MAX_NDIM];
+    struct obj_location_cell **buckets;
+    int num_buckets;
+    int num_cells;
+    struct obj_location_cell unindexed;
+    uint32_t query_stamp;
 };
 
 struct var_list_node {
     struct list_head entry;
     char name[256];
     struct list_head obj_location_list;    
+    int num_obj_location;
+    struct obj_location_grid grid;
 };
 
 struct metadata_storage {
+    // Called, if set, when a newer put replaces a location
+    void (*obj_location_retired)(struct rpc_cmd *cmd);
+    // Called, if set, once a location replaced by a newer put is no
+    // longer used by any reader
+    void (*obj_location_released)(struct rpc_cmd *cmd);
     int max_versions;
     struct list_head version_tab[1];
 };
@@ -115,9 +160,16 @@ struct metadata_storage *metadata_s_alloc(int max_versions);
 int metadata_s_free(struct metadata_storage *s);
 int metadata_s_add_obj_location(struct metadata_storage *s,
                                 struct rpc_cmd *cmd);
+// Returns in '*out_tab' a table with the locations of the objects
+// that intersect 'odsc', to be freed by the caller.
 int metadata_s_find_obj_location(struct metadata_storage *s,
                                 struct obj_descriptor *odsc,
-                                struct list_head *out_list, int *out_num_items);
+                                struct rpc_cmd **out_tab, int *out_num_items);
+// A reader is done with the location of object 'oid', handed out by
+// metadata_s_find_obj_location().
+int metadata_s_ack_obj_location(struct metadata_storage *s,
+                                struct obj_descriptor *odsc,
+                                const struct dimes_obj_id *oid);
 
 
 struct ss_storage * dimes_ls_alloc(int);
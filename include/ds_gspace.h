@@ -37,6 +37,7 @@
 #include "dart.h"
 #include "ss_data.h"
 #include "ds_cache_prefetch.h"
+#include "ds_workers.h"
 
 struct ds_gspace {
         struct dart_server      *ds;
@@ -63,6 +64,21 @@ struct ds_gspace {
 
         /* List of allocated locks. */
         struct list_head        locks_list;
+
+        /* Reductions waiting for partial results, see
+           dsgrpc_obj_filter(). */
+        struct list_head        filter_list;
+        pthread_mutex_t         filter_lock;
+
+        /* Worker pool for the data RPCs; NULL if all requests are
+           processed in the transport thread. */
+        struct ds_workers       *wp;
+
+        /* Protect the local storage, the shared space list and the
+           continuous query list against the workers. */
+        pthread_mutex_t         ls_lock;
+        pthread_mutex_t         sspace_lock;
+        pthread_mutex_t         cq_lock;
 };
 
 struct ds_gspace *dsg_alloc(int, int, char *);
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2009, NSF Cloud and Autonomic Computing Center, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __DS_WORKERS_H_
+#define __DS_WORKERS_H_
+
+#include <pthread.h>
+
+#include "list.h"
+
+/*
+  Pool of worker threads used by the staging server to run RPC work
+  off the transport thread. Work items run in the order they are
+  posted, but may complete in any order.
+*/
+
+typedef int (*ds_work_fn)(void *);
+
+struct ds_work {
+        struct list_head        work_entry;
+        ds_work_fn              fn;
+        void                    *arg;
+};
+
+struct ds_workers {
+        int                     num_workers;
+        pthread_t               *thr_tab;
+
+        pthread_mutex_t         lock;
+        /* Signaled when work is posted or the pool stops. */
+        pthread_cond_t          work_cond;
+        /* Signaled when all posted work is done. */
+        pthread_cond_t          idle_cond;
+
+        /* List of 'struct ds_work' waiting for a worker. */
+        struct list_head        work_list;
+        /* Number of work items queued or running. */
+        int                     num_pending;
+
+        int                     f_stop;
+};
+
+struct ds_workers *ds_workers_alloc(int);
+int ds_workers_post(struct ds_workers *, ds_work_fn, void *);
+void ds_workers_wait(struct ds_workers *);
+void ds_workers_free(struct ds_workers *);
+
+#endif /* __DS_WORKERS_H_ */
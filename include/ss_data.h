@@ -33,6 +33,7 @@
 #define __SS_DATA_H_
 
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "bbox.h"
 #include "list.h"
@@ -72,9 +73,18 @@ struct gdim_list_entry {
         struct global_dimension gdim; 
 };
 
-enum storage_level { in_memory, in_ssd, in_memory_ssd };/* storage level */
+/* storage level; 'in_producer' is an object put lazily, whose data
+   is still with the client that put it */
+enum storage_level { in_memory, in_ssd, in_memory_ssd, in_producer };
 enum storage_opera { normal, prefetching, caching };/* storage operation */
 
+/* Value range of the data of an object, kept with its descriptor in
+   the DHT; not valid if the element type of the variable is unknown. */
+struct obj_summary {
+        int                     f_valid;
+        double                  min, max;
+} __attribute__((__packed__));
+
 struct obj_data {
         struct list_head        obj_entry;
 
@@ -97,6 +107,18 @@ struct obj_data {
 	enum storage_opera       so;
 
 	void                    *s_data;	/* data pointer in ssd Duan*/
+
+        /* Objects put lazily: the peer holding the data, the requests
+           waiting for it, and if a pull is under way. */
+        int                     src_id;
+        struct list_head        pull_list;
+        unsigned int            f_pull:1;
+
+        /* Value range of the data; on a server, 'sum_type' is the
+           element type to compute it with, if 'f_sum' is set. */
+        struct obj_summary      sum;
+        int                     sum_type;
+        unsigned int            f_sum:1;
 };
 
 struct ss_storage {
@@ -111,6 +133,7 @@ struct ss_storage {
 struct obj_desc_list {
 	struct list_head	odsc_entry;
 	struct obj_descriptor	odsc;
+	struct obj_summary	sum;
 };
 
 struct dht_entry {
@@ -130,6 +153,9 @@ struct dht_entry {
         int size_bb_tab;
         struct bbox             *bb_tab;
 
+        /* Protect the descriptor lists on servers with workers. */
+        pthread_rwlock_t        de_lock;
+
         int			odsc_size, odsc_num;
         struct list_head	odsc_hash[1];
 };
@@ -202,17 +228,124 @@ struct hdr_obj_get {
     struct global_dimension gdim;
 } __attribute__((__packed__));
 
-/* Header structure for obj_put requests. */
+/* Header structure for strided obj_get requests: the points of
+   'odsc.bb' that are odsc.bb.lb + k * stride, sent back densely. */
+struct hdr_obj_get_strided {
+        int                     qid;
+        struct obj_descriptor   odsc;
+        struct coord            stride;
+} __attribute__((__packed__));
+
+/* Flags of obj_put requests. */
+enum obj_put_flags {
+        /* Register only the descriptor; the data stays with the
+           producer until a server pulls it with 'ss_obj_pull'. */
+        obj_put_lazy = 1,
+        /* Data of an object put lazily, pulled or flushed. */
+        obj_put_pulled = 2,
+        /* Answer to a pull for data the producer no longer holds. */
+        obj_put_lost = 4,
+        /* Keep the value range of the object, see 'elem_type'. */
+        obj_put_summary = 8,
+        /* With 'ss_obj_pull': the server replaced the lazy object,
+           so the producer stops holding its data. */
+        obj_put_dropped = 16,
+};
+
+/* Header structure for obj_put requests, also used for 'ss_obj_pull'. */
 struct hdr_obj_put {
     struct obj_descriptor odsc;
     struct global_dimension gdim;
+    int flags;
+    /* Server object a pull is for, echoed back with the data. */
+    uint64_t ref;
+    /* Element type of the data, one of obj_filter_type. */
+    int elem_type;
 } __attribute__((__packed__));
 
-/* Header structure for obj_filter requests. */
-struct hdr_obj_filter {
+/* Header structure for 'ss_obj_summary' updates of the DHT. */
+struct hdr_obj_summary {
+        struct obj_descriptor   odsc;
+        struct global_dimension gdim;
+        struct obj_summary      sum;
+} __attribute__((__packed__));
+
+/* Entry of the answer to an 'ss_obj_get_summary' request. */
+struct obj_desc_summary {
+        struct obj_descriptor   odsc;
+        struct obj_summary      sum;
+} __attribute__((__packed__));
+
+/*
+  Entry of a batched put/get request, one per object. The entries
+  are sent as a table at the start of the payload, followed by the
+  object data or descriptors, if any.
+*/
+struct obj_batch_ent {
         int                     qid;
+        /* Number of descriptors that follow in a reply, or negative
+           error code if the object was not found. */
+        int                     num_de;
+        struct obj_descriptor   odsc;
+        struct global_dimension gdim;
+} __attribute__((__packed__));
+
+/* Header structure for batched put/get requests and replies. */
+struct hdr_obj_batch {
+        int                     num_ent;
+        /* Size in bytes of the payload. */
+        uint64_t                size;
+} __attribute__((__packed__));
+
+/* Element types and reductions of obj_filter requests, in the same
+   order as in dataspaces.h. */
+enum obj_filter_type {
+        filter_double = 0,
+        filter_float,
+        filter_int32,
+        filter_int64,
+};
+
+enum obj_filter_op {
+        filter_min = 0,
+        filter_max,
+        filter_sum,
+        filter_avg,
+        filter_hist,
+        /* Min and max in one pass, for the object summaries. */
+        filter_range,
+};
+
+#define SSD_FILTER_MAX_BINS     64
+
+/* Reduction to run over the region of an obj_filter request. */
+struct obj_filter_spec {
+        int                     op;
+        int                     elem_type;
+        /* Histogram of 'num_bins' equal bins over [lo, hi]. */
+        int                     num_bins;
+        double                  lo, hi;
+} __attribute__((__packed__));
+
+/* Partial result of a reduction; 'count' is the number of elements
+   seen. */
+struct obj_filter_res {
         int                     rc;
-        double                  res;
+        uint64_t                count;
+        double                  min, max, sum;
+        uint64_t                bins[SSD_FILTER_MAX_BINS];
+} __attribute__((__packed__));
+
+/* Header structure for obj_filter requests and results. A request
+   carries the table of the 'num_od' object descriptors to reduce; a
+   result carries a 'struct obj_filter_res'. */
+struct hdr_obj_filter {
+        int                     qid;
+        /* Client the final result goes to. */
+        int                     cid;
+        int                     num_od;
+        int                     f_result;
+        struct obj_filter_spec  spec;
         struct obj_descriptor   odsc;
 } __attribute__((__packed__));
 
@@ -243,14 +376,22 @@ struct sspace* ssd_alloc(struct bbox *, int, int, enum sspace_hash_version);
 int ssd_init(struct sspace *, int);
 void ssd_free(struct sspace *);
 int ssd_copy(struct obj_data *, struct obj_data *);
-// TODO: ssd_copyv is not supported yet
 int ssd_copyv(struct obj_data *, struct obj_data *);
 int ssd_copy_list(struct obj_data *, struct list_head *);
-int ssd_filter(struct obj_data *, struct obj_descriptor *, double *);
+int ssd_copy_strided(struct obj_data *, struct obj_data *,
+        const struct bbox *, const struct coord *);
+void ssd_filter_init(struct obj_filter_res *);
+int ssd_filter(struct obj_data *, const struct obj_descriptor *,
+        const struct obj_filter_spec *, struct obj_filter_res *);
+void ssd_filter_merge(struct obj_filter_res *, const struct obj_filter_res *,
+        const struct obj_filter_spec *);
 int ssd_hash(struct sspace *, const struct bbox *, struct dht_entry *[]);
 
 int dht_add_entry(struct dht_entry *, const struct obj_descriptor *);
 const struct obj_descriptor * dht_find_entry(struct dht_entry *, const struct obj_descriptor *);
+int dht_set_summary(struct dht_entry *, const struct obj_descriptor *,
+        const struct obj_summary *);
+const struct obj_summary *dht_entry_summary(const struct obj_descriptor *);
 int dht_find_entry_all(struct dht_entry *, struct obj_descriptor *, 
                        const struct obj_descriptor *[]);
 int dht_find_versions(struct dht_entry *, struct obj_descriptor *, int []);
@@ -64,6 +64,20 @@ static int num_dims = 2; // TODO: remove it
 static struct dimes_client *dimes_c = NULL;
 #endif
 
+/*
+  Outstanding non-blocking requests. 'op_id' is the query transaction
+  id of an iget, or the sync operation id of an iput.
+*/
+struct dspaces_req {
+        struct list_head        req_entry;
+        int                     req_id;
+        int                     op_id;
+        unsigned int            f_get:1;
+};
+
+static LIST_HEAD(req_list);
+static int req_next_id;
+
 static void lib_exit(void)
 {
         dcg_free(dcg);
@@ -319,6 +333,70 @@ int common_dspaces_get(const char *var_name,
     return err;
 }
 
+int common_dspaces_get_strided(const char *var_name,
+	unsigned int ver, int size,
+	int ndim,
+	uint64_t *lb,
+	uint64_t *ub,
+	uint64_t *stride,
+	void *data)
+{
+    int i;
+
+    if (!is_dspaces_lib_init() || !is_ndim_within_bound(ndim)) {
+        return -EINVAL;
+    }
+
+    for (i = 0; i < ndim && stride[i] == 1; i++)
+        ;
+    if (i == ndim)
+        return common_dspaces_get(var_name, ver, size, ndim, lb, ub, data);
+
+    for (i = 0; i < ndim; i++) {
+        if (stride[i] == 0 || lb[i] > ub[i]) {
+            uloga("'%s()': invalid stride or bounding box in dimension %d.\n",
+                __func__, i);
+            return -EINVAL;
+        }
+    }
+
+    struct obj_descriptor odsc = {
+            .version = ver, .owner = -1, 
+            .st = st,
+            .size = size,
+            .bb = {.num_dims = ndim,}
+    };
+    memset(odsc.bb.lb.c, 0, sizeof(uint64_t)*BBOX_MAX_NDIM);
+    memset(odsc.bb.ub.c, 0, sizeof(uint64_t)*BBOX_MAX_NDIM);
+
+    memcpy(odsc.bb.lb.c, lb, sizeof(uint64_t)*ndim);
+    memcpy(odsc.bb.ub.c, ub, sizeof(uint64_t)*ndim);
+
+    struct obj_data *od;
+    int err = -ENOMEM;
+
+    strncpy(odsc.name, var_name, sizeof(odsc.name)-1);
+    odsc.name[sizeof(odsc.name)-1] = '\0';
+
+    od = obj_data_alloc_no_data(&odsc, data);
+    if (!od) {
+        uloga("'%s()': failed, can not allocate data object.\n", 
+            __func__);
+        return -ENOMEM;
+    }
+
+    set_global_dimension(&dcg->gdim_list, var_name, &dcg->default_gdim,
+                         &od->gdim);
+
+    err = dcg_obj_get_strided(od, stride);
+    obj_data_free(od);
+    if (err < 0 && err != -EAGAIN) 
+        uloga("'%s()': failed with %d, can not get data object.\n",
+            __func__, err);
+
+    return err;
+}
+
 int common_dspaces_put(const char *var_name, 
         unsigned int ver, int size,
         int ndim,
@@ -372,6 +450,318 @@ int common_dspaces_put(const char *var_name,
 }
 
 
+static struct dspaces_req *req_alloc(int op_id, int f_get)
+{
+        struct dspaces_req *req;
+
+        req = malloc(sizeof(*req));
+        if (!req)
+                return NULL;
+
+        req->req_id = req_next_id++;
+        if (req_next_id < 0)
+                req_next_id = 0;
+        req->op_id = op_id;
+        req->f_get = !!f_get;
+        list_add_tail(&req->req_entry, &req_list);
+
+        return req;
+}
+
+static struct dspaces_req *req_find(int req_id)
+{
+        struct dspaces_req *req;
+
+        list_for_each_entry(req, &req_list, struct dspaces_req, req_entry) {
+                if (req->req_id == req_id)
+                        return req;
+        }
+
+        return NULL;
+}
+
+static void req_free(struct dspaces_req *req)
+{
+        list_del(&req->req_entry);
+        free(req);
+}
+
+int common_dspaces_iget(const char *var_name,
+        unsigned int ver, int size,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        void *data)
+{
+    if (!is_dspaces_lib_init() || !is_ndim_within_bound(ndim)) {
+        return -EINVAL;
+    }
+
+    struct obj_descriptor odsc = {
+            .version = ver, .owner = -1, 
+            .st = st,
+            .size = size,
+            .bb = {.num_dims = ndim,}
+    };
+    memset(odsc.bb.lb.c, 0, sizeof(uint64_t)*BBOX_MAX_NDIM);
+    memset(odsc.bb.ub.c, 0, sizeof(uint64_t)*BBOX_MAX_NDIM);
+
+    memcpy(odsc.bb.lb.c, lb, sizeof(uint64_t)*ndim);
+    memcpy(odsc.bb.ub.c, ub, sizeof(uint64_t)*ndim);
+
+    struct dspaces_req *req;
+    struct obj_data *od;
+    int err = -ENOMEM;
+
+    strncpy(odsc.name, var_name, sizeof(odsc.name)-1);
+    odsc.name[sizeof(odsc.name)-1] = '\0';
+
+    od = obj_data_alloc_no_data(&odsc, data);
+    if (!od) {
+        uloga("'%s()': failed, can not allocate data object.\n", 
+            __func__);
+        return -ENOMEM;
+    }
+
+    // set global dimension
+    set_global_dimension(&dcg->gdim_list, var_name, &dcg->default_gdim,
+                         &od->gdim);
+
+    /* The transaction keeps its own copy of the descriptor and of the
+       'data' reference, so 'od' is not needed past this call. */
+    err = dcg_obj_get_nb(od);
+    obj_data_free(od);
+    if (err < 0) {
+        if (err != -EAGAIN)
+            uloga("'%s()': failed with %d, can not get data object.\n",
+                __func__, err);
+        return err;
+    }
+
+    req = req_alloc(err, 1);
+    if (!req) {
+        dcg_obj_get_wait(err);
+        return -ENOMEM;
+    }
+
+    return req->req_id;
+}
+
+int common_dspaces_iput(const char *var_name, 
+        unsigned int ver, int size,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        void *data)
+{
+        struct dspaces_req *req;
+        int err;
+
+        err = common_dspaces_put(var_name, ver, size, ndim, lb, ub, data);
+        if (err < 0)
+                return err;
+
+        req = req_alloc(sync_op_id, 0);
+        if (!req) {
+                dcg_obj_sync(sync_op_id);
+                return -ENOMEM;
+        }
+
+        return req->req_id;
+}
+
+int common_dspaces_test(int req_id, int *flag)
+{
+        struct dspaces_req *req;
+        int err;
+
+        if (!is_dspaces_lib_init()) {
+                return -EINVAL;
+        }
+
+        req = req_find(req_id);
+        if (!req) {
+                uloga("'%s()': unknown request %d.\n", __func__, req_id);
+                return -EINVAL;
+        }
+
+        if (req->f_get)
+                err = dcg_obj_get_test(req->op_id, flag);
+        else    err = dcg_obj_sync_test(req->op_id, flag);
+
+        if (*flag || err < 0)
+                req_free(req);
+
+        return err;
+}
+
+int common_dspaces_wait(int req_id)
+{
+        struct dspaces_req *req;
+        int err;
+
+        if (!is_dspaces_lib_init()) {
+                return -EINVAL;
+        }
+
+        req = req_find(req_id);
+        if (!req) {
+                uloga("'%s()': unknown request %d.\n", __func__, req_id);
+                return -EINVAL;
+        }
+
+        if (req->f_get)
+                err = dcg_obj_get_wait(req->op_id);
+        else    err = dcg_obj_sync(req->op_id);
+        req_free(req);
+
+        if (err < 0 && err != -EAGAIN)
+                uloga("'%s()': failed with %d, request %d.\n",
+                        __func__, err, req_id);
+
+        return err;
+}
+
+int common_dspaces_waitall(int num_req, int *req_ids)
+{
+        int i, err, ret = 0;
+
+        for (i = 0; i < num_req; i++) {
+                err = common_dspaces_wait(req_ids[i]);
+                if (err < 0 && ret == 0)
+                        ret = err;
+        }
+
+        return ret;
+}
+
+/*
+  Build the object table for a batch of variables that share the same
+  version and bounding box.
+*/
+static struct obj_data **batch_od_alloc(int num_vars, const char **var_names,
+        unsigned int ver, int *sizes, int ndim, uint64_t *lb, uint64_t *ub,
+        void **data)
+{
+        struct obj_data **od_tab;
+        int i;
+
+        od_tab = malloc(sizeof(*od_tab) * num_vars);
+        if (!od_tab)
+                return NULL;
+        memset(od_tab, 0, sizeof(*od_tab) * num_vars);
+
+        for (i = 0; i < num_vars; i++) {
+                struct obj_descriptor odsc = {
+                        .version = ver, .owner = -1, 
+                        .st = st,
+                        .size = sizes[i],
+                        .bb = {.num_dims = ndim,}
+                };
+                memset(odsc.bb.lb.c, 0, sizeof(uint64_t)*BBOX_MAX_NDIM);
+                memset(odsc.bb.ub.c, 0, sizeof(uint64_t)*BBOX_MAX_NDIM);
+
+                memcpy(odsc.bb.lb.c, lb, sizeof(uint64_t)*ndim);
+                memcpy(odsc.bb.ub.c, ub, sizeof(uint64_t)*ndim);
+
+                strncpy(odsc.name, var_names[i], sizeof(odsc.name)-1);
+                odsc.name[sizeof(odsc.name)-1] = '\0';
+
+                od_tab[i] = obj_data_alloc_no_data(&odsc, data[i]);
+                if (!od_tab[i])
+                        goto err_out;
+
+                set_global_dimension(&dcg->gdim_list, var_names[i], 
+                        &dcg->default_gdim, &od_tab[i]->gdim);
+        }
+
+        return od_tab;
+ err_out:
+        while (i-- > 0)
+                free(od_tab[i]);
+        free(od_tab);
+        return NULL;
+}
+
+static void batch_od_free(struct obj_data **od_tab, int num_vars)
+{
+        int i;
+
+        /* Data buffers belong to the user. */
+        for (i = 0; i < num_vars; i++)
+                free(od_tab[i]);
+        free(od_tab);
+}
+
+int common_dspaces_put_batch(int num_vars, const char **var_names,
+        unsigned int ver, int *sizes,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        void **data)
+{
+        struct obj_data **od_tab;
+        int err;
+
+        if (!is_dspaces_lib_init() || !is_ndim_within_bound(ndim)) {
+            return -EINVAL;
+        }
+        if (num_vars <= 0)
+                return 0;
+
+        od_tab = batch_od_alloc(num_vars, var_names, ver, sizes, 
+                                ndim, lb, ub, data);
+        if (!od_tab) {
+            uloga("'%s()': failed, can not allocate data objects.\n", 
+                __func__);
+                return -ENOMEM;
+        }
+
+        err = dcg_obj_put_batch(od_tab, num_vars);
+        batch_od_free(od_tab, num_vars);
+        if (err < 0) {
+            uloga("'%s()': failed with %d, can not put data objects.\n", 
+                __func__, err);
+            return err;
+        }
+        sync_op_id = err;
+
+        return 0;
+}
+
+int common_dspaces_get_batch(int num_vars, const char **var_names,
+        unsigned int ver, int *sizes,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        void **data)
+{
+        struct obj_data **od_tab;
+        int err;
+
+        if (!is_dspaces_lib_init() || !is_ndim_within_bound(ndim)) {
+            return -EINVAL;
+        }
+        if (num_vars <= 0)
+                return 0;
+
+        od_tab = batch_od_alloc(num_vars, var_names, ver, sizes, 
+                                ndim, lb, ub, data);
+        if (!od_tab) {
+            uloga("'%s()': failed, can not allocate data objects.\n", 
+                __func__);
+                return -ENOMEM;
+        }
+
+        err = dcg_obj_get_batch(od_tab, num_vars);
+        batch_od_free(od_tab, num_vars);
+        if (err < 0 && err != -EAGAIN) 
+            uloga("'%s()': failed with %d, can not get data objects.\n",
+                __func__, err);
+
+        return err;
+}
+
 int common_dspaces_remove (const char *var_name, unsigned int ver)
 {
 
@@ -385,54 +775,188 @@ int common_dspaces_remove (const char *var_name, unsigned int ver)
 
 
 /*
-int common_dspaces_select(char *var_name, unsigned int vers,
-	int ndim,
-    uint64_t *lb, //int xl, int yl, int zl,
-    uint64_t *ub, //int xu, int yu, int zu, 
-    void *data)
+  Run a reduction over a region in the servers that hold it; 'op' is
+  one of the filter_* values of ss_data.h. A histogram goes to 'bins',
+  any other result to 'result'.
+*/
+int common_dspaces_select(const char *var_name, unsigned int ver,
+        int elem_type, int op,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        double lo, double hi, int num_bins,
+        double *result, uint64_t *bins)
 {
-        // TODO: 'size' is hardcoded to 8 !!!
-        struct obj_descriptor odsc = {
-                .version = vers, .owner = -1,
-                .st = st,
-                .size = 8,
-                .bb = {.num_dims = ndim, //num_dims,
-                       //.lb.c = {xl, yl, zl},
-                       //.ub.c = {xu, yu, zu}
-                },
-        };
-        memcpy(odsc.bb.lb.c, lb, sizeof(uint64_t)*odsc.bb.num_dims);
-        memcpy(odsc.bb.ub.c, ub, sizeof(uint64_t)*odsc.bb.num_dims);
+    static const size_t elem_size[] = {
+        [filter_double] = sizeof(double),
+        [filter_float]  = sizeof(float),
+        [filter_int32]  = sizeof(int32_t),
+        [filter_int64]  = sizeof(int64_t),
+    };
+    struct obj_filter_spec spec = {
+        .op = op, .elem_type = elem_type,
+        .num_bins = num_bins, .lo = lo, .hi = hi,
+    };
+    struct obj_filter_res res;
 
-        struct obj_data *od;
-        int err = -ENOMEM;
+    if (!is_dspaces_lib_init() || !is_ndim_within_bound(ndim)) {
+        return -EINVAL;
+    }
+    if (elem_type < filter_double || elem_type > filter_int64 ||
+        op < filter_min || op > filter_hist ||
+        (op == filter_hist && (num_bins <= 0 ||
+         num_bins > SSD_FILTER_MAX_BINS || !(hi > lo)))) {
+        uloga("'%s()': invalid reduction.\n", __func__);
+        return -EINVAL;
+    }
 
+    struct obj_descriptor odsc = {
+            .version = ver, .owner = -1,
+            .st = st,
+            .size = elem_size[elem_type],
+            .bb = {.num_dims = ndim,}
+    };
+    memset(odsc.bb.lb.c, 0, sizeof(uint64_t)*BBOX_MAX_NDIM);
+    memset(odsc.bb.ub.c, 0, sizeof(uint64_t)*BBOX_MAX_NDIM);
 
-	if (!dcg) {
-		uloga("'%s()': library was not properly initialized!\n",
-			 __func__);
-		return -EINVAL;
-	}
+    memcpy(odsc.bb.lb.c, lb, sizeof(uint64_t)*ndim);
+    memcpy(odsc.bb.ub.c, ub, sizeof(uint64_t)*ndim);
 
-	strncpy(odsc.name, var_name, sizeof(odsc.name)-1);
-	odsc.name[sizeof(odsc.name)-1] = '\0';
+    struct obj_data *od;
+    int err;
 
-        od = obj_data_alloc_no_data(&odsc, data);
-        if (!od) {
-		uloga("'%s()': failed, can not allocate data object.\n",
-			__func__);
-		return -ENOMEM;
-	}
+    strncpy(odsc.name, var_name, sizeof(odsc.name)-1);
+    odsc.name[sizeof(odsc.name)-1] = '\0';
 
-        err = dcg_obj_filter(od);
-        free(od);
-        if (err < 0) 
-		uloga("'%s()': failed with %d, can not complete filter.\n",
-			__func__, err);
+    od = obj_data_alloc_no_data(&odsc, NULL);
+    if (!od) {
+        uloga("'%s()': failed, can not allocate data object.\n",
+            __func__);
+        return -ENOMEM;
+    }
 
-	return err;
+    err = dcg_obj_filter(od, &spec, &res);
+    obj_data_free(od);
+    if (err < 0) {
+        uloga("'%s()': failed with %d, can not complete filter.\n",
+            __func__, err);
+        return err;
+    }
+
+    switch (op) {
+    case filter_min:
+        *result = res.min;
+        break;
+    case filter_max:
+        *result = res.max;
+        break;
+    case filter_sum:
+        *result = res.sum;
+        break;
+    case filter_avg:
+        *result = res.sum / res.count;
+        break;
+    case filter_hist:
+        memcpy(bins, res.bins, sizeof(*bins) * num_bins);
+        break;
+    }
+
+    return 0;
+}
+
+int common_dspaces_define_summary(const char *var_name, int elem_type)
+{
+    if (!is_dspaces_lib_init()) {
+        return -EINVAL;
+    }
+
+    int err = dcg_define_summary(var_name, elem_type);
+    if (err < 0)
+        uloga("'%s()': failed with %d, invalid element type.\n",
+            __func__, err);
+
+    return err;
+}
+
+/*
+  Find the parts of a region that may hold values in [lo, hi], from the
+  value ranges the servers keep for the variable. The first 'max_bb'
+  parts go flattened to 'lb_tab' and 'ub_tab'; if 'data' is not NULL,
+  the data of all of them is copied into it. Returns the number of
+  parts.
+*/
+int common_dspaces_get_range(const char *var_name,
+        unsigned int ver, int size,
+        int ndim,
+        uint64_t *lb,
+        uint64_t *ub,
+        double lo, double hi,
+        int max_bb, uint64_t *lb_tab, uint64_t *ub_tab,
+        void *data)
+{
+    struct bbox *bb_tab = NULL;
+    int i, n;
+
+    if (!is_dspaces_lib_init() || !is_ndim_within_bound(ndim)) {
+        return -EINVAL;
+    }
+    if (max_bb < 0 || (max_bb > 0 && (!lb_tab || !ub_tab))) {
+        return -EINVAL;
+    }
+
+    struct obj_descriptor odsc = {
+            .version = ver, .owner = -1,
+            .st = st,
+            .size = size,
+            .bb = {.num_dims = ndim,}
+    };
+    memset(odsc.bb.lb.c, 0, sizeof(uint64_t)*BBOX_MAX_NDIM);
+    memset(odsc.bb.ub.c, 0, sizeof(uint64_t)*BBOX_MAX_NDIM);
+
+    memcpy(odsc.bb.lb.c, lb, sizeof(uint64_t)*ndim);
+    memcpy(odsc.bb.ub.c, ub, sizeof(uint64_t)*ndim);
+
+    struct obj_data *od;
+
+    strncpy(odsc.name, var_name, sizeof(odsc.name)-1);
+    odsc.name[sizeof(odsc.name)-1] = '\0';
+
+    if (max_bb > 0) {
+        bb_tab = malloc(sizeof(*bb_tab) * max_bb);
+        if (!bb_tab)
+            return -ENOMEM;
+    }
+
+    od = obj_data_alloc_no_data(&odsc, data);
+    if (!od) {
+        uloga("'%s()': failed, can not allocate data object.\n",
+            __func__);
+        free(bb_tab);
+        return -ENOMEM;
+    }
+
+    set_global_dimension(&dcg->gdim_list, var_name, &dcg->default_gdim,
+                         &od->gdim);
+
+    n = dcg_obj_get_range(od, lo, hi, data != NULL, bb_tab, max_bb);
+    obj_data_free(od);
+    if (n < 0) {
+        uloga("'%s()': failed with %d, can not complete range query.\n",
+            __func__, n);
+        free(bb_tab);
+        return n;
+    }
+
+    for (i = 0; i < n && i < max_bb; i++) {
+        memcpy(lb_tab + i*ndim, bb_tab[i].lb.c, sizeof(uint64_t)*ndim);
+        memcpy(ub_tab + i*ndim, bb_tab[i].ub.c, sizeof(uint64_t)*ndim);
+    }
+    free(bb_tab);
+
+    return n;
 }
 
+/*
 int common_dspaces_cq_register(char *var_name,
 	int ndim,
     uint64_t *lb, //int xl, int yl, int zl,
@@ -44,6 +44,7 @@
 
 #include "debug.h"
 #include "common_dataspaces.h"
+#include "dataspaces.h"
 #include "config.h"
 
 #ifdef DS_HAVE_DIMES
@@ -154,6 +155,64 @@ int dspaces_get (const char *var_name,
     return common_dspaces_get(var_name, ver, size, ndim, lb, ub, data);    
 }
 
+int dspaces_get_strided (const char *var_name,
+        unsigned int ver, int size,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        uint64_t *stride, void *data)
+{
+    return common_dspaces_get_strided(var_name, ver, size, ndim, lb, ub,
+        stride, data);
+}
+
+int dspaces_iput (const char *var_name,
+        unsigned int ver, int size,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        void *data)
+{
+    return common_dspaces_iput(var_name, ver, size, ndim, lb, ub, data);
+}
+
+int dspaces_iget (const char *var_name,
+        unsigned int ver, int size,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        void *data)
+{
+    return common_dspaces_iget(var_name, ver, size, ndim, lb, ub, data);
+}
+
+int dspaces_put_batch (int num_vars, const char **var_names,
+        unsigned int ver, int *sizes,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        void **data)
+{
+    return common_dspaces_put_batch(num_vars, var_names, ver, sizes,
+                ndim, lb, ub, data);
+}
+
+int dspaces_get_batch (int num_vars, const char **var_names,
+        unsigned int ver, int *sizes,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        void **data)
+{
+    return common_dspaces_get_batch(num_vars, var_names, ver, sizes,
+                ndim, lb, ub, data);
+}
+
+int dspaces_test(int req, int *flag)
+{
+    return common_dspaces_test(req, flag);
+}
+
+int dspaces_wait(int req)
+{
+    return common_dspaces_wait(req);
+}
+
+int dspaces_waitall(int num_req, int *reqs)
+{
+    return common_dspaces_waitall(num_req, reqs);
+}
+
 int dspaces_hint(const char *var_name,
         unsigned int ver, int size,
         int ndim, uint64_t *lb, uint64_t *ub)
@@ -167,6 +226,53 @@ int dspaces_remove (const char *var_name,
     return common_dspaces_remove(var_name, ver);
 }
 
+int dspaces_select(const char *var_name,
+        unsigned int ver, int elem_type, int op,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        double *result)
+{
+    if (op == DSPACES_HIST)
+        return -EINVAL;
+    return common_dspaces_select(var_name, ver, elem_type, op,
+        ndim, lb, ub, 0, 0, 0, result, NULL);
+}
+
+int dspaces_select_hist(const char *var_name,
+        unsigned int ver, int elem_type,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        double lo, double hi, int num_bins, uint64_t *bins)
+{
+    return common_dspaces_select(var_name, ver, elem_type, DSPACES_HIST,
+        ndim, lb, ub, lo, hi, num_bins, NULL, bins);
+}
+
+int dspaces_define_summary(const char *var_name, int elem_type)
+{
+    return common_dspaces_define_summary(var_name, elem_type);
+}
+
+int dspaces_query_range(const char *var_name,
+        unsigned int ver,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        double lo, double hi,
+        int max_bb, uint64_t *lb_tab, uint64_t *ub_tab)
+{
+    return common_dspaces_get_range(var_name, ver, 1, ndim, lb, ub,
+        lo, hi, max_bb, lb_tab, ub_tab, NULL);
+}
+
+int dspaces_get_range(const char *var_name,
+        unsigned int ver, int size,
+        int ndim, uint64_t *lb, uint64_t *ub,
+        double lo, double hi,
+        void *data)
+{
+    if (!data)
+        return -EINVAL;
+    return common_dspaces_get_range(var_name, ver, size, ndim, lb, ub,
+        lo, hi, 0, NULL, NULL, data);
+}
+
 
 
 int dspaces_put_sync(void)
@@ -104,12 +104,21 @@ struct query_tran_entry {
         struct query_dht        *qh;
 
         struct global_dimension gdim;
+
+        /* Strided query: 'q_obj' and the parts are in the coordinates
+           of the result, where point q_lb + k * stride is at k. */
+        struct coord            q_lb, stride;
+#ifdef TIMING_PERF
+        double                  tm_st;
+#endif
         /* Allocate/setup data for the objects in the 'od_list' that
            are retrieved from the space */
         unsigned int		f_alloc_data:1,
                     f_peer_received:1,
                     f_odsc_recv:1,
                     f_complete:1,
+                    f_cached:1,
+                    f_strided:1,
                     f_err:1;
 };
 
@@ -303,48 +312,6 @@ static void qt_free_obj_data(struct query_tran_entry *qte, int unlink)
         }
 }
 
-/*
-  Allocate obj data storage for a given transaction, i.e., allocate
-  space for all object pieces.
-*/
-static int qt_alloc_obj_data(struct query_tran_entry *qte)
-{
-        struct obj_data *od;
-        int n = 0;
-
-        list_for_each_entry(od, &qte->od_list, struct obj_data, obj_entry) {
-                od->data = malloc(obj_data_size(&od->obj_desc));
-                if (!od->data)
-                        break;
-                n++;
-        }
-
-        if (n != qte->num_od) {
-                qt_free_obj_data(qte, 0);
-                return -ENOMEM;
-        }
-        return 0;
-}
-
-static int qt_alloc_obj_data_with_size(struct query_tran_entry *qte, size_t size)
-{
-        struct obj_data *od;
-        int n = 0;
-
-        list_for_each_entry(od, &qte->od_list, struct obj_data, obj_entry) {
-                od->data = malloc(size);
-                if (!od->data)
-                        break;
-                n++;
-        }
-
-        if (n != qte->num_od) {
-                qt_free_obj_data(qte, 0);
-                return -ENOMEM;
-        }
-        return 0;
-}
-
 /*
   Add an object descriptor to a query transaction entry.
 */
@@ -513,6 +480,143 @@ static void qc_free(struct query_cache *qc)
         // free(qc);
 }
 
+/*
+  Read cache. Versions are written once, so a region fetched for a
+  (name, version) can be served locally for any query it contains,
+  until the version is removed or evicted from the space. The space
+  keeps 'max_versions' versions of a variable and a new version
+  replaces the one in the same slot (see ls_add_obj()), so we drop
+  cached versions the same way. The budget in bytes is set by the
+  DATASPACES_READ_CACHE_SIZE environment variable.
+*/
+static void rc_init(struct read_cache *rc)
+{
+        char *max_size = getenv("DATASPACES_READ_CACHE_SIZE");
+
+        INIT_LIST_HEAD(&rc->rc_list);
+        rc->num_ent = 0;
+        rc->size = 0;
+        rc->max_size = (max_size)? strtoull(max_size, NULL, 0) : 0;
+}
+
+static void rc_del_entry(struct read_cache *rc, struct obj_data *od)
+{
+        list_del(&od->obj_entry);
+        rc->num_ent--;
+        rc->size -= obj_data_size(&od->obj_desc);
+        obj_data_free(od);
+}
+
+/*
+  Test if cached object 'od' is no longer valid once object 'odsc' is
+  in the space: either it has a version that shares the same slot, or
+  it has the same version and is written again by a put ('f_put').
+*/
+static int rc_is_stale(struct obj_data *od, 
+        const struct obj_descriptor *odsc, int f_put)
+{
+        if (strcmp(od->obj_desc.name, odsc->name) != 0)
+                return 0;
+
+        if (od->obj_desc.version == odsc->version) {
+                /* Copies, the descriptors are packed. */
+                struct bbox bb = od->obj_desc.bb, q_bb = odsc->bb;
+                return f_put && bbox_does_intersect(&bb, &q_bb);
+        }
+
+        return dcg->max_versions > 0 && 
+                od->obj_desc.version % dcg->max_versions == 
+                odsc->version % dcg->max_versions;
+}
+
+static void rc_evict(struct read_cache *rc, 
+        const struct obj_descriptor *odsc, int f_put)
+{
+        struct obj_data *od, *t;
+
+        list_for_each_entry_safe(od, t, &rc->rc_list, struct obj_data, obj_entry) {
+                if (rc_is_stale(od, odsc, f_put))
+                        rc_del_entry(rc, od);
+        }
+}
+
+static void rc_remove(struct read_cache *rc, const char *var_name, unsigned int ver)
+{
+        struct obj_data *od, *t;
+
+        list_for_each_entry_safe(od, t, &rc->rc_list, struct obj_data, obj_entry) {
+                if (od->obj_desc.version == ver &&
+                    strcmp(od->obj_desc.name, var_name) == 0)
+                        rc_del_entry(rc, od);
+        }
+}
+
+/*
+  Serve object 'od' from the cache if a cached region of the same
+  version contains it; return 1 on a hit and 0 otherwise.
+*/
+static int rc_get(struct read_cache *rc, struct obj_data *od)
+{
+        struct obj_data *from;
+        struct bbox bb = od->obj_desc.bb, from_bb;
+
+        if (!rc->max_size || !od->data)
+                return 0;
+
+        list_for_each_entry(from, &rc->rc_list, struct obj_data, obj_entry) {
+                from_bb = from->obj_desc.bb;
+                if (from->obj_desc.version == od->obj_desc.version &&
+                    from->obj_desc.size == od->obj_desc.size &&
+                    strcmp(from->obj_desc.name, od->obj_desc.name) == 0 &&
+                    bbox_include(&from_bb, &bb)) {
+                        ssd_copy(od, from);
+
+                        /* Keep the list in LRU order. */
+                        list_del(&from->obj_entry);
+                        list_add(&from->obj_entry, &rc->rc_list);
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+/*
+  Add a copy of a fetched region to the cache, evicting the least
+  recently used entries to stay within the budget.
+*/
+static void rc_add(struct read_cache *rc, struct obj_descriptor *odsc, void *data)
+{
+        struct obj_data *od;
+        uint64_t size = obj_data_size(odsc);
+
+        if (!data || size == 0 || size > rc->max_size)
+                return;
+
+        rc_evict(rc, odsc, 0);
+        while (rc->size + size > rc->max_size)
+                rc_del_entry(rc, list_entry(rc->rc_list.prev, 
+                                struct obj_data, obj_entry));
+
+        od = obj_data_alloc(odsc);
+        if (!od)
+                return;
+
+        memcpy(od->data, data, size);
+        list_add(&od->obj_entry, &rc->rc_list);
+        rc->num_ent++;
+        rc->size += size;
+}
+
+static void rc_free(struct read_cache *rc)
+{
+        struct obj_data *od, *t;
+
+        list_for_each_entry_safe(od, t, &rc->rc_list, struct obj_data, obj_entry) {
+                rc_del_entry(rc, od);
+        }
+}
+
 
 /*
   NOTE: routine seems to work, however it requires some more testing.
@@ -697,6 +801,79 @@ static inline struct node_id * dcg_which_peer(void)
         return peer;
 }
 
+/*
+  Server peer that receives the objects inserted by this client.
+*/
+static inline struct node_id * dcg_which_put_peer(void)
+{
+        if (flag_set_mpi_rank)
+                return dc_get_peer(dcg->dc, mpi_rank % dcg->dc->num_sp);
+
+        return dcg_which_peer();
+}
+
+/*
+  Lookup the local copy of the shared space dht for global dimension
+  'gd'; the dht is created the first time it is needed. It is only
+  used to select servers, so one version is enough.
+*/
+static struct sspace *dcg_lookup_sspace(const struct global_dimension *gd)
+{
+        struct sspace_list_entry *ssd_entry;
+        struct bbox domain;
+        int i;
+
+        if (global_dimension_equal(gd, &dcg->default_gdim)) {
+                if (!dcg->default_ssd)
+                        dcg->default_ssd = ssd_alloc(&dcg->ss_domain,
+                                dcg->ss_info.num_space_srv, 1,
+                                dcg->hash_version);
+                return dcg->default_ssd;
+        }
+
+        list_for_each_entry(ssd_entry, &dcg->sspace_list,
+                struct sspace_list_entry, entry) {
+                if (global_dimension_equal(gd, &ssd_entry->gdim))
+                        return ssd_entry->ssd;
+        }
+
+        memset(&domain, 0, sizeof(struct bbox));
+        domain.num_dims = gd->ndim;
+        for (i = 0; i < gd->ndim; i++) {
+                domain.lb.c[i] = 0;
+                domain.ub.c[i] = gd->sizes.c[i] - 1;
+        }
+
+        ssd_entry = malloc(sizeof(*ssd_entry));
+        if (!ssd_entry)
+                return NULL;
+        memcpy(&ssd_entry->gdim, gd, sizeof(struct global_dimension));
+        ssd_entry->ssd = ssd_alloc(&domain, dcg->ss_info.num_space_srv,
+                                1, dcg->hash_version);
+        if (!ssd_entry->ssd) {
+                free(ssd_entry);
+                return NULL;
+        }
+
+        list_add(&ssd_entry->entry, &dcg->sspace_list);
+        return ssd_entry->ssd;
+}
+
+static void dcg_free_sspace(void)
+{
+        struct sspace_list_entry *ssd_entry, *t;
+
+        if (dcg->default_ssd)
+                ssd_free(dcg->default_ssd);
+
+        list_for_each_entry_safe(ssd_entry, t, &dcg->sspace_list,
+                struct sspace_list_entry, entry) {
+                ssd_free(ssd_entry->ssd);
+                list_del(&ssd_entry->entry);
+                free(ssd_entry);
+        }
+}
+
 #ifdef DS_HAVE_ACTIVESPACE
 /*
   RPC routine to receive results from code executed in the space.
@@ -803,7 +980,7 @@ static int dcg_lock_request(struct dcg_lock *lock, enum lock_type type)
 
         err = rpc_send(dcg->dc->rpc_s, peer, msg);
         if (err < 0) {
-                free(msg);
+                msg_buf_free(msg);
                 goto err_out;
         }
 
@@ -951,7 +1128,7 @@ static int get_dht_peers_completion(struct rpc_server *rpc_s, struct msg_buf *ms
         qte->qh->qh_num_peer = i;
         qte->f_peer_received = 1;
 
-        free(msg);
+        msg_buf_free(msg);
 
         return 0;
 }
@@ -990,7 +1167,7 @@ static int get_dht_peers(struct query_tran_entry *qte)
         if (err == 0)
                 return 0;
 
-        free(msg);
+        msg_buf_free(msg);
  err_out:
         ERROR_TRACE();
 }
@@ -1030,7 +1207,7 @@ static int get_obj_descriptors(struct query_tran_entry *qte)
                 qte->qh->qh_num_req_posted++;
                 err = rpc_send(dcg->dc->rpc_s, peer, msg);
                 if (err < 0) {
-                        free(msg);
+                        msg_buf_free(msg);
                         qte->qh->qh_num_req_posted--;
                         goto err_out;
                 }
@@ -1053,7 +1230,7 @@ static int obj_get_dht_peers_completion(void *dcg_ref, struct msg_buf *msg) // _
         struct hdr_obj_get *oh;
         int i, err;
 
-        free(msg);
+        msg_buf_free(msg);
 
         for (i = 0; i < qte->dht_peer_num; i++) {
                 err = -ENOMEM;
@@ -1074,7 +1251,7 @@ static int obj_get_dht_peers_completion(void *dcg_ref, struct msg_buf *msg) // _
                 qte->dht_peer_req++;
                 err = rpc_send(dcg->dc->rpc_s, peer, msg);
                 if (err < 0) {
-                        free(msg);
+                        msg_buf_free(msg);
                         qte->dht_peer_req--;
                         break;
                 }
@@ -1127,7 +1304,7 @@ static int dcgrpc_obj_get_dht_peers(struct rpc_server *rpc_s, struct rpc_cmd *cm
         err = rpc_receive_direct(rpc_s, peer, msg);
         peer->mb = MB_RPC_MSG;
         if (err < 0) {
-                free(msg);
+                msg_buf_free(msg);
                 goto err_out;
         }
 
@@ -1138,26 +1315,165 @@ static int dcgrpc_obj_get_dht_peers(struct rpc_server *rpc_s, struct rpc_cmd *cm
 }
 #endif /* 0 */
 
+/*
+  Copy a received part into the query result buffer and release the
+  part buffer.
+*/
+static void qt_assemble_obj(struct query_tran_entry *qte, struct obj_data *od)
+{
+        struct obj_data to;
+
+        if (qte->data_ref) {
+                memset(&to, 0, sizeof(to));
+                to.obj_desc = qte->q_obj;
+                to.data = qte->data_ref;
+
+                ssd_copy(&to, od);
+        }
+
+        free(od->data);
+        od->data = NULL;
+}
+
 static int obj_data_get_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
 {
         struct query_tran_entry *qte = msg->private;
+        struct obj_data *od;
         /*
         qte->num_reply++;
         if (qte->num_req == qte->num_od && qte->num_reply == qte->num_req)
                 qte->f_complete = 1;
         */
 
+        /* Assemble the part now, while the other parts are still in
+           flight. */
+        list_for_each_entry(od, &qte->od_list, struct obj_data, obj_entry) {
+                if (od->data && od->data == msg->msg_data) {
+                        qt_assemble_obj(qte, od);
+                        break;
+                }
+        }
+
         if (++qte->num_parts_rec == qte->size_od) {
                 qte->f_complete = 1;
         }
 
-        free(msg);
+        msg_buf_free(msg);
         return 0;
 }
 
+static int obj_filter_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct query_tran_entry *qte = msg->private;
+
+        qte->f_complete = 1;
+
+        msg_buf_free(msg);
+        return 0;
+}
+
+/*
+  Switch a strided query to the coordinates of the result once the
+  parts are known: the part of every object becomes the range of
+  selected points it holds, and parts that hold none are dropped.
+*/
+static void qt_set_strided(struct query_tran_entry *qte)
+{
+        /* Work on copies, the descriptors are packed. */
+        struct bbox qbb = qte->q_obj.bb, bb;
+        struct obj_data *od, *t;
+        uint64_t lb, ub;
+        int i;
+
+        list_for_each_entry_safe(od, t, &qte->od_list, struct obj_data, obj_entry) {
+                bb = od->obj_desc.bb;
+                for (i = 0; i < qbb.num_dims; i++) {
+                        lb = (bb.lb.c[i] - qte->q_lb.c[i] + qte->stride.c[i] - 1) /
+                                qte->stride.c[i];
+                        ub = (bb.ub.c[i] - qte->q_lb.c[i]) / qte->stride.c[i];
+                        if (lb > ub)
+                                break;
+                        bb.lb.c[i] = lb;
+                        bb.ub.c[i] = ub;
+                }
+                if (i < qbb.num_dims)
+                        qt_remove_obj(qte, od);
+                else
+                        od->obj_desc.bb = bb;
+        }
+
+        for (i = 0; i < qbb.num_dims; i++) {
+                qbb.ub.c[i] = (qbb.ub.c[i] - qbb.lb.c[i]) / qte->stride.c[i];
+                qbb.lb.c[i] = 0;
+        }
+        qte->q_obj.bb = qbb;
+}
+
+/*
+  Fill the 'ss_obj_get_strided' request for part 'od' of a strided
+  query; the server gets the part back in global coordinates.
+*/
+static void qt_strided_hdr(struct query_tran_entry *qte, struct obj_data *od,
+                           struct rpc_cmd *cmd)
+{
+        struct hdr_obj_get_strided *hs = (struct hdr_obj_get_strided *) cmd->pad;
+        int i;
+
+        cmd->cmd = ss_obj_get_strided;
+
+        hs->qid = qte->q_id;
+        hs->odsc = od->obj_desc;
+        hs->odsc.version = qte->q_obj.version;
+        for (i = 0; i < od->obj_desc.bb.num_dims; i++) {
+                hs->odsc.bb.lb.c[i] = qte->q_lb.c[i] +
+                        od->obj_desc.bb.lb.c[i] * qte->stride.c[i];
+                hs->odsc.bb.ub.c[i] = qte->q_lb.c[i] +
+                        od->obj_desc.bb.ub.c[i] * qte->stride.c[i];
+        }
+        hs->stride = qte->stride;
+}
+
+/*
+  Test if a part maps to a contiguous range of the query result
+  buffer, and if so, compute the byte offset of the range. The layout
+  follows matrix_copy(), i.e., dimension 0 varies fastest. A part is
+  contiguous if it spans the query on all dimensions below some
+  dimension k, and has a single element on all dimensions above k.
+*/
+static int qt_obj_contig_offset(struct query_tran_entry *qte,
+                                struct obj_data *od, uint64_t *offset)
+{
+        /* Copies, the descriptors are packed. */
+        struct bbox qbb = qte->q_obj.bb, bb = od->obj_desc.bb;
+        uint64_t off = 0;
+        int i, k, ndims = qbb.num_dims;
+
+        if (!qte->data_ref || bb.num_dims != ndims ||
+            od->obj_desc.size != qte->q_obj.size || !bbox_include(&qbb, &bb))
+                return 0;
+
+        for (k = 0; k < ndims - 1; k++)
+                if (bb.lb.c[k] != qbb.lb.c[k] || bb.ub.c[k] != qbb.ub.c[k])
+                        break;
+
+        for (i = k + 1; i < ndims; i++)
+                if (bb.lb.c[i] != bb.ub.c[i])
+                        return 0;
+
+        for (i = ndims - 1; i >= 0; i--)
+                off = off * bbox_dist(&qbb, i) + (bb.lb.c[i] - qbb.lb.c[i]);
+
+        *offset = off * qte->q_obj.size;
+        return 1;
+}
+
 /*
   Fetch a data object from the distributed storage. We call this
-  routine when we have all object descriptors for all parts.
+  routine when we have all object descriptors for all parts. Part
+  buffers are allocated as the requests are posted and released as
+  soon as the part is copied into the result, so only the parts in
+  flight take extra memory. Parts that map to a contiguous range of
+  the result are received in place, with no part buffer and no copy.
 */
 static int dcg_obj_data_get(struct query_tran_entry *qte)
 {
@@ -1165,16 +1481,22 @@ static int dcg_obj_data_get(struct query_tran_entry *qte)
         struct node_id *peer;
         struct hdr_obj_get *oh;
         struct obj_data *od;
+        uint64_t offset;
+        void *buf;
         int err;
 
-        err = qt_alloc_obj_data(qte);
-        if (err < 0)
-                goto err_out;
-
         list_for_each_entry(od, &qte->od_list, struct obj_data, obj_entry) {
                 peer = dc_get_peer(dcg->dc, od->obj_desc.owner);
 
                 err = -ENOMEM;
+                if (qt_obj_contig_offset(qte, od, &offset))
+                        buf = (char *) qte->data_ref + offset;
+                else {
+                        buf = od->data = malloc(obj_data_size(&od->obj_desc));
+                        if (!od->data)
+                                goto err_out;
+                }
+
                 msg = msg_buf_alloc(dcg->dc->rpc_s, peer, 1);
                 if (!msg) {
                         free(od->data);
@@ -1182,7 +1504,7 @@ static int dcg_obj_data_get(struct query_tran_entry *qte)
                         goto err_out;
                 }
 
-                msg->msg_data = od->data;
+                msg->msg_data = buf;
                 msg->size = obj_data_size(&od->obj_desc);
                 msg->cb = obj_data_get_completion;
                 msg->private = qte;
@@ -1190,16 +1512,20 @@ static int dcg_obj_data_get(struct query_tran_entry *qte)
                 msg->msg_rpc->cmd = ss_obj_get;
                 msg->msg_rpc->id = DCG_ID;
 
-                oh = (struct hdr_obj_get *) msg->msg_rpc->pad;
-                oh->qid = qte->q_id;
-                oh->u.o.odsc = od->obj_desc;
-                oh->u.o.odsc.version = qte->q_obj.version;
-                memcpy(&oh->gdim, &qte->gdim,
-                    sizeof(struct global_dimension));
+                if (qte->f_strided)
+                        qt_strided_hdr(qte, od, msg->msg_rpc);
+                else {
+                        oh = (struct hdr_obj_get *) msg->msg_rpc->pad;
+                        oh->qid = qte->q_id;
+                        oh->u.o.odsc = od->obj_desc;
+                        oh->u.o.odsc.version = qte->q_obj.version;
+                        memcpy(&oh->gdim, &qte->gdim,
+                            sizeof(struct global_dimension));
+                }
 
                 err = rpc_receive(dcg->dc->rpc_s, peer, msg);
                 if (err < 0) {
-                        free(msg);
+                        msg_buf_free(msg);
                         free(od->data);
                         od->data = NULL;
                         goto err_out;
@@ -1257,49 +1583,56 @@ static int dcg_obj_data_hint(struct query_tran_entry *qte)
 }
 
 /*
-  Initiate a custom filter retrieve operation.
-  TODO: add a parameter for cusom functions ... 
+  Initiate a reduction: send the descriptors of all parts to the first
+  server that holds one; the servers reduce them among themselves, and
+  the result comes back in dcgrpc_obj_filter().
 */
-static int obj_filter_init(struct query_tran_entry *qte)
+static int obj_filter_init(struct query_tran_entry *qte,
+                           const struct obj_filter_spec *spec)
 {
         struct node_id *peer;
         struct msg_buf *msg;
         struct hdr_obj_filter *hf;
+        struct obj_descriptor *od_tab;
         struct obj_data *od;
-        int err;
+        int i = 0, err = -ENOMEM;
 
-        // TODO: data size if fixed to double; make it dynamic.
-        err = qt_alloc_obj_data_with_size(qte, sizeof(double));
-        if (err < 0)
+        od_tab = malloc(sizeof(*od_tab) * qte->num_od);
+        if (!od_tab)
                 goto err_out;
 
         list_for_each_entry(od, &qte->od_list, struct obj_data, obj_entry) {
-                peer = dc_get_peer(dcg->dc, od->obj_desc.owner);
+                od_tab[i] = od->obj_desc;
+                od_tab[i++].version = qte->q_obj.version;
+        }
 
-                err = -ENOMEM;
-                msg = msg_buf_alloc(dcg->dc->rpc_s, peer, 1);
-                if (!msg)
-                        goto err_out;
+        peer = dc_get_peer(dcg->dc, od_tab[0].owner);
+        msg = msg_buf_alloc(dcg->dc->rpc_s, peer, 1);
+        if (!msg) {
+                free(od_tab);
+                goto err_out;
+        }
 
-                msg->msg_data = od->data;
-                msg->size = sizeof(double);
-                msg->cb = obj_data_get_completion;
-                msg->private = qte;
+        msg->msg_data = od_tab;
+        msg->size = sizeof(*od_tab) * qte->num_od;
+        msg->cb = default_completion_with_data_callback;
 
-                msg->msg_rpc->cmd = ss_obj_filter;
-                msg->msg_rpc->id = DCG_ID; // dcg->dc->self->id;
+        msg->msg_rpc->cmd = ss_obj_filter;
+        msg->msg_rpc->id = DCG_ID;
 
-                hf = (struct hdr_obj_filter *) msg->msg_rpc->pad;
-                hf->qid = qte->q_id;
-                hf->rc = 0;
-                hf->odsc = od->obj_desc;
-                hf->odsc.version = qte->q_obj.version;
+        hf = (struct hdr_obj_filter *) msg->msg_rpc->pad;
+        hf->qid = qte->q_id;
+        hf->cid = DCG_ID;
+        hf->num_od = qte->num_od;
+        hf->f_result = 0;
+        hf->spec = *spec;
+        hf->odsc = qte->q_obj;
 
-                err = rpc_receive(dcg->dc->rpc_s, peer, msg);
-                if (err < 0) {
-                        free(msg);
-                        goto err_out;
-                }
+        err = rpc_send(dcg->dc->rpc_s, peer, msg);
+        if (err < 0) {
+                free(od_tab);
+                msg_buf_free(msg);
+                goto err_out;
         }
 
         return 0;
@@ -1307,48 +1640,62 @@ static int obj_filter_init(struct query_tran_entry *qte)
         ERROR_TRACE();
 }
 
-static int obj_filter_reduce(struct query_tran_entry *qte, struct obj_data *od)
+/*
+  Rpc routine to receive the result of a reduction from the root
+  server.
+*/
+static int dcgrpc_obj_filter(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 {
-        struct obj_data *odt;
-        double *pa, *pb;
-        int first = 1;
+        struct hdr_obj_filter *hf = (struct hdr_obj_filter *) cmd->pad;
+        struct node_id *peer = dc_get_peer(dcg->dc, cmd->id);
+        struct query_tran_entry *qte;
+        struct msg_buf *msg;
+        int err = -ENOMEM;
 
-        pb = od->data;
-        list_for_each_entry(odt, &qte->od_list, struct obj_data, obj_entry) {
-                pa = odt->data;
-                if (first) {
-                        first = 0;
-                        *pb = *pa;
-                }
-                else if (*pa < *pb)
-                        *pb = *pa;
+        qte = qt_find(&dcg->qt, hf->qid);
+        if (!qte) {
+                uloga("'%s()': can not find transaction qid = %d.\n",
+                        __func__, hf->qid);
+                return -ENOENT;
         }
 
-        return 0;
+        msg = msg_buf_alloc(rpc_s, peer, 0);
+        if (!msg)
+                goto err_out;
+
+        msg->msg_data = qte->data_ref;
+        msg->size = sizeof(struct obj_filter_res);
+        msg->private = qte;
+        msg->cb = obj_filter_completion;
+
+        rpc_mem_info_cache(peer, msg, cmd);
+        err = rpc_receive_direct(rpc_s, peer, msg);
+        rpc_mem_info_reset(peer, msg, cmd);
+        if (err == 0)
+                return 0;
+
+        msg_buf_free(msg);
+ err_out:
+        ERROR_TRACE();
 }
 
-static int obj_get_desc_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+/*
+  Add the object descriptors received from a DHT peer to the query,
+  keeping only one copy of duplicates.
+*/
+static int qte_add_obj_desc(struct query_tran_entry *qte, 
+                            struct obj_descriptor *od_tab, int num_de)
 {
-        struct hdr_obj_get *oh = msg->private;
-        struct obj_descriptor *od_tab = msg->msg_data;
-        struct query_tran_entry *qte;
-        int i, err = -ENOENT;
-
-        qte = qt_find(&dcg->qt, oh->qid);
-        if (!qte) {
-		uloga("can not find transaction ID = %d.\n", oh->qid);
-                goto err_out_free;
-	}
+        int i, err;
 
-        qte->qh->qh_num_rep_received++;
-        qte->size_od += oh->u.o.num_de;
+        qte->size_od += num_de;
 
-        for (i = 0; i < oh->u.o.num_de; i++) {
+        for (i = 0; i < num_de; i++) {
                 if (!qt_find_obj(qte, od_tab+i)) {
                         err = qt_add_obj(qte, od_tab+i);
 			// err = qt_add_objv(qte, od_tab+i);
                         if (err < 0)
-                                goto err_out_free;
+                                return err;
                 }
                 else {
 			/* DEBUG:
@@ -1359,9 +1706,31 @@ static int obj_get_desc_completion(struct rpc_server *rpc_s, struct msg_buf *msg
                 }
         }
 
-        free(oh);
+        return 0;
+}
+
+static int obj_get_desc_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct hdr_obj_get *oh = msg->private;
+        struct obj_descriptor *od_tab = msg->msg_data;
+        struct query_tran_entry *qte;
+        int err = -ENOENT;
+
+        qte = qt_find(&dcg->qt, oh->qid);
+        if (!qte) {
+		uloga("can not find transaction ID = %d.\n", oh->qid);
+                goto err_out_free;
+	}
+
+        qte->qh->qh_num_rep_received++;
+
+        err = qte_add_obj_desc(qte, od_tab, oh->u.o.num_de);
+        if (err < 0)
+                goto err_out_free;
+
+        free(oh);
         free(od_tab);
-        free(msg);
+        msg_buf_free(msg);
 
         if (qte->qh->qh_num_rep_received == qte->qh->qh_num_peer) {
                 /* Object descriptor receive completed. */
@@ -1383,7 +1752,7 @@ static int obj_get_desc_completion(struct rpc_server *rpc_s, struct msg_buf *msg
  err_out_free:
         free(oh);
         free(od_tab);
-        free(msg);
+        msg_buf_free(msg);
 
 	ERROR_TRACE();
 }
@@ -1468,25 +1837,702 @@ static int dcgrpc_obj_get_desc(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 
         free(od_tab);
         free(oht);
-        free(msg);
+        msg_buf_free(msg);
  err_out:
         uloga("'%s()': failed with %d.\n", __func__, err);
         return err;
 }
 
 /*
-  Assemble the object 'od' from pieces in 'qte->od_list'.
+  Ask the DHT peers of a query for the descriptors of the objects and
+  their value ranges; the answers come in dcgrpc_obj_get_summary().
+*/
+static int get_obj_summaries(struct query_tran_entry *qte)
+{
+        struct hdr_obj_get *oh;
+        struct node_id *peer;
+        struct msg_buf *msg;
+        int *peer_id, err;
+
+        qte->f_odsc_recv = 0;
+        for (peer_id = qte->qh->qh_peerid_tab; *peer_id != -1; peer_id++) {
+                peer = dc_get_peer(dcg->dc, *peer_id);
+
+                err = -ENOMEM;
+                msg = msg_buf_alloc(dcg->dc->rpc_s, peer, 1);
+                if (!msg)
+                        goto err_out;
+
+                msg->msg_rpc->cmd = ss_obj_get_summary;
+                msg->msg_rpc->id = DCG_ID;
+
+                oh = (struct hdr_obj_get *) msg->msg_rpc->pad;
+                oh->qid = qte->q_id;
+                oh->u.o.odsc = qte->q_obj;
+                memcpy(&oh->gdim, &qte->gdim,
+                    sizeof(struct global_dimension));
+
+                err = rpc_send(dcg->dc->rpc_s, peer, msg);
+                if (err < 0) {
+                        msg_buf_free(msg);
+                        goto err_out;
+                }
+        }
+
+        return 0;
+ err_out:
+        ERROR_TRACE();
+}
+
+/*
+  Add the descriptors and value ranges received from a DHT peer to the
+  query, keeping only one copy of duplicates.
+*/
+static int qte_add_obj_summary(struct query_tran_entry *qte,
+                               struct obj_desc_summary *tab, int num_de)
+{
+        struct obj_data *od;
+        int i, err = 0;
+
+        for (i = 0; i < num_de && err == 0; i++) {
+                if (qt_find_obj(qte, &tab[i].odsc))
+                        continue;
+                err = qt_add_obj(qte, &tab[i].odsc);
+                if (err == 0) {
+                        od = list_entry(qte->od_list.next, struct obj_data, obj_entry);
+                        od->sum = tab[i].sum;
+                }
+        }
+        qte->size_od = qte->num_od;
+
+        if (++qte->qh->qh_num_rep_received == qte->qh->qh_num_peer)
+                qte->f_odsc_recv = 1;
+
+        return err;
+}
+
+static int obj_get_summary_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct hdr_obj_get *oh = msg->private;
+        struct query_tran_entry *qte;
+        int err = -ENOENT;
+
+        qte = qt_find(&dcg->qt, oh->qid);
+        if (qte)
+                err = qte_add_obj_summary(qte, msg->msg_data, oh->u.o.num_de);
+
+        free(msg->msg_data);
+        free(oh);
+        msg_buf_free(msg);
+
+        return err;
+}
+
+/*
+  Rpc routine to receive the descriptors and value ranges from a DHT
+  peer.
+*/
+static int dcgrpc_obj_get_summary(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_get *oht, *oh = (struct hdr_obj_get *) cmd->pad;
+        struct node_id *peer = dc_get_peer(dcg->dc, cmd->id);
+        struct query_tran_entry *qte;
+        struct msg_buf *msg;
+        void *tab;
+        int err = -ENOMEM;
+
+        if (oh->u.o.num_de == 0) {
+                qte = qt_find(&dcg->qt, oh->qid);
+                if (!qte)
+                        return -ENOENT;
+                return qte_add_obj_summary(qte, NULL, 0);
+        }
+
+        tab = malloc(sizeof(struct obj_desc_summary) * oh->u.o.num_de);
+        oht = malloc(sizeof(*oh));
+        msg = msg_buf_alloc(rpc_s, peer, 0);
+        if (!tab || !oht || !msg)
+                goto err_free;
+        memcpy(oht, oh, sizeof(*oh));
+
+        msg->size = sizeof(struct obj_desc_summary) * oh->u.o.num_de;
+        msg->msg_data = tab;
+        msg->cb = obj_get_summary_completion;
+        msg->private = oht;
+
+        rpc_mem_info_cache(peer, msg, cmd);
+        err = rpc_receive_direct(rpc_s, peer, msg);
+        rpc_mem_info_reset(peer, msg, cmd);
+        if (err == 0)
+                return 0;
+
+ err_free:
+        free(tab);
+        free(oht);
+        msg_buf_free(msg);
+        ERROR_TRACE();
+}
+
+/*
+  Set the DHT peers of a query from the local copy of the shared
+  space dht, instead of asking a server.
 */
-static int dcg_obj_assemble(struct query_tran_entry *qte, struct obj_data *od)
+static int qte_set_dht_peers(struct query_tran_entry *qte)
 {
+        struct sspace *ssd;
+        int i, num_de;
+
+        ssd = dcg_lookup_sspace(&qte->gdim);
+        if (!ssd)
+                return -ENOMEM;
+        {
+                struct dht_entry *de_tab[ssd->dht->num_entries];
+                struct bbox bb = qte->q_obj.bb;
+
+                num_de = ssd_hash(ssd, &bb, de_tab);
+                for (i = 0; i < num_de; i++)
+                        qte->qh->qh_peerid_tab[i] = de_tab[i]->rank;
+        }
+        /* The -1 here  is a marker for the end of the array. */
+        qte->qh->qh_peerid_tab[num_de] = -1;
+        qte->qh->qh_num_peer = num_de;
+        qte->f_peer_received = 1;
+
+        return 0;
+}
+
+/*
+  Send the queries of a batch to their DHT peers; all queries for one
+  peer go in a single request.
+*/
+static int get_obj_descriptors_batch(struct query_tran_entry *qte_tab[], int num_qte)
+{
+        struct query_tran_entry *qte;
+        struct obj_batch_ent *ent_tab;
+        struct hdr_obj_batch *hb;
+        struct node_id *peer;
+        struct msg_buf *msg;
+        int *peer_id, sp, i, n, err;
+
+        for (sp = 0; sp < dcg->dc->num_sp; sp++) {
+                err = -ENOMEM;
+                ent_tab = malloc(sizeof(*ent_tab) * num_qte);
+                if (!ent_tab)
+                        goto err_out;
+
+                for (i = 0, n = 0; i < num_qte; i++) {
+                        qte = qte_tab[i];
+                        for (peer_id = qte->qh->qh_peerid_tab; *peer_id != -1; peer_id++)
+                                if (*peer_id == sp)
+                                        break;
+                        if (*peer_id == -1)
+                                continue;
+
+                        ent_tab[n].qid = qte->q_id;
+                        ent_tab[n].num_de = 0;
+                        ent_tab[n].odsc = qte->q_obj;
+                        memcpy(&ent_tab[n].gdim, &qte->gdim,
+                                sizeof(struct global_dimension));
+                        qte->qh->qh_num_req_posted++;
+                        n++;
+                }
+
+                if (n == 0) {
+                        free(ent_tab);
+                        continue;
+                }
+
+                peer = dc_get_peer(dcg->dc, sp);
+                msg = msg_buf_alloc(dcg->dc->rpc_s, peer, 1);
+                if (!msg) {
+                        free(ent_tab);
+                        goto err_out;
+                }
+
+                msg->msg_data = ent_tab;
+                msg->size = sizeof(*ent_tab) * n;
+                msg->cb = default_completion_with_data_callback;
+
+                msg->msg_rpc->cmd = ss_obj_get_desc_batch;
+                msg->msg_rpc->id = DCG_ID;
+
+                hb = (struct hdr_obj_batch *) msg->msg_rpc->pad;
+                hb->num_ent = n;
+                hb->size = msg->size;
+
+                err = rpc_send(dcg->dc->rpc_s, peer, msg);
+                if (err < 0) {
+                        free(ent_tab);
+                        msg_buf_free(msg);
+                        goto err_out;
+                }
+        }
+
+        return 0;
+ err_out:
+        ERROR_TRACE();
+}
+
+static int obj_get_desc_batch_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct hdr_obj_batch *hb = msg->private;
+        struct obj_batch_ent *ent, *ent_tab = msg->msg_data;
+        struct obj_descriptor *od_tab;
+        struct query_tran_entry *qte;
+        int i, err = 0;
+
+        od_tab = (struct obj_descriptor *) (ent_tab + hb->num_ent);
+        for (i = 0; i < hb->num_ent; i++) {
+                ent = &ent_tab[i];
+                qte = qt_find(&dcg->qt, ent->qid);
+                if (!qte) {
+                        uloga("can not find transaction ID = %d.\n", ent->qid);
+                        err = -ENOENT;
+                }
+                else if (ent->num_de < 0) {
+                        qte->f_err = 1;
+                }
+                else if (qte_add_obj_desc(qte, od_tab, ent->num_de) < 0) {
+                        err = -ENOMEM;
+                        qte->f_err = 1;
+                }
+
+                if (ent->num_de > 0)
+                        od_tab += ent->num_de;
+                if (qte && ++qte->qh->qh_num_rep_received == qte->qh->qh_num_peer)
+                        qte->f_odsc_recv = 1;
+        }
+
+        free(hb);
+        free(msg->msg_data);
+        msg_buf_free(msg);
+
+        if (err == 0)
+                return 0;
+        ERROR_TRACE();
+}
+
+/*
+  RPC routine to receive the object descriptors for a batch of
+  queries from a DHT node.
+*/
+static int dcgrpc_obj_get_desc_batch(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_batch *hbt, *hb = (struct hdr_obj_batch *) cmd->pad;
+        struct node_id *peer = dc_get_peer(dcg->dc, cmd->id);
+        struct msg_buf *msg;
+        void *buf;
+        int err = -ENOMEM;
+
+        buf = malloc(hb->size);
+        if (!buf)
+                goto err_out;
+
+        hbt = malloc(sizeof(*hb));
+        if (!hbt) {
+                free(buf);
+                goto err_out;
+        }
+        memcpy(hbt, hb, sizeof(*hb));
+
+        msg = msg_buf_alloc(rpc_s, peer, 0);
+        if (!msg) {
+                free(buf);
+                free(hbt);
+                goto err_out;
+        }
+
+        msg->msg_data = buf;
+        msg->size = hb->size;
+        msg->private = hbt;
+        msg->cb = obj_get_desc_batch_completion;
+
+        rpc_mem_info_cache(peer, msg, cmd);
+        err = rpc_receive_direct(rpc_s, peer, msg);
+        rpc_mem_info_reset(peer, msg, cmd);
+        if (err == 0)
+                return 0;
+
+        free(buf);
+        free(hbt);
+        msg_buf_free(msg);
+ err_out:
+        ERROR_TRACE();
+}
+
+/*
+  Request the data of all parts of a batch; all parts owned by one
+  server go in a single request and come back in one transfer.
+*/
+static int obj_data_get_batch(struct query_tran_entry *qte_tab[], int num_qte)
+{
+        struct query_tran_entry *qte;
+        struct obj_batch_ent *ent_tab;
+        struct hdr_obj_batch *hb;
+        struct node_id *peer;
+        struct msg_buf *msg;
+        struct obj_data *od;
+        int sp, i, n, num_parts = 0;
         int err;
 
-        err = ssd_copy_list(od, &qte->od_list);
+        for (i = 0; i < num_qte; i++)
+                if (!qte_tab[i]->f_err)
+                        num_parts += qte_tab[i]->num_od;
+
+        for (sp = 0; sp < dcg->dc->num_sp; sp++) {
+                err = -ENOMEM;
+                ent_tab = malloc(sizeof(*ent_tab) * num_parts);
+                if (!ent_tab)
+                        goto err_out;
+
+                n = 0;
+                for (i = 0; i < num_qte; i++) {
+                        qte = qte_tab[i];
+                        if (qte->f_err)
+                                continue;
+
+                        list_for_each_entry(od, &qte->od_list, struct obj_data, obj_entry) {
+                                if (od->obj_desc.owner != sp)
+                                        continue;
+
+                                ent_tab[n].qid = qte->q_id;
+                                ent_tab[n].num_de = 0;
+                                ent_tab[n].odsc = od->obj_desc;
+                                ent_tab[n].odsc.version = qte->q_obj.version;
+                                memcpy(&ent_tab[n].gdim, &qte->gdim,
+                                        sizeof(struct global_dimension));
+                                n++;
+                        }
+                }
+
+                if (n == 0) {
+                        free(ent_tab);
+                        continue;
+                }
+
+                peer = dc_get_peer(dcg->dc, sp);
+                msg = msg_buf_alloc(dcg->dc->rpc_s, peer, 1);
+                if (!msg) {
+                        free(ent_tab);
+                        goto err_out;
+                }
+
+                msg->msg_data = ent_tab;
+                msg->size = sizeof(*ent_tab) * n;
+                msg->cb = default_completion_with_data_callback;
+
+                msg->msg_rpc->cmd = ss_obj_get_batch;
+                msg->msg_rpc->id = DCG_ID;
+
+                hb = (struct hdr_obj_batch *) msg->msg_rpc->pad;
+                hb->num_ent = n;
+                hb->size = msg->size;
+
+                err = rpc_send(dcg->dc->rpc_s, peer, msg);
+                if (err < 0) {
+                        free(ent_tab);
+                        msg_buf_free(msg);
+                        goto err_out;
+                }
+        }
+
+        return 0;
+ err_out:
+        ERROR_TRACE();
+}
+
+/*
+  Copy the parts of a batch reply directly into the user buffers of
+  the queries they belong to.
+*/
+static int obj_data_get_batch_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct hdr_obj_batch *hb = msg->private;
+        struct obj_batch_ent *ent, *ent_tab = msg->msg_data;
+        struct query_tran_entry *qte;
+        struct obj_data to, from;
+        char *data;
+        int i, err = 0;
+
+        memset(&to, 0, sizeof(to));
+        memset(&from, 0, sizeof(from));
+
+        data = (char *) (ent_tab + hb->num_ent);
+        for (i = 0; i < hb->num_ent; i++) {
+                ent = &ent_tab[i];
+                qte = qt_find(&dcg->qt, ent->qid);
+                if (!qte) {
+                        uloga("can not find transaction ID = %d.\n", ent->qid);
+                        err = -ENOENT;
+                }
+                else if (ent->num_de < 0) {
+                        qte->f_err = 1;
+                }
+                else {
+                        to.obj_desc = qte->q_obj;
+                        to.data = qte->data_ref;
+                        from.obj_desc = ent->odsc;
+                        from.data = data;
+                        ssd_copy(&to, &from);
+                }
+
+                if (ent->num_de >= 0)
+                        data += obj_data_size(&ent->odsc);
+                if (qte && ++qte->num_parts_rec == qte->size_od)
+                        qte->f_complete = 1;
+        }
+
+        free(hb);
+        free(msg->msg_data);
+        msg_buf_free(msg);
+
         if (err == 0)
                 return 0;
+        ERROR_TRACE();
+}
 
-        uloga("'%s()': failed with %d.\n", __func__, err);
-        return err;
+/*
+  RPC routine to receive the data for a batch of object parts.
+*/
+static int dcgrpc_obj_get_batch(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_batch *hbt, *hb = (struct hdr_obj_batch *) cmd->pad;
+        struct node_id *peer = dc_get_peer(dcg->dc, cmd->id);
+        struct msg_buf *msg;
+        void *buf;
+        int err = -ENOMEM;
+
+        buf = malloc(hb->size);
+        if (!buf)
+                goto err_out;
+
+        hbt = malloc(sizeof(*hb));
+        if (!hbt) {
+                free(buf);
+                goto err_out;
+        }
+        memcpy(hbt, hb, sizeof(*hb));
+
+        msg = msg_buf_alloc(rpc_s, peer, 0);
+        if (!msg) {
+                free(buf);
+                free(hbt);
+                goto err_out;
+        }
+
+        msg->msg_data = buf;
+        msg->size = hb->size;
+        msg->private = hbt;
+        msg->cb = obj_data_get_batch_completion;
+
+        rpc_mem_info_cache(peer, msg, cmd);
+        err = rpc_receive_direct(rpc_s, peer, msg);
+        rpc_mem_info_reset(peer, msg, cmd);
+        if (err == 0)
+                return 0;
+
+        free(buf);
+        free(hbt);
+        msg_buf_free(msg);
+ err_out:
+        ERROR_TRACE();
+}
+
+/*
+  Object put lazily: the servers only have its descriptor, and pull
+  the data from here when somebody reads it. It is held until then, or
+  until the server says it replaced the object, see dcgrpc_obj_pull().
+*/
+struct lazy_obj {
+        struct list_head        entry;
+        struct obj_data         *od;
+        /* Server the object was put to. */
+        int                     peer_id;
+};
+
+/*
+  Tell if variable 'name' is put lazily; DATASPACES_LAZY_PUT lists the
+  names of such variables separated by commas, or is "*" for all.
+*/
+static int dcg_is_lazy_put(const char *name)
+{
+        const char *s = dcg->lazy_vars, *e;
+        size_t len = strlen(name), n;
+
+        while (s && *s) {
+                e = strchr(s, ',');
+                n = (e)? (size_t) (e - s) : strlen(s);
+                if ((n == 1 && *s == '*') || (n == len && strncmp(s, name, n) == 0))
+                        return 1;
+                s = (e)? e + 1 : NULL;
+        }
+
+        return 0;
+}
+
+static int lazy_push_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        obj_data_free(msg->private);
+        msg_buf_free(msg);
+
+        dcg_dec_pending();
+        return 0;
+}
+
+/*
+  Send the data of lazy object 'od' to server 'peer', in answer to the
+  pull of server object 'ref', or as a flush if 'ref' is 0. A NULL
+  'od' answers that the data of 'odsc' is not here anymore.
+*/
+static int lazy_push(struct node_id *peer, struct obj_data *od,
+        const struct obj_descriptor *odsc, uint64_t ref)
+{
+        struct hdr_obj_put *hdr;
+        struct msg_buf *msg;
+        int err = -ENOMEM;
+
+        msg = msg_buf_alloc(dcg->dc->rpc_s, peer, 1);
+        if (!msg)
+                goto err_out;
+
+        msg->msg_rpc->cmd = ss_obj_put;
+        msg->msg_rpc->id = DCG_ID;
+
+        hdr = (struct hdr_obj_put *) msg->msg_rpc->pad;
+        hdr->odsc = *odsc;
+        hdr->ref = ref;
+        hdr->flags = obj_put_lost;
+        if (od) {
+                memcpy(&hdr->gdim, &od->gdim, sizeof(struct global_dimension));
+                hdr->flags = obj_put_pulled;
+
+                msg->msg_data = od->data;
+                msg->size = obj_data_size(&od->obj_desc);
+                msg->private = od;
+                msg->cb = lazy_push_completion;
+        }
+
+        err = rpc_send(dcg->dc->rpc_s, peer, msg);
+        if (err < 0) {
+                msg_buf_free(msg);
+                goto err_out;
+        }
+
+        if (od)
+                dcg_inc_pending();
+        return 0;
+ err_out:
+        if (od)
+                obj_data_free(od);
+        ERROR_TRACE();
+}
+
+/*
+  Rpc routine to answer an 'ss_obj_pull': send the data of an object
+  put lazily to the server that asks for it, and stop holding it. With
+  'obj_put_dropped' the server replaced the object instead, and the
+  data is released without an answer.
+*/
+static int dcgrpc_obj_pull(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_put *hdr = (struct hdr_obj_put *) cmd->pad;
+        struct node_id *peer = dc_get_peer(dcg->dc, cmd->id);
+        struct obj_data *od = NULL;
+        struct lazy_obj *lo;
+
+        /* The oldest match first, a server replaces objects in put order. */
+        list_for_each_entry(lo, &dcg->lazy_list, struct lazy_obj, entry) {
+                if (lo->peer_id == cmd->id &&
+                    lo->od->obj_desc.version == hdr->odsc.version &&
+                    obj_desc_equals_no_owner(&lo->od->obj_desc, &hdr->odsc)) {
+                        list_del(&lo->entry);
+                        od = lo->od;
+                        free(lo);
+                        break;
+                }
+        }
+
+        if (hdr->flags & obj_put_dropped) {
+                if (od)
+                        obj_data_free(od);
+                return 0;
+        }
+
+        return lazy_push(peer, od, &hdr->odsc, hdr->ref);
+}
+
+/*
+  Push the data of all objects still held to the servers, before this
+  client goes away.
+*/
+static void lazy_flush(void)
+{
+        struct lazy_obj *lo, *t;
+
+        list_for_each_entry_safe(lo, t, &dcg->lazy_list, struct lazy_obj, entry) {
+                list_del(&lo->entry);
+                lazy_push(dc_get_peer(dcg->dc, lo->peer_id), lo->od,
+                        &lo->od->obj_desc, 0);
+                free(lo);
+        }
+}
+
+/*
+  Variable the servers keep the value range of the objects for, see
+  dcg_define_summary().
+*/
+struct summary_var {
+        struct list_head        entry;
+        int                     elem_type;
+        char                    name[sizeof(((struct obj_descriptor *) 0)->name)];
+};
+
+static struct summary_var *summary_find(const char *name)
+{
+        struct summary_var *sv;
+
+        list_for_each_entry(sv, &dcg->summary_list, struct summary_var, entry) {
+                if (strcmp(sv->name, name) == 0)
+                        return sv;
+        }
+
+        return NULL;
+}
+
+static void summary_free(void)
+{
+        struct summary_var *sv, *t;
+
+        list_for_each_entry_safe(sv, t, &dcg->summary_list, struct summary_var, entry) {
+                list_del(&sv->entry);
+                free(sv);
+        }
+}
+
+/*
+  Ask the servers to keep the value range of every object put for
+  variable 'name' from now on, reading the elements as 'elem_type',
+  one of obj_filter_type.
+*/
+int dcg_define_summary(const char *name, int elem_type)
+{
+        struct summary_var *sv;
+
+        if (elem_type < filter_double || elem_type > filter_int64)
+                return -EINVAL;
+
+        sv = summary_find(name);
+        if (!sv) {
+                sv = malloc(sizeof(*sv));
+                if (!sv)
+                        return -ENOMEM;
+                strncpy(sv->name, name, sizeof(sv->name)-1);
+                sv->name[sizeof(sv->name)-1] = '\0';
+                list_add(&sv->entry, &dcg->summary_list);
+        }
+        sv->elem_type = elem_type;
+
+        return 0;
 }
 
 /*
@@ -1499,7 +2545,35 @@ static int obj_put_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
         (*msg->sync_op_id) = 1;
 
         obj_data_free(od);
-        free(msg);
+        msg_buf_free(msg);
+
+        dcg_dec_pending();
+        return 0;
+}
+
+/*
+  Complete a lazy 'dcg_obj_put()'; the object is held in 'lazy_list'
+  until a server pulls it.
+*/
+static int obj_put_lazy_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        (*msg->sync_op_id) = 1;
+
+        msg_buf_free(msg);
+
+        dcg_dec_pending();
+        return 0;
+}
+
+/*
+  Free resources after 'dcg_obj_put_batch()' inserts the objects.
+*/
+static int obj_put_batch_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        (*msg->sync_op_id) = 1;
+
+        free(msg->msg_data);
+        msg_buf_free(msg);
 
         dcg_dec_pending();
         return 0;
@@ -1583,6 +2657,11 @@ struct dcg_space *dcg_alloc(int num_nodes, int appid, void* comm)
         rpc_add_service(cp_lock, dcgrpc_lock_service);
         rpc_add_service(cn_timing, dcgrpc_time_log);
         rpc_add_service(ss_info, dcgrpc_ss_info);
+        rpc_add_service(ss_obj_get_desc_batch, dcgrpc_obj_get_desc_batch);
+        rpc_add_service(ss_obj_get_batch, dcgrpc_obj_get_batch);
+        rpc_add_service(ss_obj_pull, dcgrpc_obj_pull);
+        rpc_add_service(ss_obj_filter, dcgrpc_obj_filter);
+        rpc_add_service(ss_obj_get_summary, dcgrpc_obj_get_summary);
 #ifdef DS_HAVE_ACTIVESPACE
         rpc_add_service(ss_code_reply, dcgrpc_code_reply);
 #endif
@@ -1604,8 +2683,13 @@ struct dcg_space *dcg_alloc(int num_nodes, int appid, void* comm)
         }
 
         INIT_LIST_HEAD(&dcg_l->locks_list);
+        INIT_LIST_HEAD(&dcg_l->lazy_list);
+        dcg_l->lazy_vars = getenv("DATASPACES_LAZY_PUT");
+        INIT_LIST_HEAD(&dcg_l->summary_list);
+        INIT_LIST_HEAD(&dcg_l->sspace_list);
         init_gdim_list(&dcg_l->gdim_list);    
         qc_init(&dcg_l->qc);
+        rc_init(&dcg_l->rc);
         dcg_l->hash_version = ssd_hash_version_v1; // set default hash version
 
 #ifdef TIMING_PERF
@@ -1631,13 +2715,17 @@ void dcg_free(struct dcg_space *dcg)
         uloga("'%s()': num pending = %d.\n", __func__, dcg->num_pending);
 #endif
 
+	lazy_flush();
 	while (dcg->num_pending)
 	      dc_process(dcg->dc);
 
     dc_free(dcg->dc);
     qc_free(&dcg->qc);
+    rc_free(&dcg->rc);
 
 	lock_free();
+        summary_free();
+        dcg_free_sspace();
 
     free_gdim_list(&dcg->gdim_list);
     free(dcg);
@@ -1650,42 +2738,143 @@ int dcg_obj_put(struct obj_data *od)
         struct msg_buf *msg;
         struct node_id *peer;
         struct hdr_obj_put *hdr; 
+        struct lazy_obj *lo = NULL;
+        struct summary_var *sv;
         int sync_op_id;
         int err = -ENOMEM;
 
-        if (flag_set_mpi_rank) {
-            int peer_id = mpi_rank % dcg->dc->num_sp;
-            peer = dc_get_peer(dcg->dc, peer_id);
-        } else {
-            peer = dcg_which_peer();
-        }
+        peer = dcg_which_put_peer();
 
         sync_op_id = syncop_next();
 
+        rc_evict(&dcg->rc, &od->obj_desc, 1);
+
+        if (dcg_is_lazy_put(od->obj_desc.name)) {
+                lo = malloc(sizeof(*lo));
+                if (!lo)
+                        goto err_out;
+        }
+
+        msg = msg_buf_alloc(dcg->dc->rpc_s, peer, 1);
+        if (!msg) {
+                free(lo);
+                goto err_out;
+        }
+
+        /* A lazy put sends only the descriptor and keeps the data. */
+        if (lo) {
+                msg->cb = obj_put_lazy_completion;
+        }
+        else {
+                msg->msg_data = od->data;
+                msg->size = obj_data_size(&od->obj_desc);
+                msg->cb = obj_put_completion;
+        }
+        msg->private = od;
+
+        msg->sync_op_id = syncop_ref(sync_op_id);
+
+        msg->msg_rpc->cmd = ss_obj_put;
+        msg->msg_rpc->id = DCG_ID; // dcg->dc->self->id;
+
+        hdr = msg->msg_rpc->pad;
+        hdr->odsc = od->obj_desc;
+        memcpy(&hdr->gdim, &od->gdim, sizeof(struct global_dimension));
+        hdr->flags = (lo)? obj_put_lazy : 0;
+        sv = summary_find(od->obj_desc.name);
+        if (sv) {
+                hdr->flags |= obj_put_summary;
+                hdr->elem_type = sv->elem_type;
+        }
+
+        uloga("%s(Yubo): before rpc_send timestamp: %f\n", __func__, timer_timestamp_1());
+
+
+        err = rpc_send(dcg->dc->rpc_s, peer, msg);
+        if (err < 0) {
+                free(lo);
+                msg_buf_free(msg);
+                goto err_out;
+        }
+
+        if (lo) {
+                lo->od = od;
+                lo->peer_id = peer->ptlmap.id;
+                list_add_tail(&lo->entry, &dcg->lazy_list);
+        }
+
+        dcg_inc_pending();
+
+        return sync_op_id;
+ err_out:
+        uloga("'%s()': failed with %d.\n", __func__, err);
+        return err;
+}
+
+/*
+  Insert a batch of objects in the space with a single request; the
+  descriptors and data are packed in one buffer, so the objects and
+  their data can be released as soon as this routine returns.
+*/
+int dcg_obj_put_batch(struct obj_data *od_tab[], int num_od)
+{
+        struct obj_batch_ent *ent_tab;
+        struct hdr_obj_batch *hb;
+        struct msg_buf *msg;
+        struct node_id *peer;
+        uint64_t size;
+        char *buf, *data;
+        int sync_op_id, i;
+        int err = -ENOMEM;
+
+        size = sizeof(*ent_tab) * num_od;
+        for (i = 0; i < num_od; i++)
+                size += obj_data_size(&od_tab[i]->obj_desc);
+
+        buf = malloc(size);
+        if (!buf)
+                goto err_out;
+
+        ent_tab = (struct obj_batch_ent *) buf;
+        data = buf + sizeof(*ent_tab) * num_od;
+        for (i = 0; i < num_od; i++) {
+                ent_tab[i].qid = -1;
+                ent_tab[i].num_de = 0;
+                ent_tab[i].odsc = od_tab[i]->obj_desc;
+                memcpy(&ent_tab[i].gdim, &od_tab[i]->gdim,
+                        sizeof(struct global_dimension));
+
+                memcpy(data, od_tab[i]->data, obj_data_size(&od_tab[i]->obj_desc));
+                data += obj_data_size(&od_tab[i]->obj_desc);
+
+                rc_evict(&dcg->rc, &od_tab[i]->obj_desc, 1);
+        }
+
+        peer = dcg_which_put_peer();
         msg = msg_buf_alloc(dcg->dc->rpc_s, peer, 1);
-        if (!msg)
+        if (!msg) {
+                free(buf);
                 goto err_out;
+        }
 
-        msg->msg_data = od->data;
-        msg->size = obj_data_size(&od->obj_desc);
-        msg->cb = obj_put_completion;
-        msg->private = od;
+        sync_op_id = syncop_next();
 
+        msg->msg_data = buf;
+        msg->size = size;
+        msg->cb = obj_put_batch_completion;
         msg->sync_op_id = syncop_ref(sync_op_id);
 
-        msg->msg_rpc->cmd = ss_obj_put;
-        msg->msg_rpc->id = DCG_ID; // dcg->dc->self->id;
-
-        hdr = msg->msg_rpc->pad;
-        hdr->odsc = od->obj_desc;
-        memcpy(&hdr->gdim, &od->gdim, sizeof(struct global_dimension));
-
-        uloga("%s(Yubo): before rpc_send timestamp: %f\n", __func__, timer_timestamp_1());
+        msg->msg_rpc->cmd = ss_obj_put_batch;
+        msg->msg_rpc->id = DCG_ID;
 
+        hb = (struct hdr_obj_batch *) msg->msg_rpc->pad;
+        hb->num_ent = num_od;
+        hb->size = size;
 
         err = rpc_send(dcg->dc->rpc_s, peer, msg);
         if (err < 0) {
-                free(msg);
+                free(buf);
+                msg_buf_free(msg);
                 goto err_out;
         }
 
@@ -1693,8 +2882,7 @@ int dcg_obj_put(struct obj_data *od)
 
         return sync_op_id;
  err_out:
-        uloga("'%s()': failed with %d.\n", __func__, err);
-        return err;
+        ERROR_TRACE();
 }
 
 /* 
@@ -1758,13 +2946,7 @@ int dcg_obj_cq_update(int cq_id)
         }
         qte->f_complete = 0;
 
-	/*
-        // TODO: do I need more fields here ?!
-        od.data = qte->data_ref;
-        od.obj_desc = qte->q_obj;
-
-        err = dcg_obj_assemble(qte, &od);
-	*/
+        /* Parts were copied into 'qte->data_ref' as they arrived. */
         qt_free_obj_data(qte, 1);
 
         if (!list_empty(&qte->od_list)) {
@@ -1784,6 +2966,26 @@ int dcg_obj_cq_update(int cq_id)
         ERROR_TRACE();
 }
 
+/*
+  Check without blocking if put operation 'sync_op_id' is complete.
+*/
+int dcg_obj_sync_test(int sync_op_id, int *flag)
+{
+        int *sync_op_ref = syncop_ref(sync_op_id);
+        int err;
+
+        if (sync_op_ref[0] != 1) {
+                err = dc_process(dcg->dc);
+                if (err < 0) {
+                        uloga("'%s()': failed with %d.\n", __func__, err);
+                        return err;
+                }
+        }
+
+        *flag = (sync_op_ref[0] == 1);
+        return 0;
+}
+
 int dcg_obj_sync(int sync_op_id)
 {
         int *sync_op_ref = syncop_ref(sync_op_id);
@@ -1865,8 +3067,12 @@ err_out:
 }
 
 /*
+  Locate the parts of object 'od' and post the data requests for
+  them, but do not wait for the data. Returns the transaction id to be
+  passed to dcg_obj_get_test() or dcg_obj_get_wait(); the result is
+  assembled into 'od->data', which should remain valid until then.
 */
-int dcg_obj_get(struct obj_data *od)
+int dcg_obj_get_nb(struct obj_data *od)
 {
         struct query_tran_entry *qte;
         const struct query_cache_entry *qce;
@@ -1882,6 +3088,13 @@ int dcg_obj_get(struct obj_data *od)
 
         qt_add(&dcg->qt, qte);
 
+        /* A region of a cached version completes right away. */
+        if (rc_get(&dcg->rc, od)) {
+                qte->f_complete = 1;
+                qte->f_cached = 1;
+                return qte->q_id;
+        }
+
         versions_reset();
 
         // TODO:  I have  intentionately  disabled the  cache here.  I
@@ -1919,7 +3132,7 @@ int dcg_obj_get(struct obj_data *od)
         tm_end = timer_read(&tm_perf);
         uloga("TIMING_PERF locate_data ts %d peer %d time %lf %s\n",
             od->obj_desc.version, dcg_get_rank(dcg), tm_end-tm_st, log_header);
-        tm_st = tm_end;
+        qte->tm_st = tm_end;
 #endif
 
         err = dcg_obj_data_get(qte);
@@ -1929,9 +3142,97 @@ int dcg_obj_get(struct obj_data *od)
                 goto err_data_free; // err_out;
         }
 
-        /* The request send succeeds, we can post the transaction to
-           the list. */
+        /* The request send succeeds, the transaction stays in the
+           list until the caller completes it. */
+        return qte->q_id;
+ out_no_data:
+        qt_free_obj_data(qte, 1);
+        qt_remove(&dcg->qt, qte);
+        free(qte);
+
+        return err;
+ err_data_free:
+        qt_free_obj_data(qte, 1);
+ err_qt_free:
+        qt_remove(&dcg->qt, qte);
+        free(qte);
+ err_out:
+        ERROR_TRACE();
+}
+
+/*
+  Release a completed 'dcg_obj_get_nb()' transaction.
+*/
+static int dcg_obj_get_finish(struct query_tran_entry *qte)
+{
+        int err = -ENODATA;
+
+        /* Parts are copied into the user buffer as they arrive. */
+        if (qte->f_complete) {
+                err = 0;
+                if (dcg->rc.max_size && !qte->f_cached)
+                        rc_add(&dcg->rc, &qte->q_obj, qte->data_ref);
+#ifdef TIMING_PERF
+                uloga("TIMING_PERF fetch_data ts %d peer %d time %lf %s\n",
+                    qte->q_obj.version, dcg_get_rank(dcg),
+                    timer_read(&tm_perf)-qte->tm_st, log_header);
+#endif
+        }
+
+        qt_free_obj_data(qte, 1);
+        qt_remove(&dcg->qt, qte);
+        qte_free(qte);
+
+        return err;
+}
+
+/*
+  Check without blocking if transaction 'q_id' is complete; '*flag' is
+  set to 1 and the transaction is released if it is.
+*/
+int dcg_obj_get_test(int q_id, int *flag)
+{
+        struct query_tran_entry *qte;
+        int err;
+
+        *flag = 0;
+        qte = qt_find(&dcg->qt, q_id);
+        if (!qte) {
+                uloga("'%s()': can not find transaction ID = %d.\n", 
+                        __func__, q_id);
+                return -ENOENT;
+        }
+
+        if (!qte->f_complete) {
+                err = dc_process(dcg->dc);
+                if (err < 0) {
+                        uloga("'%s()': error %d.\n", __func__, err);
+                        *flag = 1;
+                        dcg_obj_get_finish(qte);
+                        return err;
+                }
+                if (!qte->f_complete)
+                        return 0;
+        }
+
+        *flag = 1;
+        return dcg_obj_get_finish(qte);
+}
+
+/*
+  Block until transaction 'q_id' completes and release it.
+*/
+int dcg_obj_get_wait(int q_id)
+{
+        struct query_tran_entry *qte;
+        int err;
 
+        qte = qt_find(&dcg->qt, q_id);
+        if (!qte) {
+                uloga("'%s()': can not find transaction ID = %d.\n", 
+                        __func__, q_id);
+                return -ENOENT;
+        }
 
         /* Wait for transaction to complete. */
         while (! qte->f_complete) {
@@ -1942,32 +3243,212 @@ int dcg_obj_get(struct obj_data *od)
                 }
         }
 
-        if (!qte->f_complete) {
-                // !qte->num_req || qte->num_reply != qte->num_od) {
-                /* Object is not complete, not all parts
-                   successfull. */
-                // qt_free_obj_data(qte, 1);
-                err = -ENODATA;
-                goto out_no_data;
+        /* An incomplete object (not all parts successful) is
+           reported as -ENODATA. */
+        return dcg_obj_get_finish(qte);
+}
+
+/*
+*/
+int dcg_obj_get(struct obj_data *od)
+{
+        int q_id;
+
+        q_id = dcg_obj_get_nb(od);
+        if (q_id < 0)
+                return q_id;
+
+        return dcg_obj_get_wait(q_id);
+}
+
+/*
+  Retrieve every stride[i]-th point of the region of 'od', starting
+  at its lower corner, into 'od->data'. The servers select the points
+  before sending, so only the reduced parts travel; they are not kept
+  in the read cache.
+*/
+int dcg_obj_get_strided(struct obj_data *od, const uint64_t *stride)
+{
+        struct query_tran_entry *qte;
+        int i, err = -ENOMEM;
+
+        qte = qte_alloc(od, 1);
+        if (!qte)
+                goto err_out;
+        qt_add(&dcg->qt, qte);
+
+        qte->f_strided = 1;
+        for (i = 0; i < od->obj_desc.bb.num_dims; i++) {
+                qte->q_lb.c[i] = od->obj_desc.bb.lb.c[i];
+                qte->stride.c[i] = stride[i];
         }
 
-        err = dcg_obj_assemble(qte, od);
-#ifdef TIMING_PERF
-        tm_end = timer_read(&tm_perf);
-        uloga("TIMING_PERF fetch_data ts %d peer %d time %lf %s\n",
-            od->obj_desc.version, dcg_get_rank(dcg), tm_end-tm_st, log_header);
-#endif 
- out_no_data:
+        versions_reset();
+
+        err = get_dht_peers(qte);
+        if (err < 0)
+                goto err_qt_free;
+        DC_WAIT_COMPLETION(qte->f_peer_received == 1);
+
+        err = get_obj_descriptors(qte);
+        if (err < 0)
+                goto err_qt_free;
+        DC_WAIT_COMPLETION(qte->f_odsc_recv == 1);
+
+        err = -EAGAIN;
+        if (qte->f_err != 0)
+                goto err_qt_free;
+
+        qt_set_strided(qte);
+        if (qte->size_od == 0)
+                qte->f_complete = 1;
+
+        err = dcg_obj_data_get(qte);
+        if (err < 0)
+                goto err_qt_free;
+        DC_WAIT_COMPLETION(qte->f_complete == 1);
+        err = 0;
+
+ err_qt_free:
         qt_free_obj_data(qte, 1);
         qt_remove(&dcg->qt, qte);
-        free(qte);
+        qte_free(qte);
+        if (err == 0 || err == -EAGAIN)
+                return err;
+ err_out:
+        ERROR_TRACE();
+}
+
+/*
+  Value-range query: find the parts of the region of 'od' whose objects
+  may hold values in [lo, hi], from the value ranges kept in the DHT;
+  parts of objects without a range always match. The first 'max_bb'
+  matching parts go to 'bb_tab', and if 'f_data' is set their data is
+  copied into 'od->data', leaving the rest of it untouched. Returns
+  the number of matching parts.
+*/
+int dcg_obj_get_range(struct obj_data *od, double lo, double hi, int f_data,
+                      struct bbox *bb_tab, int max_bb)
+{
+        struct query_tran_entry *qte;
+        struct obj_data *odp, *t;
+        int n = 0, err = -ENOMEM;
+
+        qte = qte_alloc(od, 1);
+        if (!qte)
+                goto err_out;
+        qt_add(&dcg->qt, qte);
+
+        err = get_dht_peers(qte);
+        if (err < 0)
+                goto err_qt_free;
+        DC_WAIT_COMPLETION(qte->f_peer_received == 1);
+
+        err = get_obj_summaries(qte);
+        if (err < 0)
+                goto err_qt_free;
+        DC_WAIT_COMPLETION(qte->f_odsc_recv == 1);
+
+        list_for_each_entry_safe(odp, t, &qte->od_list, struct obj_data, obj_entry) {
+                if (odp->sum.f_valid && (odp->sum.max < lo || odp->sum.min > hi)) {
+                        qt_remove_obj(qte, odp);
+                        continue;
+                }
+                if (n < max_bb)
+                        bb_tab[n] = odp->obj_desc.bb;
+                n++;
+        }
+
+        if (f_data && n > 0) {
+                err = dcg_obj_data_get(qte);
+                if (err < 0)
+                        goto err_qt_free;
+                DC_WAIT_COMPLETION(qte->f_complete == 1);
+        }
+        err = n;
 
-        return err;
- err_data_free:
-        qt_free_obj_data(qte, 1);
  err_qt_free:
+        qt_free_obj_data(qte, 1);
         qt_remove(&dcg->qt, qte);
-        free(qte);
+        qte_free(qte);
+        if (err >= 0)
+                return err;
+ err_out:
+        ERROR_TRACE();
+}
+
+/*
+  Retrieve a batch of objects. The DHT peers are computed locally,
+  and the queries and data requests are grouped so that each server
+  receives at most one descriptor request and one data request for
+  the whole batch. Parts are copied straight into 'od_tab[i]->data'.
+*/
+int dcg_obj_get_batch(struct obj_data *od_tab[], int num_od)
+{
+        struct query_tran_entry **qte_tab;
+        struct query_tran_entry *qte;
+        int posted[num_od];
+        int i, ret = 0;
+        int err = -ENOMEM;
+
+        qte_tab = malloc(sizeof(*qte_tab) * num_od);
+        if (!qte_tab)
+                goto err_out;
+        memset(qte_tab, 0, sizeof(*qte_tab) * num_od);
+
+        versions_reset();
+
+        for (i = 0; i < num_od; i++) {
+                posted[i] = 0;
+                qte = qte_alloc(od_tab[i], 0);
+                if (!qte)
+                        goto err_qt_free;
+                qt_add(&dcg->qt, qte);
+                qte_tab[i] = qte;
+
+                err = qte_set_dht_peers(qte);
+                if (err < 0)
+                        goto err_qt_free;
+        }
+
+        err = get_obj_descriptors_batch(qte_tab, num_od);
+        if (err < 0)
+                goto err_qt_free;
+        for (i = 0; i < num_od; i++)
+                DC_WAIT_COMPLETION(qte_tab[i]->f_odsc_recv == 1);
+
+        for (i = 0; i < num_od; i++) {
+                qte = qte_tab[i];
+                if (qte->f_err)
+                        continue;
+                posted[i] = 1;
+                if (qte->size_od == 0)
+                        qte->f_complete = 1;
+        }
+
+        err = obj_data_get_batch(qte_tab, num_od);
+        if (err < 0)
+                goto err_qt_free;
+        for (i = 0; i < num_od; i++) {
+                if (posted[i])
+                        DC_WAIT_COMPLETION(qte_tab[i]->f_complete == 1);
+        }
+
+        for (i = 0; i < num_od; i++) {
+                if (qte_tab[i]->f_err)
+                        ret = -EAGAIN;
+        }
+        err = ret;
+
+ err_qt_free:
+        for (i = 0; i < num_od && qte_tab[i]; i++) {
+                qt_free_obj_data(qte_tab[i], 1);
+                qt_remove(&dcg->qt, qte_tab[i]);
+                qte_free(qte_tab[i]);
+        }
+        free(qte_tab);
+        if (err == 0 || err == -EAGAIN)
+                return err;
  err_out:
         ERROR_TRACE();
 }
@@ -1985,52 +3466,60 @@ int dcg_get_versions(int **p_version)
 }
 
 /*
-  Routine to implement the "custom" filters, e.g., min, max, avg, sum.
+  Routine to implement the "custom" filters, e.g., min, max, avg, sum:
+  run reduction 'spec' over the region of 'od' in the servers and
+  return the merged result in 'res'.
 */
-int dcg_obj_filter(struct obj_data *od)
+int dcg_obj_filter(struct obj_data *od, const struct obj_filter_spec *spec,
+                   struct obj_filter_res *res)
 {
         struct query_tran_entry *qte;
         const struct query_cache_entry *qce;
         int err = -ENOMEM;
 
-        qte = qte_alloc(od, 1);
+        qte = qte_alloc(od, 0);
         if (!qte)
                 goto err_out;
-        // DELETE: qt_set(qte, od);
+        qte->data_ref = res;
         qt_add(&dcg->qt, qte);
 
         qce = qc_find(&dcg->qc, &od->obj_desc);
         if (qce) {
                 err = qte_set_odsc_from_cache(qte, qce);
-                if (err < 0) {
-                        free(qte);
-                        goto err_out;
-                }
+                if (err < 0)
+                        goto err_qt_free;
         }
         else {
                 err = get_dht_peers(qte);
                 if (err < 0)
-                        goto err_out;
+                        goto err_qt_free;
                 DC_WAIT_COMPLETION(qte->f_peer_received == 1);
 
                 err = get_obj_descriptors(qte);
                 if (err < 0)
-                        goto err_out;
+                        goto err_qt_free;
                 DC_WAIT_COMPLETION(qte->f_odsc_recv == 1);
         }
 
-        err = obj_filter_init(qte);
+        err = -ENOENT;
+        if (qte->num_od == 0)
+                goto err_qt_free;
+
+        err = obj_filter_init(qte, spec);
         if (err < 0)
-                goto err_out;
+                goto err_qt_free;
         DC_WAIT_COMPLETION(qte->f_complete == 1);
 
-        err = obj_filter_reduce(qte, od);
+        err = res->rc;
+        if (err == 0 && res->count == 0)
+                err = -ENOENT;
 
+ err_qt_free:
         qt_free_obj_data(qte, 1);
         qt_remove(&dcg->qt, qte);
-        free(qte);
-
-        return err;
+        qte_free(qte);
+        if (err == 0)
+                return 0;
  err_out:
         ERROR_TRACE();
 }
@@ -2136,6 +3625,9 @@ int dcg_remove(const char *var_name, unsigned int ver)
 {
 	int err = -ENOMEM;
 	int i;
+
+	rc_remove(&dcg->rc, var_name, ver);
+
 	for(i=0; i <dcg->dc->num_sp;i++){
 	        struct node_id *peer;
 	        struct msg_buf *msg;
@@ -2158,7 +3650,7 @@ int dcg_remove(const char *var_name, unsigned int ver)
 
 	        err = rpc_send(dcg->dc->rpc_s, peer, msg);
 	        if (err < 0) {
-        	        free(msg);
+        	        msg_buf_free(msg);
                 	goto err_out;
 	        }
 	}
@@ -2171,6 +3663,36 @@ int dcg_remove(const char *var_name, unsigned int ver)
 
 
 
+/*
+  Barrier of the lock routines, on 'comm' or on the whole application
+  if it is NULL. With lazy puts enabled, a client keeps answering pulls
+  in the barrier, as the lock may wait for readers that wait for data
+  it holds. All ranks must take the same path, since a blocking and a
+  nonblocking barrier do not match.
+*/
+static int dcg_lock_barrier(void *comm)
+{
+	MPI_Request req;
+	int flag = 0, err;
+
+	if (comm == NULL)
+		return dc_barrier(dcg->dc);
+
+	if (!dcg->lazy_vars) {
+		err = MPI_Barrier(*(MPI_Comm *)comm);
+		return (err == MPI_SUCCESS)? 0 : -EIO;
+	}
+
+	err = MPI_Ibarrier(*(MPI_Comm *)comm, &req);
+	while (err == MPI_SUCCESS && !flag) {
+		if (dc_process(dcg->dc) < 0)
+			return -EIO;
+		err = MPI_Test(&req, &flag, MPI_STATUS_IGNORE);
+	}
+
+	return (err == MPI_SUCCESS)? 0 : -EIO;
+}
+
 int dcg_lock_on_read(const char *lock_name, void *comm)
 {
 	struct dcg_lock *lock;
@@ -2203,16 +3725,9 @@ int dcg_lock_on_read(const char *lock_name, void *comm)
 	}
 
 
-	if(comm == NULL){
-		err = dc_barrier(dcg->dc);
-		if (err == 0)
-			return 0;
-	}
-	else{
-		err = MPI_Barrier(*(MPI_Comm *)comm);
-		if(err == MPI_SUCCESS)
-			return 0;
-	}
+	err = dcg_lock_barrier(comm);
+	if (err == 0)
+		return 0;
 
  err_out:
 	ERROR_TRACE();
@@ -2228,16 +3743,9 @@ int dcg_unlock_on_read(const char *lock_name, void *comm)
 	if (!lock)
 		goto err_out;
 
-	if(comm == NULL){
-		err = dc_barrier(dcg->dc);
-		if (err < 0)
-			goto err_out;
-	}
-	else{
-		err = MPI_Barrier(*(MPI_Comm *)comm);
-		if(err != MPI_SUCCESS)
-			goto err_out;
-	}
+	err = dcg_lock_barrier(comm);
+	if (err < 0)
+		goto err_out;
 
 	if (comm == NULL) {
 		myid = DCG_ID;
@@ -2289,16 +3797,9 @@ int dcg_lock_on_write(const char *lock_name, void *comm)
 		}
 	}
 
-	if(comm == NULL){
-		err = dc_barrier(dcg->dc);
-		if (err == 0)
-			return 0;
-	}
-	else{
-		err = MPI_Barrier(*(MPI_Comm *)comm);
-		if(err == MPI_SUCCESS)
-			return 0;
-	}
+	err = dcg_lock_barrier(comm);
+	if (err == 0)
+		return 0;
 
  err_out:
 	ERROR_TRACE();
@@ -2314,16 +3815,9 @@ int dcg_unlock_on_write(const char *lock_name, void *comm)
 	if (!lock)
 		goto err_out;
 
-	if(comm == NULL){
-		err = dc_barrier(dcg->dc);
-		if (err < 0)
-			goto err_out;
-	}
-	else{
-		err = MPI_Barrier(*(MPI_Comm *)comm);
-		if(err != MPI_SUCCESS)
-			goto err_out;
-	}
+	err = dcg_lock_barrier(comm);
+	if (err < 0)
+		goto err_out;
 
 	if (comm == NULL) {
 		myid = DCG_ID;
@@ -2382,7 +3876,7 @@ dcg_code_rexec_at_peers(const void *fn_addr, int size, int off,
 
 		err = rpc_send(dcg->dc->rpc_s, peer, msg);
 		if (err < 0) {
-			free(msg);
+			msg_buf_free(msg);
 			goto err_out;
 		}
 	}
@@ -67,6 +67,9 @@ static struct timer tm_perf;
 #define RPC_SERVER_PTR dimes_c->dcg->dc->rpc_s 
 // Return number of servers.
 #define NUM_SERVER dimes_c->dcg->dc->num_sp
+// Defaults of the read cost model, see plan_fetch_as_slab().
+#define DIMES_DEFAULT_READ_OVERHEAD 4096
+#define DIMES_DEFAULT_READ_WASTE 1.0
 
 /* Forward declarations. */
 static int dimes_memory_free(struct dart_rdma_mem_handle *rdma_hndl);
@@ -274,6 +277,18 @@ static struct dimes_storage_group* storage_lookup_group(const char *group_name)
 	return NULL;
 } 
 
+// Number of objects retired by all servers they were put to, and not
+// freed yet: these come back once their readers are done.
+static int num_obj_retired = 0;
+
+static void storage_free_obj(struct dimes_memory_obj *p)
+{
+    if (p->num_retired == p->num_put) num_obj_retired--;
+    dimes_memory_free(&p->rdma_handle);
+    list_del(&p->entry);
+    free(p);
+}
+
 // Deallocate a group.
 static int storage_free_group(struct dimes_storage_group *group)
 {
@@ -282,9 +297,7 @@ static int storage_free_group(struct dimes_storage_group *group)
     for (i = 0; i < dimes_c->dcg->max_versions; i++) {
         list_for_each_entry_safe(p, t, &group->version_tab[i],
                     struct dimes_memory_obj, entry) {
-            dimes_memory_free(&p->rdma_handle);
-            list_del(&p->entry);
-            free(p);            
+            storage_free_obj(p);
         }
     }
 
@@ -339,6 +352,55 @@ static struct dimes_memory_obj* storage_lookup_obj(const struct dimes_obj_id *oi
 	return NULL;
 }
 
+/*
+    Objects are also freed without a sync. A put retires, on the
+    servers, the locations of older objects it overlaps, and each such
+    server sends the owner a dimes_obj_retire_msg. A server drops a
+    retired location once the readers it handed it to have acked it,
+    and sends the owner a dimes_obj_release_msg. The object is freed
+    when all servers it was put to have released it, so writers keep
+    only about max_versions versions of a region in the RDMA buffer,
+    even if they never call dimes_put_sync_*(). An object that only
+    some of its servers retired stays until a sync.
+*/
+// Callback function for 'dimes_obj_retire_msg' message.
+static int dcgrpc_dimes_obj_retire(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+    struct hdr_dimes_ack *hdr = (struct hdr_dimes_ack *)cmd->pad;
+    struct dimes_obj_id obj_id = hdr->obj_id;
+    struct dimes_memory_obj *mem_obj = storage_lookup_obj(&obj_id,
+                                                   hdr->odsc.version);
+    if (!mem_obj) {
+        // Already freed by a sync
+        return 0;
+    }
+
+    if (++mem_obj->num_retired == mem_obj->num_put) num_obj_retired++;
+    return 0;
+}
+
+// Callback function for 'dimes_obj_release_msg' message.
+static int dcgrpc_dimes_obj_release(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+    struct hdr_dimes_ack *hdr = (struct hdr_dimes_ack *)cmd->pad;
+    struct dimes_obj_id obj_id = hdr->obj_id;
+    struct dimes_memory_obj *mem_obj = storage_lookup_obj(&obj_id,
+                                                   hdr->odsc.version);
+    if (!mem_obj) {
+        // Already freed by a sync
+        return 0;
+    }
+
+    if (++mem_obj->num_released >= mem_obj->num_put) {
+#ifdef DEBUG
+        uloga("%s(): peer %d frees obj %u version %d.\n", __func__,
+            DIMES_CID, mem_obj->obj_id.local_obj_index, hdr->odsc.version);
+#endif
+        storage_free_obj(mem_obj);
+    }
+    return 0;
+}
+
 static int dimes_memory_init()
 {
     void *data_buf = NULL;
@@ -587,40 +649,106 @@ static void qt_remove_d(struct query_tran_d *qt, struct query_tran_entry_d *qte)
 	qt->num_entry--;
 }
 
-static struct obj_descriptor *
+static struct fetch_entry *
 qt_find_obj_d(struct query_tran_entry_d *qte, struct obj_descriptor *odsc)
 {
-	struct obj_data_wrapper *od_w;
-	struct obj_data *od;
     struct fetch_entry *fetch;
 
     list_for_each_entry(fetch, &qte->fetch_list, struct fetch_entry, entry)
     {
         if (obj_desc_equals(&fetch->dst_odsc, odsc)) {
-            return &fetch->dst_odsc;
+            return fetch;
         }
     }
 
 	return NULL;
 }
 
+// Record that server 'server_id' handed us the location of 'fetch'.
+static int fetch_add_server(struct fetch_entry *fetch, int server_id)
+{
+    int *tab = realloc(fetch->server_tab, sizeof(int) * (fetch->num_server + 1));
+    if (!tab) return -ENOMEM;
+    fetch->server_tab = tab;
+    fetch->server_tab[fetch->num_server++] = server_id;
+    return 0;
+}
+
+// Tell server 'server_id' that we are done with the location of object
+// 'oid' it handed us, see dcgrpc_dimes_obj_release().
+static void send_read_ack(int server_id, const struct dimes_obj_id *oid,
+                          const struct obj_descriptor *odsc)
+{
+    struct node_id *peer = dc_get_peer(DART_CLIENT_PTR, server_id);
+    struct hdr_dimes_ack *hdr;
+    struct msg_buf *msg;
+
+    msg = msg_buf_alloc(RPC_SERVER_PTR, peer, 1);
+    if (!msg) {
+        uloga("%s(): ERROR failed to allocate message.\n", __func__);
+        return;
+    }
+    msg->msg_rpc->cmd = dimes_obj_read_ack_msg;
+    msg->msg_rpc->id = DIMES_CID;
+    hdr = (struct hdr_dimes_ack *)msg->msg_rpc->pad;
+    hdr->obj_id = *oid;
+    hdr->odsc = *odsc;
+    if (rpc_send(RPC_SERVER_PTR, peer, msg) < 0) {
+        uloga("%s(): ERROR failed to send to peer #%d.\n",
+            __func__, peer->ptlmap.id);
+        msg_buf_free(msg);
+    }
+}
+
+// Ack the locations of the table 'tab' of 'num_obj' entries, handed by
+// server 'server_id', that are not part of any fetch.
+static void send_read_acks_tab(int server_id, struct rpc_cmd *tab, int num_obj)
+{
+    int i;
+
+    for (i = 0; i < num_obj; i++) {
+        struct hdr_dimes_put *hdr = (struct hdr_dimes_put*)tab[i].pad;
+        struct dimes_obj_id obj_id = hdr->obj_id;
+        struct obj_descriptor odsc = hdr->odsc;
+        send_read_ack(server_id, &obj_id, &odsc);
+    }
+}
+
+// Tell the servers that located the objects of 'qte' that we are done
+// with them.
+static void qt_send_read_acks_d(struct query_tran_entry_d *qte)
+{
+    struct fetch_entry *fetch;
+    int i;
+
+    list_for_each_entry(fetch, &qte->fetch_list, struct fetch_entry, entry)
+    {
+        for (i = 0; i < fetch->num_server; i++) {
+            send_read_ack(fetch->server_tab[i], &fetch->remote_obj_id,
+                          &fetch->src_odsc);
+        }
+    }
+}
+
 /*
     Release memory resources for fetch_list 
 */
 static void qt_free_obj_data_d(struct query_tran_entry_d *qte)
 {
     struct fetch_entry *fetch, *t;
+    qt_send_read_acks_d(qte);
     list_for_each_entry_safe(fetch,t,&qte->fetch_list,struct fetch_entry,entry)
     {
         dart_rdma_delete_read_tran(fetch->read_tran->tran_id);
         list_del(&fetch->entry);
+        free(fetch->server_tab);
         free(fetch);
         qte->num_fetch--;       
     }
 }
 
 static int qt_add_obj_with_cmd_d(struct query_tran_entry_d *qte,
-                struct obj_descriptor *odsc, struct rpc_cmd *cmd)
+                struct obj_descriptor *odsc, struct rpc_cmd *cmd, int server_id)
 {
     struct hdr_dimes_put *hdr = (struct hdr_dimes_put*)cmd->pad;
     struct node_id *peer;
@@ -637,6 +765,13 @@ static int qt_add_obj_with_cmd_d(struct query_tran_entry_d *qte,
     fetch->remote_obj_id = hdr->obj_id;
     fetch->src_odsc = hdr->odsc;
     fetch->dst_odsc = *odsc;
+    fetch->server_tab = NULL;
+    fetch->num_server = 0;
+    if (fetch_add_server(fetch, server_id) < 0) {
+        dart_rdma_delete_read_tran(fetch->read_tran->tran_id);
+        free(fetch);
+        return -ENOMEM;
+    }
 
     // Set source rdma memory handle
     dart_rdma_get_memregion_from_cmd(&fetch->read_tran->src, cmd);
@@ -679,6 +814,16 @@ static int obj_assemble(struct fetch_entry *fetch, struct obj_data *od)
     return err;
 }
 
+// Count a location reply of 'qte' that could not be used: the get
+// fails once all replies are in.
+static void qte_locate_data_failed_d(struct query_tran_entry_d *qte)
+{
+	qte->f_err = 1;
+	if (qte->qh->qh_num_req_received == qte->qh->qh_num_req_posted) {
+		qte->f_locate_data_complete = 1;
+	}
+}
+
 // Callback function that invoked when the client succesfully transfers
 // the data location information from server.
 static int locate_data_completion_client(struct rpc_server *rpc_s,
@@ -686,13 +831,14 @@ static int locate_data_completion_client(struct rpc_server *rpc_s,
 {
 	struct hdr_dimes_get *oh = msg->private;
 	struct rpc_cmd *tab = msg->msg_data;
-	int i, err = -ENOENT;
+	int server_id = msg->peer->ptlmap.id;
+	int i = 0, err = -ENOENT;
 
 	struct query_tran_entry_d *qte = qt_find_d(&dimes_c->qt, oh->qid);
 	if (!qte) {
 		uloga("%s(): ERROR can not find transaction qid= %d\n",
 			__func__, oh->qid);
-		goto err_out_free;
+		goto err_out_ack;
 	}
 
 	// Add received rpc_cmd information.
@@ -703,29 +849,42 @@ static int locate_data_completion_client(struct rpc_server *rpc_s,
 		struct obj_descriptor odsc = hdr->odsc;
 		// Calculate the intersection of the bbox (specified by the 
 		// receiver process) and the bbox (returned by the server).
-		bbox_intersect(&qte->q_obj.bb, &hdr->odsc.bb, &odsc.bb);	
-		if (!qt_find_obj_d(qte, &odsc)) {
-            err = qt_add_obj_with_cmd_d(qte, &odsc, &tab[i]);
-            if (err < 0) goto err_out_free;
+		// Copies, the descriptors are packed.
+		struct bbox q_bb = qte->q_obj.bb, bb = odsc.bb, bbcom;
+		bbox_intersect(&q_bb, &bb, &bbcom);
+		odsc.bb = bbcom;
+		struct fetch_entry *fetch = qt_find_obj_d(qte, &odsc);
+		if (!fetch) {
+            err = qt_add_obj_with_cmd_d(qte, &odsc, &tab[i], server_id);
+            if (err < 0) goto err_out_fail;
 		} else {
+			err = fetch_add_server(fetch, server_id);
+			if (err < 0) goto err_out_fail;
 			qte->num_fetch--;
 		}
 	}
 
 	free(oh);
 	free(tab);
-	free(msg);
+	msg_buf_free(msg);
 
 	if (qte->qh->qh_num_req_received == qte->qh->qh_num_req_posted) {
 		qte->f_locate_data_complete = 1;
 	}
 
 	return 0;
-err_out_free:
+err_out_fail:
+	// The get fails; the locations already added are acked with it
+	qte->num_fetch -= oh->num_obj - i;
+	qte_locate_data_failed_d(qte);
+err_out_ack:
+	send_read_acks_tab(server_id, tab + i, oh->num_obj - i);
 	free(oh);
 	free(tab);
-	free(msg);
-	ERROR_TRACE();
+	msg_buf_free(msg);
+	// Released here, do not fail back to the receive path
+	uloga("'%s()': failed with %d.\n", __func__, err);
+	return 0;
 }
 
 // Callback function for 'dimes_locate_data_msg' message.
@@ -735,6 +894,7 @@ static int dcgrpc_dimes_locate_data(struct rpc_server *rpc_s,
 	struct hdr_dimes_get *oht, 
 			 *oh = (struct hdr_dimes_get *) cmd->pad;
 	struct node_id *peer = dc_get_peer(DART_CLIENT_PTR, cmd->id);
+	struct query_tran_entry_d *qte;
 	struct rpc_cmd *tab;
 	struct msg_buf *msg;
 	int err = -ENOMEM;
@@ -746,8 +906,7 @@ static int dcgrpc_dimes_locate_data(struct rpc_server *rpc_s,
 
 	if (oh->rc == -1) {
 		// Server has no location information.
-		struct query_tran_entry_d *qte =
-				qt_find_d(&dimes_c->qt, oh->qid);
+		qte = qt_find_d(&dimes_c->qt, oh->qid);
 		if (!qte) {
 			uloga("%s(): ERROR can not find transaction qid= %d\n",
 					__func__, oh->qid);
@@ -765,19 +924,20 @@ static int dcgrpc_dimes_locate_data(struct rpc_server *rpc_s,
     // Transfer data location information from server using rpc_receive_direct().
     // Location information is stored as an array of struct rpc_cmd.
 	tab = malloc(sizeof(struct rpc_cmd) * oh->num_obj);
-	if (!tab) goto err_out;
+	if (!tab) goto err_out_fail;
 
 	oht = malloc(sizeof(*oh));
 	if (!oht) {
 		free(tab);
-		goto err_out;
+		goto err_out_fail;
 	}
 	memcpy(oht, oh, sizeof(*oh));
 
 	msg = msg_buf_alloc(rpc_s, peer, 0);
 	if (!msg) {
 		free(tab);
-		goto err_out;
+		free(oht);
+		goto err_out_fail;
 	}
 
 	msg->size = sizeof(struct rpc_cmd) * oh->num_obj;
@@ -787,8 +947,9 @@ static int dcgrpc_dimes_locate_data(struct rpc_server *rpc_s,
 
 	if (msg->size <= 0) {
 		free(tab);
-		free(msg);
-		goto err_out;
+		free(oht);
+		msg_buf_free(msg);
+		goto err_out_fail;
 	}	
 
 	rpc_mem_info_cache(peer, msg, cmd);
@@ -797,7 +958,15 @@ static int dcgrpc_dimes_locate_data(struct rpc_server *rpc_s,
 	if (err == 0) return 0;
 
 	free(tab);
-	free(msg);
+	free(oht);
+	msg_buf_free(msg);
+err_out_fail:
+	// The locations are lost, fail the get rather than wait for them
+	qte = qt_find_d(&dimes_c->qt, oh->qid);
+	if (qte) {
+		qte->qh->qh_num_req_received++;
+		qte_locate_data_failed_d(qte);
+	}
 err_out:
 	ERROR_TRACE();
 }
@@ -811,7 +980,7 @@ static int completion_dimes_obj_put(struct rpc_server *rpc_s, struct msg_buf *ms
     if (msg) {
         int *pflag = msg->private;
         *pflag = 1;
-        free(msg);
+        msg_buf_free(msg);
     }
     return 0;
 }
@@ -840,7 +1009,8 @@ static int dimes_obj_put(struct dimes_memory_obj *mem_obj)
 
 	// Update the DHT nodes
     struct sspace *ssd = lookup_sspace_dimes(dimes_c, &mem_obj->gdim);
-	num_dht_nodes = ssd_hash(ssd, &mem_obj->obj_desc.bb, dht_nodes);
+	struct bbox bb = mem_obj->obj_desc.bb;
+	num_dht_nodes = ssd_hash(ssd, &bb, dht_nodes);
 	if (num_dht_nodes <= 0) {
 		uloga("%s(): ERROR: ssd_hash() return %d but the value should be > 0\n",
 				__func__, num_dht_nodes);
@@ -876,7 +1046,7 @@ static int dimes_obj_put(struct dimes_memory_obj *mem_obj)
 	
 		err = rpc_send(RPC_SERVER_PTR, peer, msg);
 		if (err < 0) {
-			free(msg);
+			msg_buf_free(msg);
 			goto err_out;
 		}
 	}
@@ -894,6 +1064,7 @@ static int dimes_obj_put(struct dimes_memory_obj *mem_obj)
     free(send_flags);
 #endif
 
+	mem_obj->num_put = num_dht_nodes;
 	storage_add_obj(mem_obj);
 	return 0;
 err_out:
@@ -929,7 +1100,7 @@ static int dimes_locate_data(struct query_tran_entry_d *qte)
 		qte->qh->qh_num_req_posted++;
 		err = rpc_send(RPC_SERVER_PTR, peer, msg);
 		if (err < 0) {
-			free(msg);
+			msg_buf_free(msg);
 			qte->qh->qh_num_req_posted--;
 			goto err_out;
 		}
@@ -973,124 +1144,95 @@ static void matrix_init_d(struct matrix_d *mat, enum storage_type st,
     mat->size_elem = se;
 }
 
-static int matrix_rdma_copy(struct matrix_d *a, struct matrix_d *b, int tran_id)
+// Merge dimension 0 of 'mat' into dimension 1.
+static void matrix_merge_dim0_d(struct matrix_d *mat)
 {
-    uint64_t src_offset = 0;
-    uint64_t dst_offset = 0;
-    uint64_t bytes = 0;
-    int err = -ENOMEM;
-
-    uint64_t a0, a1, a2, a3, a4, a5, a6, a7, a8, a9;
-    uint64_t aloc=0, aloc1=0, aloc2=0, aloc3=0, aloc4=0, aloc5=0, aloc6=0, aloc7=0, aloc8=0, aloc9=0;
-    uint64_t b0, b1, b2, b3, b4, b5, b6, b7, b8, b9;
-    uint64_t bloc=0, bloc1=0, bloc2=0, bloc3=0, bloc4=0, bloc5=0, bloc6=0, bloc7=0, bloc8=0, bloc9=0;
-
-    uint64_t n = 0;
-    n = a->mat_view.ub[0] - a->mat_view.lb[0] + 1;
-    a0 = a->mat_view.lb[0];
-    b0 = b->mat_view.lb[0];
-
-    switch(a->num_dims){
-        case(1):
-                        goto dim1;
-                        break;
-                case(2):
-                        goto dim2;
-                        break;
-                case(3):
-                        goto dim3;
-                        break;
-                case(4):
-                        goto dim4;
-                        break;
-                case(5):
-                        goto dim5;
-                        break;
-                case(6):
-                        goto dim6;
-                        break;
-                case(7):
-                        goto dim7;
-                        break;
-                case(8):
-                        goto dim8;
-                        break;
-                case(9):
-                        goto dim9;
-                        break;
-                case(10):
-                        goto dim10;
-                        break;
-                default:
-                        break;
+    int i;
+    uint64_t d0 = mat->dist[0];
+
+    mat->mat_view.lb[0] = mat->mat_view.lb[1] * d0;
+    mat->mat_view.ub[0] = mat->mat_view.ub[1] * d0 + d0 - 1;
+    mat->dist[0] = d0 * mat->dist[1];
+    for (i = 1; i < mat->num_dims - 1; i++) {
+        mat->mat_view.lb[i] = mat->mat_view.lb[i+1];
+        mat->mat_view.ub[i] = mat->mat_view.ub[i+1];
+        mat->dist[i] = mat->dist[i+1];
     }
+    mat->num_dims--;
+}
 
-dim10:    for(a9 = a->mat_view.lb[9], b9 = b->mat_view.lb[9];     //TODO-Q
-        a9 <= a->mat_view.ub[9]; a9++, b9++){
-        aloc9 = a9 * a->dist[8];
-        bloc9 = a9 * b->dist[8];
-dim9:    for(a8 = a->mat_view.lb[8], b8 = b->mat_view.lb[8];     //TODO-Q
-        a8 <= a->mat_view.ub[8]; a8++, b8++){
-        aloc8 = (aloc9 + a8) * a->dist[7];
-        bloc8 = (bloc9 + b8) * b->dist[7];
-dim8:    for(a7 = a->mat_view.lb[7], b7 = b->mat_view.lb[7];     //TODO-Q
-        a7 <= a->mat_view.ub[7]; a7++, b7++){
-        aloc7 = (aloc8 + a7) * a->dist[6];
-        bloc7 = (bloc8 + b7) * b->dist[6];
-dim7:    for(a6 = a->mat_view.lb[6], b6 = b->mat_view.lb[6];     //TODO-Q
-        a6 <= a->mat_view.ub[6]; a6++, b6++){
-        aloc6 = (aloc7 + a6) * a->dist[5];
-        bloc6 = (bloc7 + b6) * b->dist[5];
-dim6:    for(a5 = a->mat_view.lb[5], b5 = b->mat_view.lb[5];     //TODO-Q
-        a5 <= a->mat_view.ub[5]; a5++, b5++){
-        aloc5 = (aloc6 + a5) * a->dist[4];
-        bloc5 = (bloc6 + b5) * b->dist[4];
-dim5:    for(a4 = a->mat_view.lb[4], b4 = b->mat_view.lb[4];
-        a4 <= a->mat_view.ub[4]; a4++, b4++){
-        aloc4 = (aloc5 + a4) * a->dist[3];
-        bloc4 = (bloc5 + b4) * b->dist[3];
-dim4:    for(a3 = a->mat_view.lb[3], b3 = b->mat_view.lb[3];
-        a3 <= a->mat_view.ub[3]; a3++, b3++){
-        aloc3 = (aloc4 + a3) * a->dist[2];
-        bloc3 = (bloc4 + b3) * b->dist[2]; 
-dim3:        for(a2 = a->mat_view.lb[2], b2 = b->mat_view.lb[2];
-            a2 <= a->mat_view.ub[2]; a2++, b2++){
-            aloc2 = (aloc3 + a2) * a->dist[1];
-            bloc2 = (bloc3 + b2) * b->dist[1];
-dim2:            for(a1 = a->mat_view.lb[1], b1 = b->mat_view.lb[1];
-                a1 <= a->mat_view.ub[1]; a1++, b1++){
-                aloc1 = (aloc2 + a1) * a->dist[0];
-                bloc1 = (bloc2 + b1) * b->dist[0];
-               /* for(a0 = a->mat_view.lb[0], b0 = b->mat_view.lb[0];
-                    a0 <= a->mat_view.ub[0]; a0++, b0++){
-                    aloc = aloc1 + a0;
-                    bloc = bloc1 + b0;
-               */
-dim1:           aloc = aloc1 + a0;
-                bloc = bloc1 + b0;
-                src_offset = bloc * a->size_elem;
-                dst_offset = aloc * a->size_elem;
-                bytes = n * a->size_elem;
-                err = dart_rdma_schedule_read(tran_id, src_offset, dst_offset, bytes);
-                if (err < 0)
-                        goto err_out;
-        if(a->num_dims == 1)    return 0;
-    }
-    if(a->num_dims == 2)    return 0;
-    }
-    if(a->num_dims == 3)    return 0;
-    }
-    if(a->num_dims == 4)    return 0;
-    }
-    if(a->num_dims == 5)    return 0;
-    }
-    if(a->num_dims == 6)    return 0;
+/*
+  While the fastest dimension is spanned in full in both matrices, the
+  rows follow each other in both memories; merge it into the next one
+  so that they are read as one.
+*/
+static void matrix_collapse_d(struct matrix_d *a, struct matrix_d *b)
+{
+    while (a->num_dims > 1 &&
+           a->mat_view.ub[0] - a->mat_view.lb[0] + 1 == a->dist[0] &&
+           b->mat_view.ub[0] - b->mat_view.lb[0] + 1 == b->dist[0]) {
+        matrix_merge_dim0_d(a);
+        matrix_merge_dim0_d(b);
     }
-    if(a->num_dims == 7)    return 0;
+}
+
+// Number of reads matrix_rdma_copy() schedules for 'a'.
+static uint64_t matrix_num_reads_d(struct matrix_d *a)
+{
+    uint64_t n = 1;
+    int i;
+    for (i = 1; i < a->num_dims; i++) {
+        n *= a->mat_view.ub[i] - a->mat_view.lb[i] + 1;
     }
-    if(a->num_dims == 8)    return 0;
+    return n;
+}
+
+/*
+  Schedule one read per row of dimension 0 of the view of 'a'; 'b' is
+  the matching view of the remote source. The row index runs over
+  dimensions 1 to num_dims-1, fastest first.
+*/
+static int matrix_rdma_copy(struct matrix_d *a, struct matrix_d *b, int tran_id)
+{
+    uint64_t ai[BBOX_MAX_NDIM], bi[BBOX_MAX_NDIM];
+    uint64_t aloc, bloc, bytes;
+    int i, ndims = a->num_dims;
+    int err = -EINVAL;
+
+    if (ndims < 1 || ndims > BBOX_MAX_NDIM)
+        goto err_out;
+
+    for (i = 0; i < ndims; i++) {
+        ai[i] = a->mat_view.lb[i];
+        bi[i] = b->mat_view.lb[i];
     }
-    if(a->num_dims == 9)    return 0;
+    bytes = (a->mat_view.ub[0] - a->mat_view.lb[0] + 1) * a->size_elem;
+
+    while (1) {
+        aloc = bloc = 0;
+        for (i = ndims - 1; i > 0; i--) {
+            aloc = (aloc + ai[i]) * a->dist[i-1];
+            bloc = (bloc + bi[i]) * b->dist[i-1];
+        }
+        aloc += ai[0];
+        bloc += bi[0];
+        err = dart_rdma_schedule_read(tran_id, bloc * a->size_elem,
+                                      aloc * a->size_elem, bytes);
+        if (err < 0)
+            goto err_out;
+
+        // Next row
+        for (i = 1; i < ndims; i++) {
+            if (ai[i] < a->mat_view.ub[i]) {
+                ai[i]++;
+                bi[i]++;
+                break;
+            }
+            ai[i] = a->mat_view.lb[i];
+            bi[i] = b->mat_view.lb[i];
+        }
+        if (i == ndims)
+            break;
     }
 
     return 0;
@@ -1122,12 +1264,13 @@ static int schedule_rdma_reads(int tran_id,
 		}
 	} else {
 		struct matrix_d to, from;
-		struct bbox bbcom;
-		bbox_intersect(&dst_odsc->bb, &src_odsc->bb, &bbcom);
-		matrix_init_d(&from, src_odsc->st, &src_odsc->bb, &bbcom,
+		struct bbox bbcom, src_bb = src_odsc->bb, dst_bb = dst_odsc->bb;
+		bbox_intersect(&dst_bb, &src_bb, &bbcom);
+		matrix_init_d(&from, src_odsc->st, &src_bb, &bbcom,
 				src_odsc->size);
-		matrix_init_d(&to, dst_odsc->st, &dst_odsc->bb, &bbcom,
+		matrix_init_d(&to, dst_odsc->st, &dst_bb, &bbcom,
 				dst_odsc->size);
+		matrix_collapse_d(&to, &from);
 		err = matrix_rdma_copy(&to, &from, tran_id);
 		if (err < 0) {
 			uloga("%s(): ERROR failed with matrix_rdma_copy()\n", __func__);
@@ -1149,9 +1292,9 @@ static int is_remote_data_contiguous_in_memory(struct obj_descriptor *src_odsc,
     if (src_odsc->bb.num_dims != dst_odsc->bb.num_dims) return 0;
 
     struct matrix_d from;
-    struct bbox bb;
-    bbox_intersect(&dst_odsc->bb, &src_odsc->bb, &bb);
-    matrix_init_d(&from, src_odsc->st, &src_odsc->bb, &bb, src_odsc->size);
+    struct bbox bb, src_bb = src_odsc->bb, dst_bb = dst_odsc->bb;
+    bbox_intersect(&dst_bb, &src_bb, &bb);
+    matrix_init_d(&from, src_odsc->st, &src_bb, &bb, src_odsc->size);
     
     // check dimension 0 -> n-2 (fast to slow)
     int i, ret = 1;
@@ -1169,9 +1312,9 @@ static size_t calculate_offset_for_remote_data(struct obj_descriptor *src_odsc,
                 struct obj_descriptor *dst_odsc)
 {
     struct matrix_d from;
-    struct bbox bb;
-    bbox_intersect(&dst_odsc->bb, &src_odsc->bb, &bb);
-    matrix_init_d(&from, src_odsc->st, &src_odsc->bb, &bb, src_odsc->size);
+    struct bbox bb, src_bb = src_odsc->bb, dst_bb = dst_odsc->bb;
+    bbox_intersect(&dst_bb, &src_bb, &bb);
+    matrix_init_d(&from, src_odsc->st, &src_bb, &bb, src_odsc->size);
 
     size_t num_elem = 1, offset = 0;
     int i;
@@ -1184,6 +1327,54 @@ static size_t calculate_offset_for_remote_data(struct obj_descriptor *src_odsc,
     return offset;
 }
 
+/*
+  Cost model for reading a sub-array that is not contiguous in the
+  remote memory: each read costs 'read_overhead' bytes on top of the
+  bytes it moves. When that makes the sub-array dearer than the slab
+  of the source that encloses it (the rows of the slowest dimension
+  it spans, contiguous in memory), and the slab wastes no more than
+  'max_read_waste' times the bytes needed, the fetch reads the slab in
+  one go and obj_assemble() extracts the sub-array from it. Returns 1
+  if the fetch was changed into a slab read.
+*/
+static int plan_fetch_as_slab(struct fetch_entry *fetch)
+{
+    struct obj_descriptor *src_odsc = &fetch->src_odsc;
+    struct matrix_d to, from;
+    struct bbox bbcom, slab;
+    struct bbox src_bb = src_odsc->bb, dst_bb = fetch->dst_odsc.bb;
+    int n = src_bb.num_dims;
+
+    if (options.max_read_waste <= 0 || n < 2) return 0;
+
+    bbox_intersect(&dst_bb, &src_bb, &bbcom);
+    matrix_init_d(&from, src_odsc->st, &src_bb, &bbcom, src_odsc->size);
+    matrix_init_d(&to, fetch->dst_odsc.st, &dst_bb, &bbcom,
+                  fetch->dst_odsc.size);
+    matrix_collapse_d(&to, &from);
+
+    uint64_t num_reads = matrix_num_reads_d(&to);
+    size_t read_bytes = bbox_volume(&bbcom) * src_odsc->size;
+
+    slab = src_bb;
+    slab.lb.c[n-1] = bbcom.lb.c[n-1];
+    slab.ub.c[n-1] = bbcom.ub.c[n-1];
+    size_t slab_bytes = bbox_volume(&slab) * src_odsc->size;
+
+    if (slab_bytes - read_bytes > options.max_read_waste * read_bytes) return 0;
+    if (num_reads * options.read_overhead + read_bytes <=
+        options.read_overhead + slab_bytes) return 0;
+    if (slab_bytes > get_available_rdma_buffer_size()) return 0;
+
+#ifdef DEBUG
+    uloga("%s(): peer %d reads slab of %zu bytes instead of %llu reads "
+          "of %zu bytes.\n", __func__, DIMES_CID, slab_bytes,
+          (unsigned long long)num_reads, read_bytes);
+#endif
+    fetch->dst_odsc.bb = slab;
+    return 1;
+}
+
 static int get_num_posted_fetch(struct fetch_entry **fetch_tab, int *fetch_status_tab, int fetch_tab_size)
 {
     int i;
@@ -1242,30 +1433,40 @@ static int all_fetch_done(struct query_tran_entry_d *qte, struct fetch_entry **f
     ERROR_TRACE();
 }
 
+/*
+  Pick the next fetch to start. Reads from the local memory complete
+  right away and are taken at any time, so they are copied while the
+  remote reads are in flight; a remote fetch waits for a free slot in
+  the window of concurrent reads and for room in the RDMA buffer.
+*/
 static int get_next_fetch(struct fetch_entry **fetch_tab, int *fetch_status_tab, int fetch_tab_size, int *index)
 {
     *index = -1;
-    int err, i;
+    int i;
     int num_posted_fetch = get_num_posted_fetch(fetch_tab, fetch_status_tab,
                                                 fetch_tab_size);
-    if (num_posted_fetch >= options.max_num_concurrent_rdma_read_op) {
-        return 0;
-    }
 
     for (i = 0; i < fetch_tab_size; i++) {
-        size_t read_size = obj_data_size(&fetch_tab[i]->dst_odsc);
-        if (fetch_status_tab[i] == fetch_ready) {
-            err = dimes_memory_alloc(&fetch_tab[i]->read_tran->dst,
-                                     read_size, dart_memory_rdma);
-            if (err < 0) goto err_out;
+        if (fetch_status_tab[i] != fetch_ready) continue;
+
+        if (is_peer_myself(fetch_tab[i]->read_tran->remote_peer)) {
             *index = i;
             return 0;
         }
+
+        if (num_posted_fetch >= options.max_num_concurrent_rdma_read_op) {
+            continue;
+        }
+        // Buffer space comes back as posted fetches complete
+        size_t read_size = obj_data_size(&fetch_tab[i]->dst_odsc);
+        if (num_posted_fetch > 0 && get_available_rdma_buffer_size() < read_size) {
+            continue;
+        }
+        *index = i;
+        return 0;
     }
 
     return 0;
- err_out:
-    ERROR_TRACE();
 }
 
 /*
@@ -1307,6 +1508,72 @@ static int estimate_fetch_tab_capacity(struct query_tran_entry_d *qte)
 */
 }
 
+// Start a fetch: allocate the receive buffer, schedule and perform the
+// reads. A fetch from the local memory is copied into the result here,
+// without going through a receive buffer.
+static int post_fetch(struct query_tran_entry_d *qte, struct fetch_entry *fetch,
+                      int *fetch_status)
+{
+    int err;
+    size_t read_size = obj_data_size(&fetch->dst_odsc);
+    int tran_id = fetch->read_tran->tran_id;
+
+    if (is_peer_myself(fetch->read_tran->remote_peer)) {
+#ifdef DEBUG
+        uloga("%s(): peer %d fetch data from local memory.\n", __func__, DIMES_CID);
+#endif
+        // Data is in local memory, fetch directly
+        struct dimes_memory_obj *mem_obj = storage_lookup_obj(&fetch->remote_obj_id,
+                                                   fetch->src_odsc.version);
+        if (mem_obj == NULL) {
+            uloga("%s(): ERROR failed to find data object in local memory.\n", __func__);
+            err = -ENOENT;
+            goto err_out;
+        }
+
+        // Copy the common region straight from the stored object
+        struct obj_data *from = obj_data_alloc_no_data(&fetch->src_odsc,
+                                    (void*)mem_obj->rdma_handle.base_addr);
+        if (!from) {
+            err = -ENOMEM;
+            goto err_out;
+        }
+        ssd_copy(qte->data_ref, from);
+        obj_data_free(from);
+        *fetch_status = fetch_done;
+        return 0;
+    }
+
+    err = dimes_memory_alloc(&fetch->read_tran->dst, read_size, dart_memory_rdma);
+    if (err < 0) {
+        goto err_out;
+    }
+
+    if (is_remote_data_contiguous_in_memory(&fetch->src_odsc, &fetch->dst_odsc)) {
+        // One read of the whole sub-array
+        size_t src_offset = calculate_offset_for_remote_data(&fetch->src_odsc,
+                                                             &fetch->dst_odsc);
+        err = dart_rdma_schedule_read(tran_id, src_offset, 0, read_size);
+    } else {
+        err = schedule_rdma_reads(tran_id, &fetch->src_odsc, &fetch->dst_odsc);
+    }
+    if (err < 0) {
+        dimes_memory_free(&fetch->read_tran->dst);
+        goto err_out;
+    }
+
+    // From here on the buffer is released with the posted fetch
+    *fetch_status = fetch_posted;
+    err = dart_rdma_perform_reads(tran_id);
+    if (err < 0) {
+        goto err_out;
+    }
+
+    return 0;
+ err_out:
+    ERROR_TRACE();
+}
+
 // Fetching data for a dimes_get query.
 static int dimes_fetch_data(struct query_tran_entry_d *qte)
 {
@@ -1327,13 +1594,14 @@ static int dimes_fetch_data(struct query_tran_entry_d *qte)
         fetch_status_tab[i] = fetch_ready;
     }
 
-    // Copy fetch entry (if any) that data object resides on remote cores
-    // and does NOT require sub-array reading 
+    // All fetches, from local or remote memory, contiguous or not, go
+    // through the same window of concurrent reads
     i = 0;
     list_for_each_entry(fetch, &qte->fetch_list, struct fetch_entry, entry)
     {
         // check the size of remote data object
-        if (obj_data_size(&fetch->dst_odsc) > get_available_rdma_buffer_size())
+        if (!is_peer_myself(fetch->read_tran->remote_peer) &&
+            obj_data_size(&fetch->dst_odsc) > get_available_rdma_buffer_size())
         {
             uloga("%s(): ERROR no sufficient RDMA memory for fetching "
                 "remote data object with size %u bytes. Suggested fix: "
@@ -1341,25 +1609,17 @@ static int dimes_fetch_data(struct query_tran_entry_d *qte)
                 "at configuration.\n",
                 __func__, obj_data_size(&fetch->dst_odsc));
             print_rdma_buffer_usage();
+            err = -ENOMEM;
             goto err_out_free;
         }
 
         if (!is_peer_myself(fetch->read_tran->remote_peer) &&
-            is_remote_data_contiguous_in_memory(&fetch->src_odsc, &fetch->dst_odsc))
+            !is_remote_data_contiguous_in_memory(&fetch->src_odsc, &fetch->dst_odsc))
         {
-            fetch_tab[i] = fetch;
-
-            size_t data_size, src_offset, dst_offset;
-            data_size = obj_data_size(&fetch->dst_odsc);
-            src_offset = calculate_offset_for_remote_data(&fetch->src_odsc, &fetch->dst_odsc);
-            dst_offset = 0;
-            // TODO: why this can not be moved to the loop below?
-            dart_rdma_schedule_read(fetch_tab[i]->read_tran->tran_id,
-                                  src_offset,
-                                  dst_offset,
-                                  data_size);
-            i++; // Count number of fetch entry in the table
+            plan_fetch_as_slab(fetch);
         }
+
+        fetch_tab[i++] = fetch;
     }
     fetch_tab_size = i;
 
@@ -1375,13 +1635,13 @@ static int dimes_fetch_data(struct query_tran_entry_d *qte)
             }
             if (i < 0 || i >= fetch_tab_size) break; // break inner loop
 
-            err = dart_rdma_perform_reads(fetch_tab[i]->read_tran->tran_id);
-            fetch_status_tab[i] = fetch_posted;
+            err = post_fetch(qte, fetch_tab[i], &fetch_status_tab[i]);
             if (err < 0) {
                 goto err_out_free;
             }
-        } while (1); // TODO: fix magic number
+        } while (1);
 
+        // Assemble the fetches completed so far, the others stay in flight
         err = all_fetch_done(qte, fetch_tab, fetch_status_tab,
                              fetch_tab_size, &loop_done);
         if (err < 0) {
@@ -1389,75 +1649,8 @@ static int dimes_fetch_data(struct query_tran_entry_d *qte)
         }
     } while (!loop_done);
 
-	if (fetch_tab) {
-		free(fetch_tab);
-	}
-    if (fetch_status_tab) {
-        free(fetch_status_tab);
-    }
-
-    // Read data object (if any) that (1) resides on remote cores BUT 
-    // require sub-array reading, OR (2) resides on local core
-    list_for_each_entry(fetch, &qte->fetch_list, struct fetch_entry, entry)
-    {
-        if (is_peer_myself(fetch->read_tran->remote_peer)) {
-#ifdef DEBUG
-            uloga("%s(): peer %d fetch data from local memory.\n", __func__, DIMES_CID);
-#endif
-            // Data is in local memory, fetch directly
-            struct dimes_memory_obj *mem_obj = storage_lookup_obj(&fetch->remote_obj_id,
-                                                       fetch->src_odsc.version);
-            if (mem_obj == NULL) {
-                uloga("%s(): ERROR failed to find data object in local memory.\n", __func__);
-                goto err_out;
-            }
-
-            // Update source memory region
-            fetch->read_tran->src.base_addr = mem_obj->rdma_handle.base_addr;
-            fetch->read_tran->src.size = mem_obj->rdma_handle.size;
-
-            // Alloc receive buffer, schedle reads, perform reads
-            dimes_memory_alloc(&fetch->read_tran->dst,
-                               obj_data_size(&fetch->dst_odsc),
-                               dart_memory_non_rdma);
-            schedule_rdma_reads(fetch->read_tran->tran_id,
-                                &fetch->src_odsc, &fetch->dst_odsc);
-            dart_rdma_perform_reads(fetch->read_tran->tran_id);
-            // Copy fetched data
-            obj_assemble(fetch, qte->data_ref);
-            dimes_memory_free(&fetch->read_tran->dst);
-        } 
-        else if (!is_remote_data_contiguous_in_memory(&fetch->src_odsc, &fetch->dst_odsc))
-        {
-            // Data on remote peer
-            // Alloc receive buffer, schedle reads, perform reads
-            err = dimes_memory_alloc(&fetch->read_tran->dst,
-                               obj_data_size(&fetch->dst_odsc),
-                               dart_memory_rdma);
-            if (err < 0) {
-                goto err_out;
-            }
-
-            schedule_rdma_reads(fetch->read_tran->tran_id,
-                                &fetch->src_odsc, &fetch->dst_odsc);
-
-            err = dart_rdma_perform_reads(fetch->read_tran->tran_id);
-            if (err < 0) {
-                goto err_out;
-            }
-
-            while (!dart_rdma_check_reads(fetch->read_tran->tran_id)) {
-                err = dart_rdma_process_reads();
-                if (err < 0) {
-                    goto err_out;
-                }
-            }
-
-            // Copy fetched data
-            obj_assemble(fetch, qte->data_ref);
-            dimes_memory_free(&fetch->read_tran->dst);
-        }
-    }
+    free(fetch_tab);
+    free(fetch_status_tab);
 
 	qte->f_complete = 1;
 	return 0;
@@ -1469,7 +1662,6 @@ err_out_free:
     } 
     free(fetch_tab);
     free(fetch_status_tab);
-err_out:
 	ERROR_TRACE();
 }
 
@@ -1490,7 +1682,8 @@ static int dimes_obj_get(struct obj_data *od)
 
 	/* get dht nodes */
     struct sspace *ssd = lookup_sspace_dimes(dimes_c, &od->gdim);
-	num_dht_nodes = ssd_hash(ssd, &od->obj_desc.bb, dht_nodes);
+	struct bbox bb = od->obj_desc.bb;
+	num_dht_nodes = ssd_hash(ssd, &bb, dht_nodes);
 	if (num_dht_nodes <= 0) {
 		uloga("%s(): ERROR ssd_hash() return %d but value should be > 0\n",
             __func__, num_dht_nodes);
@@ -1513,8 +1706,16 @@ static int dimes_obj_get(struct obj_data *od)
 			goto out_no_data;
 		else goto err_qt_free;
 	}
-	DIMES_WAIT_COMPLETION(qte->f_locate_data_complete == 1);
-    // TODO: check the received data location information
+	// Not DIMES_WAIT_COMPLETION(): the locations received so far are
+	// acked on error too
+	while (!qte->f_locate_data_complete) {
+		err = dc_process(DART_CLIENT_PTR);
+		if (err < 0) goto err_data_free;
+	}
+	if (qte->f_err) {
+		err = -ENOMEM;
+		goto err_data_free;
+	}
 #ifdef DEBUG
 	//uloga("%s(): #%d locate data complete!\n", __func__, DIMES_CID);
 #endif
@@ -1576,6 +1777,13 @@ struct dimes_client* dimes_client_alloc(void * ptr)
     options.rdma_buffer_usage = 0;
     options.max_num_concurrent_rdma_read_op = DIMES_RDMA_MAX_NUM_CONCURRENT_READ;
 
+    char *read_overhead = getenv("DATASPACES_DIMES_READ_OVERHEAD");
+    char *max_read_waste = getenv("DATASPACES_DIMES_READ_WASTE");
+    options.read_overhead = (read_overhead)? strtoull(read_overhead, NULL, 0) :
+                            DIMES_DEFAULT_READ_OVERHEAD;
+    options.max_read_waste = (max_read_waste)? strtod(max_read_waste, NULL) :
+                             DIMES_DEFAULT_READ_WASTE;
+
 	dimes_c = calloc(1, sizeof(*dimes_c));
 	dimes_c->dcg = (struct dcg_space*)ptr;
 	if (!dimes_c->dcg) {
@@ -1586,6 +1794,8 @@ struct dimes_client* dimes_client_alloc(void * ptr)
 
 	// Add rpc servie routines
 	rpc_add_service(dimes_locate_data_msg, dcgrpc_dimes_locate_data);
+	rpc_add_service(dimes_obj_release_msg, dcgrpc_dimes_obj_release);
+	rpc_add_service(dimes_obj_retire_msg, dcgrpc_dimes_obj_retire);
 
 	if (!dimes_c->dcg->f_ss_info) {
 		uloga("%s(): ERROR failed to retrieve the default global domain "
@@ -1700,8 +1910,16 @@ int dimes_client_put(const char *var_name,
     size_t data_size = obj_data_size(&odsc);
     // TODO: fix alignment issue, here assumes obj_data_size(&odsc) align by
     // 4 bytes ...
+    // Room in the RDMA buffer comes back as readers are done with the
+    // retired objects, so wait while there are any.
+    while (get_available_rdma_buffer_size() < data_size &&
+           num_obj_retired > 0) {
+        err = dc_process(DART_CLIENT_PTR);
+        if (err < 0) goto err_out;
+    }
+
     struct dimes_memory_obj *mem_obj = (struct dimes_memory_obj*)
-                                       malloc(sizeof(*mem_obj));
+                                       calloc(1, sizeof(*mem_obj));
     mem_obj->obj_id.dart_id = DIMES_CID;
     mem_obj->obj_id.local_obj_index = next_local_obj_index();
     mem_obj->obj_desc = odsc;
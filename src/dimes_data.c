@@ -48,6 +48,259 @@ int equal_dimes_obj_id(const struct dimes_obj_id *oid1, const struct dimes_obj_i
     return (oid1->dart_id == oid2->dart_id) && (oid1->local_obj_index == oid2->local_obj_index);
 }
 
+// Objects spanning more cells than this are not indexed.
+#define GRID_MAX_CELLS_PER_OBJ 64
+
+static uint64_t grid_hash(const struct obj_location_grid *g, const uint64_t *coord)
+{
+    uint64_t h = 0;
+    int i;
+    for (i = 0; i < g->num_dims; i++) {
+        h = (h ^ coord[i]) * 0x100000001B3ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+/*
+  Range of cells of 'g' that 'bb' overlaps; returns the number of cells
+  in it, capped at GRID_MAX_CELLS_PER_OBJ + 1.
+*/
+static uint64_t grid_cell_range(const struct obj_location_grid *g,
+                                const struct bbox *bb, uint64_t *lo, uint64_t *hi)
+{
+    uint64_t n = 1;
+    int i;
+
+    if (bb->num_dims != g->num_dims) return GRID_MAX_CELLS_PER_OBJ + 1;
+    for (i = 0; i < g->num_dims; i++) {
+        lo[i] = bb->lb.c[i] / g->cell_size[i];
+        hi[i] = bb->ub.c[i] / g->cell_size[i];
+        n *= hi[i] - lo[i] + 1;
+        if (hi[i] - lo[i] > GRID_MAX_CELLS_PER_OBJ || n > GRID_MAX_CELLS_PER_OBJ) {
+            return GRID_MAX_CELLS_PER_OBJ + 1;
+        }
+    }
+    return n;
+}
+
+// Step 'coord' to the next cell of the range, returns 0 past the last one.
+static int grid_next_cell(const struct obj_location_grid *g,
+                          const uint64_t *lo, const uint64_t *hi, uint64_t *coord)
+{
+    int i;
+    for (i = 0; i < g->num_dims; i++) {
+        if (coord[i] < hi[i]) {
+            coord[i]++;
+            return 1;
+        }
+        coord[i] = lo[i];
+    }
+    return 0;
+}
+
+static int grid_grow(struct obj_location_grid *g)
+{
+    int i, num_buckets = g->num_buckets ? 2 * g->num_buckets : 64;
+    struct obj_location_cell **buckets = calloc(num_buckets, sizeof(*buckets));
+    if (!buckets) return -1;
+
+    for (i = 0; i < g->num_buckets; i++) {
+        struct obj_location_cell *c, *next;
+        for (c = g->buckets[i]; c; c = next) {
+            uint64_t h = grid_hash(g, c->coord) & (num_buckets - 1);
+            next = c->next;
+            c->next = buckets[h];
+            buckets[h] = c;
+        }
+    }
+    free(g->buckets);
+    g->buckets = buckets;
+    g->num_buckets = num_buckets;
+    return 0;
+}
+
+static struct obj_location_cell *grid_lookup_cell(struct obj_location_grid *g,
+                                                  const uint64_t *coord, int f_create)
+{
+    struct obj_location_cell *c;
+    uint64_t h;
+
+    if (g->num_buckets) {
+        h = grid_hash(g, coord) & (g->num_buckets - 1);
+        for (c = g->buckets[h]; c; c = c->next) {
+            if (!memcmp(c->coord, coord, sizeof(uint64_t) * g->num_dims))
+                return c;
+        }
+    }
+    if (!f_create) return NULL;
+
+    if (g->num_cells >= g->num_buckets && grid_grow(g) < 0) return NULL;
+    c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    memcpy(c->coord, coord, sizeof(uint64_t) * g->num_dims);
+    h = grid_hash(g, coord) & (g->num_buckets - 1);
+    c->next = g->buckets[h];
+    g->buckets[h] = c;
+    g->num_cells++;
+    return c;
+}
+
+static int cell_add_node(struct obj_location_cell *c, struct obj_location_list_node *n)
+{
+    if (c->num_nodes == c->max_nodes) {
+        int max_nodes = c->max_nodes ? 2 * c->max_nodes : 4;
+        void *p = realloc(c->nodes, sizeof(*c->nodes) * max_nodes);
+        if (!p) return -1;
+        c->nodes = p;
+        c->max_nodes = max_nodes;
+    }
+    c->nodes[c->num_nodes++] = n;
+    return 0;
+}
+
+static void cell_remove_node(struct obj_location_cell *c, struct obj_location_list_node *n)
+{
+    int i;
+    for (i = 0; i < c->num_nodes; i++) {
+        if (c->nodes[i] == n) {
+            c->nodes[i] = c->nodes[--c->num_nodes];
+            return;
+        }
+    }
+}
+
+static int grid_add(struct obj_location_grid *g, struct obj_location_list_node *n)
+{
+    /* A copy, the header is packed. */
+    struct bbox bb = ((struct hdr_dimes_put *)n->cmd.pad)->odsc.bb;
+    uint64_t lo[BBOX_MAX_NDIM], hi[BBOX_MAX_NDIM], coord[BBOX_MAX_NDIM];
+    int i;
+
+    if (g->num_dims == 0) {
+        g->num_dims = bb.num_dims;
+        for (i = 0; i < g->num_dims; i++) {
+            g->cell_size[i] = bb.ub.c[i] - bb.lb.c[i] + 1;
+        }
+    }
+
+    if (grid_cell_range(g, &bb, lo, hi) > GRID_MAX_CELLS_PER_OBJ) {
+        return cell_add_node(&g->unindexed, n);
+    }
+    memcpy(coord, lo, sizeof(coord));
+    do {
+        struct obj_location_cell *c = grid_lookup_cell(g, coord, 1);
+        if (!c || cell_add_node(c, n) < 0) return -1;
+    } while (grid_next_cell(g, lo, hi, coord));
+
+    return 0;
+}
+
+static void grid_remove(struct obj_location_grid *g, struct obj_location_list_node *n)
+{
+    /* A copy, the header is packed. */
+    struct bbox bb = ((struct hdr_dimes_put *)n->cmd.pad)->odsc.bb;
+    uint64_t lo[BBOX_MAX_NDIM], hi[BBOX_MAX_NDIM], coord[BBOX_MAX_NDIM];
+
+    if (grid_cell_range(g, &bb, lo, hi) > GRID_MAX_CELLS_PER_OBJ) {
+        cell_remove_node(&g->unindexed, n);
+        return;
+    }
+    memcpy(coord, lo, sizeof(coord));
+    do {
+        struct obj_location_cell *c = grid_lookup_cell(g, coord, 0);
+        if (c) cell_remove_node(c, n);
+    } while (grid_next_cell(g, lo, hi, coord));
+}
+
+static void grid_free(struct obj_location_grid *g)
+{
+    int i;
+    for (i = 0; i < g->num_buckets; i++) {
+        struct obj_location_cell *c, *next;
+        for (c = g->buckets[i]; c; c = next) {
+            next = c->next;
+            free(c->nodes);
+            free(c);
+        }
+    }
+    free(g->buckets);
+    free(g->unindexed.nodes);
+}
+
+/*
+  Call 'fn' once for every object location of 'var_node' whose bbox may
+  intersect 'bb'. The cells the query overlaps are visited, unless
+  there are more of them than object locations; the list is scanned
+  then.
+*/
+static int var_node_visit(struct var_list_node *var_node, const struct bbox *bb,
+                          int (*fn)(struct obj_location_list_node *, void *), void *arg)
+{
+    struct obj_location_grid *g = &var_node->grid;
+    uint64_t lo[BBOX_MAX_NDIM], hi[BBOX_MAX_NDIM], coord[BBOX_MAX_NDIM];
+    uint64_t num_cells = 0;
+    int i, err;
+
+    if (g->num_dims > 0) {
+        // Count the cells of the query, stop once a scan is cheaper
+        num_cells = 1;
+        if (bb->num_dims != g->num_dims) {
+            num_cells = (uint64_t)var_node->num_obj_location + 1;
+        }
+        for (i = 0; i < g->num_dims && num_cells <= (uint64_t)var_node->num_obj_location; i++) {
+            lo[i] = bb->lb.c[i] / g->cell_size[i];
+            hi[i] = bb->ub.c[i] / g->cell_size[i];
+            num_cells *= hi[i] - lo[i] + 1;
+        }
+    }
+
+    if (g->num_dims == 0 || num_cells > (uint64_t)var_node->num_obj_location) {
+        struct obj_location_list_node *n, *tmp;
+        list_for_each_entry_safe(n, tmp, &var_node->obj_location_list,
+                                 struct obj_location_list_node, entry) {
+            err = fn(n, arg);
+            if (err < 0) return err;
+        }
+        return 0;
+    }
+
+    uint32_t stamp = ++g->query_stamp;
+    // 'fn' may remove nodes, so walk a copy of each cell
+    struct obj_location_list_node **tab = NULL;
+    int max_tab = 0;
+    memcpy(coord, lo, sizeof(coord));
+    do {
+        struct obj_location_cell *c = grid_lookup_cell(g, coord, 0);
+        if (!c || c->num_nodes == 0) continue;
+        if (c->num_nodes > max_tab) {
+            free(tab);
+            max_tab = c->num_nodes;
+            tab = malloc(sizeof(*tab) * max_tab);
+            if (!tab) return -ENOMEM;
+        }
+        int num = 0;
+        for (i = 0; i < c->num_nodes; i++) {
+            if (c->nodes[i]->query_stamp != stamp) {
+                c->nodes[i]->query_stamp = stamp;
+                tab[num++] = c->nodes[i];
+            }
+        }
+        for (i = 0; i < num; i++) {
+            err = fn(tab[i], arg);
+            if (err < 0) goto out;
+        }
+    } while (grid_next_cell(g, lo, hi, coord));
+
+    err = 0;
+    // Backwards, as 'fn' may remove the node it is given
+    for (i = g->unindexed.num_nodes - 1; i >= 0 && err == 0; i--) {
+        err = fn(g->unindexed.nodes[i], arg);
+    }
+ out:
+    free(tab);
+    return err < 0 ? err : 0;
+}
+
 static struct var_list_node* var_node_lookup(struct list_head *var_list,
                                     const char* var_name)
 {
@@ -67,19 +320,13 @@ static struct var_list_node* var_node_lookup(struct list_head *var_list,
     return n;
 }
 
-static struct list_head* obj_location_list_lookup(struct metadata_storage *s,
+static struct var_list_node* obj_location_var_lookup(struct metadata_storage *s,
                                     int version, const char* var_name)
 {
     int index = version % s->max_versions;
     struct list_head *l = &s->version_tab[index];
 
-    struct var_list_node *var_node;
-    var_node = var_node_lookup(l, var_name);
-    if (var_node == NULL) {
-        return NULL;
-    }
-    
-    return &(var_node->obj_location_list);
+    return var_node_lookup(l, var_name);
 }
 
 static int var_node_free(struct var_list_node *var_node)
@@ -91,6 +338,7 @@ static int var_node_free(struct var_list_node *var_node)
         list_del(&n->entry);
         free(n);
     }
+    grid_free(&var_node->grid);
 
     return 0;
 }
@@ -134,76 +382,190 @@ int metadata_s_free(struct metadata_storage *s)
     return 0;
 }
 
+struct replace_arg {
+    struct metadata_storage *s;
+    struct var_list_node *var_node;
+    struct obj_descriptor *odsc;
+};
+
+static void remove_obj_location(struct var_list_node *var_node,
+                                struct obj_location_list_node *n)
+{
+    grid_remove(&var_node->grid, n);
+    list_del(&n->entry);
+    var_node->num_obj_location--;
+    free(n);
+}
+
+/*
+  Retire the object location 'n' if the new one overlaps it, and tell
+  the owner. Readers may still be reading the object, so the location
+  is only dropped, and the owner told it may free the object, once
+  they all acked it.
+*/
+static int replace_obj_location(struct obj_location_list_node *n, void *arg)
+{
+    struct replace_arg *r = arg;
+    struct hdr_dimes_put *hdr = (struct hdr_dimes_put*)(n->cmd.pad);
+
+    if (n->f_retired || !obj_desc_by_name_intersect(r->odsc, &hdr->odsc)) {
+        return 0;
+    }
+
+    n->f_retired = 1;
+    if (r->s->obj_location_retired) {
+        r->s->obj_location_retired(&n->cmd);
+    }
+    if (n->num_acked >= n->num_located) {
+        if (r->s->obj_location_released) {
+            r->s->obj_location_released(&n->cmd);
+        }
+        remove_obj_location(r->var_node, n);
+    }
+    return 0;
+}
+
 int metadata_s_add_obj_location(struct metadata_storage *s,
                                 struct rpc_cmd *cmd)
 {
     int err;
-    struct list_head *l = NULL;
+    struct var_list_node *var_node = NULL;
     struct hdr_dimes_put *hdr = (struct hdr_dimes_put *)cmd->pad;
     struct obj_descriptor *odsc = &hdr->odsc;
 
     // Lookup  
-    l = obj_location_list_lookup(s, odsc->version, odsc->name);
-    if (l == NULL) {
+    var_node = obj_location_var_lookup(s, odsc->version, odsc->name);
+    if (var_node == NULL) {
         err = -1;
         goto err_out;
     }
 
     // First remove any existing obj location info whose bbox intersects with 
     // the newly inserted obj location info
-    struct obj_location_list_node *n, *tmp;
-    list_for_each_entry_safe(n, tmp, l, struct obj_location_list_node, entry)
-    {
-        hdr = (struct hdr_dimes_put*)(n->cmd.pad);
-        if (obj_desc_by_name_intersect(odsc, &hdr->odsc))
-        {
-            list_del(&n->entry);
-            free(n);
-        }
+    struct replace_arg r = { s, var_node, odsc };
+    struct bbox bb = odsc->bb;
+    err = var_node_visit(var_node, &bb, replace_obj_location, &r);
+    if (err < 0) {
+        goto err_out;
     }
 
+    struct obj_location_list_node *n;
     n = calloc(1, sizeof(struct obj_location_list_node));
     n->cmd = *cmd;
-    list_add(&n->entry, l);
+    err = grid_add(&var_node->grid, n);
+    if (err < 0) {
+        grid_remove(&var_node->grid, n);
+        free(n);
+        goto err_out;
+    }
+    list_add(&n->entry, &var_node->obj_location_list);
+    var_node->num_obj_location++;
 
     return 0;
  err_out:
     ERROR_TRACE();
 }
 
+struct find_arg {
+    struct obj_descriptor *odsc;
+    struct rpc_cmd *tab;
+    int num;
+    int max;
+};
+
+// Append the object location 'n' to the table if it intersects the query.
+static int find_obj_location(struct obj_location_list_node *n, void *arg)
+{
+    struct find_arg *f = arg;
+    struct hdr_dimes_put *hdr = (struct hdr_dimes_put *)(n->cmd.pad);
+
+    if (n->f_retired || !obj_desc_equals_intersect(f->odsc, &hdr->odsc)) {
+        return 0;
+    }
+    if (f->num == f->max) {
+        int max = f->max ? 2 * f->max : 16;
+        struct rpc_cmd *tab = realloc(f->tab, sizeof(struct rpc_cmd) * max);
+        if (!tab) return -ENOMEM;
+        f->tab = tab;
+        f->max = max;
+    }
+    f->tab[f->num++] = n->cmd;
+    n->num_located++;
+    return 0;
+}
+
 int metadata_s_find_obj_location(struct metadata_storage *s,
                                  struct obj_descriptor *odsc,
-                                 struct list_head *out_list, int *out_num_items)
+                                 struct rpc_cmd **out_tab, int *out_num_items)
 {
     int err;
-    struct list_head *l = NULL;
+    struct var_list_node *var_node = NULL;
     
     // lookup
-    l = obj_location_list_lookup(s, odsc->version, odsc->name);
-    if (l == NULL) {
+    var_node = obj_location_var_lookup(s, odsc->version, odsc->name);
+    if (var_node == NULL) {
         err = -1;
         goto err_out;
     }
 
-    *out_num_items = 0;
-    struct obj_location_list_node *n;
-    list_for_each_entry(n, l, struct obj_location_list_node, entry)
-    {
-        struct hdr_dimes_put *hdr = (struct hdr_dimes_put *)(n->cmd.pad);
-        if (obj_desc_equals_intersect(odsc, &hdr->odsc)) {
-            struct obj_location_wrapper *p;
-            p = malloc(sizeof(struct obj_location_wrapper));
-            p->data_ref = &(n->cmd);
-            list_add(&p->entry, out_list);
-            (*out_num_items)++;
-        }
+    // The matches go straight into the table sent back to the client
+    struct find_arg f = { odsc, NULL, 0, 0 };
+    struct bbox bb = odsc->bb;
+    err = var_node_visit(var_node, &bb, find_obj_location, &f);
+    if (err < 0) {
+        free(f.tab);
+        goto err_out;
     }
-    
+
+    *out_tab = f.tab;
+    *out_num_items = f.num;
     return 0;
  err_out:
     ERROR_TRACE();
 }
 
+struct ack_arg {
+    struct metadata_storage *s;
+    struct var_list_node *var_node;
+    const struct dimes_obj_id *oid;
+};
+
+static int ack_obj_location(struct obj_location_list_node *n, void *arg)
+{
+    struct ack_arg *a = arg;
+    struct hdr_dimes_put *hdr = (struct hdr_dimes_put *)(n->cmd.pad);
+    struct dimes_obj_id obj_id = hdr->obj_id;
+
+    if (!equal_dimes_obj_id(a->oid, &obj_id)) {
+        return 0;
+    }
+
+    n->num_acked++;
+    if (n->f_retired && n->num_acked >= n->num_located) {
+        if (a->s->obj_location_released) {
+            a->s->obj_location_released(&n->cmd);
+        }
+        remove_obj_location(a->var_node, n);
+    }
+    return 0;
+}
+
+int metadata_s_ack_obj_location(struct metadata_storage *s,
+                                struct obj_descriptor *odsc,
+                                const struct dimes_obj_id *oid)
+{
+    struct var_list_node *var_node;
+
+    var_node = obj_location_var_lookup(s, odsc->version, odsc->name);
+    if (var_node == NULL) {
+        return -1;
+    }
+
+    struct ack_arg a = { s, var_node, oid };
+    struct bbox bb = odsc->bb;
+    return var_node_visit(var_node, &bb, ack_obj_location, &a);
+}
+
 /*
   Allocate and init the local storage structure.
 */
@@ -361,15 +723,22 @@ size_t dimes_buffer_size = 0;
 //Starting pointer to the memory buffer
 uint64_t dimes_buffer_ptr = 0;
 
-/*linked list for free dimes_buf_block. And the blocks in the list
-are sorted by block_size in ascending order.
-*/
-struct list_head free_blocks_list;
-
-/*linked list for in use dimes_buf_block. And the blocks in the list
-are sorted by block_size in ascending order.
+/*
+  The buffer is managed as a two-level segregated fit (TLSF) allocator:
+  free blocks are kept in lists by size class, a first level for each
+  power of two split into DIMES_BUF_SL_COUNT second level ranges, and
+  two levels of bitmaps tell which lists are not empty. Each block
+  links to its neighbors in the buffer (boundary tags), so freeing
+  merges with them directly, and blocks in use are found from their
+  address through a hash table. Allocation and free take constant
+  time. Block descriptors live outside the buffer.
 */
-struct list_head used_blocks_list;
+#define DIMES_BUF_ALIGN_LOG2 3
+#define DIMES_BUF_SL_LOG2 4
+#define DIMES_BUF_SL_COUNT (1 << DIMES_BUF_SL_LOG2)
+#define DIMES_BUF_FL_SHIFT (DIMES_BUF_SL_LOG2 + DIMES_BUF_ALIGN_LOG2)
+#define DIMES_BUF_SMALL_SIZE ((size_t)1 << DIMES_BUF_FL_SHIFT)
+#define DIMES_BUF_FL_COUNT (64 - DIMES_BUF_FL_SHIFT + 1)
 
 enum mem_block_status {
     free_block = 0,
@@ -378,7 +747,10 @@ enum mem_block_status {
 
 /*dynamic mem block data structure*/
 struct dimes_buf_block {
-    struct list_head mem_block_entry;
+    struct list_head mem_block_entry; // in a free list, when free
+    struct dimes_buf_block *phys_prev; // neighbors in the buffer
+    struct dimes_buf_block *phys_next;
+    struct dimes_buf_block *hash_next; // in a hash bucket, when used
     size_t block_size;
     uint64_t block_ptr;
     enum mem_block_status block_status;
@@ -386,92 +758,173 @@ struct dimes_buf_block {
 
 #define SIZE_DART_MEM_BLOCK sizeof(struct dimes_buf_block)
 
-//
-// Cleanup a blocks list
-//
-static void dimes_buf_cleanup_list(struct list_head* blocks_list)
+static struct list_head free_lists[DIMES_BUF_FL_COUNT][DIMES_BUF_SL_COUNT];
+static uint64_t fl_bitmap;
+static uint32_t sl_bitmap[DIMES_BUF_FL_COUNT];
+
+// Blocks in use, by address
+static struct dimes_buf_block **used_hash;
+static size_t used_hash_size;
+static size_t num_used_blocks;
+
+// First block of the buffer, start of the chain of neighbors
+static struct dimes_buf_block *first_block;
+// Descriptors of merged blocks, reused for later splits
+static struct dimes_buf_block *spare_blocks;
+
+static int dimes_buf_fls(uint64_t x)
+{
+    return 63 - __builtin_clzll(x);
+}
+
+static int dimes_buf_ffs(uint64_t x)
 {
-    struct dimes_buf_block * mb, *tmp;
-    list_for_each_entry_safe(mb, tmp, blocks_list, struct dimes_buf_block, mem_block_entry) {
-        list_del(&mb->mem_block_entry);
-        free(mb);//free the memory
+    return __builtin_ctzll(x);
+}
+
+// Size class of a free block of 'size' bytes
+static void dimes_buf_mapping(size_t size, int *fl, int *sl)
+{
+    if (size < DIMES_BUF_SMALL_SIZE) {
+        *fl = 0;
+        *sl = (int)(size >> DIMES_BUF_ALIGN_LOG2);
+    } else {
+        int f = dimes_buf_fls(size);
+        *sl = (int)(size >> (f - DIMES_BUF_SL_LOG2)) ^ DIMES_BUF_SL_COUNT;
+        *fl = f - DIMES_BUF_FL_SHIFT + 1;
     }
 }
 
-//
-// Insert a memory block into the list that sorted by block_size.
-//
-static void dimes_buf_insert_block(
-    struct dimes_buf_block *block,
-    struct list_head* blocks_list)
-{
-    struct dimes_buf_block *mb, *tmp;
-    int inserted = 0;
-
-    list_for_each_entry_safe(mb, tmp, blocks_list, struct dimes_buf_block, mem_block_entry) {
-        if(block->block_size <= mb->block_size) {
-            //add the block befor the position of mb in the list.
-            list_add_before_pos(&block->mem_block_entry, &mb->mem_block_entry);
-            inserted = 1;
-            break;
-        }
+static struct dimes_buf_block *dimes_buf_new_block(void)
+{
+    struct dimes_buf_block *block = spare_blocks;
+    if (block) {
+        spare_blocks = block->hash_next;
+        return block;
     }
+    return (struct dimes_buf_block*)malloc(SIZE_DART_MEM_BLOCK);
+}
 
-    //add the block to the tail
-    if (!inserted)
-        list_add_tail(&block->mem_block_entry, blocks_list);
+static void dimes_buf_drop_block(struct dimes_buf_block *block)
+{
+    block->hash_next = spare_blocks;
+    spare_blocks = block;
 }
 
-/* 
-   Insert a memory  block into the  free blocks list,  and merge
-   contiguous free blocks into larger new one.
-*/
-static void dimes_buf_insert_block_to_freelist(
-    struct dimes_buf_block *block,
-    struct list_head *blocks_list)
-{
-    /*    low_memory_addresses ------->  high_memory_addresses
-    |             |    |                         |
-    | contiguous_block_before |  block |  contiguous_block_after | 
-    |                         |        |                 |
-    */
-    //the contiguous free block before 'block' in the buffer
-    struct dimes_buf_block *contiguous_block_before = NULL;
-    //the contiguous free block after 'block' in the buffer
-    struct dimes_buf_block *contiguous_block_after = NULL;
-
-    struct dimes_buf_block * mb, *tmp;
-    list_for_each_entry_safe(mb, tmp, blocks_list, struct dimes_buf_block, mem_block_entry) {
-        if(block->block_ptr == (mb->block_ptr + mb->block_size) )
-            contiguous_block_before = mb;
-        if(mb->block_ptr == (block->block_ptr + block->block_size) )
-            contiguous_block_after = mb;
-    }
-
-    if(contiguous_block_after) {
-        //update the size of the merged new free block
-        block->block_size = block->block_size + contiguous_block_after->block_size;
-        //the starting address of the merged new free block does NOT change
-
-        //remove from free blocks list
-        list_del(&contiguous_block_after->mem_block_entry);
-        free(contiguous_block_after);
-    }
-
-    if(contiguous_block_before) {
-        //update the size of the merged new free block
-        block->block_size = block->block_size + contiguous_block_before->block_size;
-        //update the starting address of the merged new free block  
-        block->block_ptr = contiguous_block_before->block_ptr;
-
-        //remove from free blocks list
-        list_del(&contiguous_block_before->mem_block_entry);
-        free(contiguous_block_before);
-    }
-
-    //add the new free block into list
+static void dimes_buf_insert_free(struct dimes_buf_block *block)
+{
+    int fl, sl;
+    dimes_buf_mapping(block->block_size, &fl, &sl);
     block->block_status = free_block;
-    dimes_buf_insert_block(block, blocks_list);
+    list_add(&block->mem_block_entry, &free_lists[fl][sl]);
+    fl_bitmap |= (uint64_t)1 << fl;
+    sl_bitmap[fl] |= (uint32_t)1 << sl;
+}
+
+static void dimes_buf_remove_free(struct dimes_buf_block *block)
+{
+    int fl, sl;
+    dimes_buf_mapping(block->block_size, &fl, &sl);
+    list_del(&block->mem_block_entry);
+    if (list_empty(&free_lists[fl][sl])) {
+        sl_bitmap[fl] &= ~((uint32_t)1 << sl);
+        if (!sl_bitmap[fl])
+            fl_bitmap &= ~((uint64_t)1 << fl);
+    }
+}
+
+/*
+  Find a free block of at least 'size' bytes: the first non empty list
+  whose blocks all fit. Failing that, the blocks of the list 'size'
+  itself maps to may still hold one that fits.
+*/
+static struct dimes_buf_block *dimes_buf_find_free(size_t size)
+{
+    size_t rounded = size;
+    int fl, sl;
+
+    if (size >= DIMES_BUF_SMALL_SIZE)
+        rounded += ((size_t)1 << (dimes_buf_fls(size) - DIMES_BUF_SL_LOG2)) - 1;
+    if (rounded >= size) {
+        dimes_buf_mapping(rounded, &fl, &sl);
+        if (fl < DIMES_BUF_FL_COUNT) {
+            uint64_t sl_map = sl_bitmap[fl] & (~(uint64_t)0 << sl);
+            if (!sl_map) {
+                uint64_t fl_map = (fl + 1 < 64) ? fl_bitmap & (~(uint64_t)0 << (fl + 1)) : 0;
+                if (fl_map) {
+                    fl = dimes_buf_ffs(fl_map);
+                    sl_map = sl_bitmap[fl];
+                }
+            }
+            if (sl_map) {
+                sl = dimes_buf_ffs(sl_map);
+                return list_entry(free_lists[fl][sl].next,
+                    struct dimes_buf_block, mem_block_entry);
+            }
+        }
+    }
+
+    struct dimes_buf_block *mb;
+    dimes_buf_mapping(size, &fl, &sl);
+    list_for_each_entry(mb, &free_lists[fl][sl], struct dimes_buf_block, mem_block_entry) {
+        if (mb->block_size >= size)
+            return mb;
+    }
+    return NULL;
+}
+
+static size_t dimes_buf_hash(uint64_t ptr)
+{
+    return (size_t)(((ptr >> DIMES_BUF_ALIGN_LOG2) * 0x9E3779B97F4A7C15ULL) >> 32) & (used_hash_size - 1);
+}
+
+static int dimes_buf_hash_grow(void)
+{
+    size_t i, old_size = used_hash_size;
+    struct dimes_buf_block **old_hash = used_hash;
+
+    used_hash_size = old_size ? 2 * old_size : 256;
+    used_hash = (struct dimes_buf_block**)calloc(used_hash_size, sizeof(*used_hash));
+    if (!used_hash) {
+        used_hash = old_hash;
+        used_hash_size = old_size;
+        return -1;
+    }
+    for (i = 0; i < old_size; i++) {
+        struct dimes_buf_block *mb = old_hash[i], *next;
+        for (; mb; mb = next) {
+            size_t h = dimes_buf_hash(mb->block_ptr);
+            next = mb->hash_next;
+            mb->hash_next = used_hash[h];
+            used_hash[h] = mb;
+        }
+    }
+    free(old_hash);
+    return 0;
+}
+
+static void dimes_buf_hash_insert(struct dimes_buf_block *block)
+{
+    if (num_used_blocks >= used_hash_size)
+        dimes_buf_hash_grow();
+    size_t h = dimes_buf_hash(block->block_ptr);
+    block->hash_next = used_hash[h];
+    used_hash[h] = block;
+    num_used_blocks++;
+}
+
+static struct dimes_buf_block *dimes_buf_hash_remove(uint64_t ptr)
+{
+    struct dimes_buf_block **pp = &used_hash[dimes_buf_hash(ptr)];
+    for (; *pp; pp = &(*pp)->hash_next) {
+        if ((*pp)->block_ptr == ptr) {
+            struct dimes_buf_block *mb = *pp;
+            *pp = mb->hash_next;
+            num_used_blocks--;
+            return mb;
+        }
+    }
+    return NULL;
 }
 
 //
@@ -479,22 +932,35 @@ static void dimes_buf_insert_block_to_freelist(
 //
 int dimes_buffer_init(uint64_t base_addr, size_t size)
 {
-    INIT_LIST_HEAD(&free_blocks_list);
-    INIT_LIST_HEAD(&used_blocks_list);
+    int i, j;
+    for (i = 0; i < DIMES_BUF_FL_COUNT; i++) {
+        for (j = 0; j < DIMES_BUF_SL_COUNT; j++)
+            INIT_LIST_HEAD(&free_lists[i][j]);
+        sl_bitmap[i] = 0;
+    }
+    fl_bitmap = 0;
+    used_hash = NULL;
+    used_hash_size = 0;
+    num_used_blocks = 0;
+    first_block = NULL;
+    spare_blocks = NULL;
 
     dimes_buffer_ptr = base_addr;
     if (dimes_buffer_ptr != 0) {
         dimes_buffer_size = size;
+        if (dimes_buf_hash_grow() < 0)
+            return -1;
 
         //create the first free block
         struct dimes_buf_block *block;
         block = (struct dimes_buf_block*)malloc(SIZE_DART_MEM_BLOCK);
         block->block_size = size;
         block->block_ptr = dimes_buffer_ptr;
-        block->block_status = free_block;
+        block->phys_prev = block->phys_next = NULL;
+        first_block = block;
 
         //add the block into free blocks list 
-        dimes_buf_insert_block(block, &free_blocks_list);
+        dimes_buf_insert_free(block);
 
         return 0;
     }
@@ -506,11 +972,20 @@ int dimes_buffer_init(uint64_t base_addr, size_t size)
 //
 int dimes_buffer_finalize()
 {
-    //cleanup the free_blocks_list
-    dimes_buf_cleanup_list(&free_blocks_list);
+    struct dimes_buf_block *mb, *next;
 
-    //cleanup the used_blocks_list
-    dimes_buf_cleanup_list(&used_blocks_list);
+    for (mb = first_block; mb; mb = next) {
+        next = mb->phys_next;
+        free(mb);
+    }
+    for (mb = spare_blocks; mb; mb = next) {
+        next = mb->hash_next;
+        free(mb);
+    }
+    first_block = spare_blocks = NULL;
+    free(used_hash);
+    used_hash = NULL;
+    used_hash_size = num_used_blocks = 0;
 
     return 0;
 }
@@ -524,65 +999,45 @@ void dimes_buffer_alloc(size_t size, uint64_t *ptr)
 {
     //If requested buffer size exceeds the total available
     if (size > dimes_buffer_size) {
-        fprintf(stderr, "%s(): requested size %u exceeds buffer size %u\n",
+        fprintf(stderr, "%s(): requested size %zu exceeds buffer size %zu\n",
             __func__, size, dimes_buffer_size); 
         goto err_out;
     }
 
-    //Search for usable free block with the smallest data size
-    struct dimes_buf_block * mb, *tmp;
-    int found = 0;
-    list_for_each_entry_safe(mb, tmp, &free_blocks_list,
-        struct dimes_buf_block, mem_block_entry){
-        if(mb->block_size >= size) {
-            //Usable free block found
-            found = 1;
-            break;
-        }
-    }
-
-    if (found) {
-        /*Usable free block 'mb' found*/
-
-        //new_free_mb is the new free memory block after allocating space from 'mb'
-        //new_used_mb is the new in_use memory block after allocating space from 'mb'
-        struct dimes_buf_block * new_free_mb, * new_used_mb;
+    // Blocks start aligned to 8 bytes
+    size = (size + (1 << DIMES_BUF_ALIGN_LOG2) - 1) & ~(size_t)((1 << DIMES_BUF_ALIGN_LOG2) - 1);
+    if (size == 0)
+        size = 1 << DIMES_BUF_ALIGN_LOG2;
 
-        //remove 'mb' from free blocks list
-        list_del(&mb->mem_block_entry);
-
-        if(mb->block_size == size){
-            new_free_mb = NULL;
-            new_used_mb = mb;
-            new_used_mb->block_status = used_block;
-        }
+    struct dimes_buf_block *mb = dimes_buf_find_free(size);
+    if (!mb) {
+        /*Could not find usable free block*/
+        fprintf(stderr, "%s: failed! no space\n", __func__);
+        goto err_out;
+    }
+    dimes_buf_remove_free(mb);
 
-        if(mb->block_size > size){
-            new_free_mb = (struct dimes_buf_block*)malloc(SIZE_DART_MEM_BLOCK);
-            new_free_mb->block_status = free_block;
+    // Split off the rest of the block as a new free block
+    if (mb->block_size > size) {
+        struct dimes_buf_block *new_free_mb = dimes_buf_new_block();
+        if (new_free_mb) {
             new_free_mb->block_ptr = mb->block_ptr + size;
             new_free_mb->block_size = mb->block_size - size;
-            new_used_mb = mb;
-            new_used_mb->block_status = used_block;
-            new_used_mb->block_size = size;
+            new_free_mb->phys_prev = mb;
+            new_free_mb->phys_next = mb->phys_next;
+            if (mb->phys_next)
+                mb->phys_next->phys_prev = new_free_mb;
+            mb->phys_next = new_free_mb;
+            mb->block_size = size;
+            dimes_buf_insert_free(new_free_mb);
         }
-
-        //add 'new_free_mb'  into free blocks list
-        if(new_free_mb != NULL)
-            dimes_buf_insert_block(new_free_mb, &free_blocks_list);
-        //add 'new_used_mb' into used blocks list 
-        if(new_used_mb != NULL)
-            dimes_buf_insert_block(new_used_mb, &used_blocks_list);
-
-        *ptr = (uint64_t)new_used_mb->block_ptr;
-        return;
-    }
-    else {
-        /*Could not find usable free block*/
-        fprintf(stderr, "%s: failed! no space\n", __func__);
-        goto err_out;
     }
 
+    mb->block_status = used_block;
+    dimes_buf_hash_insert(mb);
+    *ptr = mb->block_ptr;
+    return;
+
  err_out:
     *ptr = (uint64_t)0;
     return;
@@ -602,24 +1057,32 @@ void dimes_buffer_free(uint64_t ptr)
     }
 
     /*search for the corresponding in_use memory block for ptr*/
-    struct dimes_buf_block * mb, *tmp;
-    unsigned int found = 0;//flag value init as 0!
-    list_for_each_entry_safe(mb, tmp, &used_blocks_list, struct dimes_buf_block, mem_block_entry){
-        if(mb->block_ptr == ptr) {
-            found = 1;
-            break;
-        }
-    }
-
-    if (found) {
-
-        //remove 'mb' from used blocks list
-        list_del(&mb->mem_block_entry);
+    struct dimes_buf_block *mb = dimes_buf_hash_remove(ptr);
+    if (!mb)
+        return;
 
-        //add back 'mb' into free blocks list
-        dimes_buf_insert_block_to_freelist(mb, &free_blocks_list);
+    // Merge with the free neighbors in the buffer
+    struct dimes_buf_block *next = mb->phys_next;
+    if (next && next->block_status == free_block) {
+        dimes_buf_remove_free(next);
+        mb->block_size += next->block_size;
+        mb->phys_next = next->phys_next;
+        if (next->phys_next)
+            next->phys_next->phys_prev = mb;
+        dimes_buf_drop_block(next);
+    }
+    struct dimes_buf_block *prev = mb->phys_prev;
+    if (prev && prev->block_status == free_block) {
+        dimes_buf_remove_free(prev);
+        prev->block_size += mb->block_size;
+        prev->phys_next = mb->phys_next;
+        if (mb->phys_next)
+            mb->phys_next->phys_prev = prev;
+        dimes_buf_drop_block(mb);
+        mb = prev;
     }
-    else return;
+
+    dimes_buf_insert_free(mb);
 }
 
 //For testing
@@ -627,10 +1090,11 @@ void print_free_blocks_list()
 {
     printf("#####Free Blocks List####\n");
 
-    struct dimes_buf_block * mb, *tmp;
-    list_for_each_entry_safe(mb, tmp, &free_blocks_list, struct dimes_buf_block, mem_block_entry){
-        printf("free block: ptr=%p, size=%zu, status=%u\n",
-            mb->block_ptr, mb->block_size, mb->block_status);
+    struct dimes_buf_block * mb;
+    for (mb = first_block; mb; mb = mb->phys_next) {
+        if (mb->block_status == free_block)
+            printf("free block: ptr=%p, size=%zu, status=%u\n",
+                (void*)mb->block_ptr, mb->block_size, mb->block_status);
     }
 }
 
@@ -638,10 +1102,11 @@ void print_used_blocks_list()
 {
     printf("#####Used Blocks List####\n");
 
-    struct dimes_buf_block * mb, *tmp;
-    list_for_each_entry_safe(mb, tmp, &used_blocks_list, struct dimes_buf_block, mem_block_entry){
-        printf("used block: ptr=%p, size=%zu, status=%u\n",
-            mb->block_ptr, mb->block_size, mb->block_status);
+    struct dimes_buf_block * mb;
+    for (mb = first_block; mb; mb = mb->phys_next) {
+        if (mb->block_status == used_block)
+            printf("used block: ptr=%p, size=%zu, status=%u\n",
+                (void*)mb->block_ptr, mb->block_size, mb->block_status);
     }
 }
 
@@ -49,7 +49,7 @@ static struct dimes_server *dimes_s = NULL;
 static int locate_data_completion_server(struct rpc_server *rpc_s, struct msg_buf *msg)
 {
 	free(msg->msg_data);
-	free(msg);
+	msg_buf_free(msg);
 	return 0;
 }
 
@@ -60,11 +60,9 @@ static int locate_data(struct rpc_server *rpc_s, struct rpc_cmd *cmd,
 	struct node_id *peer = ds_get_peer(dimes_s->dsg->ds, cmd->id);
 	struct msg_buf *msg;
 	int err = -ENOMEM;
-	int qid;
+	int qid, i;
     int num_obj = 0;
-	struct rpc_cmd *tab;
-	struct list_head obj_loc_wrapper_list;
-	INIT_LIST_HEAD(&obj_loc_wrapper_list);
+	struct rpc_cmd *tab = NULL;
 
 #ifdef DEBUG
 	uloga("%s(): get request from peer #%d "
@@ -78,7 +76,7 @@ static int locate_data(struct rpc_server *rpc_s, struct rpc_cmd *cmd,
 	// Search in the metadata storage
     err = metadata_s_find_obj_location(dimes_s->meta_store,
                                        &hdr->odsc,
-                                       &obj_loc_wrapper_list,
+                                       &tab,
                                        &num_obj);
 	if (err < 0)
 		goto err_out;
@@ -86,6 +84,7 @@ static int locate_data(struct rpc_server *rpc_s, struct rpc_cmd *cmd,
 	// Send back the cmd table if there is any entries found.
 	msg = msg_buf_alloc(rpc_s, peer, 1);
 	if (!msg) {
+		free(tab);
 		goto err_out;
 	}
 	qid = hdr->qid;
@@ -94,19 +93,6 @@ static int locate_data(struct rpc_server *rpc_s, struct rpc_cmd *cmd,
 	hdr->qid = qid;
 
 	if (num_obj > 0) {
-		tab = malloc(sizeof(struct rpc_cmd) * num_obj);
-		if (!tab)
-			goto err_out;
-
-		int i = 0;
-        struct obj_location_wrapper *obj_loc_w, *tmp;
-		list_for_each_entry_safe(obj_loc_w, tmp, &obj_loc_wrapper_list,
-								 struct obj_location_wrapper, entry) {
-            list_del(&obj_loc_w->entry);
-			tab[i++] = *(obj_loc_w->data_ref);
-			free(obj_loc_w);
-		}
-
 		msg->size = sizeof(struct rpc_cmd) * num_obj;
 		msg->msg_data = tab;
 		msg->cb = locate_data_completion_server;
@@ -134,8 +120,16 @@ static int locate_data(struct rpc_server *rpc_s, struct rpc_cmd *cmd,
 	if (err == 0)
 		return 0;
 
+	// The reader never gets these locations, ack them for it
+	for (i = 0; i < num_obj; i++) {
+		struct hdr_dimes_put *put = (struct hdr_dimes_put *) tab[i].pad;
+		struct obj_descriptor odsc = put->odsc;
+		struct dimes_obj_id obj_id = put->obj_id;
+
+		metadata_s_ack_obj_location(dimes_s->meta_store, &odsc, &obj_id);
+	}
 	free(tab);
-	free(msg);
+	msg_buf_free(msg);
 err_out:
 	ERROR_TRACE();
 }
@@ -146,6 +140,64 @@ static int dsgrpc_dimes_locate_data(struct rpc_server *rpc_s,
 	return locate_data(rpc_s, cmd, dimes_locate_data_msg);
 }
 
+/*
+  Send the owner of the object location 'loc_cmd' a notice 'cmd_type'
+  about it.
+*/
+static void obj_location_notify(struct rpc_cmd *loc_cmd, int cmd_type)
+{
+	struct hdr_dimes_put *put = (struct hdr_dimes_put *) loc_cmd->pad;
+	struct rpc_server *rpc_s = dimes_s->dsg->ds->rpc_s;
+	struct node_id *peer = ds_get_peer(dimes_s->dsg->ds, put->obj_id.dart_id);
+	struct hdr_dimes_ack *hdr;
+	struct msg_buf *msg;
+
+	msg = msg_buf_alloc(rpc_s, peer, 1);
+	if (!msg) {
+		uloga("%s(): ERROR failed to allocate message.\n", __func__);
+		return;
+	}
+	msg->msg_rpc->cmd = cmd_type;
+	msg->msg_rpc->id = DIMES_SID;
+
+	hdr = (struct hdr_dimes_ack *) msg->msg_rpc->pad;
+	hdr->obj_id = put->obj_id;
+	hdr->odsc = put->odsc;
+
+	if (rpc_send(rpc_s, peer, msg) < 0) {
+		uloga("%s(): ERROR failed to send to peer #%d.\n", __func__, peer->ptlmap.id);
+		msg_buf_free(msg);
+	}
+}
+
+/*
+  The object location 'loc_cmd' was replaced by a newer put: the owner
+  gets it back once the readers are done, see obj_location_released().
+*/
+static void obj_location_retired(struct rpc_cmd *loc_cmd)
+{
+	obj_location_notify(loc_cmd, dimes_obj_retire_msg);
+}
+
+/*
+  The object location 'loc_cmd' was replaced by a newer put and all
+  readers handed it are done with it: the owner may free the object.
+*/
+static void obj_location_released(struct rpc_cmd *loc_cmd)
+{
+	obj_location_notify(loc_cmd, dimes_obj_release_msg);
+}
+
+static int dsgrpc_dimes_obj_read_ack(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+	struct hdr_dimes_ack *hdr = (struct hdr_dimes_ack *) cmd->pad;
+	struct obj_descriptor odsc = hdr->odsc;
+	struct dimes_obj_id obj_id = hdr->obj_id;
+
+	metadata_s_ack_obj_location(dimes_s->meta_store, &odsc, &obj_id);
+	return 0;
+}
+
 static int dsgrpc_dimes_put(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 {
 	struct hdr_dimes_put *hdr = (struct hdr_dimes_put*)cmd->pad;
@@ -185,6 +237,7 @@ struct dimes_server *dimes_server_alloc(int num_sp, int num_cp, char *conf_name)
 
 	rpc_add_service(dimes_put_msg, dsgrpc_dimes_put);
 	rpc_add_service(dimes_locate_data_msg, dsgrpc_dimes_locate_data);
+	rpc_add_service(dimes_obj_read_ack_msg, dsgrpc_dimes_obj_read_ack);
 
 	dimes_s_l->meta_store =
         metadata_s_alloc(dimes_s_l->dsg->ls->size_hash);
@@ -193,6 +246,8 @@ struct dimes_server *dimes_server_alloc(int num_sp, int num_cp, char *conf_name)
 		free(dimes_s_l);
 		goto err_out;
 	}
+	dimes_s_l->meta_store->obj_location_retired = obj_location_retired;
+	dimes_s_l->meta_store->obj_location_released = obj_location_released;
 
 	dimes_s = dimes_s_l;
 
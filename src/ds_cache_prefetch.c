@@ -110,6 +110,9 @@ int cache_replacement(int added_mem_size){
 		version = index % ls->size_hash;
 		list = &ls->obj_hash[index];
 		list_for_each_entry_safe(od, t, list, struct obj_data, obj_entry) {
+			/* Objects pinned by a server worker stay in memory. */
+			if (od->refcnt > 0)
+				continue;
 
 			//uloga("%s(Yubo), cache replacement #2\n", __func__);
 
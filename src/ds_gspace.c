@@ -147,6 +147,7 @@ static struct {
         int lock_type;		/* 1 - generic, 2 - custom */
         int hash_version;   /* 1 - ssd_hash_version_v1, 2 - ssd_hash_version_v2 */
         int memory_size;  /* memory size */
+        int num_workers;    /* 0 - process requests in the transport thread */
 } ds_conf;
 
 static struct {
@@ -160,6 +161,7 @@ static struct {
         {"lock_type",           &ds_conf.lock_type},
         {"hash_version",        &ds_conf.hash_version}, 
         {"memory_size",         &ds_conf.memory_size},
+        {"num_workers",         &ds_conf.num_workers},
 };
 
 static void eat_spaces(char *line)
@@ -298,7 +300,7 @@ static int free_sspace(struct ds_gspace *dsg_l)
     return 0;
 }
 
-static struct sspace* lookup_sspace(struct ds_gspace *dsg_l, const char* var_name, const struct global_dimension* gd)
+static struct sspace* __lookup_sspace(struct ds_gspace *dsg_l, const char* var_name, const struct global_dimension* gd)
 {
     struct global_dimension gdim;
     memcpy(&gdim, gd, sizeof(struct global_dimension));
@@ -359,6 +361,17 @@ static struct sspace* lookup_sspace(struct ds_gspace *dsg_l, const char* var_nam
     return ssd_entry->ssd;
 }
 
+static struct sspace* lookup_sspace(struct ds_gspace *dsg_l, const char* var_name, const struct global_dimension* gd)
+{
+    struct sspace *ssd;
+
+    pthread_mutex_lock(&dsg_l->sspace_lock);
+    ssd = __lookup_sspace(dsg_l, var_name, gd);
+    pthread_mutex_unlock(&dsg_l->sspace_lock);
+
+    return ssd;
+}
+
 #ifdef DS_HAVE_ACTIVESPACE
 static int bin_code_local_bind(void *pbuf, int offset)
 {
@@ -463,7 +476,7 @@ static int bin_code_return_result(struct rexec_args *rargs, struct node_id *peer
 	if (err == 0)
 		return 0;
 
-	free(msg);
+	msg_buf_free(msg);
  err_out:
 	ERROR_TRACE();
 }
@@ -526,7 +539,7 @@ static int bin_code_put_completion(struct rpc_server *rpc_s, struct msg_buf *msg
 	*/
 
 	free(msg->private);
-	free(msg);
+	msg_buf_free(msg);
 
 	r_exit++;
 
@@ -561,7 +574,7 @@ static int dsgrpc_bin_code_put(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 		return 0;
 
 	free(msg->private);
-	free(msg);
+	msg_buf_free(msg);
  err_out:
 	ERROR_TRACE();
 }
@@ -637,7 +650,7 @@ static int dsg_lock_grant(struct node_id *peer, struct lockhdr *lhr)
         err = rpc_send(dsg->ds->rpc_s, peer, msg);
         if (err == 0)
                 return 0;
-        free(msg);
+        msg_buf_free(msg);
  err_out:
         ERROR_TRACE();
 }
@@ -996,15 +1009,20 @@ static int dsgrpc_remove_service(struct rpc_server *rpc, struct rpc_cmd *cmd)
 	struct list_head *list;
 	int i;
 
+	pthread_mutex_lock(&dsg->ls_lock);
 	for (i = 0; i < dsg->ls->size_hash; i++) {
         	list = &(dsg->ls)->obj_hash[i];
 	        list_for_each_entry_safe(od, t, list, struct obj_data, obj_entry ) {
 			if (od->obj_desc.version == lh->lock_num && !strcmp(od->obj_desc.name,lh->name) ) {
 				ls_remove(dsg->ls, od);
-				obj_data_free(od);
+				/* A worker still copying from it frees it. */
+				od->f_free = 1;
+				if (od->refcnt == 0)
+					obj_data_free(od);
 			}
 		}
 	}
+	pthread_mutex_unlock(&dsg->ls_lock);
 
         
 	return 0;
@@ -1032,14 +1050,18 @@ static struct cont_query *cq_alloc(struct hdr_obj_get *oh)
 static void cq_add_to_list(struct cont_query *cq)
 {
         // TODO: add policy, e.g., add only new entries ?!
+        pthread_mutex_lock(&dsg->cq_lock);
         list_add(&cq->cq_entry, &dsg->cq_list);
         dsg->cq_num++;
+        pthread_mutex_unlock(&dsg->cq_lock);
 }
 
 static void cq_rem_from_list(struct cont_query *cq)
 {
+        pthread_mutex_lock(&dsg->cq_lock);
         list_del(&cq->cq_entry);
         dsg->cq_num--;
+        pthread_mutex_unlock(&dsg->cq_lock);
 }
 
 static struct cont_query *cq_find_in_list(struct hdr_obj_get *oh)
@@ -1113,6 +1135,7 @@ static int cq_check_match(struct obj_descriptor *odsc)
         struct cont_query *cq;
         int err;
 
+        pthread_mutex_lock(&dsg->cq_lock);
         list_for_each_entry(cq, &dsg->cq_list, struct cont_query, cq_entry) {
                 if (obj_desc_by_name_intersect(&cq->cq_odsc, odsc)) {
                         err = cq_notify_on_match(cq, odsc);
@@ -1120,9 +1143,11 @@ static int cq_check_match(struct obj_descriptor *odsc)
                                 goto err_out;
                 }
         }
+        pthread_mutex_unlock(&dsg->cq_lock);
 
         return 0;
  err_out:
+        pthread_mutex_unlock(&dsg->cq_lock);
         ERROR_TRACE();
 }
 
@@ -1165,7 +1190,9 @@ static int dsgrpc_obj_update(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
  }
 #endif
         oh->u.o.odsc.owner = cmd->id;
+        pthread_rwlock_wrlock(&de->de_lock);
         err = dht_add_entry(de, &oh->u.o.odsc);
+        pthread_rwlock_unlock(&de->de_lock);
         if (err < 0)
                 goto err_out;
 
@@ -1179,6 +1206,89 @@ static int dsgrpc_obj_update(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
         ERROR_TRACE();
 }
 
+/*
+  Store the value range of an object in the DHT, next to its
+  descriptor.
+*/
+static int dsgrpc_obj_summary(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_summary *hs = (struct hdr_obj_summary *) cmd->pad;
+        struct sspace* ssd = lookup_sspace(dsg, hs->odsc.name, &hs->gdim);
+        struct dht_entry *de = ssd->ent_self;
+
+        /* This may come in before the descriptor itself. */
+        pthread_rwlock_wrlock(&de->de_lock);
+        dht_set_summary(de, &hs->odsc, &hs->sum);
+        pthread_rwlock_unlock(&de->de_lock);
+
+        return 0;
+}
+
+/*
+  Compute the value range of an object just put.
+*/
+static void obj_summary_compute(struct obj_data *od)
+{
+        struct obj_filter_spec spec = {.op = filter_range, .elem_type = od->sum_type};
+        struct obj_filter_res res;
+
+        ssd_filter_init(&res);
+        memset(&od->sum, 0, sizeof(od->sum));
+        if (ssd_filter(od, &od->obj_desc, &spec, &res) == 0 && res.count > 0) {
+                od->sum.f_valid = 1;
+                od->sum.min = res.min;
+                od->sum.max = res.max;
+        }
+}
+
+/*
+  Send the value range of an object to the DHT entries that index it.
+*/
+static int obj_summary_update_dht(const struct obj_descriptor *odsc,
+        const struct global_dimension *gdim, const struct obj_summary *sum)
+{
+        struct sspace* ssd = lookup_sspace(dsg, odsc->name, gdim);
+        struct dht_entry *dht_tab[ssd->dht->num_entries];
+        struct hdr_obj_summary *hs;
+        struct msg_buf *msg;
+        struct node_id *peer;
+        int num_de, i, err;
+
+        num_de = ssd_hash(ssd, &odsc->bb, dht_tab);
+        for (i = 0; i < num_de; i++) {
+                peer = ds_get_peer(dsg->ds, dht_tab[i]->rank);
+                if (peer == dsg->ds->self) {
+                        pthread_rwlock_wrlock(&ssd->ent_self->de_lock);
+                        dht_set_summary(ssd->ent_self, odsc, sum);
+                        pthread_rwlock_unlock(&ssd->ent_self->de_lock);
+                        continue;
+                }
+
+                err = -ENOMEM;
+                msg = msg_buf_alloc(dsg->ds->rpc_s, peer, 1);
+                if (!msg)
+                        goto err_out;
+
+                msg->msg_rpc->cmd = ss_obj_summary;
+                msg->msg_rpc->id = DSG_ID;
+
+                hs = (struct hdr_obj_summary *) msg->msg_rpc->pad;
+                hs->odsc = *odsc;
+                hs->gdim = *gdim;
+                hs->sum = *sum;
+
+                err = rpc_send(dsg->ds->rpc_s, peer, msg);
+                if (err < 0) {
+                        msg_buf_free(msg);
+                        goto err_out;
+                }
+        }
+
+        return 0;
+ err_out:
+        ERROR_TRACE();
+}
+
 /* 
    Update the DHT metadata with the new obj_descriptor information.
 */
@@ -1221,7 +1331,9 @@ static int obj_put_update_dht(struct ds_gspace *dsg, struct obj_data *od)
 			uloga("'%s()': %s\n", __func__, str);
 			free(str);
 #endif
+			pthread_rwlock_wrlock(&ssd->ent_self->de_lock);
 			dht_add_entry(ssd->ent_self, odsc);
+			pthread_rwlock_unlock(&ssd->ent_self->de_lock);
 			if (peer->ptlmap.id == min_rank) {
 				err = cq_check_match(odsc);
 				if (err < 0)
@@ -1256,7 +1368,7 @@ static int obj_put_update_dht(struct ds_gspace *dsg, struct obj_data *od)
 
 		err = rpc_send(dsg->ds->rpc_s, peer, msg);
 		if (err < 0) {
-			free(msg);
+			msg_buf_free(msg);
 			goto err_out;
 		}
 	}
@@ -1267,11 +1379,11 @@ static int obj_put_update_dht(struct ds_gspace *dsg, struct obj_data *od)
 }
 
 /*
+  Account for the memory used by the data of 'od', making room for it
+  in the cache; the caller holds 'ls_lock'.
 */
-static int obj_put_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+static void obj_cache_add(struct obj_data *od)
 {
-        struct obj_data *od = msg->private;
-	
 	if (ls == NULL){//init ls Duan
 		ls = dsg->ls;
 		//ls->mem_size = ds_conf.memory_size;
@@ -1302,10 +1414,6 @@ static int obj_put_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
 		free(str);
 	}
 #endif
-	od->sl = in_memory; //data storage level in memory Duan
-	od->so = caching; //data storage operation caching Duan
-	ls_add_obj(dsg->ls, od);
-
 	//cache data to memory and arrange memory if it is full Duan
     //uloga("%s(Yubo), in cache_replacement\n",__func__);
 	cache_replacement(obj_data_size(&od->obj_desc));
@@ -1314,10 +1422,100 @@ static int obj_put_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
 	pthread_mutex_lock(&pmutex); //lock
 	dsg->ls->mem_used += obj_data_size(&od->obj_desc);
 	pthread_mutex_unlock(&pmutex);
+}
+
+/*
+  Tell the producer of the lazy object 'odsc' that it was replaced in
+  the local storage, so that it stops holding the data.
+*/
+static int obj_drop_send(const struct obj_descriptor *odsc, int src_id)
+{
+        struct node_id *peer = ds_get_peer(dsg->ds, src_id);
+        struct hdr_obj_put *hdr;
+        struct msg_buf *msg;
+        int err = -ENOMEM;
+
+        msg = msg_buf_alloc(dsg->ds->rpc_s, peer, 1);
+        if (!msg)
+                goto err_out;
+
+        msg->msg_rpc->cmd = ss_obj_pull;
+        msg->msg_rpc->id = DSG_ID;
+
+        hdr = (struct hdr_obj_put *) msg->msg_rpc->pad;
+        hdr->odsc = *odsc;
+        hdr->flags = obj_put_dropped;
+        hdr->ref = 0;
+
+        err = rpc_send(dsg->ds->rpc_s, peer, msg);
+        if (err == 0)
+                return 0;
+
+        msg_buf_free(msg);
+ err_out:
+        ERROR_TRACE();
+}
+
+/*
+  Add 'od' to the local storage, see ls_add_obj(). If that replaces an
+  object put lazily, return the id of its producer and its descriptor
+  in 'odsc', -1 otherwise. Caller holds 'ls_lock'.
+*/
+static int obj_ls_add(struct obj_data *od, struct obj_descriptor *odsc)
+{
+        struct obj_data *od_existing;
+        int src_id = -1;
+
+        od_existing = ls_find_no_version(dsg->ls, &od->obj_desc);
+        if (od_existing && od_existing->sl == in_producer) {
+                *odsc = od_existing->obj_desc;
+                src_id = od_existing->src_id;
+        }
+        ls_add_obj(dsg->ls, od);
+
+        return src_id;
+}
+
+/*
+  Insert a received object in the local storage and account for the
+  memory it uses.
+*/
+static void obj_put_store(struct obj_data *od)
+{
+	struct obj_descriptor odsc;
+	int src_id;
+
+	pthread_mutex_lock(&dsg->ls_lock);
+	od->sl = in_memory; //data storage level in memory Duan
+	od->so = caching; //data storage operation caching Duan
+	src_id = obj_ls_add(od, &odsc);
+
+	obj_cache_add(od);
+	pthread_mutex_unlock(&dsg->ls_lock);
+
+	if (src_id >= 0)
+		obj_drop_send(&odsc, src_id);
+}
+
+/*
+*/
+static int obj_put_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct obj_data *od = msg->private;
+        struct obj_descriptor odsc = od->obj_desc;
+        struct global_dimension gdim = od->gdim;
+        int f_sum = od->f_sum;
+
+        if (f_sum)
+                obj_summary_compute(od);
+        obj_put_store(od);
+        if (f_sum && obj_summary_update_dht(&odsc, &gdim, &od->sum) < 0)
+                uloga("'%s()': can not store the value range of '%s' version %d.\n",
+                        __func__, odsc.name, odsc.version);
 
     uloga("%s(Yubo): after obj_put_completion timestamp=%f\n", __func__, timer_timestamp_2());
 
-    free(msg);
+    msg_buf_free(msg);
 
 #ifdef DEBUG
     uloga("'%s()': server %d finished receiving  %s, version %d.\n",
@@ -1327,6 +1525,45 @@ static int obj_put_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
     return 0;
 }
 
+/*
+  Register an object put lazily: only the descriptor is stored and
+  indexed, the data is pulled from the producer on the first read.
+*/
+static int obj_put_lazy_register(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_put *hdr = (struct hdr_obj_put *)cmd->pad;
+        struct obj_descriptor odsc;
+        struct obj_data *od;
+        int src_id, err = -ENOMEM;
+
+        od = obj_data_alloc_no_data(&hdr->odsc, NULL);
+        if (!od)
+                goto err_out;
+
+        od->obj_desc.owner = DSG_ID;
+        memcpy(&od->gdim, &hdr->gdim, sizeof(struct global_dimension));
+        od->sl = in_producer;
+        od->so = normal;
+        od->src_id = cmd->id;
+        INIT_LIST_HEAD(&od->pull_list);
+
+        pthread_mutex_lock(&dsg->ls_lock);
+        src_id = obj_ls_add(od, &odsc);
+        pthread_mutex_unlock(&dsg->ls_lock);
+
+        if (src_id >= 0)
+                obj_drop_send(&odsc, src_id);
+
+        err = obj_put_update_dht(dsg, od);
+        if (err == 0)
+                return 0;
+ err_out:
+        uloga("'%s()': failed with %d.\n", __func__, err);
+        return err;
+}
+
+static int obj_pull_recv(struct rpc_server *, struct rpc_cmd *);
+
 /*
 */
 static int dsgrpc_obj_put(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
@@ -1351,6 +1588,11 @@ static int dsgrpc_obj_put(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 		}
 #endif
 
+        if (hdr->flags & (obj_put_pulled | obj_put_lost))
+                return obj_pull_recv(rpc_s, cmd);
+        if (hdr->flags & obj_put_lazy)
+                return obj_put_lazy_register(rpc_s, cmd);
+
         odsc->owner = DSG_ID;
 
         err = -ENOMEM;
@@ -1361,6 +1603,10 @@ static int dsgrpc_obj_put(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 
         od->obj_desc.owner = DSG_ID;
         memcpy(&od->gdim, &hdr->gdim, sizeof(struct global_dimension));
+        if (hdr->flags & obj_put_summary) {
+                od->f_sum = 1;
+                od->sum_type = hdr->elem_type;
+        }
 
         msg = msg_buf_alloc(rpc_s, peer, 0);
         if (!msg)
@@ -1391,7 +1637,7 @@ static int dsgrpc_obj_put(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
         if (err == 0)
 	        return 0;
  err_free_msg:
-        free(msg);
+        msg_buf_free(msg);
  err_free_data:
         free(od);
  err_out:
@@ -1399,6 +1645,96 @@ static int dsgrpc_obj_put(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
         return err;
 }
 
+/*
+  Store all objects of a batched put once the payload is in.
+*/
+static int obj_put_batch_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct hdr_obj_batch *hb = msg->private;
+        struct obj_batch_ent *ent_tab = msg->msg_data;
+        struct obj_data *od;
+        char *data;
+        int i, err = 0;
+
+        data = (char *) (ent_tab + hb->num_ent);
+        for (i = 0; i < hb->num_ent; i++) {
+                od = obj_data_alloc(&ent_tab[i].odsc);
+                if (!od) {
+                        err = -ENOMEM;
+                        break;
+                }
+
+                od->obj_desc.owner = DSG_ID;
+                memcpy(&od->gdim, &ent_tab[i].gdim, sizeof(struct global_dimension));
+                memcpy(od->data, data, obj_data_size(&od->obj_desc));
+                data += obj_data_size(&od->obj_desc);
+
+                obj_put_store(od);
+
+                err = obj_put_update_dht(dsg, od);
+                if (err < 0)
+                        break;
+        }
+
+        free(hb);
+        free(msg->msg_data);
+        msg_buf_free(msg);
+
+        if (err == 0)
+                return 0;
+
+        ERROR_TRACE();
+}
+
+/*
+  Rpc routine to insert a batch of objects sent by a compute peer in
+  one request; the payload carries the descriptor table followed by
+  the data of all objects.
+*/
+static int dsgrpc_obj_put_batch(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_batch *hbt, *hb = (struct hdr_obj_batch *) cmd->pad;
+        struct node_id *peer = ds_get_peer(dsg->ds, cmd->id);
+        struct msg_buf *msg;
+        void *buf;
+        int err = -ENOMEM;
+
+        buf = malloc(hb->size);
+        if (!buf)
+                goto err_out;
+
+        hbt = malloc(sizeof(*hb));
+        if (!hbt) {
+                free(buf);
+                goto err_out;
+        }
+        memcpy(hbt, hb, sizeof(*hb));
+
+        msg = msg_buf_alloc(rpc_s, peer, 0);
+        if (!msg) {
+                free(buf);
+                free(hbt);
+                goto err_out;
+        }
+
+        msg->msg_data = buf;
+        msg->size = hb->size;
+        msg->private = hbt;
+        msg->cb = obj_put_batch_completion;
+
+        rpc_mem_info_cache(peer, msg, cmd);
+        err = rpc_receive_direct(rpc_s, peer, msg);
+        rpc_mem_info_reset(peer, msg, cmd);
+        if (err == 0)
+                return 0;
+
+        free(buf);
+        free(hbt);
+        msg_buf_free(msg);
+ err_out:
+        ERROR_TRACE();
+}
+
 static int obj_info_reply_descriptor(
         struct node_id *q_peer,
         const struct obj_descriptor *q_odsc) // __attribute__((__unused__))
@@ -1433,7 +1769,7 @@ static int obj_info_reply_descriptor(
         if (err == 0)
                 return 0;
 
-        free(msg);
+        msg_buf_free(msg);
         return err;
 }
 
@@ -1457,7 +1793,7 @@ static int obj_query_reply_num_de(struct node_id *peer, int num_de)
         if (err == 0)
                 return 0;
 
-        free(msg);
+        msg_buf_free(msg);
         return err;
 }
 
@@ -1490,7 +1826,7 @@ static int obj_query_forward_obj_info(struct dht_entry *de_tab[], int num_de,
 
                 err = rpc_send(dsg->ds->rpc_s, peer, msg);
                 if (err < 0) {
-                        free(msg);
+                        msg_buf_free(msg);
                         break;
                 }
         }
@@ -1505,7 +1841,7 @@ static int obj_query_forward_obj_info(struct dht_entry *de_tab[], int num_de,
 static int obj_send_dht_peers_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
 {
         free(msg->msg_data);
-        free(msg);
+        msg_buf_free(msg);
 
         return 0;
 }
@@ -1552,7 +1888,7 @@ static int dsgrpc_obj_send_dht_peers(struct rpc_server *rpc_s, struct rpc_cmd *c
                 return 0;
 
         free(peer_id_tab);
-        free(msg);
+        msg_buf_free(msg);
  err_out:
         ERROR_TRACE();
 }
@@ -1607,7 +1943,7 @@ static int __dsgrpc_obj_send_dht_peers(struct rpc_server *rpc_s, struct rpc_cmd
                 return 0;
 
         free(peer_id_tab);
-        free(msg);
+        msg_buf_free(msg);
  err_out:
         uloga("'%s()': failed with %d.\n", __func__, err);
         return err;
@@ -1748,7 +2084,7 @@ static int obj_desc_not_found(struct node_id *peer, int qid, int num_vers, int *
 static int obj_get_desc_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
 {
         free(msg->msg_data);
-        free(msg);
+        msg_buf_free(msg);
         return 0;
 }
 
@@ -1762,13 +2098,17 @@ static int dsgrpc_obj_get_desc(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
         struct node_id *peer = ds_get_peer(dsg->ds, cmd->id);
         struct obj_descriptor odsc, *odsc_tab;
         struct sspace* ssd = lookup_sspace(dsg, oh->u.o.odsc.name, &oh->gdim);
-        const struct obj_descriptor *podsc[ssd->ent_self->odsc_num];
-        int obj_versions[ssd->ent_self->odsc_size];
+        struct dht_entry *de = ssd->ent_self;
         int num_odsc, i;
         struct msg_buf *msg;
         int err = -ENOENT;
 
-        num_odsc = dht_find_entry_all(ssd->ent_self, &oh->u.o.odsc, podsc);
+        /* Hold the entry until the descriptors are copied out. */
+        pthread_rwlock_rdlock(&de->de_lock);
+        const struct obj_descriptor *podsc[de->odsc_num];
+        int obj_versions[de->odsc_size];
+
+        num_odsc = dht_find_entry_all(de, &oh->u.o.odsc, podsc);
         if (!num_odsc) {
 #ifdef DEBUG
 		char *str = 0;
@@ -1779,7 +2119,8 @@ static int dsgrpc_obj_get_desc(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 		uloga("'%s()': %s\n", __func__, str);
 		free(str);
 #endif
-		i = dht_find_versions(ssd->ent_self, &oh->u.o.odsc, obj_versions);
+		i = dht_find_versions(de, &oh->u.o.odsc, obj_versions);
+                pthread_rwlock_unlock(&de->de_lock);
                 err = obj_desc_not_found(peer, oh->qid, i, obj_versions);
                 if (err < 0)
                         goto err_out;
@@ -1789,8 +2130,10 @@ static int dsgrpc_obj_get_desc(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 
         err = -ENOMEM;
         odsc_tab = malloc(sizeof(*odsc_tab) * num_odsc);
-        if (!odsc_tab)
+        if (!odsc_tab) {
+                pthread_rwlock_unlock(&de->de_lock);
                 goto err_out;
+        }
 
         for (i = 0; i < num_odsc; i++) {
             odsc = *podsc[i];
@@ -1799,6 +2142,7 @@ static int dsgrpc_obj_get_desc(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
             bbox_intersect(&oh->u.o.odsc.bb, &odsc.bb, &odsc.bb);
             odsc_tab[i] = odsc;
         }
+        pthread_rwlock_unlock(&de->de_lock);
 
         msg = msg_buf_alloc(rpc_s, peer, 1);
         if (!msg) {
@@ -1823,63 +2167,320 @@ static int dsgrpc_obj_get_desc(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
                 return 0;
 
         free(odsc_tab);
-        free(msg);
+        msg_buf_free(msg);
  err_out:
         uloga("'%s()': failed with %d.\n", __func__, err);
         return err;
 }
 
-static int obj_cq_local_register(struct hdr_obj_get *oh)
+/*
+  Rpc routine to answer a value-range query: send back the descriptors
+  that intersect the query, each with the value range of its object.
+*/
+static int dsgrpc_obj_get_summary(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 {
-        struct cont_query *cq;
+        struct hdr_obj_get *oh = (struct hdr_obj_get *) cmd->pad;
+        struct node_id *peer = ds_get_peer(dsg->ds, cmd->id);
+        struct sspace* ssd = lookup_sspace(dsg, oh->u.o.odsc.name, &oh->gdim);
+        struct dht_entry *de = ssd->ent_self;
+        struct obj_desc_summary *tab = NULL;
+        struct msg_buf *msg;
+        int num_odsc, i, qid = oh->qid;
         int err = -ENOMEM;
 
-        cq = cq_alloc(oh);
-        if (!cq)
+        pthread_rwlock_rdlock(&de->de_lock);
+        const struct obj_descriptor *podsc[de->odsc_num];
+
+        num_odsc = dht_find_entry_all(de, &oh->u.o.odsc, podsc);
+        if (num_odsc > 0) {
+                tab = malloc(sizeof(*tab) * num_odsc);
+                if (!tab) {
+                        pthread_rwlock_unlock(&de->de_lock);
+                        goto err_out;
+                }
+        }
+
+        for (i = 0; i < num_odsc; i++) {
+                tab[i].odsc = *podsc[i];
+                tab[i].odsc.st = oh->u.o.odsc.st;
+                bbox_intersect(&oh->u.o.odsc.bb, &tab[i].odsc.bb, &tab[i].odsc.bb);
+                tab[i].sum = *dht_entry_summary(podsc[i]);
+        }
+        pthread_rwlock_unlock(&de->de_lock);
+
+        msg = msg_buf_alloc(rpc_s, peer, 1);
+        if (!msg) {
+                free(tab);
                 goto err_out;
+        }
 
-        cq_add_to_list(cq);
+        if (num_odsc > 0) {
+                msg->size = sizeof(*tab) * num_odsc;
+                msg->msg_data = tab;
+                msg->cb = default_completion_with_data_callback;
+        }
 
-        return 0;
+        msg->msg_rpc->cmd = ss_obj_get_summary;
+        msg->msg_rpc->id = DSG_ID;
+
+        oh = (struct hdr_obj_get *) msg->msg_rpc->pad;
+        oh->qid = qid;
+        oh->u.o.num_de = num_odsc;
+
+        err = rpc_send(rpc_s, peer, msg);
+        if (err == 0)
+                return 0;
+
+        free(tab);
+        msg_buf_free(msg);
  err_out:
         ERROR_TRACE();
 }
 
-static int obj_cq_forward_register(struct hdr_obj_get *oh)
+/*
+  Answer a batch request 'cmd' with its table alone, all entries
+  failed with 'err', so that the compute peer does not wait for it;
+  takes over 'ent_tab'.
+*/
+static int obj_batch_send_err(struct rpc_server *rpc_s, struct node_id *peer,
+        enum cmd_type cmd, struct obj_batch_ent *ent_tab, int num_ent, int err)
 {
+        struct hdr_obj_batch *hr;
         struct msg_buf *msg;
-        struct dht_entry *de_tab[dsg->ssd->dht->num_entries];
-        struct node_id *peer;
-        int num_de, i, err;
+        int i;
 
-        oh->rc = 1;
-        num_de = ssd_hash(dsg->ssd, &oh->u.o.odsc.bb, de_tab);
+        for (i = 0; i < num_ent; i++)
+                ent_tab[i].num_de = err;
 
-        for (i = 0; i < num_de; i++) {
-                peer = ds_get_peer(dsg->ds, de_tab[i]->rank);
-                if (peer == dsg->ds->self) {
-                        err = obj_cq_local_register(oh);
-                        if (err < 0)
-                                goto err_out;
-                        continue;
-                }
+        err = -ENOMEM;
+        msg = msg_buf_alloc(rpc_s, peer, 1);
+        if (!msg)
+                goto err_out;
 
-                err = -ENOMEM;
-                msg = msg_buf_alloc(dsg->ds->rpc_s, peer, 1);
-                if (!msg)
-                        goto err_out;
+        msg->msg_data = ent_tab;
+        msg->size = sizeof(*ent_tab) * num_ent;
+        msg->cb = default_completion_with_data_callback;
 
-                msg->msg_rpc->cmd = ss_obj_cq_register;
-                msg->msg_rpc->id = DSG_ID; // dsg->ds->self->id;
+        msg->msg_rpc->cmd = cmd;
+        msg->msg_rpc->id = DSG_ID;
 
-                memcpy(msg->msg_rpc->pad, oh, sizeof(*oh));
+        hr = (struct hdr_obj_batch *) msg->msg_rpc->pad;
+        hr->num_ent = num_ent;
+        hr->size = msg->size;
 
-                err = rpc_send(dsg->ds->rpc_s, peer, msg);
-                if (err < 0) {
-                        free(msg);
-                        goto err_out;
-                }
-        }
+        err = rpc_send(rpc_s, peer, msg);
+        if (err == 0)
+                return 0;
+
+        msg_buf_free(msg);
+ err_out:
+        free(ent_tab);
+        ERROR_TRACE();
+}
+
+/*
+  Look up the descriptors for all queries of a batch and send them
+  back to the compute peer in a single reply.
+*/
+static int obj_get_desc_batch_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct hdr_obj_batch *hb = msg->private;
+        struct obj_batch_ent *ent, *ent_tab = msg->msg_data;
+        struct node_id *peer = (struct node_id *) msg->peer;
+        struct obj_descriptor *odsc_tab;
+        struct hdr_obj_batch *hr;
+        struct msg_buf *rmsg;
+        struct sspace *ssd;
+        void *buf;
+        int num_ent = hb->num_ent;
+        int num_odsc = 0, i, j, n;
+        int err = -ENOMEM;
+
+        /* Count the descriptors first to size the reply. */
+        for (i = 0; i < num_ent; i++) {
+                ent = &ent_tab[i];
+                ssd = lookup_sspace(dsg, ent->odsc.name, &ent->gdim);
+                pthread_rwlock_rdlock(&ssd->ent_self->de_lock);
+                {
+                        const struct obj_descriptor *podsc[ssd->ent_self->odsc_num];
+
+                        ent->num_de = dht_find_entry_all(ssd->ent_self, 
+                                                &ent->odsc, podsc);
+                }
+                pthread_rwlock_unlock(&ssd->ent_self->de_lock);
+                if (ent->num_de == 0)
+                        ent->num_de = -ENOENT;
+                else    num_odsc += ent->num_de;
+        }
+
+        buf = malloc(sizeof(*ent_tab) * num_ent + sizeof(*odsc_tab) * num_odsc);
+        if (!buf)
+                goto err_out;
+        memcpy(buf, ent_tab, sizeof(*ent_tab) * num_ent);
+        odsc_tab = (struct obj_descriptor *) ((struct obj_batch_ent *) buf + num_ent);
+
+        for (i = 0; i < num_ent; i++) {
+                ent = &ent_tab[i];
+                if (ent->num_de < 0)
+                        continue;
+
+                ssd = lookup_sspace(dsg, ent->odsc.name, &ent->gdim);
+                pthread_rwlock_rdlock(&ssd->ent_self->de_lock);
+                {
+                        const struct obj_descriptor *podsc[ssd->ent_self->odsc_num];
+
+                        /* Skip descriptors added since the first pass. */
+                        n = dht_find_entry_all(ssd->ent_self, &ent->odsc, podsc);
+                        if (n > ent->num_de)
+                                n = ent->num_de;
+                        for (j = 0; j < n; j++) {
+                                *odsc_tab = *podsc[j];
+                                /* Preserve storage type at the destination. */
+                                odsc_tab->st = ent->odsc.st;
+                                bbox_intersect(&ent->odsc.bb, &odsc_tab->bb, 
+                                        &odsc_tab->bb);
+                                odsc_tab++;
+                        }
+                }
+                pthread_rwlock_unlock(&ssd->ent_self->de_lock);
+        }
+
+        rmsg = msg_buf_alloc(rpc_s, peer, 1);
+        if (!rmsg) {
+                free(buf);
+                goto err_out;
+        }
+
+        rmsg->msg_data = buf;
+        rmsg->size = sizeof(*ent_tab) * num_ent + sizeof(*odsc_tab) * num_odsc;
+        rmsg->cb = obj_get_desc_completion;
+
+        rmsg->msg_rpc->cmd = ss_obj_get_desc_batch;
+        rmsg->msg_rpc->id = DSG_ID;
+
+        hr = (struct hdr_obj_batch *) rmsg->msg_rpc->pad;
+        hr->num_ent = num_ent;
+        hr->size = rmsg->size;
+
+        err = rpc_send(rpc_s, peer, rmsg);
+        if (err == 0) {
+                free(hb);
+                free(msg->msg_data);
+                msg_buf_free(msg);
+                return 0;
+        }
+
+        free(buf);
+        msg_buf_free(rmsg);
+ err_out:
+        obj_batch_send_err(rpc_s, peer, ss_obj_get_desc_batch, ent_tab, num_ent, err);
+        free(hb);
+        msg_buf_free(msg);
+        /* Answered and released here; do not fail back to the
+           receive path, which would release the message again. */
+        uloga("'%s()': failed with %d.\n", __func__, err);
+        return 0;
+}
+
+/*
+  RPC routine to send the object descriptors for a batch of queries
+  from one compute peer.
+*/
+static int dsgrpc_obj_get_desc_batch(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_batch *hbt, *hb = (struct hdr_obj_batch *) cmd->pad;
+        struct node_id *peer = ds_get_peer(dsg->ds, cmd->id);
+        struct msg_buf *msg;
+        void *buf;
+        int err = -ENOMEM;
+
+        buf = malloc(hb->size);
+        if (!buf)
+                goto err_out;
+
+        hbt = malloc(sizeof(*hb));
+        if (!hbt) {
+                free(buf);
+                goto err_out;
+        }
+        memcpy(hbt, hb, sizeof(*hb));
+
+        msg = msg_buf_alloc(rpc_s, peer, 0);
+        if (!msg) {
+                free(buf);
+                free(hbt);
+                goto err_out;
+        }
+
+        msg->msg_data = buf;
+        msg->size = hb->size;
+        msg->private = hbt;
+        msg->cb = obj_get_desc_batch_completion;
+
+        rpc_mem_info_cache(peer, msg, cmd);
+        err = rpc_receive_direct(rpc_s, peer, msg);
+        rpc_mem_info_reset(peer, msg, cmd);
+        if (err == 0)
+                return 0;
+
+        free(buf);
+        free(hbt);
+        msg_buf_free(msg);
+ err_out:
+        ERROR_TRACE();
+}
+
+static int obj_cq_local_register(struct hdr_obj_get *oh)
+{
+        struct cont_query *cq;
+        int err = -ENOMEM;
+
+        cq = cq_alloc(oh);
+        if (!cq)
+                goto err_out;
+
+        cq_add_to_list(cq);
+
+        return 0;
+ err_out:
+        ERROR_TRACE();
+}
+
+static int obj_cq_forward_register(struct hdr_obj_get *oh)
+{
+        struct msg_buf *msg;
+        struct dht_entry *de_tab[dsg->ssd->dht->num_entries];
+        struct node_id *peer;
+        int num_de, i, err;
+
+        oh->rc = 1;
+        num_de = ssd_hash(dsg->ssd, &oh->u.o.odsc.bb, de_tab);
+
+        for (i = 0; i < num_de; i++) {
+                peer = ds_get_peer(dsg->ds, de_tab[i]->rank);
+                if (peer == dsg->ds->self) {
+                        err = obj_cq_local_register(oh);
+                        if (err < 0)
+                                goto err_out;
+                        continue;
+                }
+
+                err = -ENOMEM;
+                msg = msg_buf_alloc(dsg->ds->rpc_s, peer, 1);
+                if (!msg)
+                        goto err_out;
+
+                msg->msg_rpc->cmd = ss_obj_cq_register;
+                msg->msg_rpc->id = DSG_ID; // dsg->ds->self->id;
+
+                memcpy(msg->msg_rpc->pad, oh, sizeof(*oh));
+
+                err = rpc_send(dsg->ds->rpc_s, peer, msg);
+                if (err < 0) {
+                        msg_buf_free(msg);
+                        goto err_out;
+                }
+        }
 
         return 0;
  err_out:
@@ -1913,7 +2514,9 @@ static int dsgrpc_obj_hint(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 #endif
 	
 	// CRITICAL: use version here !!!
+	pthread_mutex_lock(&dsg->ls_lock);
 	from_obj = ls_find(dsg->ls, &oh->u.o.odsc);
+	pthread_mutex_unlock(&dsg->ls_lock);
 
 	if (!from_obj) {
 		char *str;
@@ -1924,7 +2527,8 @@ static int dsgrpc_obj_hint(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 	}
 	//prefetch data from ssd to memory
 	pthread_mutex_lock(&pmutex); //lock
-	if (from_obj->sl == in_ssd || from_obj->data == NULL || from_obj->_data == NULL){
+	if (from_obj->sl != in_producer &&
+	    (from_obj->sl == in_ssd || from_obj->data == NULL || from_obj->_data == NULL)){
 		cond_num = 1;
 #ifdef DEBUG
 	{
@@ -1969,11 +2573,80 @@ static int dsgrpc_obj_cq_register(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
         ERROR_TRACE();
 }
 
+/*
+  Find the local object for descriptor 'odsc' and make sure its data
+  is in memory; the caller holds 'ls_lock'.
+*/
+static struct obj_data *obj_find_in_mem(struct obj_descriptor *odsc)
+{
+        struct obj_data *from_obj;
+
+        // CRITICAL: use version here !!!
+        from_obj = ls_find(dsg->ls, odsc);
+        if (!from_obj) {
+            char *str;
+            str = obj_desc_sprint(odsc);
+            uloga("'%s()': %s\n", __func__, str);
+            free(str);
+            return NULL;
+        }
+
+        /* Data put lazily is pulled first, see obj_pull_wait(). */
+        if (from_obj->sl == in_producer)
+                return NULL;
+
+	/*cache data from ssd to memory, if it isn't prefetched just moment */
+	while (from_obj->sl == in_ssd && from_obj->so == prefetching){}
+	if (from_obj->data == NULL && from_obj->_data == NULL){
+	//if (from_obj->sl == in_ssd || (from_obj->data == NULL && from_obj->_data == NULL)){
+		//pthread_mutex_lock(&pmutex); //lock
+		cache_replacement(obj_data_size(&from_obj->obj_desc));
+			
+		obj_data_copy_to_mem(from_obj);
+
+		from_obj->so = caching;
+		pthread_mutex_lock(&pmutex); //lock
+		dsg->ls->mem_used += obj_data_size(&from_obj->obj_desc);
+		pthread_mutex_unlock(&pmutex);
+        }
+
+        return from_obj;
+}
+
+/*
+  Find the local object for 'odsc', bring it to memory and pin it
+  there while a worker reads from it. Cache replacement skips pinned
+  objects, and an object removed or replaced meanwhile is freed by
+  obj_unref().
+*/
+static struct obj_data *obj_ref_in_mem(struct obj_descriptor *odsc)
+{
+        struct obj_data *od;
+
+        pthread_mutex_lock(&dsg->ls_lock);
+        od = obj_find_in_mem(odsc);
+        if (od)
+                od->refcnt++;
+        pthread_mutex_unlock(&dsg->ls_lock);
+
+        return od;
+}
+
+static void obj_unref(struct obj_data *od)
+{
+        pthread_mutex_lock(&dsg->ls_lock);
+        if (--od->refcnt == 0 && od->f_free)
+                obj_data_free(od);
+        pthread_mutex_unlock(&dsg->ls_lock);
+}
+
 static int obj_get_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
 {
         struct obj_data *od = msg->private;
 
-        free(msg);
+        /* The transport may have written straight from the object */
+        obj_unref(od->obj_ref);
+        msg_buf_free(msg);
         obj_data_free(od);
 
         uloga("%s(Yubo), get completed!\n",__func__);
@@ -1982,18 +2655,310 @@ static int obj_get_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
 }
 
 /*
-  Rpc routine  to respond to  an 'ss_obj_get' request; we  assume that
-  the requesting peer knows we have the data.
+  Request handed over to the worker pool; the command is copied as
+  the transport reuses its buffer for the next request.
 */
-static int dsgrpc_obj_get(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+struct dsg_work {
+        struct rpc_server       *rpc_s;
+        rpc_service             service;
+        struct rpc_cmd          cmd;
+        completion_callback     cb;
+        struct msg_buf          *msg;
+
+        /* Entry in the 'pull_list' of an object put lazily. */
+        struct list_head        entry;
+};
+
+static int dsg_work_run(void *arg)
+{
+        struct dsg_work *w = arg;
+        int err;
+
+        if (w->service)
+                err = w->service(w->rpc_s, &w->cmd);
+        else    err = w->cb(w->rpc_s, w->msg);
+        free(w);
+
+        return err;
+}
+
+static int dsg_work_post(struct dsg_work *w)
+{
+        int err;
+
+        err = ds_workers_post(dsg->wp, dsg_work_run, w);
+        if (err < 0)
+                free(w);
+
+        return err;
+}
+
+/*
+  Run rpc 'service' for 'cmd' on a worker, or right away when the
+  server runs without workers.
+*/
+static int dsg_post_service(rpc_service service, struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct dsg_work *w;
+
+        if (!dsg->wp)
+                return service(rpc_s, cmd);
+
+        w = calloc(1, sizeof(*w));
+        if (!w)
+                return -ENOMEM;
+
+        w->rpc_s = rpc_s;
+        w->service = service;
+        memcpy(&w->cmd, cmd, sizeof(*cmd));
+
+        return dsg_work_post(w);
+}
+
+/*
+  Same as dsg_post_service() for the completion of a received message.
+*/
+static int dsg_post_completion(completion_callback cb, struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct dsg_work *w;
+
+        if (!dsg->wp)
+                return cb(rpc_s, msg);
+
+        w = calloc(1, sizeof(*w));
+        if (!w)
+                return -ENOMEM;
+
+        w->rpc_s = rpc_s;
+        w->cb = cb;
+        w->msg = msg;
+
+        return dsg_work_post(w);
+}
+
+/*
+  Ask the producer of the lazy object 'od' for its data; the object
+  is pinned until the answer comes in.
+*/
+static int obj_pull_send(struct rpc_server *rpc_s, struct obj_data *od)
+{
+        struct node_id *peer = ds_get_peer(dsg->ds, od->src_id);
+        struct hdr_obj_put *hdr;
+        struct msg_buf *msg;
+        int err = -ENOMEM;
+
+        msg = msg_buf_alloc(rpc_s, peer, 1);
+        if (!msg)
+                goto err_out;
+
+        msg->msg_rpc->cmd = ss_obj_pull;
+        msg->msg_rpc->id = DSG_ID;
+
+        hdr = (struct hdr_obj_put *) msg->msg_rpc->pad;
+        hdr->odsc = od->obj_desc;
+        hdr->flags = 0;
+        hdr->ref = (uintptr_t) od;
+
+        err = rpc_send(rpc_s, peer, msg);
+        if (err == 0)
+                return 0;
+
+        msg_buf_free(msg);
+ err_out:
+        ERROR_TRACE();
+}
+
+/*
+  Finish a pull of the lazy object 'od'; 'f_data' tells if its data
+  came in, and 'f_ref' if this is the answer to our 'ss_obj_pull'
+  rather than a flush from the producer. The requests waiting for the
+  data run again once it is in, or once it is known to be lost; a
+  lost object is dropped, so they fail as for any missing object.
+*/
+static int obj_pull_done(struct obj_data *od, int f_data, int f_ref)
+{
+        struct list_head pull_list;
+        struct dsg_work *w, *t;
+        int err = 0;
+
+        INIT_LIST_HEAD(&pull_list);
+
+        pthread_mutex_lock(&dsg->ls_lock);
+        if (f_data) {
+                od->sl = in_memory;
+                od->so = caching;
+                obj_cache_add(od);
+        }
+        if (f_ref)
+                od->f_pull = 0;
+
+        /* Unless data is still on the way, from a pull or a flush. */
+        if (od->sl != in_producer || (!od->f_pull && !od->_data)) {
+                if (od->sl == in_producer && !od->f_free) {
+                        uloga("'%s()': data of '%s' version %d is lost.\n",
+                                __func__, od->obj_desc.name, od->obj_desc.version);
+                        ls_remove(dsg->ls, od);
+                        od->f_free = 1;
+                }
+                list_for_each_entry_safe(w, t, &od->pull_list, struct dsg_work, entry) {
+                        list_del(&w->entry);
+                        list_add_tail(&w->entry, &pull_list);
+                }
+        }
+
+        if (--od->refcnt == 0 && od->f_free)
+                obj_data_free(od);
+        pthread_mutex_unlock(&dsg->ls_lock);
+
+        list_for_each_entry_safe(w, t, &pull_list, struct dsg_work, entry) {
+                list_del(&w->entry);
+                if (dsg->wp)
+                        err = dsg_work_post(w);
+                else    err = dsg_work_run(w);
+        }
+
+        return err;
+}
+
+static int obj_pull_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct obj_data *od = msg->private;
+
+        msg_buf_free(msg);
+        return obj_pull_done(od, 1, 1);
+}
+
+static int obj_flush_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct obj_data *od = msg->private;
+
+        msg_buf_free(msg);
+        return obj_pull_done(od, 1, 0);
+}
+
+/*
+  Receive the data of an object put lazily, sent by its producer in
+  answer to a pull, or flushed when the producer exits. Flushed data
+  for an object that is gone or already in memory is dropped.
+*/
+static int obj_pull_recv(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_put *hdr = (struct hdr_obj_put *)cmd->pad;
+        struct node_id *peer = ds_get_peer(dsg->ds, cmd->id);
+        struct obj_data *od = (struct obj_data *) (uintptr_t) hdr->ref;
+        struct msg_buf *msg;
+        void *buf;
+        int err = -ENOMEM;
+
+        if (hdr->flags & obj_put_lost)
+                return obj_pull_done(od, 0, 1);
+
+        if (!od) {
+                pthread_mutex_lock(&dsg->ls_lock);
+                od = ls_find(dsg->ls, &hdr->odsc);
+                if (od && od->sl == in_producer &&
+                    bbox_equals(&od->obj_desc.bb, &hdr->odsc.bb))
+                        od->refcnt++;
+                else    od = NULL;
+                pthread_mutex_unlock(&dsg->ls_lock);
+        }
+
+        buf = malloc(obj_data_size(&hdr->odsc) + 7);
+        if (!buf)
+                goto err_out;
+
+        msg = msg_buf_alloc(rpc_s, peer, 0);
+        if (!msg) {
+                free(buf);
+                goto err_out;
+        }
+
+        msg->size = obj_data_size(&hdr->odsc);
+        if (od) {
+                /* Nobody reads the object before it leaves 'in_producer'. */
+                od->_data = od->data = buf;
+                ALIGN_ADDR_QUAD_BYTES(od->data);
+                msg->msg_data = od->data;
+                msg->private = od;
+                msg->cb = (hdr->ref)? obj_pull_completion : obj_flush_completion;
+        }
+        else {
+                msg->msg_data = buf;
+                msg->cb = default_completion_with_data_callback;
+        }
+
+        rpc_mem_info_cache(peer, msg, cmd);
+        err = rpc_receive_direct(rpc_s, peer, msg);
+        rpc_mem_info_reset(peer, msg, cmd);
+        if (err == 0)
+                return 0;
+
+        free(buf);
+        msg_buf_free(msg);
+ err_out:
+        if (od) {
+                od->_data = od->data = NULL;
+                obj_pull_done(od, 0, !!hdr->ref);
+        }
+        ERROR_TRACE();
+}
+
+/*
+  Queue a copy of work 'wt' on the object of 'odsc' if its data is
+  still with the producer, and pull the data unless a pull is under
+  way; the work runs again once the data is in. Returns 1 if the work
+  was queued, 0 if the data is here or there is no such object.
+*/
+static int obj_pull_wait(struct obj_descriptor *odsc, const struct dsg_work *wt)
+{
+        struct obj_data *od;
+        struct dsg_work *w;
+        int f_pull = 0, err = 0;
+
+        pthread_mutex_lock(&dsg->ls_lock);
+        od = ls_find(dsg->ls, odsc);
+        if (od && od->sl == in_producer) {
+                err = -ENOMEM;
+                w = malloc(sizeof(*w));
+                if (w) {
+                        *w = *wt;
+                        list_add_tail(&w->entry, &od->pull_list);
+                        if (!od->f_pull) {
+                                od->f_pull = 1;
+                                od->refcnt++;
+                                f_pull = 1;
+                        }
+                        err = 1;
+                }
+        }
+        pthread_mutex_unlock(&dsg->ls_lock);
+
+        if (f_pull && obj_pull_send(wt->rpc_s, od) < 0)
+                obj_pull_done(od, 0, 1);
+
+        return err;
+}
+
+/*
+  Copy the requested part of a local object and send it back; runs on
+  a worker if the server has any.
+*/
+static int obj_get_send_data(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 {
         struct hdr_obj_get *oh = (struct hdr_obj_get *) cmd->pad;
         struct node_id *peer;
         struct msg_buf *msg;
         struct obj_data *od, *from_obj;
-        int fast_v;
+        int fast_v, num_iov = 0;
         int err = -ENOENT; 
 
+        struct dsg_work wt = {.rpc_s = rpc_s, .service = obj_get_send_data, .cmd = *cmd};
+
+        /* Data put lazily comes from the producer first. */
+        err = obj_pull_wait(&oh->u.o.odsc, &wt);
+        if (err != 0)
+                return (err > 0)? 0 : err;
+
         peer = ds_get_peer(dsg->ds, cmd->id);
 
 #ifdef DEBUG
@@ -2007,34 +2972,11 @@ static int dsgrpc_obj_get(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
  	 uloga("'%s()': %s\n", __func__, str);
 	 free(str);
  }
-#endif
-
-        // CRITICAL: use version here !!!
-        from_obj = ls_find(dsg->ls, &oh->u.o.odsc);
-        if (!from_obj) {
-            char *str;
-            str = obj_desc_sprint(&oh->u.o.odsc);
-            uloga("'%s()': %s\n", __func__, str);
-            free(str);
-            goto err_out;
-        }
-
-	/*cache data from ssd to memory, if it isn't prefetched just moment */
-	while (from_obj->sl == in_ssd && from_obj->so == prefetching){}
-	if (from_obj->data == NULL && from_obj->_data == NULL){
-	//if (from_obj->sl == in_ssd || (from_obj->data == NULL && from_obj->_data == NULL)){
-		//pthread_mutex_lock(&pmutex); //lock
-		cache_replacement(obj_data_size(&from_obj->obj_desc));
-       // uloga("%s(Yubo), in dsgrpc_obj_get #1\n", __func__);
-			
-		obj_data_copy_to_mem(from_obj);
-
-		from_obj->so = caching;
-		pthread_mutex_lock(&pmutex); //lock
-		dsg->ls->mem_used += obj_data_size(&from_obj->obj_desc);
-		pthread_mutex_unlock(&pmutex);
-        }
-       // uloga("%s(Yubo), in dsgrpc_obj_get #2\n", __func__);
+#endif
+
+        from_obj = obj_ref_in_mem(&oh->u.o.odsc);
+        if (!from_obj)
+                goto err_out;
 
         //TODO:  if required  object is  not  found, I  should send  a
         //proper error message back, and the remote node should handle
@@ -2046,8 +2988,15 @@ static int dsgrpc_obj_get(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
           RPC in response to a transfer.
         */
 
+#ifdef HAVE_TCP_SOCKET
+        /* Send the region straight from the stored object when it
+           covers the request; the object stays pinned until sent. */
+        fast_v = bbox_include(&from_obj->obj_desc.bb, &oh->u.o.odsc.bb) &&
+                oh->u.o.odsc.size == from_obj->obj_desc.size;
+#else
         fast_v = 0; // ERROR: iovec operation fails after Cray Portals
         // Update (oh->odsc.st == from_obj->obj_desc.st);
+#endif
 
         err = -ENOMEM;
         // CRITICAL:     experimental    stuff,     assumption    data
@@ -2055,10 +3004,14 @@ static int dsgrpc_obj_get(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
         // od = obj_data_alloc(&oh->odsc);
         od = (fast_v)? obj_data_allocv(&oh->u.o.odsc) : obj_data_alloc(&oh->u.o.odsc);
       //  uloga("%s(Yubo), in dsgrpc_obj_get #3\n", __func__);
-        if (!od)
+        if (!od) {
+                obj_unref(from_obj);
                 goto err_out;
+        }
 
-        (fast_v)? ssd_copyv(od, from_obj) : ssd_copy(od, from_obj);
+        if (fast_v)
+                num_iov = ssd_copyv(od, from_obj);
+        else    ssd_copy(od, from_obj);
         od->obj_ref = from_obj;
 
       //  uloga("%s(Yubo), in dsgrpc_obj_get #4\n", __func__);
@@ -2066,11 +3019,12 @@ static int dsgrpc_obj_get(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
         msg = msg_buf_alloc(rpc_s, peer, 0);
         if (!msg) {
                 obj_data_free(od);
+                obj_unref(from_obj);
                 goto err_out;
         }
 
         msg->msg_data = od->data;
-        msg->size = (fast_v)? obj_data_sizev(&od->obj_desc) / sizeof(iovec_t) : obj_data_size(&od->obj_desc);
+        msg->size = (fast_v)? num_iov : obj_data_size(&od->obj_desc);
         msg->cb = obj_get_completion;
         msg->private = od;
       //  uloga("%s(Yubo), in dsgrpc_obj_get #5\n", __func__);
@@ -2082,8 +3036,9 @@ static int dsgrpc_obj_get(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
         if (err == 0)
                 return 0;
 
+        obj_unref(from_obj);
         obj_data_free(od);
-        free(msg);
+        msg_buf_free(msg);
        // uloga("%s(Yubo), in dsgrpc_obj_get #7\n", __func__);
  err_out:
         uloga("'%s()': failed with %d.\n", __func__, err);
@@ -2091,51 +3046,599 @@ static int dsgrpc_obj_get(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 }
 
 /*
-  Routine to execute "custom" application filters.
+  Copy every stride-th point of the requested part of a local object
+  and send the reduced part back; runs on a worker if the server has
+  any.
 */
-static int dsgrpc_obj_filter(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+static int obj_get_send_strided(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
 {
-        struct hdr_obj_filter *hf = (struct hdr_obj_filter *) cmd->pad;
+        struct hdr_obj_get_strided *hs = (struct hdr_obj_get_strided *) cmd->pad;
         struct node_id *peer = ds_get_peer(dsg->ds, cmd->id);
+        struct dsg_work wt = {.rpc_s = rpc_s, .service = obj_get_send_strided, .cmd = *cmd};
+        /* Copies, the header is packed. */
+        struct obj_descriptor q_odsc = hs->odsc, odsc = hs->odsc;
+        struct coord stride = hs->stride;
+        struct bbox bb = hs->odsc.bb;
         struct msg_buf *msg;
-        struct obj_data *from;
-	double *dval;
-        int err = -ENOENT;
+        struct obj_data *od, *from_obj;
+        int i, err;
 
-        // BUG: when using version numbers here.
-        from = ls_find(dsg->ls, &hf->odsc);
-        if (!from) {
-		char *str;
-                str = obj_desc_sprint(&hf->odsc);
-		uloga("'%s()': %s\n", __func__, str);
-		free(str);
+        err = obj_pull_wait(&q_odsc, &wt);
+        if (err != 0)
+                return (err > 0)? 0 : err;
+
+        err = -EINVAL;
+        for (i = 0; i < odsc.bb.num_dims; i++) {
+                if (stride.c[i] == 0)
+                        goto err_out;
+                odsc.bb.lb.c[i] = 0;
+                odsc.bb.ub.c[i] = (q_odsc.bb.ub.c[i] - q_odsc.bb.lb.c[i]) /
+                        stride.c[i];
+        }
+
+        err = -ENOENT;
+        from_obj = obj_ref_in_mem(&q_odsc);
+        if (!from_obj)
+                goto err_out;
+
+        err = -ENOMEM;
+        od = obj_data_alloc(&odsc);
+        if (!od) {
+                obj_unref(from_obj);
+                goto err_out;
+        }
 
+        ssd_copy_strided(od, from_obj, &bb, &stride);
+        od->obj_ref = from_obj;
+
+        msg = msg_buf_alloc(rpc_s, peer, 0);
+        if (!msg) {
+                obj_data_free(od);
+                obj_unref(from_obj);
                 goto err_out;
         }
 
+        msg->msg_data = od->data;
+        msg->size = obj_data_size(&od->obj_desc);
+        msg->cb = obj_get_completion;
+        msg->private = od;
+
+        rpc_mem_info_cache(peer, msg, cmd);
+        err = rpc_send_direct(rpc_s, peer, msg);
+        rpc_mem_info_reset(peer, msg, cmd);
+        if (err == 0)
+                return 0;
+
+        obj_unref(from_obj);
+        obj_data_free(od);
+        msg_buf_free(msg);
+ err_out:
+        uloga("'%s()': failed with %d.\n", __func__, err);
+        return err;
+}
+
+/*
+  Rpc routine  to respond to  an 'ss_obj_get' request; we  assume that
+  the requesting peer knows we have the data.
+*/
+static int dsgrpc_obj_get(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        return dsg_post_service(obj_get_send_data, rpc_s, cmd);
+}
+
+static int dsgrpc_obj_get_strided(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        return dsg_post_service(obj_get_send_strided, rpc_s, cmd);
+}
+
+/*
+  Copy the data of all parts in a batch into one buffer and send it
+  back to the compute peer.
+*/
+static int obj_get_batch_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct hdr_obj_batch *hb = msg->private;
+        struct obj_batch_ent *ent_tab = msg->msg_data;
+        struct node_id *peer = (struct node_id *) msg->peer;
+        struct obj_data *from_obj;
+        struct obj_data od;
+        struct hdr_obj_batch *hr;
+        struct msg_buf *rmsg;
+        uint64_t size;
+        char *buf, *data;
+        int num_ent = hb->num_ent;
+        int i, err;
+        struct dsg_work wt = {.rpc_s = rpc_s, .cb = obj_get_batch_completion, .msg = msg};
+
+        for (i = 0; i < num_ent; i++) {
+                err = obj_pull_wait(&ent_tab[i].odsc, &wt);
+                if (err > 0)
+                        return 0;
+                if (err < 0)
+                        goto err_out;
+        }
+
         err = -ENOMEM;
-        dval = malloc(sizeof(*dval));
-        if (!dval)
+        size = sizeof(*ent_tab) * num_ent;
+        pthread_mutex_lock(&dsg->ls_lock);
+        for (i = 0; i < num_ent; i++) {
+                if (ls_find(dsg->ls, &ent_tab[i].odsc)) {
+                        ent_tab[i].num_de = 1;
+                        size += obj_data_size(&ent_tab[i].odsc);
+                }
+                else    ent_tab[i].num_de = -ENOENT;
+        }
+        pthread_mutex_unlock(&dsg->ls_lock);
+
+        buf = malloc(size);
+        if (!buf)
+                goto err_out;
+        memcpy(buf, ent_tab, sizeof(*ent_tab) * num_ent);
+
+        /* Bring each object to memory right before the copy, as
+           loading one may evict another; a part that is gone by then
+           is answered as not found, and takes no room. */
+        data = buf + sizeof(*ent_tab) * num_ent;
+        for (i = 0; i < num_ent; i++) {
+                if (ent_tab[i].num_de < 0)
+                        continue;
+
+                from_obj = obj_ref_in_mem(&ent_tab[i].odsc);
+                if (!from_obj) {
+                        ((struct obj_batch_ent *) buf)[i].num_de = -ENOENT;
+                        size -= obj_data_size(&ent_tab[i].odsc);
+                        continue;
+                }
+
+                memset(&od, 0, sizeof(od));
+                od.obj_desc = ent_tab[i].odsc;
+                od.data = data;
+                ssd_copy(&od, from_obj);
+                obj_unref(from_obj);
+                data += obj_data_size(&ent_tab[i].odsc);
+        }
+
+        rmsg = msg_buf_alloc(rpc_s, peer, 1);
+        if (!rmsg) {
+                free(buf);
+                goto err_out;
+        }
+
+        rmsg->msg_data = buf;
+        rmsg->size = size;
+        rmsg->cb = default_completion_with_data_callback;
+
+        rmsg->msg_rpc->cmd = ss_obj_get_batch;
+        rmsg->msg_rpc->id = DSG_ID;
+
+        hr = (struct hdr_obj_batch *) rmsg->msg_rpc->pad;
+        hr->num_ent = num_ent;
+        hr->size = size;
+
+        err = rpc_send(rpc_s, peer, rmsg);
+        if (err == 0) {
+                free(hb);
+                free(msg->msg_data);
+                msg_buf_free(msg);
+                return 0;
+        }
+
+        free(buf);
+        msg_buf_free(rmsg);
+ err_out:
+        obj_batch_send_err(rpc_s, peer, ss_obj_get_batch, ent_tab, num_ent, err);
+        free(hb);
+        msg_buf_free(msg);
+        /* Answered and released here; do not fail back to the
+           receive path, which would release the message again. */
+        uloga("'%s()': failed with %d.\n", __func__, err);
+        return 0;
+}
+
+/*
+  Rpc routine to respond to an 'ss_obj_get_batch' request: a table of
+  object parts we own, all returned in one transfer.
+*/
+static int dsgrpc_obj_get_batch(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_batch *hbt, *hb = (struct hdr_obj_batch *) cmd->pad;
+        struct node_id *peer = ds_get_peer(dsg->ds, cmd->id);
+        struct msg_buf *msg;
+        void *buf;
+        int err = -ENOMEM;
+
+        buf = malloc(hb->size);
+        if (!buf)
                 goto err_out;
 
-        ssd_filter(from, &hf->odsc, dval);
+        hbt = malloc(sizeof(*hb));
+        if (!hbt) {
+                free(buf);
+                goto err_out;
+        }
+        memcpy(hbt, hb, sizeof(*hb));
 
-        // TODO: process the filter ... and return the result
         msg = msg_buf_alloc(rpc_s, peer, 0);
-        if (!msg)
+        if (!msg) {
+                free(buf);
+                free(hbt);
+                goto err_out;
+        }
+
+        msg->msg_data = buf;
+        msg->size = hb->size;
+        msg->private = hbt;
+        msg->cb = NULL;
+
+        /* Read the part table here, copy and reply on a worker. */
+        rpc_mem_info_cache(peer, msg, cmd);
+        err = rpc_receive_direct(rpc_s, peer, msg);
+        rpc_mem_info_reset(peer, msg, cmd);
+        if (err == 0)
+                return dsg_post_completion(obj_get_batch_completion, rpc_s, msg);
+
+        free(buf);
+        free(hbt);
+        msg_buf_free(msg);
+ err_out:
+        ERROR_TRACE();
+}
+
+/*
+  Reductions ("custom" filters) run where the data is. The client
+  sends the descriptors of the parts to the first server that holds
+  one; the servers that hold parts form a binary tree in the order of
+  their first part in the table, and each one forwards the request to
+  its children, reduces its own parts, merges the partial results of
+  its subtree and passes them up. Only the root answers the client.
+*/
+struct filter_req {
+        struct list_head        entry;
+        struct hdr_obj_filter   hf;
+        struct obj_descriptor   *od_tab;
+
+        /* Position in the tree and number of servers in it. */
+        int                     pos, num_srv;
+        int                     *srv_tab;
+
+        /* Partial results still to come, ours included. */
+        int                     num_wait;
+        struct obj_filter_res   res;
+};
+
+/* Partial result received from a child. */
+struct filter_part {
+        int                     cid, qid;
+        struct obj_filter_res   res;
+};
+
+static struct filter_req *filter_req_find(int cid, int qid)
+{
+        struct filter_req *fq;
+
+        list_for_each_entry(fq, &dsg->filter_list, struct filter_req, entry) {
+                if (fq->hf.cid == cid && fq->hf.qid == qid)
+                        return fq;
+        }
+
+        return NULL;
+}
+
+static void filter_req_free(struct filter_req *fq)
+{
+        free(fq->od_tab);
+        free(fq->srv_tab);
+        free(fq);
+}
+
+/*
+  Send the result of our subtree to 'peer'.
+*/
+static int filter_send_result_to(struct rpc_server *rpc_s, struct node_id *peer,
+                                 struct filter_req *fq)
+{
+        struct hdr_obj_filter *hf;
+        struct msg_buf *msg;
+        struct obj_filter_res *res;
+        int err = -ENOMEM;
+
+        res = malloc(sizeof(*res));
+        if (!res)
+                goto err_out;
+        *res = fq->res;
+
+        msg = msg_buf_alloc(rpc_s, peer, 1);
+        if (!msg) {
+                free(res);
                 goto err_out;
+        }
 
-        msg->msg_data = dval;
-        msg->size = sizeof(*dval);
+        msg->msg_data = res;
+        msg->size = sizeof(*res);
         msg->cb = default_completion_with_data_callback;
 
-	rpc_mem_info_cache(peer, msg, cmd);
-        err = rpc_send_direct(rpc_s, peer, msg);
-	rpc_mem_info_reset(peer, msg, cmd);
-        if (err < 0)
+        msg->msg_rpc->cmd = ss_obj_filter;
+        msg->msg_rpc->id = DSG_ID;
+
+        hf = (struct hdr_obj_filter *) msg->msg_rpc->pad;
+        *hf = fq->hf;
+        hf->num_od = 0;
+        hf->f_result = 1;
+
+        err = rpc_send(rpc_s, peer, msg);
+        if (err == 0)
+                return 0;
+
+        free(res);
+        msg_buf_free(msg);
+ err_out:
+        ERROR_TRACE();
+}
+
+/*
+  Send the result of our subtree to the parent, or to the client from
+  the root.
+*/
+static int filter_send_result(struct rpc_server *rpc_s, struct filter_req *fq)
+{
+        struct node_id *peer;
+
+        if (fq->pos == 0)
+                peer = ds_get_peer(dsg->ds, fq->hf.cid);
+        else    peer = ds_get_peer(dsg->ds, fq->srv_tab[(fq->pos-1)/2]);
+
+        return filter_send_result_to(rpc_s, peer, fq);
+}
+
+/*
+  Merge a partial result into the request of client 'cid', and pass
+  the result up once all parts are in.
+*/
+static int filter_req_put(struct rpc_server *rpc_s, int cid, int qid,
+                          const struct obj_filter_res *res)
+{
+        struct filter_req *fq;
+        int err = 0;
+
+        pthread_mutex_lock(&dsg->filter_lock);
+        fq = filter_req_find(cid, qid);
+        if (fq) {
+                ssd_filter_merge(&fq->res, res, &fq->hf.spec);
+                if (--fq->num_wait == 0)
+                        list_del(&fq->entry);
+                else    fq = NULL;
+        }
+        pthread_mutex_unlock(&dsg->filter_lock);
+
+        if (fq) {
+                err = filter_send_result(rpc_s, fq);
+                filter_req_free(fq);
+        }
+
+        return err;
+}
+
+/*
+  Reduce the parts we hold; runs on a worker if the server has any,
+  and again once the data of parts put lazily is in.
+*/
+static int filter_local(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_filter *hf = (struct hdr_obj_filter *) cmd->pad;
+        struct dsg_work wt = {.rpc_s = rpc_s, .service = filter_local, .cmd = *cmd};
+        struct obj_descriptor *od_tab;
+        struct obj_filter_res res;
+        struct filter_req *fq;
+        struct obj_data *from;
+        int i, err;
+
+        /* The request stays until our own part is in. */
+        pthread_mutex_lock(&dsg->filter_lock);
+        fq = filter_req_find(hf->cid, hf->qid);
+        pthread_mutex_unlock(&dsg->filter_lock);
+        if (!fq)
+                return 0;
+        od_tab = fq->od_tab;
+
+        ssd_filter_init(&res);
+        for (i = 0; i < hf->num_od; i++) {
+                if (od_tab[i].owner != DSG_ID)
+                        continue;
+                err = obj_pull_wait(&od_tab[i], &wt);
+                if (err > 0)
+                        return 0;
+                if (err < 0)
+                        res.rc = err;
+        }
+
+        for (i = 0; i < hf->num_od && res.rc == 0; i++) {
+                if (od_tab[i].owner != DSG_ID)
+                        continue;
+                from = obj_ref_in_mem(&od_tab[i]);
+                if (!from) {
+                        res.rc = -ENOENT;
+                        break;
+                }
+                res.rc = ssd_filter(from, &hf->odsc, &hf->spec, &res);
+                obj_unref(from);
+        }
+
+        return filter_req_put(rpc_s, hf->cid, hf->qid, &res);
+}
+
+/*
+  Start a reduction once its table of descriptors is in: forward it
+  to our children in the tree, and reduce our own parts.
+*/
+static int filter_req_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct filter_req *fq = msg->private;
+        /* The client if we are the root, else our parent. */
+        struct node_id *from = (struct node_id *) msg->peer;
+        struct hdr_obj_filter *hf;
+        struct node_id *peer;
+        struct msg_buf *m;
+        struct rpc_cmd cmd;
+        void *tab;
+        int i, j, child, err;
+
+        msg_buf_free(msg);
+
+        err = -ENOMEM;
+        fq->srv_tab = malloc(sizeof(int) * fq->hf.num_od);
+        if (!fq->srv_tab)
+                goto err_out;
+
+        fq->pos = -1;
+        for (i = 0; i < fq->hf.num_od; i++) {
+                for (j = 0; j < fq->num_srv; j++)
+                        if (fq->srv_tab[j] == fq->od_tab[i].owner)
+                                break;
+                if (j == fq->num_srv)
+                        fq->srv_tab[fq->num_srv++] = fq->od_tab[i].owner;
+                if (fq->od_tab[i].owner == DSG_ID)
+                        fq->pos = j;
+        }
+
+        err = -EINVAL;
+        if (fq->pos < 0)
                 goto err_out;
 
+        fq->num_wait = 1;
+        for (child = 2*fq->pos+1; child <= 2*fq->pos+2; child++)
+                if (child < fq->num_srv)
+                        fq->num_wait++;
+
+        pthread_mutex_lock(&dsg->filter_lock);
+        list_add_tail(&fq->entry, &dsg->filter_list);
+        pthread_mutex_unlock(&dsg->filter_lock);
+
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.cmd = ss_obj_filter;
+        cmd.id = fq->hf.cid;
+        memcpy(cmd.pad, &fq->hf, sizeof(fq->hf));
+
+        for (child = 2*fq->pos+1; child <= 2*fq->pos+2; child++) {
+                struct obj_filter_res res;
+
+                if (child >= fq->num_srv)
+                        continue;
+
+                err = -ENOMEM;
+                peer = ds_get_peer(dsg->ds, fq->srv_tab[child]);
+                tab = malloc(sizeof(*fq->od_tab) * fq->hf.num_od);
+                m = (tab)? msg_buf_alloc(rpc_s, peer, 1) : NULL;
+                if (m) {
+                        memcpy(tab, fq->od_tab, sizeof(*fq->od_tab) * fq->hf.num_od);
+                        m->msg_data = tab;
+                        m->size = sizeof(*fq->od_tab) * fq->hf.num_od;
+                        m->cb = default_completion_with_data_callback;
+
+                        m->msg_rpc->cmd = ss_obj_filter;
+                        m->msg_rpc->id = DSG_ID;
+                        hf = (struct hdr_obj_filter *) m->msg_rpc->pad;
+                        *hf = fq->hf;
+
+                        err = rpc_send(rpc_s, peer, m);
+                        if (err == 0)
+                                continue;
+                        msg_buf_free(m);
+                }
+                free(tab);
+
+                /* Account the lost subtree as failed, so that the
+                   client still gets an answer. */
+                uloga("'%s()': failed with %d, can not forward to server %d.\n",
+                        __func__, err, fq->srv_tab[child]);
+                ssd_filter_init(&res);
+                res.rc = err;
+                filter_req_put(rpc_s, fq->hf.cid, fq->hf.qid, &res);
+        }
+
+        return dsg_post_service(filter_local, rpc_s, &cmd);
+ err_out:
+        /* Answer for the whole subtree, so that the client still gets
+           a result. */
+        ssd_filter_init(&fq->res);
+        fq->res.rc = err;
+        filter_send_result_to(rpc_s, from, fq);
+        filter_req_free(fq);
+        /* Answered and released here, as above. */
+        uloga("'%s()': failed with %d.\n", __func__, err);
         return 0;
+}
+
+static int filter_part_completion(struct rpc_server *rpc_s, struct msg_buf *msg)
+{
+        struct filter_part *fp = msg->private;
+        int err;
+
+        err = filter_req_put(rpc_s, fp->cid, fp->qid, &fp->res);
+
+        free(fp);
+        msg_buf_free(msg);
+
+        return err;
+}
+
+/*
+  Rpc routine for 'ss_obj_filter': a reduction request from the client
+  or the parent server, or a partial result from a child server.
+*/
+static int dsgrpc_obj_filter(struct rpc_server *rpc_s, struct rpc_cmd *cmd)
+{
+        struct hdr_obj_filter *hf = (struct hdr_obj_filter *) cmd->pad;
+        struct node_id *peer = ds_get_peer(dsg->ds, cmd->id);
+        struct filter_part *fp = NULL;
+        struct filter_req *fq = NULL;
+        struct msg_buf *msg;
+        int err = -ENOMEM;
+
+        msg = msg_buf_alloc(rpc_s, peer, 0);
+        if (!msg)
+                goto err_out;
+
+        if (hf->f_result) {
+                fp = malloc(sizeof(*fp));
+                if (!fp)
+                        goto err_free;
+                fp->cid = hf->cid;
+                fp->qid = hf->qid;
+
+                msg->msg_data = &fp->res;
+                msg->size = sizeof(fp->res);
+                msg->private = fp;
+                msg->cb = filter_part_completion;
+        }
+        else {
+                fq = calloc(1, sizeof(*fq));
+                if (!fq)
+                        goto err_free;
+                fq->hf = *hf;
+                ssd_filter_init(&fq->res);
+
+                fq->od_tab = malloc(sizeof(*fq->od_tab) * hf->num_od);
+                if (!fq->od_tab)
+                        goto err_free;
+
+                msg->msg_data = fq->od_tab;
+                msg->size = sizeof(*fq->od_tab) * hf->num_od;
+                msg->private = fq;
+                msg->cb = filter_req_completion;
+        }
+
+        rpc_mem_info_cache(peer, msg, cmd);
+        err = rpc_receive_direct(rpc_s, peer, msg);
+        rpc_mem_info_reset(peer, msg, cmd);
+        if (err == 0)
+                return 0;
+
+ err_free:
+        if (fq)
+                free(fq->od_tab);
+        free(fq);
+        free(fp);
+        msg_buf_free(msg);
  err_out:
         ERROR_TRACE();
 }
@@ -2232,8 +3735,14 @@ struct ds_gspace *dsg_alloc(int num_sp, int num_cp, char *conf_name)
         rpc_add_service(ss_obj_get_dht_peers, dsgrpc_obj_send_dht_peers);
         rpc_add_service(ss_obj_get_desc, dsgrpc_obj_get_desc);
         rpc_add_service(ss_obj_get, dsgrpc_obj_get);
+        rpc_add_service(ss_obj_get_strided, dsgrpc_obj_get_strided);
+        rpc_add_service(ss_obj_summary, dsgrpc_obj_summary);
+        rpc_add_service(ss_obj_get_summary, dsgrpc_obj_get_summary);
         rpc_add_service(ss_obj_hint, dsgrpc_obj_hint);
         rpc_add_service(ss_obj_put, dsgrpc_obj_put);
+        rpc_add_service(ss_obj_put_batch, dsgrpc_obj_put_batch);
+        rpc_add_service(ss_obj_get_desc_batch, dsgrpc_obj_get_desc_batch);
+        rpc_add_service(ss_obj_get_batch, dsgrpc_obj_get_batch);
         rpc_add_service(ss_obj_update, dsgrpc_obj_update);
         rpc_add_service(ss_obj_filter, dsgrpc_obj_filter);
         rpc_add_service(ss_obj_cq_register, dsgrpc_obj_cq_register);
@@ -2247,6 +3756,12 @@ struct ds_gspace *dsg_alloc(int num_sp, int num_cp, char *conf_name)
         INIT_LIST_HEAD(&dsg_l->obj_desc_req_list);
         INIT_LIST_HEAD(&dsg_l->obj_data_req_list);
         INIT_LIST_HEAD(&dsg_l->locks_list);
+        INIT_LIST_HEAD(&dsg_l->filter_list);
+        pthread_mutex_init(&dsg_l->ls_lock, NULL);
+        pthread_mutex_init(&dsg_l->sspace_lock, NULL);
+        pthread_mutex_init(&dsg_l->cq_lock, NULL);
+        pthread_mutex_init(&dsg_l->filter_lock, NULL);
+        dsg_l->wp = NULL;
 
         dsg_l->ds = ds_alloc(num_sp, num_cp, dsg_l);
         if (!dsg_l->ds)
@@ -2263,6 +3778,23 @@ struct ds_gspace *dsg_alloc(int num_sp, int num_cp, char *conf_name)
             goto err_free;
         }
 
+#ifndef HAVE_TCP_SOCKET
+        /* Only the TCP transport serializes sends from several threads
+           to the same peer. */
+        if (ds_conf.num_workers > 0) {
+                uloga("%s(): num_workers needs the TCP transport, "
+                        "requests are served in the transport thread.\n", __func__);
+                ds_conf.num_workers = 0;
+        }
+#endif
+        if (ds_conf.num_workers > 0) {
+                dsg_l->wp = ds_workers_alloc(ds_conf.num_workers);
+                if (!dsg_l->wp) {
+                        uloga("%s(): ERROR ds_workers_alloc() failed\n", __func__);
+                        goto err_free;
+                }
+        }
+
         return dsg_l;
  err_free:
         free(dsg_l);
@@ -2294,6 +3826,8 @@ void dsg_dht_print_descriptors(const struct obj_descriptor *odsc_tab[], int n)
 
 void dsg_free(struct ds_gspace *dsg)
 {
+        if (dsg->wp)
+                ds_workers_free(dsg->wp);
         ds_free(dsg->ds);
         free_sspace(dsg);
         ls_free(dsg->ls);
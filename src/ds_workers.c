@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2009, NSF Cloud and Autonomic Computing Center, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "debug.h"
+#include "ds_workers.h"
+
+static void *ds_worker_run(void *arg)
+{
+        struct ds_workers *wp = arg;
+        struct ds_work *w;
+        int err;
+
+        pthread_mutex_lock(&wp->lock);
+        while (1) {
+                while (!wp->f_stop && list_empty(&wp->work_list))
+                        pthread_cond_wait(&wp->work_cond, &wp->lock);
+
+                if (list_empty(&wp->work_list))
+                        break;
+
+                w = list_entry(wp->work_list.next, struct ds_work, work_entry);
+                list_del(&w->work_entry);
+                pthread_mutex_unlock(&wp->lock);
+
+                err = w->fn(w->arg);
+                if (err < 0)
+                        uloga("'%s()': work item failed with %d.\n", 
+                                __func__, err);
+                free(w);
+
+                pthread_mutex_lock(&wp->lock);
+                if (--wp->num_pending == 0)
+                        pthread_cond_broadcast(&wp->idle_cond);
+        }
+        pthread_mutex_unlock(&wp->lock);
+
+        return NULL;
+}
+
+struct ds_workers *ds_workers_alloc(int num_workers)
+{
+        struct ds_workers *wp;
+        int i, err = -ENOMEM;
+
+        wp = malloc(sizeof(*wp) + sizeof(pthread_t) * num_workers);
+        if (!wp)
+                goto err_out;
+        memset(wp, 0, sizeof(*wp));
+
+        wp->thr_tab = (pthread_t *) (wp + 1);
+        INIT_LIST_HEAD(&wp->work_list);
+        pthread_mutex_init(&wp->lock, NULL);
+        pthread_cond_init(&wp->work_cond, NULL);
+        pthread_cond_init(&wp->idle_cond, NULL);
+
+        for (i = 0; i < num_workers; i++) {
+                err = -pthread_create(&wp->thr_tab[i], NULL, ds_worker_run, wp);
+                if (err < 0) {
+                        wp->num_workers = i;
+                        ds_workers_free(wp);
+                        goto err_out;
+                }
+        }
+        wp->num_workers = num_workers;
+
+        return wp;
+ err_out:
+        uloga("'%s()': failed with %d.\n", __func__, err);
+        return NULL;
+}
+
+/*
+  Queue 'fn(arg)' for execution by a worker.
+*/
+int ds_workers_post(struct ds_workers *wp, ds_work_fn fn, void *arg)
+{
+        struct ds_work *w;
+
+        w = malloc(sizeof(*w));
+        if (!w)
+                return -ENOMEM;
+
+        w->fn = fn;
+        w->arg = arg;
+
+        pthread_mutex_lock(&wp->lock);
+        list_add_tail(&w->work_entry, &wp->work_list);
+        wp->num_pending++;
+        pthread_cond_signal(&wp->work_cond);
+        pthread_mutex_unlock(&wp->lock);
+
+        return 0;
+}
+
+/*
+  Block until all the work posted so far is done.
+*/
+void ds_workers_wait(struct ds_workers *wp)
+{
+        pthread_mutex_lock(&wp->lock);
+        while (wp->num_pending > 0)
+                pthread_cond_wait(&wp->idle_cond, &wp->lock);
+        pthread_mutex_unlock(&wp->lock);
+}
+
+/*
+  Finish the pending work and release the pool.
+*/
+void ds_workers_free(struct ds_workers *wp)
+{
+        int i;
+
+        pthread_mutex_lock(&wp->lock);
+        wp->f_stop = 1;
+        pthread_cond_broadcast(&wp->work_cond);
+        pthread_mutex_unlock(&wp->lock);
+
+        for (i = 0; i < wp->num_workers; i++)
+                pthread_join(wp->thr_tab[i], NULL);
+
+        pthread_cond_destroy(&wp->idle_cond);
+        pthread_cond_destroy(&wp->work_cond);
+        pthread_mutex_destroy(&wp->lock);
+        free(wp);
+}
@@ -326,93 +326,53 @@ dim1:                    for(a0 = a->mat_view.lb[0], b0 = b->mat_view.lb[0];
     }
 }
 
-/* a = destination, b = source. Destination uses iovec_t format. */
-static void matrix_copyv(struct matrix *a, struct matrix *b)
-{
 /*
-        typedef char matrix_elem_generic_t[a->size_elem];
-
-        int ai, aj, bi, bj, bk; // , ak;
-        int n;
-
-        if (a->mat_storage == column_major && b->mat_storage == column_major) {
-
-		// matrix_elem_generic_t (*A)[a->dimz][a->dimx][a->dimy] = a->pdata;
-                matrix_elem_generic_t (*B)[b->dimz][b->dimx][b->dimy] = b->pdata;
-		iovec_t *A = a->pdata;
-
-                // Column major data representation (Fortran style) 
-                n = a->mat_view.ub[bb_y] - a->mat_view.lb[bb_y] + 1;
-		// ak = a->mat_view.lb[bb_y];
-                bk = b->mat_view.lb[bb_y];
-                for (ai = a->mat_view.lb[bb_z], bi = b->mat_view.lb[bb_z]; 
-                     ai <= a->mat_view.ub[bb_z]; ai++, bi++) {
-                        for (aj = a->mat_view.lb[bb_x], bj = b->mat_view.lb[bb_x]; 
-                             aj <= a->mat_view.ub[bb_x]; aj++, bj++) {
-				A->iov_base = &(*B)[bi][bj][bk];
-				A->iov_len = a->size_elem * n;
-				A++;
-			}
-                }
-        }
-        else if (a->mat_storage == row_major && b->mat_storage == row_major) {
-
-                // matrix_elem_generic_t (*A)[a->dimz][a->dimy][a->dimx] = a->pdata;
-                matrix_elem_generic_t (*B)[b->dimz][b->dimy][b->dimx] = b->pdata;
-		iovec_t *A = a->pdata;
-
-                n = a->mat_view.ub[bb_x] - a->mat_view.lb[bb_x] + 1;
-		// ak = a->mat_view.lb[bb_x];
-                bk = b->mat_view.lb[bb_x];
-                for (ai = a->mat_view.lb[bb_z], bi = b->mat_view.lb[bb_z];
-                     ai <= a->mat_view.ub[bb_z]; ai++, bi++) {
-                        for (aj = a->mat_view.lb[bb_y], bj = b->mat_view.lb[bb_y];
-                             aj <= a->mat_view.ub[bb_y]; aj++, bj++) {
-				A->iov_base = &(*B)[bi][bj][bk];
-				A->iov_len = a->size_elem * n;
-				A++;
-			}
-                }
-        }
+  a = destination, b = source. Destination uses iovec_t format: one
+  entry per run of elements along dim 0 of the source view, with runs
+  that follow each other in memory merged. Returns the number of
+  entries used.
 */
-	/*
-        else if (a->mat_storage == column_major && b->mat_storage == row_major) {
-
-                matrix_elem_generic_t (*A)[a->dimz][a->dimx][a->dimy] = a->pdata;
-                matrix_elem_generic_t (*B)[b->dimz][b->dimy][b->dimx] = b->pdata;
-
-                for (ai = a->mat_view.lb[bb_z], bi = b->mat_view.lb[bb_z];
-                     ai <= a->mat_view.ub[bb_z]; ai++, bi++) {
-                        for (aj = a->mat_view.lb[bb_x], bj = b->mat_view.lb[bb_y];
-                             aj <= a->mat_view.ub[bb_x]; aj++, bj++) {
-                                for (ak = a->mat_view.lb[bb_y], bk = b->mat_view.lb[bb_y];
-                                     ak <= a->mat_view.ub[bb_y]; ak++, bk++) 
-                                        memcpy(&(*A)[ai][aj][ak], 
-                                               &(*B)[bi][bk][bj],
-                                               a->size_elem);
-                                // (*A)[ai][aj][ak] = (*B)[bi][bk][bj];
-                        }
+static int matrix_copyv(struct matrix *a, struct matrix *b)
+{
+        iovec_t *A = a->pdata;
+        char *B = b->pdata;
+        uint64_t idx[BBOX_MAX_NDIM];
+        uint64_t bloc, len;
+        char *base;
+        int i, n = 0;
+
+        len = (b->mat_view.ub[0] - b->mat_view.lb[0] + 1) * b->size_elem;
+        for (i = 0; i < b->num_dims; i++)
+                idx[i] = b->mat_view.lb[i];
+
+        while (1) {
+                bloc = 0;
+                for (i = b->num_dims - 1; i > 0; i--)
+                        bloc = (bloc + idx[i]) * b->dist[i-1];
+                bloc = bloc + idx[0];
+
+                base = &B[bloc * b->size_elem];
+                if (n > 0 && (char *) A[n-1].iov_base + A[n-1].iov_len == base)
+                        A[n-1].iov_len += len;
+                else {
+                        A[n].iov_base = base;
+                        A[n].iov_len = len;
+                        n++;
                 }
-        }
-        else if (a->mat_storage == row_major && b->mat_storage == column_major) {
-
-                matrix_elem_generic_t (*A)[a->dimz][a->dimy][a->dimx] = a->pdata;
-                matrix_elem_generic_t (*B)[b->dimz][b->dimx][b->dimy] = b->pdata;
-
-                for (ai = a->mat_view.lb[bb_z], bi = b->mat_view.lb[bb_z];
-                     ai <= a->mat_view.ub[bb_z]; ai++, bi++) {
-                        for (aj = a->mat_view.lb[bb_y], bj = b->mat_view.lb[bb_y];
-                             aj <= a->mat_view.ub[bb_y]; aj++, bj++) {
-                                for (ak = a->mat_view.lb[bb_x], bk = b->mat_view.lb[bb_x];
-                                     ak <= a->mat_view.ub[bb_x]; ak++, bk++)
-                                        memcpy(&(*A)[ai][aj][ak], 
-                                               &(*B)[bi][bk][bj],
-                                               a->size_elem);
-                                // (*A)[ai][aj][ak] = (*B)[bi][bk][bj];
+
+                /* Step to the next run over dims 1 .. num_dims-1. */
+                for (i = 1; i < b->num_dims; i++) {
+                        if (idx[i] < b->mat_view.ub[i]) {
+                                idx[i]++;
+                                break;
                         }
+                        idx[i] = b->mat_view.lb[i];
                 }
+                if (i >= b->num_dims)
+                        break;
         }
-	*/
+
+        return n;
 }
 
 static void get_bbox_max_dim(const struct bbox *bb, uint64_t *out_max_dim,
@@ -459,6 +419,7 @@ static struct dht_entry * dht_entry_alloc(struct sspace *ssd, int size_hash)
 
 	de->ss = ssd;
 	de->odsc_size = size_hash;
+	pthread_rwlock_init(&de->de_lock, NULL);
 
 	for (i = 0; i < size_hash; i++)
 		INIT_LIST_HEAD(&de->odsc_hash[i]);
@@ -993,6 +954,11 @@ int ssd_copy(struct obj_data *to_obj, struct obj_data *from_obj)
         return 0;
 }
 
+/*
+  Fill 'obj_dest', allocated with obj_data_allocv(), with references
+  to the data of 'obj_src' in the common region, in the order
+  ssd_copy() would pack it; returns the number of iovec_t entries.
+*/
 int ssd_copyv(struct obj_data *obj_dest, struct obj_data *obj_src)
 {
 	struct matrix mat_dest, mat_src;
@@ -1008,9 +974,81 @@ int ssd_copyv(struct obj_data *obj_dest, struct obj_data *obj_src)
 			&obj_src->obj_desc.bb, &bbcom,
 			obj_src->data, obj_src->obj_desc.size);
 
-	matrix_copyv(&mat_dest, &mat_src);
+	return matrix_copyv(&mat_dest, &mat_src);
+}
 
-	return 0;
+/*
+  Copy every stride[i]-th point of region 'bb' of 'from', starting at
+  the lower corner of 'bb', into 'to', which holds the selected points
+  densely: point bb->lb + k * stride goes to index k. Only the points
+  that 'from' has are copied.
+*/
+int ssd_copy_strided(struct obj_data *to, struct obj_data *from,
+        const struct bbox *bb, const struct coord *stride)
+{
+        struct bbox fbb = from->obj_desc.bb;
+        uint64_t k[BBOX_MAX_NDIM], klo[BBOX_MAX_NDIM], khi[BBOX_MAX_NDIM];
+        uint64_t fdist[BBOX_MAX_NDIM], tdist[BBOX_MAX_NDIM];
+        uint64_t lo, hi, foff, toff, n, j, s0 = stride->c[0];
+        size_t se = from->obj_desc.size;
+        const char *src;
+        char *dst;
+        int i, ndims = bb->num_dims;
+
+        if (ndims < 1)
+                return 0;
+
+        for (i = 0; i < ndims; i++) {
+                lo = max(bb->lb.c[i], fbb.lb.c[i]);
+                hi = min(bb->ub.c[i], fbb.ub.c[i]);
+                if (lo > hi)
+                        return 0;
+                klo[i] = (lo - bb->lb.c[i] + stride->c[i] - 1) / stride->c[i];
+                khi[i] = (hi - bb->lb.c[i]) / stride->c[i];
+                if (klo[i] > khi[i])
+                        return 0;
+                k[i] = klo[i];
+        }
+
+        fdist[0] = tdist[0] = 1;
+        for (i = 1; i < ndims; i++) {
+                fdist[i] = fdist[i-1] * bbox_dist(&fbb, i-1);
+                tdist[i] = tdist[i-1] *
+                        ((bb->ub.c[i-1] - bb->lb.c[i-1]) / stride->c[i-1] + 1);
+        }
+        n = khi[0] - klo[0] + 1;
+
+        while (1) {
+                foff = toff = 0;
+                for (i = 0; i < ndims; i++) {
+                        foff += (bb->lb.c[i] + k[i] * stride->c[i] - fbb.lb.c[i]) * fdist[i];
+                        toff += k[i] * tdist[i];
+                }
+                src = (const char *) from->data + foff * se;
+                dst = (char *) to->data + toff * se;
+
+                if (s0 == 1)
+                        memcpy(dst, src, n * se);
+                else if (se == sizeof(uint64_t))
+                        for (j = 0; j < n; j++)
+                                ((uint64_t *) dst)[j] = ((const uint64_t *) src)[j * s0];
+                else if (se == sizeof(uint32_t))
+                        for (j = 0; j < n; j++)
+                                ((uint32_t *) dst)[j] = ((const uint32_t *) src)[j * s0];
+                else
+                        for (j = 0; j < n; j++)
+                                memcpy(dst + j * se, src + j * s0 * se, se);
+
+                for (i = 1; i < ndims; i++) {
+                        if (++k[i] <= khi[i])
+                                break;
+                        k[i] = klo[i];
+                }
+                if (i >= ndims)
+                        break;
+        }
+
+        return 0;
 }
 
 /*
@@ -1039,17 +1077,204 @@ int ssd_copy_list(struct obj_data *to, struct list_head *od_list)
         return 0;
 }
 
-int ssd_filter(struct obj_data *from, struct obj_descriptor *odsc, double *dval)
+/*
+  Reduce a run of 'n' elements of type T, n > 0. The loops keep four
+  independent accumulators, so the compiler can turn them into vector
+  code without reordering a single chain of floating point operations.
+*/
+#define SSD_FILTER_RUN(T)                                               \
+static void filter_run_##T(const T *p, uint64_t n,                      \
+        const struct obj_filter_spec *fs, struct obj_filter_res *fr)    \
+{                                                                       \
+        uint64_t i, m = n & ~(uint64_t) 3;                              \
+        double a0, a1, a2, a3, w;                                       \
+        int b;                                                          \
+                                                                        \
+        switch (fs->op) {                                               \
+        case filter_min:                                                \
+                a0 = a1 = a2 = a3 = p[0];                               \
+                for (i = 0; i < m; i += 4) {                            \
+                        a0 = (p[i] < a0)? p[i] : a0;                    \
+                        a1 = (p[i+1] < a1)? p[i+1] : a1;                \
+                        a2 = (p[i+2] < a2)? p[i+2] : a2;                \
+                        a3 = (p[i+3] < a3)? p[i+3] : a3;                \
+                }                                                       \
+                for (; i < n; i++)                                      \
+                        a0 = (p[i] < a0)? p[i] : a0;                    \
+                a0 = (a1 < a0)? a1 : a0;                                \
+                a2 = (a3 < a2)? a3 : a2;                                \
+                a0 = (a2 < a0)? a2 : a0;                                \
+                if (a0 < fr->min)                                       \
+                        fr->min = a0;                                   \
+                break;                                                  \
+        case filter_max:                                                \
+                a0 = a1 = a2 = a3 = p[0];                               \
+                for (i = 0; i < m; i += 4) {                            \
+                        a0 = (p[i] > a0)? p[i] : a0;                    \
+                        a1 = (p[i+1] > a1)? p[i+1] : a1;                \
+                        a2 = (p[i+2] > a2)? p[i+2] : a2;                \
+                        a3 = (p[i+3] > a3)? p[i+3] : a3;                \
+                }                                                       \
+                for (; i < n; i++)                                      \
+                        a0 = (p[i] > a0)? p[i] : a0;                    \
+                a0 = (a1 > a0)? a1 : a0;                                \
+                a2 = (a3 > a2)? a3 : a2;                                \
+                a0 = (a2 > a0)? a2 : a0;                                \
+                if (a0 > fr->max)                                       \
+                        fr->max = a0;                                   \
+                break;                                                  \
+        case filter_sum:                                                \
+        case filter_avg:                                                \
+                a0 = a1 = a2 = a3 = 0.0;                                \
+                for (i = 0; i < m; i += 4) {                            \
+                        a0 += p[i];                                     \
+                        a1 += p[i+1];                                   \
+                        a2 += p[i+2];                                   \
+                        a3 += p[i+3];                                   \
+                }                                                       \
+                for (; i < n; i++)                                      \
+                        a0 += p[i];                                     \
+                fr->sum += (a0 + a1) + (a2 + a3);                       \
+                break;                                                  \
+        case filter_range:                                              \
+                a0 = a1 = a2 = a3 = p[0];                               \
+                for (i = 0; i < (n & ~(uint64_t) 1); i += 2) {          \
+                        a0 = (p[i] < a0)? p[i] : a0;                    \
+                        a1 = (p[i+1] < a1)? p[i+1] : a1;                \
+                        a2 = (p[i] > a2)? p[i] : a2;                    \
+                        a3 = (p[i+1] > a3)? p[i+1] : a3;                \
+                }                                                       \
+                for (; i < n; i++) {                                    \
+                        a0 = (p[i] < a0)? p[i] : a0;                    \
+                        a2 = (p[i] > a2)? p[i] : a2;                    \
+                }                                                       \
+                a0 = (a1 < a0)? a1 : a0;                                \
+                a2 = (a3 > a2)? a3 : a2;                                \
+                if (a0 < fr->min)                                       \
+                        fr->min = a0;                                   \
+                if (a2 > fr->max)                                       \
+                        fr->max = a2;                                   \
+                break;                                                  \
+        case filter_hist:                                               \
+                w = fs->num_bins / (fs->hi - fs->lo);                   \
+                for (i = 0; i < n; i++) {                               \
+                        if (!(p[i] >= fs->lo && p[i] <= fs->hi))        \
+                                continue;                               \
+                        b = (int) ((p[i] - fs->lo) * w);                \
+                        fr->bins[(b < fs->num_bins)? b : fs->num_bins-1]++; \
+                }                                                       \
+                break;                                                  \
+        }                                                               \
+        fr->count += n;                                                 \
+}
+
+SSD_FILTER_RUN(double)
+SSD_FILTER_RUN(float)
+SSD_FILTER_RUN(int32_t)
+SSD_FILTER_RUN(int64_t)
+
+static const size_t filter_type_size[] = {
+        [filter_double] = sizeof(double),
+        [filter_float]  = sizeof(float),
+        [filter_int32]  = sizeof(int32_t),
+        [filter_int64]  = sizeof(int64_t),
+};
+
+void ssd_filter_init(struct obj_filter_res *fr)
 {
-        //TODO: search the matrix to find the min
-        static int n = 1;
+        memset(fr, 0, sizeof(*fr));
+        fr->min = HUGE_VAL;
+        fr->max = -HUGE_VAL;
+}
 
-        *dval = 2.0 * n;
-        n++;
+/*
+  Reduce the elements of object 'from' in the region of 'odsc' into
+  the partial result 'fr', one run along dimension 0 at a time.
+*/
+int ssd_filter(struct obj_data *from, const struct obj_descriptor *odsc,
+        const struct obj_filter_spec *fs, struct obj_filter_res *fr)
+{
+        const struct bbox *bb = &from->obj_desc.bb;
+        struct bbox bbcom;
+        uint64_t c[BBOX_MAX_NDIM], stride[BBOX_MAX_NDIM];
+        uint64_t off, n;
+        const char *p;
+        int i, ndims = bb->num_dims;
+
+        if (fs->elem_type < filter_double || fs->elem_type > filter_int64 ||
+            fs->op < filter_min || fs->op > filter_range ||
+            from->obj_desc.size != filter_type_size[fs->elem_type])
+                return -EINVAL;
+        if (fs->op == filter_hist && (fs->num_bins <= 0 ||
+            fs->num_bins > SSD_FILTER_MAX_BINS || !(fs->hi > fs->lo)))
+                return -EINVAL;
+
+        if (!bbox_does_intersect(bb, &odsc->bb))
+                return 0;
+        bbox_intersect((struct bbox *) bb, &odsc->bb, &bbcom);
+
+        stride[0] = 1;
+        for (i = 1; i < ndims; i++)
+                stride[i] = stride[i-1] * bbox_dist((struct bbox *) bb, i-1);
+        for (i = 0; i < ndims; i++)
+                c[i] = bbcom.lb.c[i];
+        n = bbox_dist(&bbcom, 0);
+
+        while (1) {
+                off = 0;
+                for (i = 0; i < ndims; i++)
+                        off += (c[i] - bb->lb.c[i]) * stride[i];
+                p = (const char *) from->data + off * from->obj_desc.size;
+
+                switch (fs->elem_type) {
+                case filter_double:
+                        filter_run_double((const double *) p, n, fs, fr);
+                        break;
+                case filter_float:
+                        filter_run_float((const float *) p, n, fs, fr);
+                        break;
+                case filter_int32:
+                        filter_run_int32_t((const int32_t *) p, n, fs, fr);
+                        break;
+                case filter_int64:
+                        filter_run_int64_t((const int64_t *) p, n, fs, fr);
+                        break;
+                }
+
+                /* Next run: odometer over dimensions 1 .. ndims-1. */
+                for (i = 1; i < ndims; i++) {
+                        if (++c[i] <= bbcom.ub.c[i])
+                                break;
+                        c[i] = bbcom.lb.c[i];
+                }
+                if (i >= ndims)
+                        break;
+        }
 
         return 0;
 }
 
+/*
+  Merge partial result 'b' into 'a'.
+*/
+void ssd_filter_merge(struct obj_filter_res *a, const struct obj_filter_res *b,
+        const struct obj_filter_spec *fs)
+{
+        int i;
+
+        if (b->rc < 0)
+                a->rc = b->rc;
+        a->count += b->count;
+        if (b->min < a->min)
+                a->min = b->min;
+        if (b->max > a->max)
+                a->max = b->max;
+        a->sum += b->sum;
+        if (fs->op == filter_hist)
+                for (i = 0; i < fs->num_bins && i < SSD_FILTER_MAX_BINS; i++)
+                        a->bins[i] += b->bins[i];
+}
+
 /*
   Allocate and init the local storage structure.
 */
@@ -1105,9 +1330,10 @@ void ls_add_obj(struct ss_storage *ls, struct obj_data *od)
 
         od_existing = ls_find_no_version(ls, &od->obj_desc);
         if (od_existing) {
+                /* A pinned object is freed by its last user. */
                 od_existing->f_free = 1;
+                ls_remove(ls, od_existing);
                 if (od_existing->refcnt == 0) {
-                        ls_remove(ls, od_existing);
                         obj_data_free(od_existing);
                 }
                 else {
@@ -1242,6 +1468,11 @@ int dht_add_entry(struct dht_entry *de, const struct obj_descriptor *odsc)
         if (odscl) {
                 /* There  is allready  a descriptor  with  a different
 		   version in the DHT, so I will overwrite it. */
+                /* Keep the value range if it already came in for
+                   this very object. */
+                if (odscl->odsc.version != odsc->version ||
+                    !obj_desc_equals_no_owner(&odscl->odsc, odsc))
+                        memset(&odscl->sum, 0, sizeof(odscl->sum));
                 memcpy(&odscl->odsc, odsc, sizeof(*odsc));
                 return 0;
         }
@@ -1251,6 +1482,7 @@ int dht_add_entry(struct dht_entry *de, const struct obj_descriptor *odsc)
 	if (!odscl)
 		return err;
 	memcpy(&odscl->odsc, odsc, sizeof(*odsc));
+	memset(&odscl->sum, 0, sizeof(odscl->sum));
 
 	list_add(&odscl->odsc_entry, &de->odsc_hash[n]);
 	de->odsc_num++;
@@ -1258,6 +1490,49 @@ int dht_add_entry(struct dht_entry *de, const struct obj_descriptor *odsc)
         return 0;
 }
 
+/*
+  Set the value range of the object of descriptor 'odsc' in the dht
+  entry 'de', adding the descriptor if the update for it did not come
+  in yet; returns -ENOENT if a newer version replaced it already.
+*/
+int dht_set_summary(struct dht_entry *de, const struct obj_descriptor *odsc,
+        const struct obj_summary *sum)
+{
+	struct obj_desc_list *odscl;
+	int n, err;
+
+	n = odsc->version % de->odsc_size;
+	list_for_each_entry(odscl, &de->odsc_hash[n], struct obj_desc_list, odsc_entry) {
+		if (odscl->odsc.version == odsc->version &&
+		    obj_desc_equals_no_owner(&odscl->odsc, odsc)) {
+			odscl->sum = *sum;
+			return 0;
+		}
+	}
+
+	/* Do not bring back an older version a newer one replaced. */
+	odscl = dht_find_match(de, odsc);
+	if (odscl && odscl->odsc.version > odsc->version)
+		return -ENOENT;
+
+	err = dht_add_entry(de, odsc);
+	if (err < 0)
+		return err;
+
+	return dht_set_summary(de, odsc, sum);
+}
+
+/*
+  Value range stored with a descriptor returned by dht_find_entry_all().
+*/
+const struct obj_summary *dht_entry_summary(const struct obj_descriptor *odsc)
+{
+	const struct obj_desc_list *odscl =
+		list_entry(odsc, struct obj_desc_list, odsc);
+
+	return &odscl->sum;
+}
+
 /*
   Search the dht entry 'de' for an object that intersects object
   descriptor 'odsc' and return a reference to it.
@@ -1669,21 +1944,16 @@ uint64_t obj_data_size(struct obj_descriptor *obj_desc)
     return obj_desc->size * bbox_volume(&obj_desc->bb);
 }
 
+/*
+  Size of the iovec_t table for 'odsc': one entry per run along dim 0.
+*/
 uint64_t obj_data_sizev(struct obj_descriptor *odsc)
 {
-	uint64_t size = 1; // sizeof(iovec_t);
+	uint64_t size = sizeof(iovec_t);
+	int i;
 
-	if (odsc->bb.num_dims == 2) {
-		if (odsc->st == row_major)
-			size = size * bbox_dist(&odsc->bb, bb_y);
-		else	size = size * bbox_dist(&odsc->bb, bb_x);
-	}
-	else if (odsc->bb.num_dims == 3) {
-		size = size * bbox_dist(&odsc->bb, bb_z);
-		if (odsc->st == row_major)
-			size = size * bbox_dist(&odsc->bb, bb_y);
-		else	size = size * bbox_dist(&odsc->bb, bb_x);
-	}
+	for (i = 1; i < odsc->bb.num_dims; i++)
+		size = size * bbox_dist(&odsc->bb, i);
 
 	return size;
 }
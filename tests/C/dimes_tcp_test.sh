@@ -0,0 +1,34 @@
+#!/bin/sh
+# DIMES over TCP (configure --enable-dart-tcp --enable-dimes): the
+# readers fetch from the writers' memory with process_vm_readv() on
+# the same node (vm), or through the writers' read service (socket).
+DIR=.
+CONF_DIMS=2048
+
+for MODE in vm socket
+do
+rm -f conf cred dataspaces.conf srv.lck
+
+echo "## Config file for DataSpaces
+ndim = 2
+dims = $CONF_DIMS, $CONF_DIMS
+
+max_versions = 1
+lock_type = 2
+" > dataspaces.conf
+
+unset DATASPACES_TCP_VM_READ
+if [ $MODE = socket ]; then
+    export DATASPACES_TCP_VM_READ=0
+fi
+
+mpirun -n 1 $DIR/dataspaces_server -s 1 -c 4 > $DIR/server_$MODE.log 2>&1 & sleep 2
+
+mpirun -n 2 $DIR/test_writer DIMES 2 2 2 1 $((CONF_DIMS/2)) $CONF_DIMS 5 1 > $DIR/writer_$MODE.log 2>&1 &
+mpirun -n 2 $DIR/test_reader DIMES 2 2 1 2 $CONF_DIMS $((CONF_DIMS/2)) 5 2 > $DIR/reader_$MODE.log 2>&1 &
+wait
+
+echo "$MODE:"
+grep "read MAX time" $DIR/reader_$MODE.log
+grep "error elem" $DIR/reader_$MODE.log
+done
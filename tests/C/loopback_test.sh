@@ -0,0 +1,21 @@
+#!/bin/sh
+# Server and client in one process (test_loopback): each version is
+# put and read back through the in-process server, no MPI job layout
+# or network involved. Needs an MPI library with MPI_THREAD_MULTIPLE.
+DIR=.
+CONF_DIMS=1024
+
+rm -f conf cred dataspaces.conf srv.lck
+
+echo "## Config file for DataSpaces
+ndim = 2
+dims = $CONF_DIMS, $CONF_DIMS
+
+max_versions = 1
+lock_type = 1
+" > dataspaces.conf
+
+mpirun -n 1 $DIR/test_loopback DATASPACES 1 2 1 1 $CONF_DIMS $CONF_DIMS 5 1 > $DIR/loopback.log 2>&1
+
+grep "TS=" $DIR/loopback.log
+grep "error elem" $DIR/loopback.log
@@ -0,0 +1,29 @@
+#!/bin/sh
+# Read throughput of one server for a growing number of worker threads
+# (num_workers in dataspaces.conf, 0 = all requests on the main thread).
+DIR=.
+CONF_DIMS=4096
+NUM_READERS=8
+
+for NW in 0 1 2 4 8
+do
+rm -f conf cred dataspaces.conf srv.lck
+
+echo "## Config file for DataSpaces
+ndim = 2
+dims = $CONF_DIMS, $CONF_DIMS
+
+max_versions = 1
+lock_type = 2
+num_workers = $NW
+" > dataspaces.conf
+
+mpirun -n 1 $DIR/dataspaces_server -s 1 -c $((NUM_READERS+1)) > $DIR/server_w$NW.log 2>&1 & sleep 2
+
+mpirun -n 1 $DIR/test_writer DATASPACES 1 2 1 1 $CONF_DIMS $CONF_DIMS 5 1 > $DIR/writer_w$NW.log 2>&1 &
+mpirun -n $NUM_READERS $DIR/test_reader DATASPACES $NUM_READERS 2 $NUM_READERS 1 $((CONF_DIMS/NUM_READERS)) $CONF_DIMS 5 2 > $DIR/reader_w$NW.log 2>&1 &
+wait
+
+echo "num_workers = $NW"
+grep "read MAX time" $DIR/reader_w$NW.log
+done
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Put/get throughput between a server and clients on the same node,
+# over the shared memory rings (default) and over loopback TCP
+# (DATASPACES_SHM_RING_SIZE=0).
+DIR=.
+CONF_DIMS=4096
+
+for MODE in shm tcp
+do
+rm -f conf cred dataspaces.conf srv.lck
+
+echo "## Config file for DataSpaces
+ndim = 2
+dims = $CONF_DIMS, $CONF_DIMS
+
+max_versions = 1
+lock_type = 2
+" > dataspaces.conf
+
+unset DATASPACES_SHM_RING_SIZE
+if [ $MODE = tcp ]; then
+export DATASPACES_SHM_RING_SIZE=0
+fi
+
+mpirun -n 1 $DIR/dataspaces_server -s 1 -c 2 > $DIR/server_$MODE.log 2>&1 & sleep 2
+
+mpirun -n 1 $DIR/test_writer DATASPACES 1 2 1 1 $CONF_DIMS $CONF_DIMS 5 1 > $DIR/writer_$MODE.log 2>&1 &
+mpirun -n 1 $DIR/test_reader DATASPACES 1 2 1 1 $CONF_DIMS $CONF_DIMS 5 2 > $DIR/reader_$MODE.log 2>&1 &
+wait
+
+echo "$MODE:"
+grep "write MAX time" $DIR/writer_$MODE.log
+grep "read MAX time" $DIR/reader_$MODE.log
+done
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Put throughput over loopback TCP for the socket write settings:
+# fixed 16KB writes, adaptive writes (default) and MSG_ZEROCOPY for
+# payloads of 1MB and up. On loopback the kernel copies anyway and
+# the zero copy path turns itself off after the first notification.
+DIR=.
+CONF_DIMS=8192
+
+for MODE in fixed adaptive zerocopy
+do
+rm -f conf cred dataspaces.conf srv.lck
+
+echo "## Config file for DataSpaces
+ndim = 2
+dims = $CONF_DIMS, $CONF_DIMS
+
+max_versions = 1
+lock_type = 2
+" > dataspaces.conf
+
+unset DATASPACES_TCP_WRITE_SIZE DATASPACES_TCP_ZEROCOPY_SIZE
+case $MODE in
+fixed)    export DATASPACES_TCP_WRITE_SIZE=16384 ;;
+zerocopy) export DATASPACES_TCP_ZEROCOPY_SIZE=1048576 ;;
+esac
+
+mpirun -n 1 $DIR/dataspaces_server -s 1 -c 2 > $DIR/server_$MODE.log 2>&1 & sleep 2
+
+mpirun -n 1 $DIR/test_writer DATASPACES 1 2 1 1 $CONF_DIMS $CONF_DIMS 5 1 > $DIR/writer_$MODE.log 2>&1 &
+mpirun -n 1 $DIR/test_reader DATASPACES 1 2 1 1 $CONF_DIMS $CONF_DIMS 5 2 > $DIR/reader_$MODE.log 2>&1 &
+wait
+
+echo "$MODE:"
+grep "write MAX time" $DIR/writer_$MODE.log
+grep "read MAX time" $DIR/reader_$MODE.log
+done
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Put/get throughput for a growing number of TCP connections per peer
+# pair (DATASPACES_TCP_NUM_STREAMS); payloads from 4MB on are striped
+# across them. Shared memory is turned off so that co-located runs
+# still go through TCP.
+DIR=.
+CONF_DIMS=8192
+export DATASPACES_SHM_RING_SIZE=0
+
+for NS in 1 2 4 8
+do
+rm -f conf cred dataspaces.conf srv.lck
+
+echo "## Config file for DataSpaces
+ndim = 2
+dims = $CONF_DIMS, $CONF_DIMS
+
+max_versions = 1
+lock_type = 2
+" > dataspaces.conf
+
+export DATASPACES_TCP_NUM_STREAMS=$NS
+
+mpirun -n 1 $DIR/dataspaces_server -s 1 -c 2 > $DIR/server_s$NS.log 2>&1 & sleep 2
+
+mpirun -n 1 $DIR/test_writer DATASPACES 1 2 1 1 $CONF_DIMS $CONF_DIMS 5 1 > $DIR/writer_s$NS.log 2>&1 &
+mpirun -n 1 $DIR/test_reader DATASPACES 1 2 1 1 $CONF_DIMS $CONF_DIMS 5 2 > $DIR/reader_s$NS.log 2>&1 &
+wait
+
+echo "num_streams = $NS"
+grep "write MAX time" $DIR/writer_s$NS.log
+grep "read MAX time" $DIR/reader_s$NS.log
+done
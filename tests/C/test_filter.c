@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2009, NSF Cloud and Autonomic Computing Center, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+  Server and client in one process: the server runs in a thread, the
+  main thread puts each version and reads it back. With the TCP
+  transport the client reaches the in-process server through shared
+/*
+  Standalone check of the server-side reduction kernels: reduce small
+  1-D and 3-D objects over partially intersecting regions, with run
+  lengths that are not a multiple of 4, and compare min, max, sum, avg
+  and histogram against a plain loop. Also checks that merging the
+  results of two halves gives the result of the whole.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "debug.h"
+#include "ss_data.h"
+
+#define NUM_BINS	7
+
+static int num_fail_;
+
+/* Value of the element at 'c': distinct, with negative values too. */
+static double elem_value(const uint64_t *c)
+{
+	return (double) c[0] + 100.0 * c[1] + 10000.0 * c[2] - 5000.5;
+}
+
+static struct obj_data *make_obj(int ndims, const uint64_t *lb,
+	const uint64_t *ub, int elem_type)
+{
+	static const size_t elem_size[] = {
+		[filter_double] = sizeof(double),
+		[filter_float]  = sizeof(float),
+		[filter_int32]  = sizeof(int32_t),
+		[filter_int64]  = sizeof(int64_t),
+	};
+	struct obj_descriptor odsc;
+	struct obj_data *od;
+	uint64_t c[BBOX_MAX_NDIM] = {0}, n, k;
+	int i;
+
+	memset(&odsc, 0, sizeof(odsc));
+	strcpy(odsc.name, "filter");
+	odsc.size = elem_size[elem_type];
+	odsc.bb.num_dims = ndims;
+	memcpy(odsc.bb.lb.c, lb, sizeof(uint64_t) * ndims);
+	memcpy(odsc.bb.ub.c, ub, sizeof(uint64_t) * ndims);
+
+	od = obj_data_alloc(&odsc);
+	if (!od)
+		return NULL;
+
+	n = obj_data_size(&odsc) / odsc.size;
+	for (i = 0; i < ndims; i++)
+		c[i] = lb[i];
+	for (k = 0; k < n; k++) {
+		double v = elem_value(c);
+		switch (elem_type) {
+		case filter_double:
+			((double *) od->data)[k] = v;
+			break;
+		case filter_float:
+			((float *) od->data)[k] = (float) v;
+			break;
+		case filter_int32:
+			((int32_t *) od->data)[k] = (int32_t) floor(v);
+			break;
+		case filter_int64:
+			((int64_t *) od->data)[k] = (int64_t) floor(v);
+			break;
+		}
+		for (i = 0; i < ndims; i++) {
+			if (++c[i] <= ub[i])
+				break;
+			c[i] = lb[i];
+		}
+	}
+
+	return od;
+}
+
+/* Expected result, one element at a time over the intersection. */
+static void expect(int ndims, const uint64_t *olb, const uint64_t *oub,
+	const uint64_t *qlb, const uint64_t *qub, int elem_type,
+	const struct obj_filter_spec *fs, struct obj_filter_res *fr)
+{
+	uint64_t c[BBOX_MAX_NDIM] = {0}, lo[BBOX_MAX_NDIM], hi[BBOX_MAX_NDIM];
+	double v, w = fs->num_bins / (fs->hi - fs->lo);
+	int i, b;
+
+	ssd_filter_init(fr);
+	for (i = 0; i < ndims; i++) {
+		lo[i] = (olb[i] > qlb[i]) ? olb[i] : qlb[i];
+		hi[i] = (oub[i] < qub[i]) ? oub[i] : qub[i];
+		if (lo[i] > hi[i])
+			return;
+		c[i] = lo[i];
+	}
+
+	while (1) {
+		v = elem_value(c);
+		if (elem_type == filter_float)
+			v = (float) v;
+		else if (elem_type != filter_double)
+			v = floor(v);
+		fr->count++;
+		fr->sum += v;
+		if (v < fr->min)
+			fr->min = v;
+		if (v > fr->max)
+			fr->max = v;
+		if (v >= fs->lo && v <= fs->hi) {
+			b = (int) ((v - fs->lo) * w);
+			fr->bins[(b < fs->num_bins) ? b : fs->num_bins-1]++;
+		}
+
+		for (i = 0; i < ndims; i++) {
+			if (++c[i] <= hi[i])
+				break;
+			c[i] = lo[i];
+		}
+		if (i == ndims)
+			break;
+	}
+}
+
+static void check(const char *what, const struct obj_filter_res *fr,
+	const struct obj_filter_res *ex, int op)
+{
+	double tol = 1e-9 * (fabs(ex->sum) + 1.0);
+	int i, ok = (fr->count == ex->count);
+
+	switch (op) {
+	case filter_min:
+		ok = ok && fr->min == ex->min;
+		break;
+	case filter_max:
+		ok = ok && fr->max == ex->max;
+		break;
+	case filter_sum:
+	case filter_avg:
+		ok = ok && fabs(fr->sum - ex->sum) <= tol;
+		if (op == filter_avg && ex->count > 0)
+			ok = ok && fabs(fr->sum / fr->count -
+				ex->sum / ex->count) <= tol;
+		break;
+	case filter_hist:
+		for (i = 0; i < NUM_BINS; i++)
+			ok = ok && fr->bins[i] == ex->bins[i];
+		break;
+	}
+
+	if (!ok) {
+		uloga("FAILED %s op %d: count %llu/%llu min %g/%g max %g/%g "
+			"sum %g/%g\n", what, op,
+			(unsigned long long) fr->count,
+			(unsigned long long) ex->count,
+			fr->min, ex->min, fr->max, ex->max, fr->sum, ex->sum);
+		num_fail_++;
+	}
+}
+
+/*
+  Reduce the object [olb, oub] over [qlb, qub] with every operation,
+  as a whole and as two halves split along the last dimension.
+*/
+static void run_case(const char *what, int ndims, const uint64_t *olb,
+	const uint64_t *oub, const uint64_t *qlb, const uint64_t *qub,
+	int elem_type)
+{
+	struct obj_filter_spec fs = {
+		.elem_type = elem_type, .num_bins = NUM_BINS,
+		.lo = -4000.0, .hi = 30000.0,
+	};
+	struct obj_filter_res fr, fr2, ex;
+	struct obj_descriptor q;
+	struct obj_data *od, *od1, *od2;
+	uint64_t mub[BBOX_MAX_NDIM], mlb[BBOX_MAX_NDIM];
+	int d = ndims - 1, op;
+
+	memset(&q, 0, sizeof(q));
+	q.bb.num_dims = ndims;
+	memcpy(q.bb.lb.c, qlb, sizeof(uint64_t) * ndims);
+	memcpy(q.bb.ub.c, qub, sizeof(uint64_t) * ndims);
+
+	memcpy(mub, oub, sizeof(uint64_t) * ndims);
+	memcpy(mlb, olb, sizeof(uint64_t) * ndims);
+	mub[d] = (olb[d] + oub[d]) / 2;
+	mlb[d] = mub[d] + 1;
+
+	od = make_obj(ndims, olb, oub, elem_type);
+	od1 = make_obj(ndims, olb, mub, elem_type);
+	od2 = make_obj(ndims, mlb, oub, elem_type);
+	if (!od || !od1 || !od2) {
+		uloga("FAILED %s: can not allocate objects\n", what);
+		num_fail_++;
+		return;
+	}
+
+	for (op = filter_min; op <= filter_hist; op++) {
+		fs.op = op;
+		expect(ndims, olb, oub, qlb, qub, elem_type, &fs, &ex);
+
+		ssd_filter_init(&fr);
+		if (ssd_filter(od, &q, &fs, &fr) < 0)
+			num_fail_++;
+		check(what, &fr, &ex, op);
+
+		ssd_filter_init(&fr);
+		ssd_filter_init(&fr2);
+		if (ssd_filter(od1, &q, &fs, &fr) < 0 ||
+		    ssd_filter(od2, &q, &fs, &fr2) < 0)
+			num_fail_++;
+		ssd_filter_merge(&fr, &fr2, &fs);
+		check(what, &fr, &ex, op);
+	}
+
+	obj_data_free(od);
+	obj_data_free(od1);
+	obj_data_free(od2);
+}
+
+/* NaN must not be binned, nor corrupt anything. */
+static void run_nan(void)
+{
+	uint64_t lb[1] = {0}, ub[1] = {10};
+	struct obj_filter_spec fs = {
+		.op = filter_hist, .elem_type = filter_double,
+		.num_bins = NUM_BINS, .lo = -1e9, .hi = 1e9,
+	};
+	struct obj_filter_res fr;
+	struct obj_data *od = make_obj(1, lb, ub, filter_double);
+	uint64_t total = 0;
+	int i;
+
+	if (!od) {
+		num_fail_++;
+		return;
+	}
+	((double *) od->data)[3] = NAN;
+	((double *) od->data)[8] = NAN;
+
+	ssd_filter_init(&fr);
+	if (ssd_filter(od, &od->obj_desc, &fs, &fr) < 0)
+		num_fail_++;
+	for (i = 0; i < NUM_BINS; i++)
+		total += fr.bins[i];
+	if (total != 9) {
+		uloga("FAILED nan: %llu values binned\n",
+			(unsigned long long) total);
+		num_fail_++;
+	}
+	obj_data_free(od);
+}
+
+int main(int argc, char **argv)
+{
+	int t;
+
+	for (t = filter_double; t <= filter_int64; t++) {
+		/* 1-D: 31 elements of a 38 element object. */
+		uint64_t olb1[1] = {3}, oub1[1] = {40};
+		uint64_t qlb1[1] = {5}, qub1[1] = {35};
+		run_case("1-D", 1, olb1, oub1, qlb1, qub1, t);
+
+		/* 1-D: the query covers the object, 38 elements. */
+		uint64_t qlb1b[1] = {0}, qub1b[1] = {50};
+		run_case("1-D cover", 1, olb1, oub1, qlb1b, qub1b, t);
+
+		/* 3-D: runs of 7 elements along dimension 0. */
+		uint64_t olb3[3] = {2, 1, 0}, oub3[3] = {12, 7, 4};
+		uint64_t qlb3[3] = {4, 0, 1}, qub3[3] = {10, 5, 3};
+		run_case("3-D", 3, olb3, oub3, qlb3, qub3, t);
+
+		/* 3-D: runs of 1 and 3 elements. */
+		uint64_t qlb3b[3] = {12, 3, 2}, qub3b[3] = {20, 9, 9};
+		run_case("3-D edge", 3, olb3, oub3, qlb3b, qub3b, t);
+		uint64_t qlb3c[3] = {0, 0, 0}, qub3c[3] = {4, 7, 9};
+		run_case("3-D corner", 3, olb3, oub3, qlb3c, qub3c, t);
+	}
+	run_nan();
+
+	if (num_fail_) {
+		uloga("%s(): %d checks failed\n", __func__, num_fail_);
+		return 1;
+	}
+	uloga("%s(): all checks passed\n", __func__);
+	return 0;
+}
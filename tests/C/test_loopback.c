@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2009, NSF Cloud and Autonomic Computing Center, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+  Server and client in one process: the server runs in a thread, the
+  main thread puts each version and reads it back. With the TCP
+  transport the client reaches the in-process server through shared
+  memory rings, so the whole put/get path can be profiled on one host.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "debug.h"
+#include "common.h"
+
+#include "mpi.h"
+
+extern int parse_args(int argc, char** argv, enum transport_type *type, int *npapp,
+	int *dims, int* npdim, uint64_t* spdim, int *timestep, int *appid,
+	size_t *elem_size, int *num_vars);
+
+static enum transport_type type_;
+static MPI_Comm server_comm_;
+
+static void *run_server(void *arg)
+{
+	common_run_server(1, 1, type_, &server_comm_);
+	return NULL;
+}
+
+static void fill_data(double *data, uint64_t num_elem, unsigned int ts)
+{
+	uint64_t i;
+	for (i = 0; i < num_elem; i++)
+		data[i] = ts;
+}
+
+int main(int argc, char **argv)
+{
+	int provided;
+	MPI_Comm gcomm;
+	pthread_t server_thread;
+
+    // Usage: ./test_loopback type 1 dims np[0] ... np[dims-1] sp[0] ... sp[dims-1] timestep appid elem_size num_vars
+    // Same arguments as test_writer, with a single client process
+	int npapp, dims, timestep, appid, num_vars;
+	int np[10] = {0};
+	uint64_t sp[10] = {0};
+	size_t elem_size;
+
+	if (parse_args(argc, argv, &type_, &npapp, &dims, np, sp,
+		&timestep, &appid, &elem_size, &num_vars) != 0) {
+		goto err_out;
+	}
+	if (npapp != 1) {
+		uloga("%s(): only one client process is supported.\n", __func__);
+		goto err_out;
+	}
+
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+	if (provided < MPI_THREAD_MULTIPLE) {
+		uloga("%s(): MPI_THREAD_MULTIPLE is not supported.\n", __func__);
+		MPI_Finalize();
+		goto err_out;
+	}
+	MPI_Comm_dup(MPI_COMM_SELF, &server_comm_);
+	MPI_Comm_dup(MPI_COMM_SELF, &gcomm);
+
+	// The server writes the config file once it accepts connections
+	unlink("conf");
+	pthread_create(&server_thread, NULL, run_server, NULL);
+	while (access("conf", F_OK) != 0)
+		usleep(1000);
+
+	common_init(1, appid, &gcomm, NULL);
+
+	uint64_t lb[10] = {0}, ub[10] = {0};
+	uint64_t num_elem = 1;
+	int i;
+	for (i = 0; i < dims; i++) {
+		ub[i] = sp[i] - 1;
+		num_elem *= sp[i];
+	}
+	num_elem = num_elem * elem_size / sizeof(double);
+
+	double *data = (double *)malloc(num_elem * sizeof(double));
+	if (data == NULL) {
+		uloga("%s(): allocate data failed.\n", __func__);
+		goto err_out;
+	}
+
+	struct timer timer;
+	timer_init(&timer, 1);
+	timer_start(&timer);
+
+	char var_name[128];
+	unsigned int ts;
+	for (ts = 1; ts <= timestep; ts++) {
+		double tm_put = 0, tm_get = 0, tm_st;
+
+		common_lock_on_write("mnd_lock", &gcomm);
+		if (type_ == USE_DIMES)
+			common_put_sync(type_);
+		fill_data(data, num_elem, ts);
+		tm_st = timer_read(&timer);
+		for (i = 0; i < num_vars; i++) {
+			sprintf(var_name, "mnd_%d", i);
+			common_put(var_name, ts, elem_size, dims, lb, ub, data, type_);
+		}
+		if (type_ == USE_DSPACES)
+			common_put_sync(type_);
+		tm_put = timer_read(&timer) - tm_st;
+		common_unlock_on_write("mnd_lock", &gcomm);
+
+		common_lock_on_read("mnd_lock", &gcomm);
+		for (i = 0; i < num_vars; i++) {
+			sprintf(var_name, "mnd_%d", i);
+			memset(data, 0, num_elem * sizeof(double));
+			tm_st = timer_read(&timer);
+			common_get(var_name, ts, elem_size, dims, lb, ub, data, type_);
+			tm_get += timer_read(&timer) - tm_st;
+			check_data(var_name, data, num_elem, 0, ts);
+		}
+		common_unlock_on_read("mnd_lock", &gcomm);
+
+		uloga("TS= %u write time= %lf read time= %lf\n", ts, tm_put, tm_get);
+	}
+	free(data);
+
+	uloga("%s(): done\n", __func__);
+	common_finalize();
+
+	pthread_join(server_thread, NULL);
+	MPI_Finalize();
+
+	return 0;
+err_out:
+	uloga("error out!\n");
+	return -1;
+}